@@ -0,0 +1,167 @@
+/*
+ * bench.c
+ * @description: Minimal benchmark harness for the host build. Heap use is
+ *    tracked by wrapping malloc and friends at link time, stack use by running
+ *    the function on a painted stack and looking for the deepest overwrite
+ * @author: @Retrocamara42
+ *
+ */
+#include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+#define BENCH_STACK_SIZE (256*1024)
+#define BENCH_STACK_PAINT 0xA5
+
+typedef struct {
+   size_t allocs;
+   size_t bytes;
+   size_t in_use;
+   size_t peak;
+} heap_counters;
+
+static heap_counters heap;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+
+/******************* HEAP TRACKING *****************************************/
+static void track_alloc(void *ptr, size_t size){
+   if(ptr==NULL){
+      return;
+   }
+   heap.allocs++;
+   heap.bytes+=size;
+   heap.in_use+=malloc_usable_size(ptr);
+   if(heap.in_use>heap.peak){
+      heap.peak=heap.in_use;
+   }
+}
+
+
+void *__wrap_malloc(size_t size){
+   void *ptr = __real_malloc(size);
+   track_alloc(ptr, size);
+   return ptr;
+}
+
+
+void *__wrap_calloc(size_t nmemb, size_t size){
+   void *ptr = __real_calloc(nmemb, size);
+   track_alloc(ptr, nmemb*size);
+   return ptr;
+}
+
+
+void *__wrap_realloc(void *ptr, size_t size){
+   if(ptr){
+      heap.in_use-=malloc_usable_size(ptr);
+   }
+   void *new_ptr = __real_realloc(ptr, size);
+   track_alloc(new_ptr, size);
+   return new_ptr;
+}
+
+
+void __wrap_free(void *ptr){
+   if(ptr){
+      heap.in_use-=malloc_usable_size(ptr);
+   }
+   __real_free(ptr);
+}
+
+
+/******************* STACK TRACKING *****************************************/
+typedef struct {
+   bench_fn fn;
+   void *arg;
+} stack_job;
+
+static void *run_stack_job(void *arg){
+   stack_job *job = arg;
+   if(job->fn){
+      job->fn(job->arg);
+   }
+   return NULL;
+}
+
+
+/*
+ * stack_depth: Run fn once on a painted stack
+ *    Returns:
+ *       - depth: size_t. Bytes of the stack that were written to
+ */
+static size_t stack_depth(bench_fn fn, void *arg){
+   static uint8_t stack[BENCH_STACK_SIZE] __attribute__((aligned(64)));
+   memset(stack, BENCH_STACK_PAINT, sizeof stack);
+
+   pthread_attr_t attr;
+   pthread_attr_init(&attr);
+   pthread_attr_setstack(&attr, stack, sizeof stack);
+   stack_job job = { fn, arg };
+   pthread_t thread;
+   pthread_create(&thread, &attr, run_stack_job, &job);
+   pthread_join(thread, NULL);
+   pthread_attr_destroy(&attr);
+
+   size_t untouched=0;
+   while(untouched<sizeof stack && stack[untouched]==BENCH_STACK_PAINT){
+      untouched++;
+   }
+   return sizeof stack - untouched;
+}
+
+
+/******************* HARNESS *****************************************/
+static uint64_t now_ns(void){
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint64_t)now.tv_sec*1000000000ULL + now.tv_nsec;
+}
+
+
+bench_result bench_run(bench_fn fn, void *arg, uint32_t iterations){
+   bench_result result;
+   // Warm up caches and lazily initialized state
+   for(uint32_t i=0; i<iterations/10+1; i++){
+      fn(arg);
+   }
+
+   memset(&heap, 0, sizeof heap);
+   uint64_t start = now_ns();
+   for(uint32_t i=0; i<iterations; i++){
+      fn(arg);
+   }
+   uint64_t elapsed = now_ns()-start;
+
+   result.ns_per_op = (double)elapsed/iterations;
+   result.allocs_per_op = (double)heap.allocs/iterations;
+   result.bytes_per_op = (double)heap.bytes/iterations;
+   result.peak_heap = heap.peak;
+
+   // Stack used by the thread itself is taken out with an empty job
+   size_t baseline = stack_depth(NULL, NULL);
+   size_t depth = stack_depth(fn, arg);
+   result.peak_stack = depth>baseline ? depth-baseline : 0;
+   return result;
+}
+
+
+void bench_print_header(void){
+   printf("%-32s %12s %10s %10s %10s %11s\n",
+      "benchmark", "ns/op", "allocs/op", "bytes/op", "peak_heap", "peak_stack");
+}
+
+
+void bench_print(const char *name, const bench_result *result){
+   printf("%-32s %12.1f %10.2f %10.1f %10zu %11zu\n", name,
+      result->ns_per_op, result->allocs_per_op, result->bytes_per_op,
+      result->peak_heap, result->peak_stack);
+}
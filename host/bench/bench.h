@@ -0,0 +1,61 @@
+/*
+ * bench.h
+ * @description: Minimal benchmark harness for the host build. Reports time,
+ *    heap and stack use of a function
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_BENCH
+#define HOST_BENCH
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * bench_fn: Function to be benchmarked. Runs one operation
+ *    Arguments:
+ *       - arg: void*. Argument given to bench_run
+ */
+typedef void (*bench_fn)(void *arg);
+
+/*
+ * bench_result: Results of a benchmark
+ *    - ns_per_op: double. Wall time per operation
+ *    - allocs_per_op: double. Heap allocations per operation
+ *    - bytes_per_op: double. Bytes requested from the heap per operation
+ *    - peak_heap: size_t. Highest heap use reached during an operation
+ *    - peak_stack: size_t. Deepest stack use reached during an operation
+ */
+typedef struct {
+   double ns_per_op;
+   double allocs_per_op;
+   double bytes_per_op;
+   size_t peak_heap;
+   size_t peak_stack;
+} bench_result;
+
+/*
+ * bench_run: Run fn iterations times and measure it
+ *    Arguments:
+ *       - fn: bench_fn. Function to run
+ *       - arg: void*. Argument for fn
+ *       - iterations: uint32_t. Times fn is run while timing it
+ *    Returns:
+ *       - result: bench_result.
+ */
+bench_result bench_run(bench_fn fn, void *arg, uint32_t iterations);
+
+/*
+ * bench_print_header: Print header of the results table
+ */
+void bench_print_header(void);
+
+/*
+ * bench_print: Print a row of the results table
+ *    Arguments:
+ *       - name: const char*. Benchmark name
+ *       - result: bench_result*. Results to print
+ */
+void bench_print(const char *name, const bench_result *result);
+
+#endif
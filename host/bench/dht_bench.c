@@ -0,0 +1,1403 @@
+/*
+ * dht_bench.c
+ * @description: Benchmarks of the per-wake encode and send paths of
+ *    dht_driver.c. Run with: make -C host bench
+ * @author: @Retrocamara42
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <openssl/evp.h>
+#include <openssl/ec.h>
+#include <openssl/pem.h>
+
+#include "bench.h"
+#include "host_stubs.h"
+#include "dht_driver.h"
+#include "outbox.h"
+#include "mqtt_ssl.h"
+#include "command.h"
+#include "diagnostics.h"
+#include "power_trace.h"
+#include "series_codec.h"
+#include "delta_patch.h"
+#include "delta_diff.h"
+#include "http_bulk.h"
+#include "sample_buffer.h"
+#include "ota_update.h"
+#include "dht_edge_traces.h"
+#include "ota_test_keys.h"
+
+#define BENCH_DEVICE_NAME "iot_ms"
+#define BENCH_TEMPERATURE_TOPIC "temperature"
+#define BENCH_HUMIDITY_TOPIC "humidity"
+#define BENCH_REPORT_TOPIC "devices/" BENCH_DEVICE_NAME "/readings"
+#define BENCH_PIPELINE_WINDOW 4
+// A day of samples read every minute, compressed in blocks of rtc memory as
+// in sample_buffer.c
+#define BENCH_SERIES_SAMPLES 1440
+#define BENCH_SERIES_PERIOD 60
+#define BENCH_SERIES_BLOCK_SIZE 128
+// Synthetic firmware images of 16 byte records, code followed by a 32 bit
+// address into the image, as in the literal pools of xtensa code. The
+// update inserts code a third of the way in, which moves every address
+// after it, and changes a few instructions
+#define BENCH_IMAGE_RECORDS 16384
+#define BENCH_IMAGE_BASE 0x40210000
+#define BENCH_IMAGE_INSERT 300
+#define BENCH_IMAGE_PATTERNS 64
+// Samples of a batch posted in bulk, a full block of sample_buffer.c
+#define BENCH_BULK_SAMPLES SAMPLE_BUFFER_CAPACITY
+// Boot the samples and reports of the bench belong to
+#define BENCH_BOOT 3
+// Patch of the update, its signature is at the url with OTA_SIGNATURE_SUFFIX
+#define BENCH_OTA_URL "https://localhost/update.dlt"
+
+static esp_mqtt_client_handle_t client;
+static payload_encoder report_payload;
+static payload_encoder registry_payload;
+static uint32_t scheduler_clock;
+static const esp_mqtt_client_config_t mqtt_cfg = {
+   .uri = "mqtts://localhost:8883",
+};
+static const http_server_configuration http_cfg = {
+   "http://localhost/temperature",
+   "http://localhost/humidity",
+   "http://localhost/devices/" BENCH_DEVICE_NAME "/samples",
+   HTTP_ENCODING_GZIP,
+};
+
+
+// Encoders write a character of their payload here, so the compiler keeps
+// the encoding
+static volatile char sink;
+
+
+/*
+ * legacy_encode: Payload encoding used by dht_driver.c before
+ *    payload_encoder, kept as a baseline
+ */
+static void legacy_encode(void *arg){
+   DhtSensor *dht_sensor = arg;
+   uint8_t dht_dec_place=dht_sensor->dht_type==DHT_TYPE_DHT11?0:2;
+   char chTemp[7];
+   float temperature=(float)dht_sensor->temperature;
+   int dec_temp;
+   if(dht_dec_place==0)
+      dec_temp=0;
+   else
+      dec_temp=(int)((dht_dec_place*abs(temperature))%dht_dec_place);
+   snprintf(chTemp, sizeof chTemp, "%d.%d", (int)floor(temperature), dec_temp);
+   char post_data_temp[48];
+   strcpy(post_data_temp, "{\"dev_name\":\"");
+   strcat(post_data_temp, BENCH_DEVICE_NAME);
+   strcat(post_data_temp, "\",\"temp\":");
+   strcat(post_data_temp, chTemp);
+   strcat(post_data_temp, "}");
+   sink=post_data_temp[strlen(post_data_temp)-2];
+
+   char chHumid[7];
+   float humidity=dht_sensor->humidity;
+   int dec_humid;
+   if(dht_dec_place==0)
+      dec_humid=0;
+   else
+      dec_humid=(int)((dht_dec_place*abs(humidity))%dht_dec_place);
+   snprintf(chHumid, sizeof chHumid, "%d.%d", (int)floor(humidity), dec_humid);
+   char post_data_hum[48];
+   strcpy(post_data_hum, "{\"dev_name\":\"");
+   strcat(post_data_hum, BENCH_DEVICE_NAME);
+   strcat(post_data_hum, "\",\"humid\":");
+   strcat(post_data_hum, chHumid);
+   strcat(post_data_hum, "}");
+   sink=post_data_hum[strlen(post_data_hum)-2];
+}
+
+
+static void bench_encode(void *arg){
+   DhtSensor *dht_sensor = arg;
+   payload_encoder_set_value(&dht_sensor->temperature_payload, 0, dht_sensor->temperature);
+   sink=dht_sensor->temperature_payload.buffer[dht_sensor->temperature_payload.length-2];
+   payload_encoder_set_value(&dht_sensor->humidity_payload, 0, dht_sensor->humidity);
+   sink=dht_sensor->humidity_payload.buffer[dht_sensor->humidity_payload.length-2];
+}
+
+
+static void bench_encode_frame(void *arg){
+   DhtSensor *dht_sensor = arg;
+   static uint8_t frame[TELEMETRY_FRAME_MAX_SIZE];
+   dht_encode_frame(dht_sensor, NULL, frame, sizeof frame);
+}
+
+
+static void bench_decode_frame(void *arg){
+   static telemetry_frame frame;
+   const uint8_t *data = arg;
+   telemetry_frame_decode(data+1, data[0], &frame);
+}
+
+
+static void bench_mqtt_send(void *arg){
+   DhtSensor *dht_sensor = arg;
+   send_dht_data_with_mqtt(dht_sensor, client, mqtt_cfg,
+      BENCH_TEMPERATURE_TOPIC, BENCH_HUMIDITY_TOPIC);
+   host_mqtt_ack(2);
+}
+
+
+static void bench_mqtt_send_combined(void *arg){
+   DhtSensor *dht_sensor = arg;
+   dht_write_report_values(dht_sensor, &report_payload);
+   esp_mqtt_client_publish(client, BENCH_REPORT_TOPIC,
+      report_payload.buffer, report_payload.length, 0, 0);
+}
+
+
+static void bench_http_send(void *arg){
+   DhtSensor *dht_sensor = arg;
+   send_dht_data_with_http(dht_sensor, http_cfg);
+}
+
+
+/*
+ * bulk_batch: Batch of samples posted in bulk, and the endpoint
+ */
+typedef struct {
+   sensor_sample samples[BENCH_BULK_SAMPLES];
+   http_server_configuration config;
+} bulk_batch;
+
+
+static void bench_http_bulk(void *arg){
+   bulk_batch *batch = arg;
+   http_bulk_send(batch->samples, BENCH_BULK_SAMPLES, BENCH_BOOT, &batch->config);
+}
+
+
+static void bench_read(void *arg){
+   DhtSensor *dht_sensor = arg;
+   dht_read_and_process_data(&dht_sensor);
+}
+
+
+static void bench_read_bad_frame(void *arg){
+   DhtSensor *dht_sensor = arg;
+   host_dht_fail_next(1, ESP_ERR_INVALID_CRC);
+   dht_read_and_process_data(&dht_sensor);
+}
+
+
+/*
+ * dht_trace: Falling edges of a frame as captured by dht_edge_isr. Bits
+ *    take 50 us low plus 27 or 70 us high, with some jitter
+ */
+typedef struct {
+   uint8_t count;
+   uint32_t edges[DHT_MAX_EDGES];
+} dht_trace;
+
+static void build_trace(dht_trace *trace, const uint8_t data[5], uint8_t with_response){
+   uint32_t now = 1000000;
+   trace->count = 0;
+   if(with_response){
+      trace->edges[trace->count++] = now;
+      now += 160;
+   }
+   trace->edges[trace->count++] = now;
+   for(uint8_t i=0; i<40; i++){
+      uint8_t bit = (data[i/8]>>(7-i%8))&1;
+      now += (bit ? 120 : 77) + (i*7)%9 - 4;
+      trace->edges[trace->count++] = now;
+   }
+}
+
+
+/*
+ * load_trace: Build a trace from the gaps of a fixture, see dht_edge_traces.h
+ */
+static void load_trace(dht_trace *trace, const char* gaps){
+   uint32_t now = 1000000;
+   trace->count = 0;
+   trace->edges[trace->count++] = now;
+   while(*gaps!='\0' && trace->count<DHT_MAX_EDGES){
+      char *end;
+      now += strtoul(gaps, &end, 10);
+      trace->edges[trace->count++] = now;
+      gaps = *end==',' ? end+1 : end;
+   }
+}
+
+
+static void bench_decode_edges(void *arg){
+   dht_trace *trace = arg;
+   float humidity, temperature;
+   dht_decode_edges(trace->edges, trace->count, DHT_TYPE_AM2301, &humidity, &temperature);
+}
+
+
+static void bench_read_and_mqtt_send(void *arg){
+   DhtSensor *dht_sensor = arg;
+   dht_read_and_process_data(&dht_sensor);
+   bench_mqtt_send(dht_sensor);
+}
+
+
+/*
+ * bench_scheduler_cycle: One wake of transmit_data_task with the sensor
+ *    registry. Clock advances a period per wake, so every run reads
+ */
+static void bench_scheduler_cycle(void *arg){
+   if(sensor_scheduler_run(scheduler_clock, &registry_payload)>0){
+      esp_mqtt_client_publish(client, BENCH_REPORT_TOPIC,
+         registry_payload.buffer, registry_payload.length, 0, 0);
+   }
+   scheduler_clock += sensor_scheduler_next_read(scheduler_clock);
+}
+
+
+/*
+ * bench_outbox_append: Queue a report while the broker is unreachable.
+ *    The log wraps, so sector erases are part of the cost
+ */
+static void bench_outbox_append(void *arg){
+   outbox_append(BENCH_REPORT_TOPIC, registry_payload.buffer,
+      registry_payload.length, BENCH_BOOT, scheduler_clock++);
+}
+
+
+static esp_err_t outbox_mqtt_send(const char* topic, const char* payload,
+      size_t length, uint16_t boot, uint32_t timestamp, void* arg){
+   if(arg!=NULL){
+      *(uint16_t*)arg = boot;
+   }
+   return esp_mqtt_client_publish(client, topic, payload, length, 0, 0)<0 ? ESP_FAIL : ESP_OK;
+}
+
+
+/*
+ * bench_outbox_cycle: Queue a report, then replay it once the broker is back
+ */
+static void bench_outbox_cycle(void *arg){
+   bench_outbox_append(arg);
+   outbox_replay(outbox_mqtt_send, NULL, 1);
+}
+
+
+/*
+ * bench_pipeline_window: A full window of QoS 1 reports, then their acks
+ */
+static void bench_pipeline_window(void *arg){
+   for(uint8_t i=0; i<BENCH_PIPELINE_WINDOW; i++){
+      mqtt_pipeline_publish(client, BENCH_REPORT_TOPIC,
+         registry_payload.buffer, registry_payload.length);
+   }
+   host_mqtt_ack(BENCH_PIPELINE_WINDOW);
+}
+
+
+static void count_expired(const char* topic, const char* payload,
+      size_t length, void* arg){
+   (*(uint32_t*)arg)++;
+}
+
+
+static const char bench_command[] = "{\"cmd\":\"set_deadband\",\"sensor\":0,\"values\":[0.5, 2.25]}";
+
+static esp_err_t bench_command_handler(const command_message *message, void *arg){
+   float *values = arg;
+   return command_get_numbers(message, "values", values, 2)==2 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+static const command_entry bench_commands[] = {
+   { "sample_now", bench_command_handler },
+   { "set_period", bench_command_handler },
+   { "set_deadband", bench_command_handler },
+};
+
+
+static void bench_command_parse(void *arg){
+   command_message message;
+   command_parse(bench_command, sizeof bench_command-1, &message);
+}
+
+
+static void bench_command_dispatch(void *arg){
+   command_dispatch(bench_commands, 3, bench_command, sizeof bench_command-1, arg);
+}
+
+
+/*
+ * check_malformed_commands: Commands that must be rejected, and random
+ *    mutations of a valid one parsed from a buffer of their exact size
+ *    Returns:
+ *       - accepted: int. Mutations accepted, -1 if a malformed one was
+ */
+static int check_malformed_commands(uint32_t mutations){
+   static const char *malformed[] = {
+      "", "   ", "{", "}", "[]", "{\"cmd\"}", "{\"cmd\":}", "{\"cmd\":\"x\",}",
+      "{\"cmd\":\"x\"} x", "{\"cmd\":\"x", "{\"a\":[1,2", "{\"a\":[1,]}",
+      "{\"a\":[[1]]}", "{\"a\":{\"b\":1}}", "{\"a\":-}", "{\"a\":1.}", "{\"a\":1e}",
+      "{\"a\":tru}", "{\"a\":\"\\\"}", "{a:1}", "{\"a\":1 \"b\":2}",
+      "{\"a\":1,\"b\":2,\"c\":3,\"d\":4,\"e\":5,\"f\":6,\"g\":7,\"h\":8,\"i\":9}",
+   };
+   command_message message;
+   for(size_t i=0; i<sizeof malformed/sizeof malformed[0]; i++){
+      if(command_parse(malformed[i], strlen(malformed[i]), &message)==ESP_OK){
+         fprintf(stderr, "malformed command accepted: %s\n", malformed[i]);
+         return -1;
+      }
+   }
+   // A null character isn't the end of the data
+   static const char with_null[] = "{\"cmd\":\"x\"}\0junk";
+   static const char empty_with_null[] = "{}\0";
+   if(command_parse(with_null, sizeof with_null-1, &message)==ESP_OK
+         || command_parse(empty_with_null, sizeof empty_with_null-1, &message)==ESP_OK
+         || command_parse(with_null, strlen(with_null), &message)!=ESP_OK){
+      fprintf(stderr, "command with a null character parsed wrong\n");
+      return -1;
+   }
+   int accepted=0;
+   srand(1);
+   for(uint32_t i=0; i<mutations; i++){
+      size_t length = rand()%(sizeof bench_command);
+      char *data = malloc(length ? length : 1);
+      memcpy(data, bench_command, length);
+      if(length>0){
+         data[rand()%length] = (char)(rand()%256);
+      }
+      accepted += command_parse(data, length, &message)==ESP_OK;
+      free(data);
+   }
+   return accepted;
+}
+
+
+/*
+ * received_message: Last message given to the data callback
+ */
+static struct {
+   uint32_t count;
+   uint16_t topic_len;
+   const char *data;
+   uint32_t data_len;
+   char copy[2048];
+} received_message;
+
+static void record_message(uint16_t topic_len, char* topic, uint32_t data_len, char* data){
+   received_message.count++;
+   received_message.topic_len = topic_len;
+   received_message.data = data;
+   received_message.data_len = data_len;
+   memcpy(received_message.copy, data, data_len<sizeof received_message.copy ? data_len : 0);
+}
+
+static char inbound_message[2000];
+
+
+static void bench_mqtt_rx_whole(void *arg){
+   host_mqtt_deliver(client, "remote_action", inbound_message, 200, 1024, 0);
+}
+
+
+static void bench_mqtt_rx_fragmented(void *arg){
+   host_mqtt_deliver(client, "remote_action", inbound_message, 1000, 256, 7);
+}
+
+
+static void bench_diagnostics_span(void *arg){
+   DIAG_SPAN_BEGIN(DIAG_STAGE_SENSORS);
+   DIAG_SPAN_END(DIAG_STAGE_SENSORS);
+}
+
+
+static void bench_diagnostics_record(void *arg){
+   static char record[DIAGNOSTICS_RECORD_SIZE];
+   diagnostics_end_cycle(1);
+   diagnostics_encode("1.0.0", record, sizeof record);
+   diagnostics_record_sent();
+}
+
+
+static void bench_power_trace_enter(void *arg){
+   static uint32_t now_ms=0;
+   power_trace_enter(POWER_STATE_TX, now_ms++);
+   power_trace_enter(POWER_STATE_ACTIVE, now_ms++);
+}
+
+
+/*
+ * series_trace: Samples decoded from recorded dht frames, and the block
+ *    they are compressed in
+ */
+typedef struct {
+   uint32_t timestamps[BENCH_SERIES_SAMPLES];
+   int16_t values[BENCH_SERIES_SAMPLES][2];
+   uint16_t next;
+   series_encoder encoder;
+   series_decoder decoder;
+   uint8_t block[BENCH_SERIES_BLOCK_SIZE];
+} series_trace;
+
+
+/*
+ * record_series: Read a day of a room, 21 C and 55 % with a swing of 4 C
+ *    and 10 %, through the edge decoder. One reading in four jitters by a
+ *    step of the sensor
+ */
+static void record_series(series_trace *series, dht_sensor_type_t type){
+   dht_trace trace;
+   uint8_t dht11 = type==DHT_TYPE_DHT11;
+   for(uint16_t i=0; i<BENCH_SERIES_SAMPLES; i++){
+      double day = 2*M_PI*i/BENCH_SERIES_SAMPLES;
+      uint32_t hash = (i*2654435761U)>>29;
+      int jitter = hash==0 ? -1 : hash==1 ? 1 : 0;
+      double temperature = 21+4*sin(day)+jitter*(dht11 ? 1 : 0.1);
+      double humidity = 55-10*sin(day)+jitter*(dht11 ? 1 : 0.1);
+      uint8_t data[5];
+      if(dht11){
+         data[0] = (uint8_t)lround(humidity);
+         data[1] = 0;
+         data[2] = (uint8_t)lround(temperature);
+         data[3] = 0;
+      }
+      else{
+         uint16_t h = (uint16_t)lround(humidity*10);
+         uint16_t t = (uint16_t)lround(temperature*10);
+         data[0] = h>>8;
+         data[1] = h&0xff;
+         data[2] = t>>8;
+         data[3] = t&0xff;
+      }
+      data[4] = data[0]+data[1]+data[2]+data[3];
+      build_trace(&trace, data, !dht11);
+      float h, t;
+      dht_decode_edges(trace.edges, trace.count, type, &h, &t);
+      series->timestamps[i] = i*BENCH_SERIES_PERIOD;
+      series->values[i][0] = (int16_t)lroundf(t*10);
+      series->values[i][1] = (int16_t)lroundf(h*10);
+   }
+   series->next = 0;
+}
+
+
+/*
+ * compress_series: Compress a series in blocks
+ *    Returns:
+ *       - blocks: uint32_t. Blocks taken
+ *       - bytes: uint32_t*. Bytes of the blocks
+ */
+static uint32_t compress_series(series_trace *series, uint32_t *bytes){
+   uint32_t blocks = 1;
+   *bytes = 0;
+   series_encoder_init(&series->encoder, series->block, sizeof series->block, 2);
+   for(uint16_t i=0; i<BENCH_SERIES_SAMPLES; i++){
+      if(series_append(&series->encoder, series->block, sizeof series->block,
+            series->timestamps[i], series->values[i])!=ESP_OK){
+         *bytes += series_length(&series->encoder);
+         blocks++;
+         series_encoder_init(&series->encoder, series->block, sizeof series->block, 2);
+         series_append(&series->encoder, series->block, sizeof series->block,
+            series->timestamps[i], series->values[i]);
+      }
+   }
+   *bytes += series_length(&series->encoder);
+   return blocks;
+}
+
+
+static void bench_series_append(void *arg){
+   series_trace *series = arg;
+   uint16_t i = series->next;
+   if(series_append(&series->encoder, series->block, sizeof series->block,
+         series->timestamps[i], series->values[i])!=ESP_OK){
+      series_encoder_init(&series->encoder, series->block, sizeof series->block, 2);
+   }
+   series->next = (i+1)%BENCH_SERIES_SAMPLES;
+}
+
+
+static void bench_series_next(void *arg){
+   series_trace *series = arg;
+   uint32_t timestamp;
+   int16_t values[2];
+   if(series_next(&series->decoder, &timestamp, values)!=ESP_OK){
+      series_decoder_init(&series->decoder, series->block, series_length(&series->encoder));
+   }
+}
+
+
+/*
+ * flushed_samples: Samples sent by a flush of sample_buffer, oldest first,
+ *    and the boot of each one
+ */
+typedef struct {
+   sensor_sample samples[BENCH_SERIES_SAMPLES];
+   uint16_t boots[BENCH_SERIES_SAMPLES];
+   uint16_t count;
+} flushed_samples;
+
+
+static esp_err_t collect_samples(const sensor_sample *samples, uint16_t count,
+      uint16_t boot, void *arg){
+   flushed_samples *flushed = arg;
+   for(uint16_t i=0; i<count && flushed->count<BENCH_SERIES_SAMPLES; i++){
+      flushed->samples[flushed->count] = samples[i];
+      flushed->boots[flushed->count++] = boot;
+   }
+   return ESP_OK;
+}
+
+
+static esp_err_t collect_batch(const char *payload, size_t length, void *arg){
+   snprintf(arg, SAMPLE_BATCH_MAX_LENGTH, "%.*s", (int)length, payload);
+   return ESP_OK;
+}
+
+
+/*
+ * push_series: Push samples of a series to sample_buffer
+ *    Arguments:
+ *       - first: uint16_t. First sample pushed
+ *       - count: uint16_t. Samples pushed
+ */
+static void push_series(const series_trace *series, uint16_t first, uint16_t count){
+   for(uint16_t i=first; i<first+count; i++){
+      sensor_sample sample = { series->timestamps[i], { series->values[i][0], series->values[i][1] } };
+      sample_buffer_push(&sample);
+   }
+}
+
+
+/*
+ * matching_samples: Flushed samples, from one of them on, that are samples
+ *    of a series in the same order
+ *    Arguments:
+ *       - from: uint16_t. First flushed sample compared
+ *       - first: uint16_t. Sample of the series it's compared to
+ *    Returns:
+ *       - matching: uint16_t. Samples that match before the first that doesn't
+ */
+static uint16_t matching_samples(const flushed_samples *flushed, uint16_t from,
+      const series_trace *series, uint16_t first){
+   uint16_t matching = 0;
+   while(from+matching<flushed->count && first+matching<BENCH_SERIES_SAMPLES){
+      const sensor_sample *sample = &flushed->samples[from+matching];
+      if(sample->timestamp!=series->timestamps[first+matching]
+            || sample->values[0]!=series->values[first+matching][0]
+            || sample->values[1]!=series->values[first+matching][1]){
+         break;
+      }
+      matching++;
+   }
+   return matching;
+}
+
+
+/*
+ * delta_images: Old and new image of an update, and the patch between them
+ */
+typedef struct {
+   uint8_t old_image[BENCH_IMAGE_RECORDS*16];
+   uint8_t new_image[BENCH_IMAGE_RECORDS*16+BENCH_IMAGE_INSERT];
+   uint8_t out[BENCH_IMAGE_RECORDS*16+BENCH_IMAGE_INSERT];
+   uint32_t old_size;
+   uint32_t new_size;
+   uint32_t out_length;
+   uint8_t *patch;
+   size_t patch_size;
+   delta_patch applier;
+} delta_images;
+
+static uint8_t image_patterns[BENCH_IMAGE_PATTERNS][12];
+
+
+static uint32_t build_image(uint8_t *image, uint8_t updated){
+   uint32_t seed = 12345, inserted_seed = 777, length = 0;
+   uint32_t insert_record = BENCH_IMAGE_RECORDS/3;
+   for(uint32_t record=0; record<BENCH_IMAGE_RECORDS; record++){
+      if(updated && record==insert_record){
+         for(uint32_t i=0; i<BENCH_IMAGE_INSERT; i++){
+            inserted_seed = inserted_seed*1103515245+12345;
+            image[length++] = inserted_seed>>16;
+         }
+      }
+      seed = seed*1103515245+12345;
+      memcpy(image+length, image_patterns[(seed>>16)%BENCH_IMAGE_PATTERNS], 12);
+      if(updated && record%997==0){
+         image[length+3] ^= 0x5a;
+      }
+      uint32_t target = (seed>>4)%(BENCH_IMAGE_RECORDS*16);
+      if(updated && target>=insert_record*16){
+         target += BENCH_IMAGE_INSERT;
+      }
+      uint32_t address = BENCH_IMAGE_BASE+target;
+      memcpy(image+length+12, &address, 4);
+      length += 16;
+   }
+   return length;
+}
+
+
+static esp_err_t read_old_image(void *arg, uint32_t offset, uint8_t *data, size_t length){
+   delta_images *images = arg;
+   if(offset+length>images->old_size){
+      return ESP_ERR_INVALID_SIZE;
+   }
+   memcpy(data, images->old_image+offset, length);
+   return ESP_OK;
+}
+
+
+static esp_err_t write_new_image(void *arg, const uint8_t *data, size_t length){
+   delta_images *images = arg;
+   if(images->out_length+length>sizeof images->out){
+      return ESP_ERR_INVALID_SIZE;
+   }
+   memcpy(images->out+images->out_length, data, length);
+   images->out_length += length;
+   return ESP_OK;
+}
+
+
+/*
+ * apply_patch: Apply a patch fed in chunks, as downloaded
+ */
+static esp_err_t apply_patch(delta_images *images, const uint8_t *patch, size_t length,
+      size_t chunk){
+   images->out_length = 0;
+   delta_patch_init(&images->applier, read_old_image, write_new_image, images);
+   for(size_t offset=0; offset<length; offset+=chunk){
+      size_t left = length-offset;
+      esp_err_t err = delta_patch_feed(&images->applier, patch+offset, left<chunk ? left : chunk);
+      if(err!=ESP_OK){
+         return err;
+      }
+   }
+   return delta_patch_finish(&images->applier);
+}
+
+
+static void bench_delta_apply(void *arg){
+   delta_images *images = arg;
+   apply_patch(images, images->patch, images->patch_size, 512);
+}
+
+
+/*
+ * sign_image: Sign an image as openssl dgst -sha256 -sign does
+ *    Arguments:
+ *       - key: EVP_PKEY*. Private key
+ *       - signature: uint8_t*. Output, OTA_SIGNATURE_MAX_SIZE bytes
+ *    Returns:
+ *       - length: size_t. Length of the signature, 0 if signing failed
+ */
+static size_t sign_image(EVP_PKEY *key, const uint8_t *image, size_t size, uint8_t *signature){
+   EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+   size_t length = OTA_SIGNATURE_MAX_SIZE;
+   int ok = key!=NULL && ctx!=NULL && EVP_DigestSignInit(ctx, NULL, EVP_sha256(), NULL, key)==1
+      && EVP_DigestSign(ctx, signature, &length, image, size)==1;
+   EVP_MD_CTX_free(ctx);
+   return ok ? length : 0;
+}
+
+
+/*
+ * generate_key: New p-256 key, not the pair of the embedded public key
+ */
+static EVP_PKEY* generate_key(void){
+   EVP_PKEY *key = NULL;
+   EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+   if(ctx==NULL || EVP_PKEY_keygen_init(ctx)!=1
+         || EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, NID_X9_62_prime256v1)!=1
+         || EVP_PKEY_keygen(ctx, &key)!=1){
+      key = NULL;
+   }
+   EVP_PKEY_CTX_free(ctx);
+   return key;
+}
+
+
+static void bench_delta_diff(void *arg){
+   delta_images *images = arg;
+   size_t patch_size;
+   free(delta_diff(images->old_image, images->old_size, images->new_image, images->new_size,
+      &patch_size, NULL));
+}
+
+
+int main(int argc, char **argv){
+   uint32_t iterations = argc>1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 200000;
+   client = mqtt_app_start(&mqtt_cfg);
+   mqtt_pipeline_init(BENCH_PIPELINE_WINDOW, 5000);
+   host_dht_set_reading(23.4, 51.7, ESP_OK);
+
+   DhtSensor dht11 = { .dht_pin = GPIO_NUM_0, .dht_type = DHT_TYPE_DHT11 };
+   DhtSensor dht22 = { .dht_pin = GPIO_NUM_0, .dht_type = DHT_TYPE_AM2301 };
+   DhtSensor *sensor = &dht11;
+   dht_config(&sensor, BENCH_DEVICE_NAME);
+   sensor = &dht22;
+   dht_config(&sensor, BENCH_DEVICE_NAME);
+   sensor = &dht11;
+   dht_read_and_process_data(&sensor);
+   sensor = &dht22;
+   dht_read_and_process_data(&sensor);
+   payload_encoder_init(&report_payload, NULL);
+   dht_add_report_fields(&dht22, &report_payload);
+   DhtSensor registry_dht = { .dht_pin = GPIO_NUM_0, .dht_type = DHT_TYPE_AM2301 };
+   sensor_registry_add(&dht_sensor_driver, &registry_dht, 900);
+   payload_encoder_init(&registry_payload, NULL);
+   sensor_registry_init(BENCH_DEVICE_NAME, &registry_payload, 0);
+
+   bench_result result;
+   bench_print_header();
+   result = bench_run(legacy_encode, &dht22, iterations);
+   bench_print("encode/legacy_snprintf", &result);
+   result = bench_run(bench_encode, &dht22, iterations);
+   bench_print("encode/payload_encoder", &result);
+   result = bench_run(bench_encode_frame, &dht22, iterations);
+   bench_print("encode/telemetry_frame", &result);
+   // Length prefixed frame, as given to bench_decode_frame
+   uint8_t encoded[1+TELEMETRY_FRAME_MAX_SIZE];
+   encoded[0] = dht_encode_frame(&dht22, BENCH_DEVICE_NAME, encoded+1, TELEMETRY_FRAME_MAX_SIZE);
+   result = bench_run(bench_decode_frame, encoded, iterations);
+   bench_print("decode/telemetry_frame", &result);
+   result = bench_run(bench_mqtt_send, &dht11, iterations);
+   bench_print("mqtt_send/dht11", &result);
+   result = bench_run(bench_mqtt_send, &dht22, iterations);
+   bench_print("mqtt_send/dht22", &result);
+   result = bench_run(bench_mqtt_send_combined, &dht22, iterations);
+   bench_print("mqtt_send_combined/dht22", &result);
+   result = bench_run(bench_http_send, &dht11, iterations);
+   bench_print("http_send/dht11", &result);
+   result = bench_run(bench_http_send, &dht22, iterations);
+   bench_print("http_send/dht22", &result);
+   // 51.7 %, -3.5 C with the response edge. 45 %, 23 C without it
+   const uint8_t dht22_frame[5] = {0x02, 0x05, 0x80, 0x23, 0xAA};
+   const uint8_t dht11_frame[5] = {45, 0, 23, 0, 68};
+   dht_trace dht22_trace, dht11_trace;
+   build_trace(&dht22_trace, dht22_frame, 1);
+   build_trace(&dht11_trace, dht11_frame, 0);
+   result = bench_run(bench_decode_edges, &dht22_trace, iterations);
+   bench_print("decode/dht_edges", &result);
+   result = bench_run(bench_read, &dht22, iterations);
+   bench_print("read/dht22", &result);
+   result = bench_run(bench_read_bad_frame, &dht22, iterations);
+   bench_print("read/dht22_bad_frame", &result);
+   result = bench_run(bench_read_and_mqtt_send, &dht22, iterations);
+   bench_print("read_and_mqtt_send/dht22", &result);
+   result = bench_run(bench_scheduler_cycle, NULL, iterations);
+   bench_print("scheduler_cycle/dht22", &result);
+   result = bench_run(bench_pipeline_window, NULL, iterations/BENCH_PIPELINE_WINDOW);
+   bench_print("mqtt_pipeline/window4", &result);
+   for(size_t i=0; i<sizeof inbound_message; i++){
+      inbound_message[i] = 'a'+i%26;
+   }
+   set_mqtt_on_event_data_cb(record_message);
+   result = bench_run(bench_mqtt_rx_whole, NULL, iterations);
+   bench_print("mqtt_rx/whole_200", &result);
+   result = bench_run(bench_mqtt_rx_fragmented, NULL, iterations);
+   bench_print("mqtt_rx/fragmented_1000", &result);
+   diagnostics_init(0);
+   DIAG_WATCH_TASK("transmit");
+   result = bench_run(bench_diagnostics_span, NULL, iterations);
+   bench_print("diagnostics/span", &result);
+   result = bench_run(bench_diagnostics_record, NULL, iterations);
+   bench_print("diagnostics/record", &result);
+   power_trace_init(0);
+   result = bench_run(bench_power_trace_enter, NULL, iterations);
+   bench_print("power_trace/enter", &result);
+   static series_trace dht22_series, dht11_series;
+   record_series(&dht22_series, DHT_TYPE_AM2301);
+   record_series(&dht11_series, DHT_TYPE_DHT11);
+   series_encoder_init(&dht22_series.encoder, dht22_series.block, sizeof dht22_series.block, 2);
+   result = bench_run(bench_series_append, &dht22_series, iterations);
+   bench_print("series/append_dht22", &result);
+   series_decoder_init(&dht22_series.decoder, dht22_series.block, series_length(&dht22_series.encoder));
+   result = bench_run(bench_series_next, &dht22_series, iterations);
+   bench_print("series/next_dht22", &result);
+   static bulk_batch batch;
+   batch.config = http_cfg;
+   for(uint16_t i=0; i<BENCH_BULK_SAMPLES; i++){
+      batch.samples[i].timestamp = dht22_series.timestamps[i];
+      batch.samples[i].values[0] = dht22_series.values[i][0];
+      batch.samples[i].values[1] = dht22_series.values[i][1];
+   }
+   result = bench_run(bench_http_bulk, &batch, 1+iterations/100);
+   bench_print("http_bulk/gzip_96", &result);
+   batch.config.bulk_encoding = HTTP_ENCODING_IDENTITY;
+   result = bench_run(bench_http_bulk, &batch, 1+iterations/100);
+   bench_print("http_bulk/identity_96", &result);
+   float command_values[2];
+   result = bench_run(bench_command_parse, NULL, iterations);
+   bench_print("command/parse", &result);
+   result = bench_run(bench_command_dispatch, command_values, iterations);
+   bench_print("command/dispatch", &result);
+   host_flash_attach(OUTBOX_PARTITION_LABEL, NULL, 4*OUTBOX_SECTOR_SIZE);
+   outbox_init(0);
+   result = bench_run(bench_outbox_append, NULL, iterations);
+   bench_print("outbox/append", &result);
+   result = bench_run(bench_outbox_cycle, NULL, iterations);
+   bench_print("outbox/append_and_replay", &result);
+   static delta_images images;
+   uint32_t pattern_seed = 99;
+   for(uint32_t i=0; i<sizeof image_patterns; i++){
+      pattern_seed = pattern_seed*1103515245+12345;
+      image_patterns[i/12][i%12] = pattern_seed>>16;
+   }
+   images.old_size = build_image(images.old_image, 0);
+   images.new_size = build_image(images.new_image, 1);
+   delta_diff_stats diff_stats;
+   images.patch = delta_diff(images.old_image, images.old_size, images.new_image, images.new_size,
+      &images.patch_size, &diff_stats);
+   result = bench_run(bench_delta_diff, &images, 1+iterations/50000);
+   bench_print("delta/diff_256k", &result);
+   result = bench_run(bench_delta_apply, &images, 1+iterations/2000);
+   bench_print("delta/apply_256k", &result);
+
+   host_stubs_reset();
+   bench_mqtt_send(&dht22);
+   printf("\nmqtt: %u publishes, %u payload bytes per cycle. Last: %s -> %s\n",
+      host_counters.mqtt_publishes, host_counters.mqtt_bytes,
+      host_last_mqtt_topic(), host_last_mqtt_payload());
+   host_stubs_reset();
+   bench_mqtt_send_combined(&dht22);
+   printf("mqtt combined: %u publishes, %u payload bytes per cycle. Last: %s -> %s\n",
+      host_counters.mqtt_publishes, host_counters.mqtt_bytes,
+      host_last_mqtt_topic(), host_last_mqtt_payload());
+   telemetry_frame decoded;
+   uint8_t frame_length = dht_encode_frame(&dht22, NULL, encoded, sizeof encoded);
+   if(telemetry_frame_decode(encoded, frame_length, &decoded)!=ESP_OK
+         || telemetry_frame_value(&decoded, 0)!=23.4f || telemetry_frame_value(&decoded, 1)!=51.7f){
+      fprintf(stderr, "telemetry frame round trip failed\n");
+      return 1;
+   }
+   // Replayed reports carry the boot and time they were taken
+   telemetry_frame stamped = decoded;
+   stamped.flags |= TELEMETRY_FLAG_TIMESTAMP|TELEMETRY_FLAG_BOOT;
+   stamped.timestamp = 86400;
+   stamped.boot = BENCH_BOOT;
+   uint8_t stamped_length = telemetry_frame_encode(&stamped, encoded, sizeof encoded);
+   if(stamped_length!=frame_length+6 || telemetry_frame_decode(encoded, stamped_length, &decoded)!=ESP_OK
+         || decoded.timestamp!=86400 || decoded.boot!=BENCH_BOOT){
+      fprintf(stderr, "stamped telemetry frame round trip failed\n");
+      return 1;
+   }
+   printf("binary frame: %u bytes per cycle, json combined: %u bytes\n",
+      frame_length, report_payload.length);
+   host_stubs_reset();
+   bench_http_send(&dht22);
+   printf("http: %u connections, %u posts, %u body bytes per cycle. Last: %s\n",
+      host_counters.http_connections, host_counters.http_performs,
+      host_counters.http_bytes, host_last_http_body());
+
+   host_stubs_reset();
+   memset(&dht22.stats, 0, sizeof dht22.stats);
+   bench_read_bad_frame(&dht22);
+   printf("dht: %u frames, %u retries, %u checksum errors, %u ms awake per reading\n",
+      host_counters.dht_reads, dht22.stats.retries, dht22.stats.checksum_errors,
+      dht22.stats.last_latency_us/1000);
+   host_dht_set_reading(-99, -99, ESP_OK);
+   if(dht_read_and_process_data(&sensor)==ESP_OK || dht22.stats.out_of_range!=MAX_DHT_READING){
+      fprintf(stderr, "out of range frames accepted\n");
+      return 1;
+   }
+   host_dht_set_reading(21.5, 48.2, ESP_OK);
+   if(DHT_OVERSAMPLE>1){
+      // Two good frames too far apart, both are outliers
+      uint32_t outliers = dht22.stats.outliers;
+      host_dht_fail_next(MAX_DHT_READING-2, ESP_ERR_TIMEOUT);
+      host_dht_queue_reading(20.0, 50.0);
+      host_dht_queue_reading(30.0, 50.0);
+      if(dht_read_and_process_data(&sensor)==ESP_OK || dht22.stats.outliers!=outliers+2
+            || dht22.temperature!=-99){
+         fprintf(stderr, "divergent frames accepted\n");
+         return 1;
+      }
+   }
+   else{
+      // A reading is its first good frame, bad ones are retried
+      host_stubs_reset();
+      host_dht_fail_next(2, ESP_ERR_TIMEOUT);
+      host_dht_queue_reading(20.0, 50.0);
+      if(dht_read_and_process_data(&sensor)!=ESP_OK || host_counters.dht_reads!=3
+            || dht22.temperature!=20.0f){
+         fprintf(stderr, "retried frames read wrong\n");
+         return 1;
+      }
+   }
+
+   float humidity, temperature;
+   if(dht_decode_edges(dht22_trace.edges, dht22_trace.count, DHT_TYPE_AM2301, &humidity, &temperature)!=ESP_OK
+         || humidity!=51.7f || temperature!=-3.5f
+         || dht_decode_edges(dht11_trace.edges, dht11_trace.count, DHT_TYPE_DHT11, &humidity, &temperature)!=ESP_OK
+         || humidity!=45 || temperature!=23){
+      fprintf(stderr, "dht edge traces decoded wrong\n");
+      return 1;
+   }
+   const uint8_t bad_checksum_frame[5] = {0x02, 0x05, 0x80, 0x23, 0xAB};
+   dht_trace bad_checksum_trace;
+   build_trace(&bad_checksum_trace, bad_checksum_frame, 1);
+   if(dht_decode_edges(bad_checksum_trace.edges, bad_checksum_trace.count, DHT_TYPE_AM2301, &humidity, &temperature)!=ESP_ERR_INVALID_CRC
+         || dht_decode_edges(dht22_trace.edges, 30, DHT_TYPE_AM2301, &humidity, &temperature)!=ESP_ERR_TIMEOUT){
+      fprintf(stderr, "broken dht edge traces accepted\n");
+      return 1;
+   }
+   for(uint8_t i=0; i<sizeof dht_edge_fixtures/sizeof dht_edge_fixtures[0]; i++){
+      const dht_edge_fixture *fixture = &dht_edge_fixtures[i];
+      dht_trace fixture_trace;
+      load_trace(&fixture_trace, fixture->gaps);
+      esp_err_t err = dht_decode_edges(fixture_trace.edges, fixture_trace.count,
+         fixture->type, &humidity, &temperature);
+      if(err!=ESP_OK || humidity!=fixture->humidity || temperature!=fixture->temperature){
+         fprintf(stderr, "dht fixture %s decoded wrong: %s, %.1f %%, %.1f C\n",
+            fixture->name, esp_err_to_name(err), humidity, temperature);
+         return 1;
+      }
+   }
+
+   // Reports queued while offline come back in order, after a cold boot too,
+   // each one with its boot. The clock restarted, so times repeat
+   host_flash_attach(OUTBOX_PARTITION_LABEL, NULL, 4*OUTBOX_SECTOR_SIZE);
+   outbox_init(0);
+   for(uint32_t i=0; i<3; i++){
+      char report[16];
+      snprintf(report, sizeof report, "{\"n\":%u}", i);
+      outbox_append(BENCH_REPORT_TOPIC, report, strlen(report), BENCH_BOOT+i/2, 100+i%2);
+   }
+   outbox_init(0);
+   host_stubs_reset();
+   uint16_t replayed_boot=0;
+   if(outbox_count()!=3 || outbox_replay(outbox_mqtt_send, &replayed_boot, 2)!=ESP_OK
+         || strcmp(host_last_mqtt_payload(), "{\"n\":1}")!=0 || replayed_boot!=BENCH_BOOT
+         || outbox_replay(outbox_mqtt_send, &replayed_boot, 2)!=ESP_OK
+         || strcmp(host_last_mqtt_payload(), "{\"n\":2}")!=0 || replayed_boot!=BENCH_BOOT+1
+         || outbox_count()!=0){
+      fprintf(stderr, "outbox replayed wrong\n");
+      return 1;
+   }
+   outbox_stats queued;
+   get_outbox_stats(&queued);
+   printf("outbox: %u appended, %u replayed, %u dropped, %u flash writes per replay\n",
+      queued.appended, queued.replayed, queued.dropped, host_counters.flash_writes/3);
+
+   // Without acks, a full window waits until its oldest message expires
+   uint32_t expired=0;
+   mqtt_pipeline_stats pipeline_before, pipeline_stats;
+   mqtt_pipeline_set_expired_cb(count_expired, &expired);
+   get_mqtt_pipeline_stats(&pipeline_before);
+   for(uint8_t i=0; i<BENCH_PIPELINE_WINDOW+2; i++){
+      mqtt_pipeline_publish(client, BENCH_REPORT_TOPIC, "{}", 2);
+      vTaskDelay(pdMS_TO_TICKS(1000));
+   }
+   get_mqtt_pipeline_stats(&pipeline_stats);
+   uint8_t expired_at_drain = mqtt_pipeline_drain(100);
+   if(pipeline_stats.window_waits-pipeline_before.window_waits!=1 || pipeline_stats.acked!=pipeline_before.acked
+         || expired!=BENCH_PIPELINE_WINDOW+2 || expired_at_drain!=BENCH_PIPELINE_WINDOW
+         || mqtt_pipeline_in_flight()!=0){
+      fprintf(stderr, "mqtt pipeline didn't expire unacked messages\n");
+      return 1;
+   }
+   mqtt_pipeline_set_expired_cb(NULL, NULL);
+   host_mqtt_ack(64);
+   mqtt_pipeline_publish(client, BENCH_REPORT_TOPIC, "{}", 2);
+   vTaskDelay(pdMS_TO_TICKS(250));
+   host_mqtt_ack(1);
+   get_mqtt_pipeline_stats(&pipeline_stats);
+   if(mqtt_pipeline_in_flight()!=0 || pipeline_stats.last_ack_latency_us<250000){
+      fprintf(stderr, "mqtt pipeline ack not matched\n");
+      return 1;
+   }
+   // Messages too large to copy stay with the caller until their ack
+   static char large_payload[MQTT_PIPELINE_MAX_PAYLOAD*4];
+   memset(large_payload, 'x', sizeof large_payload);
+   mqtt_pipeline_set_expired_cb(count_expired, &expired);
+   expired = 0;
+   int batch_id = mqtt_pipeline_publish(client, BENCH_REPORT_TOPIC, large_payload, sizeof large_payload);
+   esp_err_t batch_unacked = mqtt_pipeline_wait_ack(batch_id);
+   host_mqtt_ack(64);
+   batch_id = mqtt_pipeline_publish(client, BENCH_REPORT_TOPIC, large_payload, sizeof large_payload);
+   host_mqtt_ack(1);
+   if(batch_unacked!=ESP_ERR_TIMEOUT || expired!=0
+         || mqtt_pipeline_wait_ack(batch_id)!=ESP_OK || mqtt_pipeline_in_flight()!=0){
+      fprintf(stderr, "mqtt pipeline batch ack wrong\n");
+      return 1;
+   }
+   mqtt_pipeline_set_expired_cb(NULL, NULL);
+   get_mqtt_pipeline_stats(&pipeline_stats);
+   printf("mqtt pipeline: %u published, %u acked, %u expired, %u unknown acks, %u us mean ack\n",
+      pipeline_stats.published, pipeline_stats.acked, pipeline_stats.expired,
+      pipeline_stats.unknown_acks,
+      (uint32_t)(pipeline_stats.total_ack_latency_us/pipeline_stats.acked));
+
+   // Messages over 255 bytes arrive whole, fragments are put together
+   mqtt_rx_stats rx_before, rx_stats;
+   get_mqtt_rx_stats(&rx_before);
+   received_message.count = 0;
+   host_mqtt_deliver(client, "remote_action", inbound_message, 300, 1024, 0);
+   if(received_message.count!=1 || received_message.data!=inbound_message
+         || received_message.data_len!=300 || received_message.topic_len!=13){
+      fprintf(stderr, "whole mqtt message not delivered in place\n");
+      return 1;
+   }
+   host_mqtt_deliver(client, "remote_action", inbound_message+3, 1000, 300, 9);
+   if(received_message.count!=2 || received_message.data_len!=1000
+         || memcmp(received_message.copy, inbound_message+3, 1000)!=0){
+      fprintf(stderr, "fragmented mqtt message put together wrong\n");
+      return 1;
+   }
+   host_mqtt_deliver(client, "remote_action", inbound_message, 2000, 512, 10);
+   get_mqtt_rx_stats(&rx_stats);
+   if(received_message.count!=2 || rx_stats.too_large-rx_before.too_large!=1){
+      fprintf(stderr, "oversized mqtt message delivered\n");
+      return 1;
+   }
+   printf("mqtt rx: %u messages, %u without copy, %u fragments, %u too large, %u incomplete\n",
+      rx_stats.messages, rx_stats.zero_copy, rx_stats.fragments, rx_stats.too_large,
+      rx_stats.incomplete);
+
+   // Values that don't convert to an integer are written as 0 or clamped
+   payload_encoder clamped;
+   payload_encoder_init(&clamped, NULL);
+   payload_encoder_add_field(&clamped, "t", 3, 1);
+   const float unconvertible[] = { NAN, INFINITY, -INFINITY, 1e30f };
+   const char *written[] = { "{\"t\":   0.0}", "{\"t\": 999.9}", "{\"t\":-999.9}", "{\"t\": 999.9}" };
+   for(uint8_t i=0; i<sizeof unconvertible/sizeof unconvertible[0]; i++){
+      payload_encoder_set_value(&clamped, 0, unconvertible[i]);
+      if(strcmp(clamped.buffer, written[i])!=0){
+         fprintf(stderr, "%f encoded as %s\n", unconvertible[i], clamped.buffer);
+         return 1;
+      }
+   }
+
+   float period;
+   command_message command;
+   if(command_dispatch(bench_commands, 3, bench_command, sizeof bench_command-1, command_values)!=ESP_OK
+         || command_values[0]!=0.5f || command_values[1]!=2.25f
+         || command_parse("{\"cmd\":\"set_period\",\"seconds\":-1.5e2}", 37, &command)!=ESP_OK
+         || command_get_number(&command, "seconds", &period)!=ESP_OK || period!=-150
+         || command_dispatch(bench_commands, 3, "{\"cmd\":\"reboot\"}", 16, NULL)!=ESP_ERR_NOT_SUPPORTED){
+      fprintf(stderr, "commands parsed wrong\n");
+      return 1;
+   }
+   // Queued commands run in order when the queue is run, extra ones drop
+   command_values[0] = 0;
+   for(uint8_t i=0; i<COMMAND_QUEUE_SIZE; i++){
+      command_queue_push(bench_command, sizeof bench_command-1);
+   }
+   if(command_queue_push(bench_command, sizeof bench_command-1)!=ESP_ERR_NO_MEM
+         || command_values[0]!=0
+         || command_queue_run(bench_commands, 3, command_values)!=COMMAND_QUEUE_SIZE
+         || command_values[0]!=0.5f
+         || command_queue_run(bench_commands, 3, command_values)!=0){
+      fprintf(stderr, "command queue ran wrong\n");
+      return 1;
+   }
+   int accepted = check_malformed_commands(iterations);
+   if(accepted<0){
+      return 1;
+   }
+   command_stats commands;
+   get_command_stats(&commands);
+   printf("commands: %u run, %u unknown, %u dropped, %d of %u mutated commands accepted\n",
+      commands.run, commands.unknown, commands.dropped, accepted, iterations);
+
+   // Spans measure the time between begin and end, record fits its buffer
+   char record[DIAGNOSTICS_RECORD_SIZE];
+   diagnostics_record_sent();
+   DIAG_SPAN_BEGIN(DIAG_STAGE_CYCLE);
+   vTaskDelay(pdMS_TO_TICKS(1500));
+   DIAG_SPAN_END(DIAG_STAGE_CYCLE);
+   for(uint8_t i=0; i<DIAG_STAGE_COUNT; i++){
+      diagnostics_span_begin(i);
+      diagnostics_span_end(i);
+   }
+   DIAG_SPAN_BEGIN(DIAG_STAGE_WIFI);
+   vTaskDelay(pdMS_TO_TICKS(99000));
+   DIAG_SPAN_END(DIAG_STAGE_WIFI);
+   diagnostics_end_cycle(1);
+   size_t record_length = diagnostics_encode("1.0.0-rc.10", record, sizeof record);
+   if(diagnostics_get_span(DIAG_STAGE_CYCLE)->max_ms<1500
+         || diagnostics_get_span(DIAG_STAGE_WIFI)->last_ms!=UINT16_MAX
+         || record_length==0 || record_length>=sizeof record){
+      fprintf(stderr, "diagnostics record wrong\n");
+      return 1;
+   }
+   printf("diagnostics: %u bytes per record. %s\n", (uint32_t)record_length, record);
+   if(diagnostics_encode("1.0.0", record, 64)!=0){
+      fprintf(stderr, "diagnostics record overflowed\n");
+      return 1;
+   }
+
+   // Full trace of the longest lines fits the export, oldest are dropped
+   // and clearing keeps the current state
+   char power_record[POWER_TRACE_EXPORT_SIZE];
+   power_trace_init(0);
+   for(uint32_t i=0; i<POWER_TRACE_SIZE+3; i++){
+      power_trace_enter(i%2 ? POWER_STATE_MODEM_SLEEP : POWER_STATE_DEEP_SLEEP, UINT32_MAX-100+i);
+   }
+   size_t power_length = power_trace_export(power_record, sizeof power_record);
+   if(power_trace_count()!=POWER_TRACE_SIZE || power_length==0
+         || strncmp(power_record, "4294967198 modem_sleep\n", 23)!=0){
+      fprintf(stderr, "power trace wrong\n");
+      return 1;
+   }
+   printf("power trace: %u bytes per full trace\n", (uint32_t)power_length);
+   power_trace_clear();
+   power_length = power_trace_export(power_record, sizeof power_record);
+   char power_last[32];
+   snprintf(power_last, sizeof power_last, "%u deep_sleep\n", UINT32_MAX-100+POWER_TRACE_SIZE+2);
+   if(power_trace_count()!=1 || strcmp(power_record, power_last)!=0
+         || power_trace_export(power_record, 8)!=0){
+      fprintf(stderr, "power trace not cleared\n");
+      return 1;
+   }
+   // Times after a clear are relative to the state kept, through the wrap
+   power_trace_enter(POWER_STATE_TX, 150);
+   snprintf(power_last+strlen(power_last), sizeof power_last-strlen(power_last), "150 tx\n");
+   if(power_trace_export(power_record, sizeof power_record)==0 || strcmp(power_record, power_last)!=0){
+      fprintf(stderr, "power trace times wrong after clear: %s\n", power_record);
+      return 1;
+   }
+
+   // Compressed days of samples decode to the recorded samples. Raw samples
+   // take 8 bytes, as sensor_sample of sample_buffer.h
+   series_trace *traces[] = { &dht22_series, &dht11_series };
+   const char *trace_names[] = { "dht22", "dht11" };
+   for(uint8_t t=0; t<2; t++){
+      series_trace *series = traces[t];
+      uint32_t bytes;
+      uint32_t blocks = compress_series(series, &bytes);
+      printf("series %s: %u samples in %u blocks of %u bytes, %u bytes, ratio %.1f, %.1f bits per sample\n",
+         trace_names[t], BENCH_SERIES_SAMPLES, blocks, BENCH_SERIES_BLOCK_SIZE, bytes,
+         8.0*BENCH_SERIES_SAMPLES/bytes, 8.0*bytes/BENCH_SERIES_SAMPLES);
+      uint16_t first = BENCH_SERIES_SAMPLES-series->encoder.count;
+      uint32_t timestamp;
+      int16_t values[2];
+      uint16_t decoded = 0;
+      series_decoder_init(&series->decoder, series->block, series_length(&series->encoder));
+      while(series_next(&series->decoder, &timestamp, values)==ESP_OK){
+         uint16_t i = first+decoded++;
+         if(timestamp!=series->timestamps[i] || values[0]!=series->values[i][0]
+               || values[1]!=series->values[i][1]){
+            break;
+         }
+      }
+      if(decoded!=series->encoder.count
+            || series_decoder_init(&series->decoder, series->block, 3)!=ESP_ERR_INVALID_SIZE){
+         fprintf(stderr, "series %s round trip failed\n", trace_names[t]);
+         return 1;
+      }
+      // Truncated blocks end early
+      series_decoder_init(&series->decoder, series->block, series_length(&series->encoder)-2);
+      while(series_next(&series->decoder, &timestamp, values)==ESP_OK);
+      if(series_next(&series->decoder, &timestamp, values)!=ESP_ERR_INVALID_SIZE){
+         fprintf(stderr, "series %s truncation not found\n", trace_names[t]);
+         return 1;
+      }
+   }
+
+   // Buffered samples past a block are spilled to nvs and come back in
+   // order. Past the spill limit, the oldest samples of the block in rtc
+   // memory are dropped: the spilled ones and the newest ones are sent
+   static flushed_samples flushed;
+   host_nvs_clear();
+   host_stubs_reset();
+   sample_buffer_init(BENCH_BOOT);
+   uint16_t pushed = 2*SAMPLE_BUFFER_CAPACITY+10;
+   push_series(&dht22_series, 0, pushed);
+   uint32_t spill_writes = host_counters.nvs_writes/(pushed/SAMPLE_BUFFER_CAPACITY);
+   flushed.count = 0;
+   if(sample_buffer_count()!=pushed || sample_buffer_flush_samples(collect_samples, &flushed)!=ESP_OK
+         || flushed.count!=pushed || matching_samples(&flushed, 0, &dht22_series, 0)!=pushed
+         || flushed.boots[0]!=BENCH_BOOT || sample_buffer_count()!=0){
+      fprintf(stderr, "spilled samples flushed wrong: %u of %u\n", flushed.count, pushed);
+      return 1;
+   }
+   pushed = (SAMPLE_BUFFER_MAX_SPILLS+1)*SAMPLE_BUFFER_CAPACITY+40;
+   push_series(&dht22_series, 0, pushed);
+   uint16_t kept = sample_buffer_count();
+   flushed.count = 0;
+   sample_buffer_flush_samples(collect_samples, &flushed);
+   uint16_t oldest = matching_samples(&flushed, 0, &dht22_series, 0);
+   uint16_t newest = flushed.count-oldest;
+   if(flushed.count!=kept || kept>=pushed || oldest<SAMPLE_BUFFER_MAX_SPILLS*SAMPLE_BUFFER_CAPACITY/2
+         || newest==0 || matching_samples(&flushed, oldest, &dht22_series, pushed-newest)!=newest){
+      fprintf(stderr, "full sample buffer flushed wrong: %u of %u kept, %u oldest, %u newest\n",
+         flushed.count, pushed, oldest, newest);
+      return 1;
+   }
+   printf("sample buffer: %u of %u samples kept, %u spilled and %u newest, %u nvs writes per spill\n",
+      kept, pushed, oldest, newest, spill_writes);
+   // Samples of a boot kept in rtc memory through a reset are sent apart
+   // from the samples of the next boot
+   push_series(&dht22_series, 0, 10);
+   sample_buffer_init(BENCH_BOOT+1);
+   push_series(&dht22_series, 10, 10);
+   flushed.count = 0;
+   sample_buffer_flush_samples(collect_samples, &flushed);
+   if(flushed.count!=20 || matching_samples(&flushed, 0, &dht22_series, 0)!=20
+         || flushed.boots[9]!=BENCH_BOOT || flushed.boots[10]!=BENCH_BOOT+1){
+      fprintf(stderr, "samples of a reset mixed with the next boot\n");
+      return 1;
+   }
+   // Json batches carry the boot
+   static char batch_payload[SAMPLE_BATCH_MAX_LENGTH];
+   char expected_batch[64];
+   push_series(&dht22_series, 0, 1);
+   sample_buffer_flush(collect_batch, batch_payload);
+   snprintf(expected_batch, sizeof expected_batch, "{\"boot\":%u,\"samples\":[[0,%d.%d,%d.%d]]}",
+      BENCH_BOOT+1, dht22_series.values[0][0]/10, dht22_series.values[0][0]%10,
+      dht22_series.values[0][1]/10, dht22_series.values[0][1]%10);
+   if(strcmp(batch_payload, expected_batch)!=0){
+      fprintf(stderr, "json batch wrong: %s\n", batch_payload);
+      return 1;
+   }
+
+   // Patches rebuild the new image fed byte by byte or in chunks, and are
+   // refused for another old image or when cut short
+   if(images.patch==NULL || apply_patch(&images, images.patch, images.patch_size, 1)!=ESP_OK
+         || images.out_length!=images.new_size
+         || memcmp(images.out, images.new_image, images.new_size)!=0
+         || apply_patch(&images, images.patch, images.patch_size, 1000)!=ESP_OK
+         || memcmp(images.out, images.new_image, images.new_size)!=0){
+      fprintf(stderr, "delta patch round trip failed\n");
+      return 1;
+   }
+   images.old_image[images.old_size/2] ^= 1;
+   esp_err_t wrong_old = apply_patch(&images, images.patch, images.patch_size, 512);
+   uint32_t written_from_wrong_old = images.out_length;
+   images.old_image[images.old_size/2] ^= 1;
+   if(wrong_old!=ESP_ERR_INVALID_CRC || written_from_wrong_old!=0
+         || apply_patch(&images, images.patch, images.patch_size-1, 512)!=ESP_ERR_INVALID_SIZE
+         || apply_patch(&images, images.patch, 3, 512)!=ESP_ERR_INVALID_SIZE){
+      fprintf(stderr, "broken delta patch accepted\n");
+      return 1;
+   }
+   images.patch[images.patch_size-1] ^= 0x80;
+   if(apply_patch(&images, images.patch, images.patch_size, 512)==ESP_OK){
+      fprintf(stderr, "corrupt delta patch accepted\n");
+      return 1;
+   }
+   images.patch[images.patch_size-1] ^= 0x80;
+   printf("delta: %u -> %u bytes, patch %u bytes (%.1f%%), %u records, %u changed bytes,"
+      " %u new, %u bytes of ram\n", images.old_size, images.new_size,
+      (uint32_t)images.patch_size, 100.0*images.patch_size/images.new_size, diff_stats.records,
+      diff_stats.changed_bytes, diff_stats.copy_bytes, (uint32_t)sizeof images.applier);
+
+   // Updates are only applied from https urls with a signature of the new
+   // image by the signing key. Nothing is downloaded without a signature,
+   // and the boot slot doesn't change for any rejected update
+   static uint8_t signature[OTA_SIGNATURE_MAX_SIZE], wrong_signature[OTA_SIGNATURE_MAX_SIZE];
+   BIO *key_pem = BIO_new_mem_buf(ota_test_signing_key, -1);
+   EVP_PKEY *signing_key = PEM_read_bio_PrivateKey(key_pem, NULL, NULL, NULL);
+   EVP_PKEY *wrong_key = generate_key();
+   BIO_free(key_pem);
+   size_t signature_length = sign_image(signing_key, images.new_image, images.new_size, signature);
+   size_t wrong_length = sign_image(wrong_key, images.new_image, images.new_size, wrong_signature);
+   EVP_PKEY_free(signing_key);
+   EVP_PKEY_free(wrong_key);
+   ota_update_stats ota_stats;
+   host_nvs_clear();
+   host_ota_load("ota_0", images.old_image, images.old_size);
+   host_http_set_response(404, NULL, 0);
+   host_http_set_url_response(BENCH_OTA_URL, 200, images.patch, images.patch_size);
+   esp_err_t http_update = ota_update_apply("http://localhost/update.dlt");
+   esp_err_t unsigned_update = ota_update_apply(BENCH_OTA_URL);
+   get_ota_update_stats(&ota_stats);
+   uint32_t unsigned_bytes = ota_stats.patch_bytes;
+   host_http_set_url_response(BENCH_OTA_URL OTA_SIGNATURE_SUFFIX, 200, wrong_signature, wrong_length);
+   esp_err_t wrong_key_update = ota_update_apply(BENCH_OTA_URL);
+   const esp_partition_t *rejected_boot = esp_ota_get_boot_partition();
+   host_http_set_url_response(BENCH_OTA_URL OTA_SIGNATURE_SUFFIX, 200, signature, signature_length);
+   esp_err_t signed_update = ota_update_apply(BENCH_OTA_URL);
+   get_ota_update_stats(&ota_stats);
+   if(signature_length==0 || wrong_length==0 || http_update!=ESP_ERR_INVALID_ARG
+         || unsigned_update!=ESP_ERR_OTA_VALIDATE_FAILED || unsigned_bytes!=0
+         || wrong_key_update!=ESP_ERR_OTA_VALIDATE_FAILED || strcmp(rejected_boot->label, "ota_0")!=0
+         || signed_update!=ESP_OK || strcmp(esp_ota_get_boot_partition()->label, "ota_1")!=0
+         || memcmp(host_ota_image("ota_1"), images.new_image, images.new_size)!=0){
+      fprintf(stderr, "ota update checks failed: http 0x%x, unsigned 0x%x, wrong key 0x%x, signed 0x%x\n",
+         http_update, unsigned_update, wrong_key_update, signed_update);
+      return 1;
+   }
+   printf("ota: http, unsigned and wrong key updates rejected, signed update applied, %u bytes of"
+      " patch, %u byte signature\n", ota_stats.patch_bytes, (uint32_t)signature_length);
+   free(images.patch);
+
+   // A batch posted per value, as send_dht_data_with_http does, and in bulk
+   // with each encoding. The server decodes bulk bodies to the same records
+   host_stubs_reset();
+   for(uint16_t i=0; i<BENCH_BULK_SAMPLES; i++){
+      dht22.temperature = batch.samples[i].values[0]/10.0f;
+      dht22.humidity = batch.samples[i].values[1]/10.0f;
+      bench_http_send(&dht22);
+   }
+   uint32_t value_posts = host_counters.http_performs;
+   uint32_t value_wire_bytes = host_counters.http_wire_bytes;
+   printf("http per value: %u posts, %u body bytes, %u bytes on the wire for %u samples\n",
+      value_posts, host_counters.http_bytes, value_wire_bytes, BENCH_BULK_SAMPLES);
+   static char records[BENCH_BULK_SAMPLES*HTTP_BULK_RECORD_SIZE];
+   static uint8_t decoded_body[BENCH_BULK_SAMPLES*HTTP_BULK_RECORD_SIZE];
+   size_t records_length = 0;
+   for(uint16_t i=0; i<BENCH_BULK_SAMPLES; i++){
+      const int16_t *values = batch.samples[i].values;
+      records_length += sprintf(records+records_length,
+         "{\"boot\":%u,\"t\":%u,\"temp\":%d.%d,\"humid\":%d.%d}\n", BENCH_BOOT,
+         batch.samples[i].timestamp, values[0]/10, values[0]%10, values[1]/10, values[1]%10);
+   }
+   const http_content_encoding encodings[] = { HTTP_ENCODING_IDENTITY, HTTP_ENCODING_GZIP,
+      HTTP_ENCODING_DEFLATE };
+   const char *encoding_names[] = { NULL, "gzip", "deflate" };
+   for(uint8_t e=0; e<3; e++){
+      host_stubs_reset();
+      batch.config.bulk_encoding = encodings[e];
+      host_http_request request;
+      size_t decoded_length;
+      esp_err_t err = http_bulk_send(batch.samples, BENCH_BULK_SAMPLES, BENCH_BOOT, &batch.config);
+      host_last_http_request(&request);
+      esp_err_t decoded = host_http_decode_body(decoded_body, sizeof decoded_body, &decoded_length);
+      // Identity bodies don't fit a post, the last one has the last records
+      if(err!=ESP_OK || decoded!=ESP_OK || strcmp(request.content_type, HTTP_BULK_CONTENT_TYPE)!=0
+            || (encoding_names[e]==NULL ? request.content_encoding!=NULL
+               : request.content_encoding==NULL || strcmp(request.content_encoding, encoding_names[e])!=0)
+            || (e>0 && (host_counters.http_performs!=1 || decoded_length!=records_length))
+            || decoded_length>records_length
+            || memcmp(decoded_body, records+records_length-decoded_length, decoded_length)!=0){
+         fprintf(stderr, "bulk http post %s decoded wrong\n", encoding_names[e] ? encoding_names[e] : "identity");
+         return 1;
+      }
+      printf("http bulk %s: %u posts, %u body bytes, %u bytes on the wire, %.1f%% of per value\n",
+         encoding_names[e] ? encoding_names[e] : "identity", host_counters.http_performs,
+         host_counters.http_bytes, host_counters.http_wire_bytes,
+         100.0*host_counters.http_wire_bytes/value_wire_bytes);
+   }
+   // A failed post keeps the batch, a corrupt body is refused by the server
+   host_http_fail_next(2);
+   batch.config.bulk_encoding = HTTP_ENCODING_GZIP;
+   if(http_bulk_send(batch.samples, BENCH_BULK_SAMPLES, BENCH_BOOT, &batch.config)==ESP_OK){
+      fprintf(stderr, "failed bulk http post not reported\n");
+      return 1;
+   }
+   http_bulk_send(batch.samples, 4, BENCH_BOOT, &batch.config);
+   host_http_request request;
+   host_last_http_request(&request);
+   size_t decoded_length;
+   ((uint8_t*)request.body)[request.length-5] ^= 1;
+   if(host_http_decode_body(decoded_body, sizeof decoded_body, &decoded_length)!=ESP_ERR_INVALID_CRC){
+      fprintf(stderr, "corrupt bulk http body accepted\n");
+      return 1;
+   }
+   http_bulk_stats bulk_stats;
+   get_http_bulk_stats(&bulk_stats);
+   printf("http bulk: %u posts, %u records, %u failures, %u bytes of compressor ram\n",
+      bulk_stats.posts, bulk_stats.records, bulk_stats.failures,
+      (uint32_t)(sizeof(deflate_stream)+HTTP_BULK_MAX_BODY));
+
+   http_request_stats stats;
+   get_http_request_stats(&stats);
+   printf("http: %u requests, %u handshakes, %u avoided, %u reconnects\n",
+      stats.requests, stats.handshakes, stats.handshakes_avoided, stats.reconnects);
+   return 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * dht_edge_traces.h
+ * @description: Fixtures of dht frames for the edge decoder, checked by
+ *    dht_bench. Each one has the us between the falling edges of a frame,
+ *    as dht_capture_frame logs them with LOG_LEVEL_DHT set to
+ *    ESP_LOG_VERBOSE:
+ *       V (1234) dht: 42 edges: 162,77,82,...,122,
+ *    A line of that log is pasted as gaps, with the values the frame holds.
+ *    Traces of frames that were decoded wrong on a device go here too,
+ *    with the values they should decode to
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_DHT_EDGE_TRACES
+#define IOT_DHT_EDGE_TRACES
+
+#include "dht_driver.h"
+
+
+/*
+ * dht_edge_fixture: Trace of a frame and what it holds
+ *    - name: const char*. Where the trace comes from
+ *    - type: dht_sensor_type_t. Sensor that sent it
+ *    - humidity: float. Humidity of the frame
+ *    - temperature: float. Temperature of the frame
+ *    - gaps: const char*. Us between falling edges, comma separated
+ */
+typedef struct {
+   const char* name;
+   dht_sensor_type_t type;
+   float humidity;
+   float temperature;
+   const char* gaps;
+} dht_edge_fixture;
+
+
+static const dht_edge_fixture dht_edge_fixtures[] = {
+   // Written from the am2301 timings, not captured: 48-56 us low, 23-29
+   // or 68-75 us high. The edge of bit 11 is 17 us late, as with a wifi
+   // interrupt in front of the gpio one, so that 0 takes 94 us and the 1
+   // after it 103 us
+   { "am2301 timings, late edge", DHT_TYPE_AM2301, 65.2f, 22.5f,
+      "162,77,82,71,79,80,75,119,75,123,74,82,94,103,122,72,75,75,78,79,79,"
+      "73,76,76,76,119,129,128,80,76,78,74,127,81,127,118,82,123,125,122,122," },
+};
+
+#endif
@@ -0,0 +1,15 @@
+/*
+ * credentials.h
+ * @description: Credentials of the simulation. The access point and broker
+ *    are simulated, these values are never checked
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_CREDENTIALS
+#define IOT_CREDENTIALS
+
+#define WIFI_SSID "sim_ap"
+#define WIFI_PWD "sim_password"
+#define IOT_CORE_MQTT_URI "mqtts://localhost:8883"
+
+#endif
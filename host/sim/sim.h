@@ -0,0 +1,311 @@
+/*
+ * sim.h
+ * @description: Definition of the full-system simulation of the firmware.
+ *    The real app_main and its tasks run as threads, one at a time, with
+ *    FreeRTOS priorities. Time is virtual: it only moves when every task is
+ *    blocked, jumping to the next timeout, interrupt or network event, so a
+ *    simulated day runs in seconds. Deep sleep restarts the program with the
+ *    rtc memory, nvs and flash of the previous boot
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_SIM
+#define HOST_SIM
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "esp_system.h"
+
+// Tasks of the firmware and of the simulated sdk
+#define SIM_MAX_TASKS 12
+// Pending timer, interrupt and network events
+#define SIM_MAX_EVENTS 256
+// Latency samples kept, later ones only count in the totals
+#define SIM_MAX_SAMPLES 4096
+// Time from the end of a deep sleep to app_main
+#define SIM_BOOT_US 250000
+// Longest time between watchdog feeds, CONFIG_TASK_WDT_TIMEOUT_S
+#define SIM_WDT_TIMEOUT_S 15
+// Commands sent to the device, see -x
+#define SIM_MAX_COMMANDS 16
+
+
+/*
+ * sim_callback: Function run by an event, in interrupt context, or by a
+ *    worker, in task context
+ *    Arguments:
+ *       - arg: void*. Argument given when it was scheduled or posted
+ */
+typedef void (*sim_callback)(void *arg);
+
+
+/*
+ * sim_command: Message published on the subscribed topic during the run
+ *    - at_s: uint32_t. Simulated second it is published at
+ *    - payload: const char*. Message
+ */
+typedef struct {
+   uint32_t at_s;
+   const char* payload;
+} sim_command;
+
+
+/*
+ * sim_config: Options of the run
+ *    - hours: double. Simulated time
+ *    - cpu_scale: double. Virtual time charged per second of host cpu used
+ *       by a task. 0 makes code run in no time, and runs deterministic
+ *    - wifi_connect_ms: uint32_t. Association with a cached access point
+ *    - wifi_scan_ms: uint32_t. Scan and association without cache
+ *    - dhcp_ms: uint32_t. Dhcp lease, not needed with a reused ip
+ *    - tls_ms: uint32_t. Tcp, tls handshake and mqtt connect
+ *    - ack_ms: uint32_t. Time from a QoS 1 publish to its ack
+ *    - state_path: const char*. File kept through deep sleeps
+ *    - verbose: uint8_t. Print the log of the firmware
+ *    - commands: sim_command[]. Messages sent to the device
+ *    - command_count: uint8_t. Messages in commands
+ */
+typedef struct {
+   double hours;
+   double cpu_scale;
+   uint32_t wifi_connect_ms;
+   uint32_t wifi_scan_ms;
+   uint32_t dhcp_ms;
+   uint32_t tls_ms;
+   uint32_t ack_ms;
+   const char* state_path;
+   uint8_t verbose;
+   sim_command commands[SIM_MAX_COMMANDS];
+   uint8_t command_count;
+} sim_config;
+
+
+/*
+ * sim_stats: Counters of the run, kept through deep sleeps
+ *    - boots: uint32_t. Power on and wakes from deep sleep
+ *    - wakes: uint32_t. Ends of a light or deep sleep
+ *    - context_switches: uint32_t. Tasks given the cpu
+ *    - interrupts: uint32_t. Events run in interrupt context
+ *    - cpu_wakeups: uint32_t. Ends of a time with every task blocked,
+ *       tick_wakeups included
+ *    - tick_wakeups: uint32_t. Freertos ticks taken with every task
+ *       blocked, 0 with tickless idle (CONFIG_ENABLE_FREERTOS_SLEEP)
+ *    - task_cpu_ns: uint64_t. Host cpu used by the tasks, sim stand-ins
+ *       included
+ *    - log_lines: uint32_t. Log lines of previous boots, see host_counters
+ *    - timer_interrupts: uint32_t. Alarms of the hardware timer
+ *    - dht_frames: uint32_t. Frames sent by the simulated dht
+ *    - semaphore_takes: uint32_t. Calls to xSemaphoreTake
+ *    - semaphore_timeouts: uint32_t. Takes that timed out
+ *    - wdt_feeds: uint32_t. Calls to esp_task_wdt_reset
+ *    - wdt_timeouts: uint32_t. Gaps between feeds longer than
+ *       SIM_WDT_TIMEOUT_S
+ *    - max_wdt_gap_ms: uint32_t. Longest gap between feeds
+ *    - wifi_connects: uint32_t. Connections to the access point
+ *    - wifi_scans: uint32_t. Connections that needed a scan
+ *    - mqtt_connects: uint32_t. Connections to the broker
+ *    - publishes: uint32_t. Messages published
+ *    - publish_failures: uint32_t. Publishes while disconnected
+ *    - acks: uint32_t. QoS 1 publishes acked
+ *    - subscribe_failures: uint32_t. Subscribes while disconnected
+ *    - commands_sent: uint32_t. Commands delivered to the device
+ *    - commands_lost: uint32_t. Commands sent while it wasn't subscribed
+ *    - commands_done: uint32_t. Bit of each command delivered or lost
+ *    - awake_us: uint64_t. Time out of sleep
+ *    - cycles: uint32_t. Wakes that went back to sleep
+ *    - reports: uint32_t. Wakes that published a QoS 1 message
+ *    - acked_reports: uint32_t. Wakes whose first QoS 1 message was acked
+ *    - awake_ms: uint32_t[]. Time awake of each cycle
+ *    - publish_ms: uint32_t[]. Time from wake to the first QoS 1 publish
+ *    - ack_ms: uint32_t[]. Time from wake to the ack of that publish
+ */
+typedef struct {
+   uint32_t boots;
+   uint32_t wakes;
+   uint32_t context_switches;
+   uint32_t interrupts;
+   uint32_t cpu_wakeups;
+   uint32_t tick_wakeups;
+   uint64_t task_cpu_ns;
+   uint32_t log_lines;
+   uint32_t timer_interrupts;
+   uint32_t dht_frames;
+   uint32_t semaphore_takes;
+   uint32_t semaphore_timeouts;
+   uint32_t wdt_feeds;
+   uint32_t wdt_timeouts;
+   uint32_t max_wdt_gap_ms;
+   uint32_t wifi_connects;
+   uint32_t wifi_scans;
+   uint32_t mqtt_connects;
+   uint32_t publishes;
+   uint32_t publish_failures;
+   uint32_t acks;
+   uint32_t subscribe_failures;
+   uint32_t commands_sent;
+   uint32_t commands_lost;
+   uint32_t commands_done;
+   uint64_t awake_us;
+   uint32_t cycles;
+   uint32_t reports;
+   uint32_t acked_reports;
+   uint32_t awake_ms[SIM_MAX_SAMPLES];
+   uint32_t publish_ms[SIM_MAX_SAMPLES];
+   uint32_t ack_ms[SIM_MAX_SAMPLES];
+} sim_stats;
+
+extern sim_config sim_cfg;
+extern sim_stats sim_counters;
+
+
+/******************* KERNEL, sim_kernel.c **********************************/
+/*
+ * sim_kernel_init: Start the virtual clock
+ *    Arguments:
+ *       - boot_us: int64_t. Simulated time of this boot
+ *       - end_us: int64_t. Simulated time the run stops at
+ */
+void sim_kernel_init(int64_t boot_us, int64_t end_us);
+
+
+/*
+ * sim_kernel_run: Run the tasks until the end of the run, or until every
+ *    task is blocked with nothing left to wake them
+ *    Returns:
+ *       - reason: const char*. Why the run stopped
+ */
+const char* sim_kernel_run(void);
+
+
+/*
+ * sim_now: Simulated time since the first power on, in us
+ */
+int64_t sim_now(void);
+
+
+/*
+ * sim_schedule: Run a function in interrupt context
+ *    Arguments:
+ *       - delay_us: int64_t. Time from now
+ *       - callback: sim_callback. Function
+ *       - arg: void*. Argument of callback
+ *    Returns:
+ *       - id: uint32_t. Id for sim_cancel, 0 if there is no room
+ */
+uint32_t sim_schedule(int64_t delay_us, sim_callback callback, void *arg);
+
+
+/*
+ * sim_cancel: Drop a scheduled event. Does nothing if it already ran
+ */
+void sim_cancel(uint32_t id);
+
+
+/*
+ * sim_worker: Task that runs posted functions in order, like the event
+ *    loop or the mqtt task of the sdk
+ */
+typedef struct sim_worker sim_worker;
+
+
+/*
+ * sim_worker_create: Create a worker task
+ *    Arguments:
+ *       - name: const char*. Name of the task
+ *       - priority: uint32_t. FreeRTOS priority
+ */
+sim_worker* sim_worker_create(const char* name, uint32_t priority);
+
+
+/*
+ * sim_worker_post: Run a function in the worker
+ *    Arguments:
+ *       - worker: sim_worker*. Worker
+ *       - delay_us: int64_t. Time from now
+ *       - callback: sim_callback. Function, given a copy of data
+ *       - data: const void*. Data, copied
+ *       - size: size_t. Size of data
+ */
+void sim_worker_post(sim_worker *worker, int64_t delay_us, sim_callback callback,
+        const void *data, size_t size);
+
+
+/*
+ * sim_print_tasks: Print the tasks with their priority and dispatches
+ */
+void sim_print_tasks(void);
+
+
+/******************* DEVICE, sim_device.c **********************************/
+/*
+ * sim_device_boot: Start the simulated hardware of a boot
+ *    Arguments:
+ *       - reason: esp_reset_reason_t. Reset reason given to the firmware
+ */
+void sim_device_boot(esp_reset_reason_t reason);
+
+
+/*
+ * sim_wifi_connected: Check if the station has an ip
+ */
+uint8_t sim_wifi_connected(void);
+
+
+/*
+ * sim_nvs_save: Write the nvs contents to a file
+ */
+void sim_nvs_save(FILE *file);
+
+
+/*
+ * sim_nvs_load: Read the nvs contents written by sim_nvs_save
+ */
+int sim_nvs_load(FILE *file);
+
+
+/******************* BROKER, sim_mqtt.c ************************************/
+/*
+ * sim_mqtt_boot: Schedule the commands of the run still to come
+ */
+void sim_mqtt_boot(void);
+
+
+/******************* RUN, sim_main.c ***************************************/
+/*
+ * sim_reboot: Save the state of the run and start the program again, as
+ *    the device does when it wakes from deep sleep. Doesn't return
+ *    Arguments:
+ *       - sleep_us: uint64_t. Time asleep
+ *       - reason: esp_reset_reason_t. Reset reason of the next boot
+ */
+void sim_reboot(uint64_t sleep_us, esp_reset_reason_t reason);
+
+
+/*
+ * sim_mark_wake: The device left a sleep
+ */
+void sim_mark_wake(void);
+
+
+/*
+ * sim_mark_sleep: The device is going to sleep
+ */
+void sim_mark_sleep(void);
+
+
+/*
+ * sim_mark_publish: The device published a message
+ *    Arguments:
+ *       - qos: int. QoS of the message
+ *       - msg_id: int. Id of the message
+ */
+void sim_mark_publish(int qos, int msg_id);
+
+
+/*
+ * sim_mark_ack: The broker acked a QoS 1 message
+ */
+void sim_mark_ack(int msg_id);
+
+#endif
@@ -0,0 +1,670 @@
+/*
+ * sim_device.c
+ * @description: Simulated hardware of the simulation: default event loop,
+ *    wifi station with an access point, hardware timer, a dht sensor on the
+ *    gpio interrupts, nvs, reset and deep sleep
+ * @author: @Retrocamara42
+ *
+ */
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+#include "host_stubs.h"
+#include "driver/gpio.h"
+#include "driver/hw_timer.h"
+#include "esp_event.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "esp_wifi.h"
+#include "nvs_flash.h"
+#include <dht.h>
+
+// Handlers registered on the default event loop
+#define SIM_MAX_HANDLERS 8
+// Largest event data posted to the default event loop
+#define SIM_MAX_EVENT_DATA 64
+// Priority of the default event loop, above the firmware tasks that wait
+// for its events
+#define SIM_EVENT_TASK_PRIORITY 20
+// Access point of the simulation
+#define SIM_AP_CHANNEL 6
+#define SIM_AP_IP 0x3201a8c0
+#define SIM_AP_GATEWAY 0x0101a8c0
+#define SIM_AP_NETMASK 0x00ffffff
+// Keys and namespaces of nvs
+#define SIM_NVS_MAX_ENTRIES 32
+#define SIM_NVS_MAX_NAMESPACES 8
+#define SIM_NVS_MAX_BLOB 512
+#define SIM_NVS_MAX_NAME 16
+// Dht frame: response after the line is released, response length and
+// length of each bit by its value
+#define SIM_DHT_RESPONSE_US 30
+#define SIM_DHT_RESPONSE_LENGTH_US 160
+#define SIM_DHT_ONE_US 120
+#define SIM_DHT_ZERO_US 78
+#define SIM_DHT_FRAME_EDGES 42
+
+esp_event_base_t WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t IP_EVENT = "IP_EVENT";
+
+// Certificates are embedded by the sdk build, the broker doesn't check them
+const uint8_t sim_root_ca[] asm("_binary_AmazonRootCA1_pem_start") = "sim root ca";
+const uint8_t sim_root_ca_end[] asm("_binary_AmazonRootCA1_pem_end") = "";
+const uint8_t sim_client_cert[] asm("_binary_iot_multisensor_certificate_pem_crt_start") = "sim cert";
+const uint8_t sim_client_cert_end[] asm("_binary_iot_multisensor_certificate_pem_crt_end") = "";
+const uint8_t sim_client_key[] asm("_binary_iot_multisensor_private_pem_key_start") = "sim key";
+const uint8_t sim_client_key_end[] asm("_binary_iot_multisensor_private_pem_key_end") = "";
+// No update is signed with this key
+const uint8_t sim_ota_cert[] asm("_binary_ota_server_cert_pem_start") = "sim ota cert";
+const uint8_t sim_ota_cert_end[] asm("_binary_ota_server_cert_pem_end") = "";
+const uint8_t sim_ota_key[] asm("_binary_ota_signing_key_pub_pem_start") = "sim ota key";
+const uint8_t sim_ota_key_end[] asm("_binary_ota_signing_key_pub_pem_end") = "";
+
+/*
+ * sim_handler: Handler registered on the default event loop
+ */
+typedef struct {
+   esp_event_base_t base;
+   int32_t id;
+   esp_event_handler_t handler;
+   void *arg;
+} sim_handler;
+
+/*
+ * sim_loop_event: Event posted to the default event loop
+ *    - generation: uint32_t. Wifi start it belongs to, see wifi_generation
+ */
+typedef struct {
+   esp_event_base_t base;
+   int32_t id;
+   uint32_t generation;
+   uint8_t data[SIM_MAX_EVENT_DATA];
+} sim_loop_event;
+
+/*
+ * sim_nvs_entry: Blob kept in nvs
+ */
+typedef struct {
+   uint8_t used;
+   uint8_t space;
+   char key[SIM_NVS_MAX_NAME];
+   uint32_t length;
+   uint8_t data[SIM_NVS_MAX_BLOB];
+} sim_nvs_entry;
+
+static const uint8_t ap_bssid[6] = {0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56};
+
+static esp_reset_reason_t reset_reason=ESP_RST_POWERON;
+static sim_worker *event_loop=NULL;
+static sim_handler handlers[SIM_MAX_HANDLERS];
+
+static wifi_config_t station;
+static wifi_ps_type_t power_save=WIFI_PS_NONE;
+static uint8_t wifi_started=0;
+static uint8_t has_ip=0;
+// Events of a stopped station are dropped
+static uint32_t wifi_generation=0;
+static uint8_t dhcp_stopped=0;
+static tcpip_adapter_ip_info_t static_ip_info;
+static tcpip_adapter_dns_info_t dns_info;
+
+static hw_timer_callback_t timer_callback=NULL;
+static void *timer_arg=NULL;
+static uint32_t timer_period_us=0;
+static uint8_t timer_reload=0;
+static uint32_t timer_event=0;
+
+static gpio_isr_t pin_handlers[GPIO_NUM_MAX];
+static void *pin_args[GPIO_NUM_MAX];
+static gpio_int_type_t pin_interrupts[GPIO_NUM_MAX];
+
+// Frame being sent by the dht, edges in us from the start signal
+static struct {
+   gpio_num_t pin;
+   uint8_t next;
+   uint32_t edges_us[SIM_DHT_FRAME_EDGES];
+} dht_frame;
+
+static char nvs_namespaces[SIM_NVS_MAX_NAMESPACES][SIM_NVS_MAX_NAME];
+static sim_nvs_entry nvs_entries[SIM_NVS_MAX_ENTRIES];
+
+
+/******************* EVENT LOOP ********************************************/
+static void dispatch_event(void *arg){
+   sim_loop_event *event = arg;
+   if(event->base==WIFI_EVENT || event->base==IP_EVENT){
+      if(event->generation!=wifi_generation){
+         return;
+      }
+      if(event->base==IP_EVENT && event->id==IP_EVENT_STA_GOT_IP){
+         has_ip=1;
+      }
+   }
+   for(uint8_t i=0; i<SIM_MAX_HANDLERS; i++){
+      sim_handler handler = handlers[i];
+      if(handler.handler!=NULL && handler.base==event->base
+            && (handler.id==ESP_EVENT_ANY_ID || handler.id==event->id)){
+         handler.handler(handler.arg, event->base, event->id, event->data);
+      }
+   }
+}
+
+
+/*
+ * post_event: Post an event to the default event loop
+ *    Arguments:
+ *       - delay_us: int64_t. Time from now
+ *       - base: esp_event_base_t. Event base
+ *       - id: int32_t. Event id
+ *       - data: const void*. Event data, copied
+ *       - size: size_t. Size of data, up to SIM_MAX_EVENT_DATA
+ */
+static void post_event(int64_t delay_us, esp_event_base_t base, int32_t id,
+        const void *data, size_t size){
+   sim_loop_event event = {
+      .base = base,
+      .id = id,
+      .generation = wifi_generation,
+   };
+   if(size>0){
+      memcpy(event.data, data, size);
+   }
+   sim_worker_post(event_loop, delay_us, dispatch_event, &event, sizeof event);
+}
+
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+        esp_event_handler_t event_handler, void *event_handler_arg){
+   for(uint8_t i=0; i<SIM_MAX_HANDLERS; i++){
+      if(handlers[i].handler==NULL){
+         handlers[i] = (sim_handler){event_base, event_id, event_handler, event_handler_arg};
+         return ESP_OK;
+      }
+   }
+   return ESP_ERR_NO_MEM;
+}
+
+
+esp_err_t esp_event_handler_unregister(esp_event_base_t event_base, int32_t event_id,
+        esp_event_handler_t event_handler){
+   for(uint8_t i=0; i<SIM_MAX_HANDLERS; i++){
+      if(handlers[i].base==event_base && handlers[i].id==event_id
+            && handlers[i].handler==event_handler){
+         memset(&handlers[i], 0, sizeof handlers[i]);
+         return ESP_OK;
+      }
+   }
+   return ESP_ERR_INVALID_STATE;
+}
+
+
+void sim_device_boot(esp_reset_reason_t reason){
+   reset_reason=reason;
+   event_loop=sim_worker_create("esp_event", SIM_EVENT_TASK_PRIORITY);
+}
+
+
+/******************* WIFI **************************************************/
+uint8_t sim_wifi_connected(void){
+   return has_ip;
+}
+
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config){
+   return ESP_OK;
+}
+
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode){
+   return ESP_OK;
+}
+
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf){
+   station=*conf;
+   return ESP_OK;
+}
+
+
+esp_err_t esp_wifi_start(void){
+   wifi_started=1;
+   post_event(0, WIFI_EVENT, WIFI_EVENT_STA_START, NULL, 0);
+   return ESP_OK;
+}
+
+
+esp_err_t esp_wifi_stop(void){
+   wifi_started=0;
+   has_ip=0;
+   wifi_generation++;
+   return ESP_OK;
+}
+
+
+/*
+ * esp_wifi_connect: Connect to the access point. Without the bssid and
+ *    channel of the access point, the station scans every channel first.
+ *    With dhcp stopped, the static ip is used right away
+ */
+esp_err_t esp_wifi_connect(void){
+   if(!wifi_started){
+      return ESP_ERR_INVALID_STATE;
+   }
+   uint32_t connect_ms = sim_cfg.wifi_connect_ms;
+   if(!station.sta.bssid_set || memcmp(station.sta.bssid, ap_bssid, sizeof ap_bssid)
+         || station.sta.channel!=SIM_AP_CHANNEL){
+      connect_ms = sim_cfg.wifi_scan_ms;
+      sim_counters.wifi_scans++;
+   }
+   sim_counters.wifi_connects++;
+   wifi_event_sta_connected_t connected = {
+      .channel = SIM_AP_CHANNEL,
+      .authmode = WIFI_AUTH_WPA2_PSK,
+   };
+   memcpy(connected.bssid, ap_bssid, sizeof ap_bssid);
+   post_event((int64_t)connect_ms*1000, WIFI_EVENT, WIFI_EVENT_STA_CONNECTED,
+      &connected, sizeof connected);
+
+   ip_event_got_ip_t got_ip = {
+      .if_index = TCPIP_ADAPTER_IF_STA,
+   };
+   uint32_t ip_ms = connect_ms;
+   if(dhcp_stopped && static_ip_info.ip.addr!=0){
+      got_ip.ip_info=static_ip_info;
+   }
+   else{
+      got_ip.ip_info.ip.addr=SIM_AP_IP;
+      got_ip.ip_info.gw.addr=SIM_AP_GATEWAY;
+      got_ip.ip_info.netmask.addr=SIM_AP_NETMASK;
+      dns_info.ip.u_addr.ip4.addr=SIM_AP_GATEWAY;
+      ip_ms += sim_cfg.dhcp_ms;
+   }
+   post_event((int64_t)ip_ms*1000, IP_EVENT, IP_EVENT_STA_GOT_IP, &got_ip, sizeof got_ip);
+   return ESP_OK;
+}
+
+
+esp_err_t esp_wifi_disconnect(void){
+   return ESP_OK;
+}
+
+
+/*
+ * esp_wifi_set_ps: Power save of the radio. The firmware only uses
+ *    WIFI_PS_MAX_MODEM between cycles, which is counted as asleep
+ */
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type){
+   if(type==WIFI_PS_MAX_MODEM && power_save!=WIFI_PS_MAX_MODEM){
+      sim_mark_sleep();
+   }
+   else if(type!=WIFI_PS_MAX_MODEM && power_save==WIFI_PS_MAX_MODEM){
+      sim_mark_wake();
+   }
+   power_save=type;
+   return ESP_OK;
+}
+
+
+void tcpip_adapter_init(void){
+}
+
+
+esp_err_t tcpip_adapter_dhcpc_start(tcpip_adapter_if_t tcpip_if){
+   dhcp_stopped=0;
+   return ESP_OK;
+}
+
+
+esp_err_t tcpip_adapter_dhcpc_stop(tcpip_adapter_if_t tcpip_if){
+   dhcp_stopped=1;
+   return ESP_OK;
+}
+
+
+esp_err_t tcpip_adapter_set_ip_info(tcpip_adapter_if_t tcpip_if, const tcpip_adapter_ip_info_t *ip_info){
+   static_ip_info=*ip_info;
+   return ESP_OK;
+}
+
+
+esp_err_t tcpip_adapter_get_ip_info(tcpip_adapter_if_t tcpip_if, tcpip_adapter_ip_info_t *ip_info){
+   *ip_info=static_ip_info;
+   return ESP_OK;
+}
+
+
+esp_err_t tcpip_adapter_set_dns_info(tcpip_adapter_if_t tcpip_if, tcpip_adapter_dns_type_t type,
+        tcpip_adapter_dns_info_t *dns){
+   dns_info=*dns;
+   return ESP_OK;
+}
+
+
+esp_err_t tcpip_adapter_get_dns_info(tcpip_adapter_if_t tcpip_if, tcpip_adapter_dns_type_t type,
+        tcpip_adapter_dns_info_t *dns){
+   *dns=dns_info;
+   return ESP_OK;
+}
+
+
+/******************* HARDWARE TIMER ****************************************/
+static void timer_alarm(void *arg){
+   timer_event = timer_reload ? sim_schedule(timer_period_us, timer_alarm, NULL) : 0;
+   sim_counters.timer_interrupts++;
+   if(timer_callback!=NULL){
+      timer_callback(timer_arg);
+   }
+}
+
+
+esp_err_t hw_timer_init(hw_timer_callback_t callback, void *arg){
+   timer_callback=callback;
+   timer_arg=arg;
+   return ESP_OK;
+}
+
+
+esp_err_t hw_timer_deinit(void){
+   sim_cancel(timer_event);
+   timer_event=0;
+   timer_callback=NULL;
+   return ESP_OK;
+}
+
+
+esp_err_t hw_timer_alarm_us(uint32_t value, bool reload){
+   sim_cancel(timer_event);
+   timer_period_us=value;
+   timer_reload=reload;
+   timer_event=sim_schedule(value, timer_alarm, NULL);
+   return ESP_OK;
+}
+
+
+esp_err_t hw_timer_enable(bool en){
+   if(!en){
+      sim_cancel(timer_event);
+      timer_event=0;
+   }
+   else if(timer_event==0 && timer_period_us>0){
+      timer_event=sim_schedule(timer_period_us, timer_alarm, NULL);
+   }
+   return ESP_OK;
+}
+
+
+/******************* DHT SENSOR ********************************************/
+/*
+ * sim_environment: Temperature and humidity of the room, a daily cycle
+ *    with the warmest and driest hour at 15:00
+ */
+static void sim_environment(float *temperature, float *humidity){
+   double hours = sim_now()/3600e6;
+   double phase = sin(2*M_PI*(hours-9)/24);
+   *temperature = 21+4*phase;
+   *humidity = 50-10*phase;
+}
+
+
+/*
+ * dht_edge: Falling edge of the data line. Each edge schedules the next
+ *    one from interrupt context, where the clock doesn't move
+ */
+static void dht_edge(void *arg){
+   gpio_num_t pin = dht_frame.pin;
+   if(pin_handlers[pin]!=NULL && pin_interrupts[pin]!=GPIO_INTR_DISABLE){
+      pin_handlers[pin](pin_args[pin]);
+   }
+   dht_frame.next++;
+   if(dht_frame.next<SIM_DHT_FRAME_EDGES){
+      sim_schedule(dht_frame.edges_us[dht_frame.next]-dht_frame.edges_us[dht_frame.next-1],
+         dht_edge, NULL);
+   }
+}
+
+
+/*
+ * send_dht_frame: Send the falling edges of a frame. The board of main.c
+ *    has a DHT11, which sends integer values and tenths
+ */
+static void send_dht_frame(gpio_num_t pin){
+   float temperature, humidity;
+   sim_environment(&temperature, &humidity);
+   uint8_t data[5] = {
+      (uint8_t)humidity, (uint8_t)(humidity*10)%10,
+      (uint8_t)temperature, (uint8_t)(temperature*10)%10,
+   };
+   data[4] = data[0]+data[1]+data[2]+data[3];
+   dht_frame.pin = pin;
+   dht_frame.next = 0;
+   dht_frame.edges_us[0] = SIM_DHT_RESPONSE_US;
+   dht_frame.edges_us[1] = SIM_DHT_RESPONSE_US+SIM_DHT_RESPONSE_LENGTH_US;
+   for(uint8_t i=0; i<40; i++){
+      uint8_t bit = (data[i/8]>>(7-i%8))&1;
+      dht_frame.edges_us[i+2] = dht_frame.edges_us[i+1]+(bit ? SIM_DHT_ONE_US : SIM_DHT_ZERO_US);
+   }
+   sim_schedule(dht_frame.edges_us[0], dht_edge, NULL);
+   sim_counters.dht_frames++;
+}
+
+
+esp_err_t gpio_config(const gpio_config_t *gpio_cfg){
+   return ESP_OK;
+}
+
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode){
+   return ESP_OK;
+}
+
+
+// Releasing the line with the falling edge interrupt on is a start signal
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level){
+   if(gpio_num>=GPIO_NUM_MAX){
+      return ESP_ERR_INVALID_ARG;
+   }
+   if(level && pin_handlers[gpio_num]!=NULL && pin_interrupts[gpio_num]==GPIO_INTR_NEGEDGE){
+      send_dht_frame(gpio_num);
+   }
+   return ESP_OK;
+}
+
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type){
+   if(gpio_num>=GPIO_NUM_MAX){
+      return ESP_ERR_INVALID_ARG;
+   }
+   pin_interrupts[gpio_num]=intr_type;
+   return ESP_OK;
+}
+
+
+esp_err_t gpio_install_isr_service(int no_use){
+   return ESP_OK;
+}
+
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args){
+   if(gpio_num>=GPIO_NUM_MAX){
+      return ESP_ERR_INVALID_ARG;
+   }
+   pin_handlers[gpio_num]=isr_handler;
+   pin_args[gpio_num]=args;
+   return ESP_OK;
+}
+
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num){
+   if(gpio_num>=GPIO_NUM_MAX){
+      return ESP_ERR_INVALID_ARG;
+   }
+   pin_handlers[gpio_num]=NULL;
+   return ESP_OK;
+}
+
+
+// Only used when the firmware is built with DHT_EDGE_CAPTURE 0
+esp_err_t dht_read_float_data(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        float *humidity, float *temperature){
+   sim_environment(temperature, humidity);
+   host_counters.dht_reads++;
+   sim_counters.dht_frames++;
+   return ESP_OK;
+}
+
+
+esp_err_t dht_read_data(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        int16_t *humidity, int16_t *temperature){
+   float float_humidity, float_temperature;
+   dht_read_float_data(sensor_type, pin, &float_humidity, &float_temperature);
+   *humidity=(int16_t)(float_humidity*10);
+   *temperature=(int16_t)(float_temperature*10);
+   return ESP_OK;
+}
+
+
+/******************* RESET AND SLEEP ***************************************/
+esp_reset_reason_t esp_reset_reason(void){
+   return reset_reason;
+}
+
+
+void esp_restart(void){
+   sim_reboot(0, ESP_RST_SW);
+}
+
+
+bool esp_deep_sleep_set_rf_option(uint8_t option){
+   return true;
+}
+
+
+void esp_deep_sleep(uint64_t time_in_us){
+   sim_mark_sleep();
+   sim_reboot(time_in_us, ESP_RST_DEEPSLEEP);
+}
+
+
+/******************* NVS ***************************************************/
+esp_err_t nvs_flash_init(void){
+   return ESP_OK;
+}
+
+
+/*
+ * nvs_find: Entry of a key
+ *    Returns:
+ *       - entry: sim_nvs_entry*. NULL if the key isn't set
+ */
+static sim_nvs_entry* nvs_find(nvs_handle handle, const char *key){
+   for(uint8_t i=0; i<SIM_NVS_MAX_ENTRIES; i++){
+      if(nvs_entries[i].used && nvs_entries[i].space==handle
+            && strncmp(nvs_entries[i].key, key, SIM_NVS_MAX_NAME)==0){
+         return &nvs_entries[i];
+      }
+   }
+   return NULL;
+}
+
+
+// Handles are the index of the namespace plus one
+esp_err_t nvs_open(const char *name, nvs_open_mode open_mode, nvs_handle *out_handle){
+   for(uint8_t i=0; i<SIM_NVS_MAX_NAMESPACES; i++){
+      if(strncmp(nvs_namespaces[i], name, SIM_NVS_MAX_NAME)==0){
+         *out_handle=i+1;
+         return ESP_OK;
+      }
+   }
+   // Read only opens of a namespace never written fail, as in the sdk
+   if(open_mode==NVS_READONLY){
+      return ESP_ERR_NVS_NOT_FOUND;
+   }
+   for(uint8_t i=0; i<SIM_NVS_MAX_NAMESPACES; i++){
+      if(nvs_namespaces[i][0]=='\0'){
+         strncpy(nvs_namespaces[i], name, SIM_NVS_MAX_NAME-1);
+         *out_handle=i+1;
+         return ESP_OK;
+      }
+   }
+   return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+}
+
+
+esp_err_t nvs_set_blob(nvs_handle handle, const char *key, const void *value, size_t length){
+   if(handle==0 || handle>SIM_NVS_MAX_NAMESPACES){
+      return ESP_ERR_NVS_INVALID_HANDLE;
+   }
+   if(length>SIM_NVS_MAX_BLOB){
+      return ESP_ERR_NVS_INVALID_LENGTH;
+   }
+   sim_nvs_entry *entry = nvs_find(handle, key);
+   for(uint8_t i=0; i<SIM_NVS_MAX_ENTRIES && entry==NULL; i++){
+      if(!nvs_entries[i].used){
+         entry=&nvs_entries[i];
+      }
+   }
+   if(entry==NULL){
+      return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+   }
+   entry->used=1;
+   entry->space=handle;
+   strncpy(entry->key, key, SIM_NVS_MAX_NAME-1);
+   entry->length=length;
+   memcpy(entry->data, value, length);
+   return ESP_OK;
+}
+
+
+esp_err_t nvs_get_blob(nvs_handle handle, const char *key, void *out_value, size_t *length){
+   sim_nvs_entry *entry = nvs_find(handle, key);
+   if(entry==NULL){
+      return ESP_ERR_NVS_NOT_FOUND;
+   }
+   if(out_value==NULL){
+      *length=entry->length;
+      return ESP_OK;
+   }
+   if(*length<entry->length){
+      *length=entry->length;
+      return ESP_ERR_NVS_INVALID_LENGTH;
+   }
+   memcpy(out_value, entry->data, entry->length);
+   *length=entry->length;
+   return ESP_OK;
+}
+
+
+esp_err_t nvs_erase_key(nvs_handle handle, const char *key){
+   sim_nvs_entry *entry = nvs_find(handle, key);
+   if(entry==NULL){
+      return ESP_ERR_NVS_NOT_FOUND;
+   }
+   entry->used=0;
+   return ESP_OK;
+}
+
+
+esp_err_t nvs_commit(nvs_handle handle){
+   return ESP_OK;
+}
+
+
+void nvs_close(nvs_handle handle){
+}
+
+
+void sim_nvs_save(FILE *file){
+   fwrite(nvs_namespaces, sizeof nvs_namespaces, 1, file);
+   fwrite(nvs_entries, sizeof nvs_entries, 1, file);
+}
+
+
+int sim_nvs_load(FILE *file){
+   if(fread(nvs_namespaces, sizeof nvs_namespaces, 1, file)!=1
+         || fread(nvs_entries, sizeof nvs_entries, 1, file)!=1){
+      return -1;
+   }
+   return 0;
+}
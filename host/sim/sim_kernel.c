@@ -0,0 +1,896 @@
+/*
+ * sim_kernel.c
+ * @description: Implementation of the FreeRTOS stand-in of the simulation.
+ *    Each task is a thread, but only the one holding the kernel lock runs.
+ *    A task gives the cpu away when it blocks, or when it wakes a task of
+ *    higher priority. Once every task is blocked the clock jumps to the next
+ *    event, and events run in interrupt context
+ * @author: @Retrocamara42
+ *
+ */
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sdkconfig.h"
+#include "sim.h"
+#include "host_stubs.h"
+#include "esp_task_wdt.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+
+// Stack of each task thread, the host needs more than the device
+#define SIM_TASK_STACK (256*1024)
+// Functions posted to a worker and not run yet
+#define SIM_WORKER_QUEUE 32
+// Priority of the FreeRTOS timer task, which runs esp_timer callbacks
+#define SIM_TIMER_TASK_PRIORITY 2
+
+typedef enum {
+   TASK_READY = 0,
+   TASK_BLOCKED,
+   TASK_DELETED,
+} task_state;
+
+/*
+ * host_task: Task of the simulation
+ *    - thread: pthread_t. Thread running the task
+ *    - wake: pthread_cond_t. Signaled when the task gets the cpu
+ *    - function: TaskFunction_t. Function of the task
+ *    - parameters: void*. Argument of function
+ *    - name: char[]. Name
+ *    - priority: UBaseType_t. Priority, higher runs first
+ *    - stack_depth: uint32_t. Stack given by xTaskCreate, in bytes
+ *    - state: task_state. Ready, blocked or deleted
+ *    - order: uint64_t. When it got ready or blocked, first in first out
+ *       among tasks of the same priority
+ *    - wake_us: int64_t. Timeout of a blocked task, -1 if none
+ *    - timed_out: uint8_t. 1 if the last block ended by timeout
+ *    - waiting_on: void*. Semaphore or event group it is blocked on
+ *    - wait_bits: EventBits_t. Bits waited for in an event group
+ *    - wait_all: uint8_t. Wait for all the bits
+ *    - wait_clear: uint8_t. Clear the bits once they are set
+ *    - result_bits: EventBits_t. Bits of the group when it was woken
+ *    - notify_value: uint32_t. Notification value
+ *    - notified: uint8_t. 1 if a notification is pending
+ *    - dispatches: uint32_t. Times it got the cpu
+ */
+typedef struct host_task {
+   pthread_t thread;
+   pthread_cond_t wake;
+   TaskFunction_t function;
+   void *parameters;
+   char name[16];
+   UBaseType_t priority;
+   uint32_t stack_depth;
+   task_state state;
+   uint64_t order;
+   int64_t wake_us;
+   uint8_t timed_out;
+   void *waiting_on;
+   EventBits_t wait_bits;
+   uint8_t wait_all;
+   uint8_t wait_clear;
+   EventBits_t result_bits;
+   uint32_t notify_value;
+   uint8_t notified;
+   uint32_t dispatches;
+} host_task;
+
+struct host_semaphore {
+   uint8_t count;
+};
+
+struct host_event_group {
+   EventBits_t bits;
+};
+
+/*
+ * esp_timer: Timer. Expiries of an earlier start or of a stopped timer are
+ *    dropped by their generation
+ */
+struct esp_timer {
+   esp_timer_create_args_t args;
+   uint32_t generation;
+   uint8_t armed;
+};
+
+/*
+ * timer_expiry: Expiry posted to the timer task
+ */
+typedef struct {
+   esp_timer_handle_t timer;
+   uint32_t generation;
+} timer_expiry;
+
+/*
+ * sim_event: Function run in interrupt context at a time
+ *    - id: uint32_t. Id, 0 if the slot is free
+ *    - at_us: int64_t. Time it runs at
+ *    - order: uint64_t. Events of the same time run in order
+ */
+typedef struct {
+   uint32_t id;
+   int64_t at_us;
+   uint64_t order;
+   sim_callback callback;
+   void *arg;
+} sim_event;
+
+/*
+ * sim_work: Function posted to a worker
+ */
+typedef struct {
+   sim_callback callback;
+   void *data;
+} sim_work;
+
+struct sim_worker {
+   SemaphoreHandle_t ready;
+   sim_work queue[SIM_WORKER_QUEUE];
+   uint8_t head;
+   uint8_t count;
+};
+
+/*
+ * worker_delivery: Event that hands a posted function to its worker
+ */
+typedef struct {
+   sim_worker *worker;
+   sim_work work;
+} worker_delivery;
+
+static pthread_mutex_t kernel_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t finished_cond = PTHREAD_COND_INITIALIZER;
+static host_task tasks[SIM_MAX_TASKS];
+static uint8_t task_count=0;
+static host_task *current=NULL;
+static sim_event events[SIM_MAX_EVENTS];
+static uint32_t next_event_id=1;
+static uint64_t next_order=1;
+static uint8_t in_interrupt=0;
+static int64_t now_us=0;
+static int64_t boot_us=0;
+static int64_t end_us=0;
+static int64_t last_feed_us=-1;
+// Host cpu time of the running task already charged to the clock
+static int64_t charged_cpu_ns=0;
+static const char* finish_reason=NULL;
+static sim_worker *timer_task=NULL;
+
+
+/******************* CLOCK *************************************************/
+static int64_t thread_cpu_ns(void){
+   struct timespec now;
+   clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+   return (int64_t)now.tv_sec*1000000000+now.tv_nsec;
+}
+
+
+void sim_kernel_init(int64_t boot, int64_t end){
+   boot_us=boot;
+   now_us=boot;
+   end_us=end;
+   last_feed_us=boot;
+   charged_cpu_ns=thread_cpu_ns();
+}
+
+
+static void charge_cpu(void);
+
+
+int64_t sim_now(void){
+   charge_cpu();
+   return now_us;
+}
+
+
+int64_t esp_timer_get_time(void){
+   return sim_now()-boot_us;
+}
+
+
+TickType_t xTaskGetTickCount(void){
+   return (TickType_t)(esp_timer_get_time()/1000/portTICK_PERIOD_MS);
+}
+
+
+/******************* EVENTS ************************************************/
+uint32_t sim_schedule(int64_t delay_us, sim_callback callback, void *arg){
+   // Before taking a slot, sim_now can run interrupts
+   int64_t at_us = sim_now()+(delay_us>0 ? delay_us : 0);
+   for(uint16_t i=0; i<SIM_MAX_EVENTS; i++){
+      if(events[i].id==0){
+         events[i].id=next_event_id++;
+         events[i].at_us=at_us;
+         events[i].order=next_order++;
+         events[i].callback=callback;
+         events[i].arg=arg;
+         return events[i].id;
+      }
+   }
+   fprintf(stderr, "sim: no room for more events\n");
+   return 0;
+}
+
+
+void sim_cancel(uint32_t id){
+   for(uint16_t i=0; i<SIM_MAX_EVENTS && id!=0; i++){
+      if(events[i].id==id){
+         events[i].id=0;
+      }
+   }
+}
+
+
+/*
+ * next_event: Earliest event due by a time
+ *    Returns:
+ *       - event: sim_event*. NULL if none is due
+ */
+static sim_event* next_event(int64_t by_us){
+   sim_event *next=NULL;
+   for(uint16_t i=0; i<SIM_MAX_EVENTS; i++){
+      sim_event *event = &events[i];
+      if(event->id!=0 && event->at_us<=by_us && (next==NULL || event->at_us<next->at_us
+            || (event->at_us==next->at_us && event->order<next->order))){
+         next=event;
+      }
+   }
+   return next;
+}
+
+
+/*
+ * make_ready: Unblock a task. Without preemption, the running task keeps
+ *    the cpu
+ */
+static void make_ready(host_task *task){
+   task->state=TASK_READY;
+   task->order=next_order++;
+   task->wake_us=-1;
+   task->waiting_on=NULL;
+}
+
+
+/*
+ * run_interrupts: Run the events due by a time, each one at its own time
+ */
+static void run_interrupts(int64_t by_us){
+   sim_event *event;
+   while((event=next_event(by_us))!=NULL){
+      sim_callback callback = event->callback;
+      void *arg = event->arg;
+      if(event->at_us>now_us){
+         now_us=event->at_us;
+      }
+      event->id=0;
+      sim_counters.interrupts++;
+      in_interrupt=1;
+      callback(arg);
+      in_interrupt=0;
+   }
+}
+
+
+/*
+ * charge_cpu: Move the clock by the host cpu used by the running task
+ *    since the last charge, see sim_config.cpu_scale. Interrupts due
+ *    meanwhile preempt the task. Calls from outside the tasks, like the
+ *    report at the end of the run, charge nothing
+ */
+static void charge_cpu(void){
+   if(in_interrupt || current==NULL || !pthread_equal(pthread_self(), current->thread)){
+      return;
+   }
+   int64_t cpu_ns = thread_cpu_ns();
+   int64_t used_ns = cpu_ns-charged_cpu_ns;
+   charged_cpu_ns = cpu_ns;
+   sim_counters.task_cpu_ns+=used_ns;
+   if(sim_cfg.cpu_scale<=0){
+      return;
+   }
+   int64_t charged_us = now_us+(int64_t)(used_ns*sim_cfg.cpu_scale/1000);
+   run_interrupts(charged_us);
+   if(charged_us>now_us){
+      now_us=charged_us;
+   }
+}
+
+
+/*
+ * advance: Move the clock to the next event or timeout and run everything
+ *    due then. Called when no task is ready
+ *    Returns:
+ *       - 0 if the run is over, see finish_reason
+ */
+static uint8_t advance(void){
+   int64_t next_us=INT64_MAX;
+   for(uint16_t i=0; i<SIM_MAX_EVENTS; i++){
+      if(events[i].id!=0 && events[i].at_us<next_us){
+         next_us=events[i].at_us;
+      }
+   }
+   for(uint8_t i=0; i<task_count; i++){
+      if(tasks[i].state==TASK_BLOCKED && tasks[i].wake_us>=0 && tasks[i].wake_us<next_us){
+         next_us=tasks[i].wake_us;
+      }
+   }
+   if(next_us==INT64_MAX){
+      finish_reason="every task is blocked forever";
+      return 0;
+   }
+   if(next_us>=end_us){
+      now_us=end_us;
+      finish_reason="end of the run";
+      return 0;
+   }
+   if(next_us>now_us){
+#ifndef CONFIG_ENABLE_FREERTOS_SLEEP
+      // Ticks before the wake, one on the wake itself isn't another wakeup.
+      // Tickless idle sleeps through them
+      int64_t tick_us = portTICK_PERIOD_MS*1000;
+      uint32_t ticks = (next_us-1-boot_us)/tick_us-(now_us-boot_us)/tick_us;
+      sim_counters.tick_wakeups+=ticks;
+      sim_counters.cpu_wakeups+=ticks;
+#endif
+      sim_counters.cpu_wakeups++;
+      now_us=next_us;
+   }
+   // The idle hook of the sdk feeds the watchdog while every task is blocked
+   last_feed_us=now_us;
+   // Interrupts first, they can wake tasks whose timeout is also due
+   run_interrupts(now_us);
+   for(uint8_t i=0; i<task_count; i++){
+      host_task *task = &tasks[i];
+      if(task->state==TASK_BLOCKED && task->wake_us>=0 && task->wake_us<=now_us){
+         make_ready(task);
+         task->timed_out=1;
+      }
+   }
+   return 1;
+}
+
+
+/******************* SCHEDULER *********************************************/
+/*
+ * highest_ready: Ready task of highest priority, the one waiting longest
+ *    among equals
+ */
+static host_task* highest_ready(void){
+   host_task *best=NULL;
+   for(uint8_t i=0; i<task_count; i++){
+      host_task *task = &tasks[i];
+      if(task->state==TASK_READY && (best==NULL || task->priority>best->priority
+            || (task->priority==best->priority && task->order<best->order))){
+         best=task;
+      }
+   }
+   return best;
+}
+
+
+/*
+ * finish: End the run. The calling thread never runs again, the main
+ *    thread prints the results and exits
+ */
+static void finish(void){
+   pthread_cond_signal(&finished_cond);
+   while(1){
+      pthread_cond_wait(&current->wake, &kernel_lock);
+   }
+}
+
+
+/*
+ * reschedule: Give the cpu to the ready task of highest priority, running
+ *    interrupts until there is one. Returns once the calling task runs again
+ */
+static void reschedule(void){
+   host_task *self = current;
+   uint8_t blocked = self->state!=TASK_READY;
+   charge_cpu();
+   host_task *next;
+   while((next=highest_ready())==NULL){
+      if(!advance()){
+         finish();
+      }
+   }
+   if(next==self && blocked){
+      // The idle task ran while it was blocked
+      self->dispatches++;
+      sim_counters.context_switches++;
+   }
+   else if(next!=self){
+      current=next;
+      next->dispatches++;
+      sim_counters.context_switches++;
+      pthread_cond_signal(&next->wake);
+      if(self->state==TASK_DELETED){
+         return;
+      }
+      while(current!=self){
+         pthread_cond_wait(&self->wake, &kernel_lock);
+      }
+   }
+   charged_cpu_ns=thread_cpu_ns();
+}
+
+
+/*
+ * wake_task: Make a blocked task ready, and give it the cpu if it has a
+ *    higher priority than the running task. Interrupts never switch tasks
+ */
+static void wake_task(host_task *task){
+   make_ready(task);
+   if(!in_interrupt && task->priority>current->priority){
+      reschedule();
+   }
+}
+
+
+/*
+ * block: Block the running task until it is woken or the ticks pass
+ *    Returns:
+ *       - timed_out: uint8_t. 1 if the ticks passed
+ */
+static uint8_t block(void *waiting_on, TickType_t ticks){
+   host_task *self = current;
+   self->state=TASK_BLOCKED;
+   self->order=next_order++;
+   self->waiting_on=waiting_on;
+   self->timed_out=0;
+   self->wake_us = ticks==portMAX_DELAY ? -1
+      : sim_now()+(int64_t)ticks*portTICK_PERIOD_MS*1000;
+   reschedule();
+   return self->timed_out;
+}
+
+
+/*
+ * first_waiting: Blocked task of highest priority waiting on an object
+ */
+static host_task* first_waiting(void *object){
+   host_task *best=NULL;
+   for(uint8_t i=0; i<task_count; i++){
+      host_task *task = &tasks[i];
+      if(task->state==TASK_BLOCKED && task->waiting_on==object && (best==NULL
+            || task->priority>best->priority
+            || (task->priority==best->priority && task->order<best->order))){
+         best=task;
+      }
+   }
+   return best;
+}
+
+
+static void* task_entry(void *arg){
+   host_task *task = arg;
+   pthread_mutex_lock(&kernel_lock);
+   while(current!=task){
+      pthread_cond_wait(&task->wake, &kernel_lock);
+   }
+   charged_cpu_ns=thread_cpu_ns();
+   task->function(task->parameters);
+   // Tasks that return are deleted, as the sdk does with app_main
+   vTaskDelete(NULL);
+   return NULL;
+}
+
+
+const char* sim_kernel_run(void){
+   pthread_mutex_lock(&kernel_lock);
+   host_task *next;
+   while((next=highest_ready())==NULL && advance());
+   if(next!=NULL){
+      current=next;
+      next->dispatches++;
+      pthread_cond_signal(&next->wake);
+      while(finish_reason==NULL){
+         pthread_cond_wait(&finished_cond, &kernel_lock);
+      }
+   }
+   return finish_reason;
+}
+
+
+void sim_print_tasks(void){
+   printf("%-16s %8s %12s\n", "task", "priority", "dispatches");
+   for(uint8_t i=0; i<task_count; i++){
+      printf("%-16s %8u %12u%s\n", tasks[i].name, tasks[i].priority, tasks[i].dispatches,
+         tasks[i].state==TASK_DELETED ? " (deleted)" : "");
+   }
+}
+
+
+/******************* TASKS *************************************************/
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth,
+        void *parameters, UBaseType_t priority, TaskHandle_t *created_task){
+   if(task_count>=SIM_MAX_TASKS){
+      return pdFAIL;
+   }
+   host_task *task = &tasks[task_count++];
+   memset(task, 0, sizeof *task);
+   pthread_cond_init(&task->wake, NULL);
+   task->function=function;
+   task->parameters=parameters;
+   strncpy(task->name, name, sizeof task->name-1);
+   task->priority=priority;
+   task->stack_depth=stack_depth;
+   make_ready(task);
+   pthread_attr_t attr;
+   pthread_attr_init(&attr);
+   pthread_attr_setstacksize(&attr, SIM_TASK_STACK);
+   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+   if(pthread_create(&task->thread, &attr, task_entry, task)!=0){
+      task->state=TASK_DELETED;
+      return pdFAIL;
+   }
+   pthread_attr_destroy(&attr);
+   if(created_task!=NULL){
+      *created_task=task;
+   }
+   // Tasks are created before the scheduler starts, or by a running task
+   if(current!=NULL && priority>current->priority){
+      reschedule();
+   }
+   return pdPASS;
+}
+
+
+void vTaskDelete(TaskHandle_t handle){
+   host_task *task = handle!=NULL ? handle : current;
+   task->state=TASK_DELETED;
+   if(task==current){
+      reschedule();
+      pthread_mutex_unlock(&kernel_lock);
+      pthread_exit(NULL);
+   }
+}
+
+
+void vTaskDelay(TickType_t ticks){
+   host_counters.delay_us += (uint64_t)ticks*portTICK_PERIOD_MS*1000;
+   if(ticks==0){
+      // Yield to tasks of the same priority
+      current->order=next_order++;
+      reschedule();
+      return;
+   }
+   block(NULL, ticks);
+}
+
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void){
+   return current;
+}
+
+
+// Stack use isn't measured, all of it is reported as free
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t handle){
+   host_task *task = handle!=NULL ? handle : current;
+   return task->stack_depth;
+}
+
+
+/******************* NOTIFICATIONS *****************************************/
+/*
+ * notify: Update the notification value of a task, and wake it if it waits
+ *    for one
+ */
+static BaseType_t notify(host_task *task, uint32_t value, eNotifyAction action){
+   switch(action){
+      case eSetBits: task->notify_value|=value; break;
+      case eIncrement: task->notify_value++; break;
+      case eSetValueWithoutOverwrite:
+         if(task->notified){
+            return pdFAIL;
+         }
+         task->notify_value=value;
+         break;
+      case eSetValueWithOverwrite: task->notify_value=value; break;
+      default: break;
+   }
+   task->notified=1;
+   if(task->state==TASK_BLOCKED && task->waiting_on==&task->notify_value){
+      wake_task(task);
+   }
+   return pdPASS;
+}
+
+
+BaseType_t xTaskNotify(TaskHandle_t handle, uint32_t value, eNotifyAction action){
+   return notify(handle, value, action);
+}
+
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t handle, uint32_t value, eNotifyAction action,
+        BaseType_t *higher_priority_task_woken){
+   host_task *task = handle;
+   uint8_t was_waiting = task->state==TASK_BLOCKED && task->waiting_on==&task->notify_value;
+   BaseType_t result = notify(task, value, action);
+   if(higher_priority_task_woken!=NULL){
+      *higher_priority_task_woken = was_waiting && task->priority>current->priority;
+   }
+   return result;
+}
+
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit,
+        uint32_t *value, TickType_t ticks){
+   host_task *self = current;
+   if(!self->notified){
+      self->notify_value&=~clear_on_entry;
+      if(ticks>0){
+         block(&self->notify_value, ticks);
+      }
+   }
+   if(!self->notified){
+      return pdFALSE;
+   }
+   if(value!=NULL){
+      *value=self->notify_value;
+   }
+   self->notify_value&=~clear_on_exit;
+   self->notified=0;
+   return pdTRUE;
+}
+
+
+/******************* SEMAPHORES ********************************************/
+SemaphoreHandle_t xSemaphoreCreateBinary(void){
+   return calloc(1, sizeof(struct host_semaphore));
+}
+
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore){
+   host_task *waiting = first_waiting(semaphore);
+   if(waiting!=NULL){
+      // Handed over to the waiting task, the count stays at 0
+      wake_task(waiting);
+      return pdTRUE;
+   }
+   if(semaphore->count>0){
+      return pdFALSE;
+   }
+   semaphore->count=1;
+   return pdTRUE;
+}
+
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *higher_priority_task_woken){
+   host_task *waiting = first_waiting(semaphore);
+   if(waiting!=NULL && higher_priority_task_woken!=NULL && current!=NULL
+         && waiting->priority>current->priority){
+      *higher_priority_task_woken=pdTRUE;
+   }
+   return xSemaphoreGive(semaphore);
+}
+
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks){
+   sim_counters.semaphore_takes++;
+   if(semaphore->count>0){
+      semaphore->count=0;
+      return pdTRUE;
+   }
+   if(ticks==0 || block(semaphore, ticks)){
+      sim_counters.semaphore_timeouts++;
+      return pdFALSE;
+   }
+   return pdTRUE;
+}
+
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore){
+   free(semaphore);
+}
+
+
+/******************* EVENT GROUPS ******************************************/
+EventGroupHandle_t xEventGroupCreate(void){
+   return calloc(1, sizeof(struct host_event_group));
+}
+
+
+static uint8_t bits_satisfied(EventBits_t bits, EventBits_t wanted, uint8_t all){
+   return all ? (bits&wanted)==wanted : (bits&wanted)!=0;
+}
+
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits){
+   group->bits|=bits;
+   EventBits_t set_bits = group->bits;
+   EventBits_t clear=0;
+   host_task *woken[SIM_MAX_TASKS];
+   uint8_t woken_count=0;
+   for(uint8_t i=0; i<task_count; i++){
+      host_task *task = &tasks[i];
+      if(task->state==TASK_BLOCKED && task->waiting_on==group
+            && bits_satisfied(set_bits, task->wait_bits, task->wait_all)){
+         task->result_bits=set_bits;
+         if(task->wait_clear){
+            clear|=task->wait_bits;
+         }
+         woken[woken_count++]=task;
+      }
+   }
+   group->bits&=~clear;
+   for(uint8_t i=0; i<woken_count; i++){
+      wake_task(woken[i]);
+   }
+   return set_bits;
+}
+
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits,
+        BaseType_t clear_on_exit, BaseType_t wait_for_all, TickType_t ticks){
+   EventBits_t current_bits = group->bits;
+   if(bits_satisfied(current_bits, bits, wait_for_all)){
+      if(clear_on_exit){
+         group->bits&=~bits;
+      }
+      return current_bits;
+   }
+   if(ticks==0){
+      return current_bits;
+   }
+   current->wait_bits=bits;
+   current->wait_all=wait_for_all;
+   current->wait_clear=clear_on_exit;
+   if(block(group, ticks)){
+      return group->bits;
+   }
+   return current->result_bits;
+}
+
+
+void vEventGroupDelete(EventGroupHandle_t group){
+   free(group);
+}
+
+
+/******************* ESP TIMER *********************************************/
+/*
+ * expire_timer: Run the callback of a timer in the timer task
+ */
+static void expire_timer(void *arg){
+   timer_expiry *expiry = arg;
+   esp_timer_handle_t timer = expiry->timer;
+   if(!timer->armed || timer->generation!=expiry->generation){
+      return;
+   }
+   timer->armed=0;
+   timer->args.callback(timer->args.arg);
+}
+
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle){
+   esp_timer_handle_t timer = calloc(1, sizeof *timer);
+   if(timer==NULL){
+      return ESP_ERR_NO_MEM;
+   }
+   if(timer_task==NULL){
+      timer_task=sim_worker_create("Tmr Svc", SIM_TIMER_TASK_PRIORITY);
+   }
+   timer->args=*create_args;
+   *out_handle=timer;
+   return ESP_OK;
+}
+
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us){
+   if(timer->armed){
+      return ESP_ERR_INVALID_STATE;
+   }
+   timer->armed=1;
+   timer_expiry expiry = {
+      .timer = timer,
+      .generation = ++timer->generation,
+   };
+   sim_worker_post(timer_task, (int64_t)timeout_us, expire_timer, &expiry, sizeof expiry);
+   return ESP_OK;
+}
+
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer){
+   if(!timer->armed){
+      return ESP_ERR_INVALID_STATE;
+   }
+   timer->armed=0;
+   timer->generation++;
+   return ESP_OK;
+}
+
+
+// Timers are kept, an expiry posted to the timer task can still refer to it
+esp_err_t esp_timer_delete(esp_timer_handle_t timer){
+   timer->armed=0;
+   timer->generation++;
+   return ESP_OK;
+}
+
+
+/******************* WATCHDOG **********************************************/
+esp_err_t esp_task_wdt_init(void){
+   last_feed_us=sim_now();
+   return ESP_OK;
+}
+
+
+void esp_task_wdt_reset(void){
+   int64_t now = sim_now();
+   uint32_t gap_ms = (uint32_t)((now-last_feed_us)/1000);
+   if(gap_ms>sim_counters.max_wdt_gap_ms){
+      sim_counters.max_wdt_gap_ms=gap_ms;
+   }
+   if(gap_ms>SIM_WDT_TIMEOUT_S*1000){
+      sim_counters.wdt_timeouts++;
+   }
+   last_feed_us=now;
+   sim_counters.wdt_feeds++;
+   host_counters.wdt_resets++;
+}
+
+
+/******************* WORKERS ***********************************************/
+static void worker_task(void *arg){
+   sim_worker *worker = arg;
+   while(1){
+      xSemaphoreTake(worker->ready, portMAX_DELAY);
+      while(worker->count>0){
+         sim_work work = worker->queue[worker->head];
+         worker->head=(worker->head+1)%SIM_WORKER_QUEUE;
+         worker->count--;
+         work.callback(work.data);
+         free(work.data);
+      }
+   }
+}
+
+
+sim_worker* sim_worker_create(const char* name, uint32_t priority){
+   sim_worker *worker = calloc(1, sizeof *worker);
+   worker->ready = xSemaphoreCreateBinary();
+   xTaskCreate(worker_task, name, 4096, worker, priority, NULL);
+   return worker;
+}
+
+
+/*
+ * deliver_work: Queue a posted function in its worker, in interrupt context
+ */
+static void deliver_work(void *arg){
+   worker_delivery *delivery = arg;
+   sim_worker *worker = delivery->worker;
+   if(worker->count<SIM_WORKER_QUEUE){
+      worker->queue[(worker->head+worker->count)%SIM_WORKER_QUEUE]=delivery->work;
+      worker->count++;
+      xSemaphoreGiveFromISR(worker->ready, NULL);
+   }
+   else{
+      fprintf(stderr, "sim: worker queue full\n");
+      free(delivery->work.data);
+   }
+   free(delivery);
+}
+
+
+void sim_worker_post(sim_worker *worker, int64_t delay_us, sim_callback callback,
+        const void *data, size_t size){
+   worker_delivery *delivery = malloc(sizeof *delivery);
+   delivery->worker=worker;
+   delivery->work.callback=callback;
+   delivery->work.data=malloc(size>0 ? size : 1);
+   memcpy(delivery->work.data, data, size);
+   if(sim_schedule(delay_us, deliver_work, delivery)==0){
+      free(delivery->work.data);
+      free(delivery);
+   }
+}
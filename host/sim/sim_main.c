@@ -0,0 +1,380 @@
+/*
+ * sim_main.c
+ * @description: Full-system simulation of the firmware. Runs the real
+ *    app_main, transmit loop, wifi and mqtt code on a virtual clock for a
+ *    number of simulated hours, then reports wake to publish latency, time
+ *    awake, context switches, interrupts, cpu wakeups with the freertos
+ *    tick, cpu time and log lines per cycle, semaphore and watchdog
+ *    activity.
+ *    Deep sleep restarts the program, keeping rtc memory, nvs and the
+ *    outbox partition in a state file
+ *
+ *    sim [-t hours] [-k cpu_scale] [-w ms] [-W ms] [-D ms] [-T ms] [-A ms]
+ *        [-x seconds:message]... [-f state_file] [-v]
+ *
+ *    -t  Simulated hours, 24 by default
+ *    -k  Virtual time charged per second of host cpu used by the firmware.
+ *        0, the default, runs code in no time and gives the same results
+ *        on every run
+ *    -w  Wifi association with the cached access point, 80 ms
+ *    -W  Wifi scan and association, 1800 ms
+ *    -D  Dhcp lease, 600 ms
+ *    -T  Tls handshake and mqtt connect, 1500 ms
+ *    -A  Broker ack of QoS 1 publishes, 120 ms
+ *    -x  Publish a message on the subscribed topic at a simulated second,
+ *        e.g. -x '3600:{"cmd":"sample_now"}'
+ *    -f  State file, sim.state next to the program by default. The outbox
+ *        partition is kept next to it, with .flash added
+ *    -v  Print the log of the firmware
+ * @author: @Retrocamara42
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "host_stubs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Marks a state file of this program
+#define SIM_STATE_MAGIC 0x53494d31
+// Size of the outbox partition, see partitions.csv
+#define SIM_OUTBOX_SIZE 0x10000
+// Hidden option of the program started by a deep sleep
+#define SIM_RESUME_OPTION "-R"
+
+/*
+ * sim_state: Header of the state file
+ *    - magic: uint32_t. SIM_STATE_MAGIC
+ *    - rtc_size: uint32_t. Size of rtc memory, checks the file belongs to
+ *       this build
+ *    - boot_us: int64_t. Simulated time of the next boot
+ *    - wall_start_ns: int64_t. Host time the run started at
+ *    - reason: esp_reset_reason_t. Reset reason of the next boot
+ */
+typedef struct {
+   uint32_t magic;
+   uint32_t rtc_size;
+   int64_t boot_us;
+   int64_t wall_start_ns;
+   esp_reset_reason_t reason;
+} sim_state;
+
+void app_main(void);
+
+// Rtc memory of the firmware, see esp_attr.h
+extern uint8_t __start_host_rtc_data[];
+extern uint8_t __stop_host_rtc_data[];
+
+sim_config sim_cfg = {
+   .hours = 24,
+   .wifi_connect_ms = 80,
+   .wifi_scan_ms = 1800,
+   .dhcp_ms = 600,
+   .tls_ms = 1500,
+   .ack_ms = 120,
+};
+sim_stats sim_counters;
+
+static char **program_args;
+static int program_arg_count;
+static char state_path[256];
+static char flash_path[sizeof state_path+sizeof ".flash"];
+static sim_state state;
+static uint8_t awake=0;
+static int64_t wake_us=0;
+static uint8_t reported=0;
+static int report_msg_id=-1;
+
+
+static int64_t wall_ns(void){
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (int64_t)now.tv_sec*1000000000+now.tv_nsec;
+}
+
+
+static void usage(const char* program){
+   fprintf(stderr, "usage: %s [-t hours] [-k cpu_scale] [-w ms] [-W ms] [-D ms] [-T ms] [-A ms]\n"
+      "          [-x seconds:message]... [-f state_file] [-v]\n", program);
+   exit(2);
+}
+
+
+/*
+ * parse_options: Read the options of the run
+ *    Returns:
+ *       - resumed: uint8_t. 1 if started by a deep sleep
+ */
+static uint8_t parse_options(int argc, char **argv){
+   uint8_t resumed=0;
+   int option;
+   while((option=getopt(argc, argv, "t:k:w:W:D:T:A:x:f:vR"))!=-1){
+      switch(option){
+         case 't': sim_cfg.hours=atof(optarg); break;
+         case 'k': sim_cfg.cpu_scale=atof(optarg); break;
+         case 'w': sim_cfg.wifi_connect_ms=atoi(optarg); break;
+         case 'W': sim_cfg.wifi_scan_ms=atoi(optarg); break;
+         case 'D': sim_cfg.dhcp_ms=atoi(optarg); break;
+         case 'T': sim_cfg.tls_ms=atoi(optarg); break;
+         case 'A': sim_cfg.ack_ms=atoi(optarg); break;
+         case 'f': sim_cfg.state_path=optarg; break;
+         case 'v': sim_cfg.verbose=1; break;
+         case 'R': resumed=1; break;
+         case 'x': {
+            char *message = strchr(optarg, ':');
+            if(message==NULL || sim_cfg.command_count>=SIM_MAX_COMMANDS){
+               usage(argv[0]);
+            }
+            sim_command *command = &sim_cfg.commands[sim_cfg.command_count++];
+            command->at_s=strtoul(optarg, NULL, 10);
+            command->payload=message+1;
+            break;
+         }
+         default: usage(argv[0]);
+      }
+   }
+   if(sim_cfg.hours<=0){
+      usage(argv[0]);
+   }
+   return resumed;
+}
+
+
+/******************* STATE *************************************************/
+static uint32_t rtc_size(void){
+   return __stop_host_rtc_data-__start_host_rtc_data;
+}
+
+
+static void save_state(void){
+   FILE *file = fopen(sim_cfg.state_path, "wb");
+   if(file==NULL){
+      perror(sim_cfg.state_path);
+      exit(1);
+   }
+   fwrite(&state, sizeof state, 1, file);
+   fwrite(&sim_counters, sizeof sim_counters, 1, file);
+   fwrite(__start_host_rtc_data, rtc_size(), 1, file);
+   sim_nvs_save(file);
+   fclose(file);
+}
+
+
+static void load_state(void){
+   FILE *file = fopen(sim_cfg.state_path, "rb");
+   if(file==NULL || fread(&state, sizeof state, 1, file)!=1
+         || state.magic!=SIM_STATE_MAGIC || state.rtc_size!=rtc_size()
+         || fread(&sim_counters, sizeof sim_counters, 1, file)!=1
+         || fread(__start_host_rtc_data, rtc_size(), 1, file)!=1
+         || sim_nvs_load(file)!=0){
+      fprintf(stderr, "sim: invalid state file %s\n", sim_cfg.state_path);
+      exit(1);
+   }
+   fclose(file);
+}
+
+
+/******************* REPORT ************************************************/
+static int compare_samples(const void *a, const void *b){
+   uint32_t x = *(const uint32_t*)a;
+   uint32_t y = *(const uint32_t*)b;
+   return x<y ? -1 : x>y;
+}
+
+
+/*
+ * print_latency: Print percentiles of samples in ms
+ */
+static void print_latency(const char* name, const uint32_t *samples, uint32_t count){
+   if(count>SIM_MAX_SAMPLES){
+      count=SIM_MAX_SAMPLES;
+   }
+   if(count==0){
+      printf("%-22s %8s\n", name, "-");
+      return;
+   }
+   uint32_t *sorted = malloc(count*sizeof *sorted);
+   memcpy(sorted, samples, count*sizeof *sorted);
+   qsort(sorted, count, sizeof *sorted, compare_samples);
+   printf("%-22s %8u %8u %8u %8u %8u\n", name, count, sorted[count/2],
+      sorted[count*9/10], sorted[count*99/100], sorted[count-1]);
+   free(sorted);
+}
+
+
+static void print_report(const char* reason){
+   double simulated_s = sim_now()/1e6;
+   double wall_s = (wall_ns()-state.wall_start_ns)/1e9;
+   printf("\nsimulated %.2f h in %.2f s, %.0fx, stopped by %s\n",
+      simulated_s/3600, wall_s, wall_s>0 ? simulated_s/wall_s : 0, reason);
+   printf("boots %u, wakes %u, cycles %u, reports %u, %u acked\n",
+      sim_counters.boots, sim_counters.wakes, sim_counters.cycles,
+      sim_counters.reports, sim_counters.acked_reports);
+   printf("awake %.1f s, %.3f%% of the time\n\n", sim_counters.awake_us/1e6,
+      simulated_s>0 ? sim_counters.awake_us/1e4/simulated_s : 0);
+   printf("%-22s %8s %8s %8s %8s %8s\n", "latency, ms", "samples", "p50", "p90", "p99", "max");
+   print_latency("wake to publish", sim_counters.publish_ms, sim_counters.reports);
+   print_latency("wake to ack", sim_counters.ack_ms, sim_counters.acked_reports);
+   print_latency("awake per cycle", sim_counters.awake_ms, sim_counters.cycles);
+   printf("\ntasks of the last boot, %u context switches in the run\n",
+      sim_counters.context_switches);
+   sim_print_tasks();
+   printf("\ninterrupts %u: %u timer alarms, %u dht frames\n", sim_counters.interrupts,
+      sim_counters.timer_interrupts, sim_counters.dht_frames);
+   printf("cpu wakeups %u, %.1f per hour, %u freertos ticks\n", sim_counters.cpu_wakeups,
+      simulated_s>0 ? sim_counters.cpu_wakeups*3600.0/simulated_s : 0,
+      sim_counters.tick_wakeups);
+   uint32_t cycles = sim_counters.cycles>0 ? sim_counters.cycles : 1;
+   uint32_t log_lines = sim_counters.log_lines+host_counters.log_lines;
+   printf("task cpu %.1f ms, %.1f us per cycle\n", sim_counters.task_cpu_ns/1e6,
+      sim_counters.task_cpu_ns/1e3/cycles);
+   printf("log lines %u, %.1f per cycle\n", log_lines, (double)log_lines/cycles);
+   printf("semaphore takes %u, %u timed out\n", sim_counters.semaphore_takes,
+      sim_counters.semaphore_timeouts);
+   printf("watchdog feeds %u, longest gap %u ms, %u gaps over %d s\n", sim_counters.wdt_feeds,
+      sim_counters.max_wdt_gap_ms, sim_counters.wdt_timeouts, SIM_WDT_TIMEOUT_S);
+   printf("wifi connections %u, %u with scan\n", sim_counters.wifi_connects,
+      sim_counters.wifi_scans);
+   printf("mqtt connections %u, publishes %u, %u failed, %u acks, %u failed subscribes\n",
+      sim_counters.mqtt_connects, sim_counters.publishes, sim_counters.publish_failures,
+      sim_counters.acks, sim_counters.subscribe_failures);
+   printf("commands %u delivered, %u lost\n", sim_counters.commands_sent,
+      sim_counters.commands_lost);
+   fflush(stdout);
+}
+
+
+/******************* RUN ***************************************************/
+void sim_mark_wake(void){
+   if(awake){
+      return;
+   }
+   awake=1;
+   wake_us=sim_now();
+   reported=0;
+   report_msg_id=-1;
+   sim_counters.wakes++;
+}
+
+
+void sim_mark_sleep(void){
+   if(!awake){
+      return;
+   }
+   awake=0;
+   int64_t awake_time = sim_now()-wake_us;
+   sim_counters.awake_us+=awake_time;
+   if(sim_counters.cycles<SIM_MAX_SAMPLES){
+      sim_counters.awake_ms[sim_counters.cycles]=awake_time/1000;
+   }
+   sim_counters.cycles++;
+}
+
+
+void sim_mark_publish(int qos, int msg_id){
+   if(!awake || reported || qos==0){
+      return;
+   }
+   reported=1;
+   report_msg_id=msg_id;
+   if(sim_counters.reports<SIM_MAX_SAMPLES){
+      sim_counters.publish_ms[sim_counters.reports]=(sim_now()-wake_us)/1000;
+   }
+   sim_counters.reports++;
+}
+
+
+void sim_mark_ack(int msg_id){
+   if(!awake || msg_id!=report_msg_id){
+      return;
+   }
+   report_msg_id=-1;
+   if(sim_counters.acked_reports<SIM_MAX_SAMPLES){
+      sim_counters.ack_ms[sim_counters.acked_reports]=(sim_now()-wake_us)/1000;
+   }
+   sim_counters.acked_reports++;
+}
+
+
+void sim_reboot(uint64_t sleep_us, esp_reset_reason_t reason){
+   state.boot_us=sim_now()+sleep_us;
+   state.reason=reason;
+   int64_t end_us = sim_cfg.hours*3600e6;
+   if(state.boot_us>=end_us){
+      print_report("end of the run");
+      exit(0);
+   }
+   sim_counters.log_lines+=host_counters.log_lines;
+   save_state();
+   fflush(stdout);
+   fflush(stderr);
+   // A new program starts with the memory of a new boot, but rtc memory
+   char **args = calloc(program_arg_count+2, sizeof *args);
+   memcpy(args, program_args, program_arg_count*sizeof *args);
+   uint8_t resumed = program_arg_count>1
+      && strcmp(program_args[program_arg_count-1], SIM_RESUME_OPTION)==0;
+   if(!resumed){
+      args[program_arg_count]=SIM_RESUME_OPTION;
+   }
+   execv("/proc/self/exe", args);
+   perror("sim: execv");
+   exit(1);
+}
+
+
+/*
+ * main_task: Main task of the sdk, runs app_main once the boot ends
+ */
+static void main_task(void *arg){
+   vTaskDelay(SIM_BOOT_US/1000/portTICK_PERIOD_MS);
+   app_main();
+}
+
+
+int main(int argc, char **argv){
+   program_args=argv;
+   program_arg_count=argc;
+   uint8_t resumed = parse_options(argc, argv);
+   if(sim_cfg.verbose){
+      setenv("HOST_LOG_VERBOSE", "1", 1);
+   }
+   if(sim_cfg.state_path==NULL){
+      ssize_t length = readlink("/proc/self/exe", state_path, sizeof state_path-sizeof ".state");
+      if(length<0){
+         perror("/proc/self/exe");
+         return 1;
+      }
+      strcpy(state_path+length, ".state");
+      sim_cfg.state_path=state_path;
+   }
+   snprintf(flash_path, sizeof flash_path, "%s.flash", sim_cfg.state_path);
+   if(resumed){
+      load_state();
+   }
+   else{
+      // A power on starts with erased rtc memory, nvs and flash
+      remove(flash_path);
+      state.magic=SIM_STATE_MAGIC;
+      state.rtc_size=rtc_size();
+      state.wall_start_ns=wall_ns();
+      state.reason=ESP_RST_POWERON;
+   }
+   if(host_flash_attach("outbox", flash_path, SIM_OUTBOX_SIZE)!=ESP_OK){
+      perror(flash_path);
+      return 1;
+   }
+   sim_counters.boots++;
+   sim_kernel_init(state.boot_us, sim_cfg.hours*3600e6);
+   sim_mark_wake();
+   sim_device_boot(state.reason);
+   sim_mqtt_boot();
+   xTaskCreate(main_task, "main", 4096, NULL, 1, NULL);
+   const char* reason = sim_kernel_run();
+   print_report(reason);
+   return 0;
+}
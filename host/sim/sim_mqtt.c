@@ -0,0 +1,297 @@
+/*
+ * sim_mqtt.c
+ * @description: Esp-mqtt client of the simulation, connected to a broker
+ *    model. Connections take the tls time of the run, QoS 1 publishes are
+ *    acked after the ack time, and the commands of the run are delivered on
+ *    the subscribed topic. Events are run by the mqtt task, as in esp-mqtt
+ * @author: @Retrocamara42
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim.h"
+#include "host_stubs.h"
+#include "mqtt_client.h"
+
+// Priority of the mqtt task, MQTT_TASK_PRIORITY of esp-mqtt
+#define SIM_MQTT_TASK_PRIORITY 5
+// Time between connection attempts without wifi
+#define SIM_MQTT_RECONNECT_US 10000000
+#define SIM_MQTT_MAX_TOPIC 64
+#define SIM_MQTT_MAX_DATA 512
+// Internal events of the client: end of the tls handshake, and retry of
+// a failed connection
+#define SIM_MQTT_EVENT_HANDSHAKE -2
+#define SIM_MQTT_EVENT_RECONNECT -3
+
+struct esp_mqtt_client {
+   esp_mqtt_client_config_t config;
+   esp_event_handler_t event_handler;
+   void *event_handler_arg;
+   int next_msg_id;
+   uint8_t started;
+   uint8_t connected;
+   // Events of a stopped session are dropped
+   uint32_t generation;
+   char subscribed[SIM_MQTT_MAX_TOPIC];
+};
+
+/*
+ * sim_mqtt_event: Event posted to the mqtt task
+ */
+typedef struct {
+   esp_mqtt_client_handle_t client;
+   uint32_t generation;
+   int32_t id;
+   int msg_id;
+   char topic[SIM_MQTT_MAX_TOPIC];
+   char data[SIM_MQTT_MAX_DATA];
+   int data_len;
+} sim_mqtt_event;
+
+static void run_mqtt_event(void *arg);
+
+static sim_worker *mqtt_task=NULL;
+// Client the commands of the run are delivered to
+static esp_mqtt_client_handle_t sim_client=NULL;
+static esp_mqtt_error_codes_t tls_error = {
+   .esp_tls_last_esp_err = ESP_ERR_TIMEOUT,
+   .error_type = MQTT_ERROR_TYPE_ESP_TLS,
+};
+
+
+/*
+ * post_mqtt_event: Post an event of a session to the mqtt task
+ *    Arguments:
+ *       - client: esp_mqtt_client_handle_t. Client
+ *       - delay_us: int64_t. Time from now
+ *       - event: sim_mqtt_event*. Event, copied. Its generation is set
+ */
+static void post_mqtt_event(esp_mqtt_client_handle_t client, int64_t delay_us,
+        sim_mqtt_event *event){
+   event->client=client;
+   event->generation=client->generation;
+   sim_worker_post(mqtt_task, delay_us, run_mqtt_event, event, sizeof *event);
+}
+
+
+/*
+ * connect_attempt: Start a connection to the broker. It only succeeds if
+ *    the station still has an ip once the handshake ends
+ */
+static void connect_attempt(esp_mqtt_client_handle_t client){
+   sim_mqtt_event before = {.id = MQTT_EVENT_BEFORE_CONNECT};
+   post_mqtt_event(client, 0, &before);
+   sim_mqtt_event handshake = {.id = SIM_MQTT_EVENT_HANDSHAKE};
+   post_mqtt_event(client, (int64_t)sim_cfg.tls_ms*1000, &handshake);
+}
+
+
+/*
+ * deliver: Give an event to the handler registered on the client
+ */
+static void deliver(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t id,
+        sim_mqtt_event *posted){
+   esp_mqtt_event_t event = {
+      .event_id = id,
+      .client = client,
+      .msg_id = posted->msg_id,
+      .error_handle = &tls_error,
+   };
+   if(id==MQTT_EVENT_DATA){
+      event.topic=posted->topic;
+      event.topic_len=strlen(posted->topic);
+      event.data=posted->data;
+      event.data_len=posted->data_len;
+      event.total_data_len=posted->data_len;
+   }
+   if(client->event_handler){
+      client->event_handler(client->event_handler_arg, "MQTT_EVENTS", id, &event);
+   }
+}
+
+
+/*
+ * run_mqtt_event: Run an event in the mqtt task. Events of a stopped
+ *    session are dropped
+ */
+static void run_mqtt_event(void *arg){
+   sim_mqtt_event *event = arg;
+   esp_mqtt_client_handle_t client = event->client;
+   if(event->generation!=client->generation){
+      return;
+   }
+   switch(event->id){
+      case SIM_MQTT_EVENT_HANDSHAKE:
+         if(sim_wifi_connected()){
+            client->connected=1;
+            sim_counters.mqtt_connects++;
+            deliver(client, MQTT_EVENT_CONNECTED, event);
+         }
+         else{
+            deliver(client, MQTT_EVENT_ERROR, event);
+            deliver(client, MQTT_EVENT_DISCONNECTED, event);
+            sim_mqtt_event reconnect = {.id = SIM_MQTT_EVENT_RECONNECT};
+            post_mqtt_event(client, SIM_MQTT_RECONNECT_US, &reconnect);
+         }
+         break;
+      case SIM_MQTT_EVENT_RECONNECT:
+         connect_attempt(client);
+         break;
+      case MQTT_EVENT_PUBLISHED:
+         sim_counters.acks++;
+         sim_mark_ack(event->msg_id);
+         deliver(client, MQTT_EVENT_PUBLISHED, event);
+         break;
+      default:
+         deliver(client, event->id, event);
+         break;
+   }
+}
+
+
+/*
+ * deliver_command: Publish a command of the run on the broker, in
+ *    interrupt context. It is lost if the device isn't subscribed
+ */
+static void deliver_command(void *arg){
+   const sim_command *command = arg;
+   sim_counters.commands_done|=1<<(command-sim_cfg.commands);
+   if(sim_client==NULL || !sim_client->connected || sim_client->subscribed[0]=='\0'){
+      sim_counters.commands_lost++;
+      return;
+   }
+   sim_mqtt_event data = {
+      .id = MQTT_EVENT_DATA,
+      .data_len = strlen(command->payload),
+   };
+   memcpy(data.topic, sim_client->subscribed, sizeof data.topic);
+   strncpy(data.data, command->payload, sizeof data.data-1);
+   if(data.data_len>=SIM_MQTT_MAX_DATA){
+      data.data_len=SIM_MQTT_MAX_DATA-1;
+   }
+   sim_counters.commands_sent++;
+   post_mqtt_event(sim_client, 0, &data);
+}
+
+
+// Commands sent during a deep sleep are lost
+void sim_mqtt_boot(void){
+   int64_t now = sim_now();
+   for(uint8_t i=0; i<sim_cfg.command_count; i++){
+      int64_t at_us = (int64_t)sim_cfg.commands[i].at_s*1000000;
+      if(at_us>=now){
+         sim_schedule(at_us-now, deliver_command, &sim_cfg.commands[i]);
+      }
+      else if(!(sim_counters.commands_done&(1<<i))){
+         sim_counters.commands_done|=1<<i;
+         sim_counters.commands_lost++;
+      }
+   }
+}
+
+
+/******************* CLIENT ************************************************/
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config){
+   esp_mqtt_client_handle_t client = calloc(1, sizeof(struct esp_mqtt_client));
+   if(client){
+      client->config=*config;
+      client->next_msg_id=1;
+      if(mqtt_task==NULL){
+         mqtt_task=sim_worker_create("mqtt_task", SIM_MQTT_TASK_PRIORITY);
+      }
+      sim_client=client;
+   }
+   return client;
+}
+
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client){
+   if(client->started){
+      return ESP_FAIL;
+   }
+   client->started=1;
+   client->generation++;
+   connect_attempt(client);
+   return ESP_OK;
+}
+
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client){
+   client->started=0;
+   client->connected=0;
+   client->subscribed[0]='\0';
+   client->generation++;
+   return ESP_OK;
+}
+
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client){
+   esp_mqtt_client_stop(client);
+   if(sim_client==client){
+      sim_client=NULL;
+   }
+   free(client);
+   return ESP_OK;
+}
+
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client,
+        esp_mqtt_event_id_t event, esp_event_handler_t event_handler,
+        void *event_handler_arg){
+   client->event_handler=event_handler;
+   client->event_handler_arg=event_handler_arg;
+   return ESP_OK;
+}
+
+
+// Esp-mqtt refuses to subscribe before the client is connected
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos){
+   if(client==NULL || !client->connected){
+      sim_counters.subscribe_failures++;
+      return -1;
+   }
+   strncpy(client->subscribed, topic, SIM_MQTT_MAX_TOPIC-1);
+   sim_mqtt_event subscribed = {
+      .id = MQTT_EVENT_SUBSCRIBED,
+      .msg_id = client->next_msg_id++,
+   };
+   post_mqtt_event(client, (int64_t)sim_cfg.ack_ms*1000, &subscribed);
+   return subscribed.msg_id;
+}
+
+
+int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *topic){
+   if(client==NULL || !client->connected){
+      return -1;
+   }
+   client->subscribed[0]='\0';
+   return client->next_msg_id++;
+}
+
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic,
+        const char *data, int len, int qos, int retain){
+   if(client==NULL || !client->connected){
+      sim_counters.publish_failures++;
+      return -1;
+   }
+   if(len==0){
+      len=strlen(data);
+   }
+   host_counters.mqtt_publishes++;
+   host_counters.mqtt_bytes+=len;
+   sim_counters.publishes++;
+   if(qos==0){
+      sim_mark_publish(0, 0);
+      return 0;
+   }
+   sim_mqtt_event published = {
+      .id = MQTT_EVENT_PUBLISHED,
+      .msg_id = client->next_msg_id++,
+   };
+   sim_mark_publish(qos, published.msg_id);
+   post_mqtt_event(client, (int64_t)sim_cfg.ack_ms*1000, &published);
+   return published.msg_id;
+}
@@ -0,0 +1,317 @@
+/*
+ * esp_http_client_stub.c
+ * @description: Host stand-in for esp_http_client. Records posts. Init
+ *    allocates buffers of the same size as the sdk's default client so heap
+ *    use per client is comparable. Like the sdk's client, a connection is
+ *    opened by the first perform and kept until close or cleanup. Streamed
+ *    reads (open, fetch_headers, read) get the response set for their url
+ *    with host_http_set_url_response or host_http_set_response, at most a
+ *    buffer per read. Posts are counted
+ *    with the bytes of their request line and headers, as the sdk's client
+ *    writes them
+ * @author: @Retrocamara42
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "host_stubs.h"
+#include "esp_http_client.h"
+
+#define HOST_HTTP_BUFFER_SIZE 512
+#define HOST_HTTP_MAX_BODY 8192
+#define HOST_HTTP_MAX_HEADER 64
+// Header the sdk's client adds to every request
+#define HOST_HTTP_USER_AGENT "ESP32 HTTP Client/1.0"
+
+/*
+ * host_http_response: Response of streamed reads
+ *    - url: const char*. Url it answers, NULL for any other
+ *    - status: int. Http status
+ *    - body: const uint8_t*. Body
+ *    - length: size_t. Length of body
+ */
+typedef struct {
+   const char *url;
+   int status;
+   const uint8_t *body;
+   size_t length;
+} host_http_response;
+
+struct esp_http_client {
+   esp_http_client_config_t config;
+   char *rx_buffer;
+   char *tx_buffer;
+   const char *post_data;
+   int post_len;
+   char content_type[HOST_HTTP_MAX_HEADER];
+   char content_encoding[HOST_HTTP_MAX_HEADER];
+   int status_code;
+   bool connected;
+   size_t read_offset;
+   const host_http_response *response;
+};
+
+static char last_body[HOST_HTTP_MAX_BODY+1];
+static size_t last_length=0;
+static char last_url[256];
+static char last_content_type[HOST_HTTP_MAX_HEADER];
+static char last_content_encoding[HOST_HTTP_MAX_HEADER];
+static uint32_t failing_performs=0;
+static host_http_response default_response = { NULL, 404, NULL, 0 };
+static host_http_response url_responses[HOST_HTTP_MAX_URL_RESPONSES];
+
+
+void host_http_fail_next(uint32_t count){
+   failing_performs=count;
+}
+
+
+void host_http_set_response(int status, const uint8_t *body, size_t length){
+   default_response.status=status;
+   default_response.body=body;
+   default_response.length=length;
+   memset(url_responses, 0, sizeof url_responses);
+}
+
+
+void host_http_set_url_response(const char *url, int status, const uint8_t *body, size_t length){
+   uint8_t i=0;
+   while(i<HOST_HTTP_MAX_URL_RESPONSES-1 && url_responses[i].url!=NULL
+         && strcmp(url_responses[i].url, url)!=0){
+      i++;
+   }
+   url_responses[i] = (host_http_response){ url, status, body, length };
+}
+
+
+/*
+ * response_of: Response of the requests to a url
+ */
+static const host_http_response* response_of(const char *url){
+   for(uint8_t i=0; i<HOST_HTTP_MAX_URL_RESPONSES && url_responses[i].url!=NULL; i++){
+      if(url!=NULL && strcmp(url_responses[i].url, url)==0){
+         return &url_responses[i];
+      }
+   }
+   return &default_response;
+}
+
+
+const char* host_last_http_body(void){
+   return last_body;
+}
+
+
+void host_last_http_request(host_http_request *request){
+   request->url = last_url;
+   request->content_type = last_content_type;
+   request->content_encoding = last_content_encoding[0]!='\0' ? last_content_encoding : NULL;
+   request->body = (const uint8_t*)last_body;
+   request->length = last_length;
+}
+
+
+/*
+ * request_head_length: Bytes of the request line and headers of a post
+ */
+static size_t request_head_length(esp_http_client_handle_t client){
+   const char *url = client->config.url;
+   const char *host = strstr(url, "://");
+   host = host!=NULL ? host+3 : url;
+   const char *path = strchr(host, '/');
+   size_t host_length = path!=NULL ? (size_t)(path-host) : strlen(host);
+   size_t path_length = path!=NULL ? strlen(path) : 1;
+   char content_length[32];
+   size_t length = strlen("POST  HTTP/1.1\r\n")+path_length
+      +strlen("Host: \r\n")+host_length
+      +strlen("User-Agent: \r\n")+strlen(HOST_HTTP_USER_AGENT)
+      +snprintf(content_length, sizeof content_length, "Content-Length: %d\r\n", client->post_len)
+      +strlen("\r\n");
+   if(client->content_type[0]!='\0'){
+      length += strlen("Content-Type: \r\n")+strlen(client->content_type);
+   }
+   if(client->content_encoding[0]!='\0'){
+      length += strlen("Content-Encoding: \r\n")+strlen(client->content_encoding);
+   }
+   return length;
+}
+
+
+static void dispatch_event(esp_http_client_handle_t client, esp_http_client_event_id_t event_id){
+   if(client->config.event_handler==NULL){
+      return;
+   }
+   esp_http_client_event_t evt = {
+      .event_id = event_id,
+      .client = client,
+      .user_data = client->config.user_data,
+   };
+   client->config.event_handler(&evt);
+}
+
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config){
+   esp_http_client_handle_t client = calloc(1, sizeof(struct esp_http_client));
+   if(client==NULL){
+      return NULL;
+   }
+   client->config=*config;
+   client->rx_buffer=malloc(HOST_HTTP_BUFFER_SIZE);
+   client->tx_buffer=malloc(HOST_HTTP_BUFFER_SIZE);
+   host_counters.http_inits++;
+   return client;
+}
+
+
+esp_err_t esp_http_client_set_url(esp_http_client_handle_t client, const char *url){
+   client->config.url=url;
+   return ESP_OK;
+}
+
+
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t client, esp_http_client_method_t method){
+   client->config.method=method;
+   return ESP_OK;
+}
+
+
+/*
+ * header_value: Value of the headers that are recorded, NULL for others
+ */
+static char* header_value(esp_http_client_handle_t client, const char *key){
+   if(strcasecmp(key, "Content-Type")==0){
+      return client->content_type;
+   }
+   if(strcasecmp(key, "Content-Encoding")==0){
+      return client->content_encoding;
+   }
+   return NULL;
+}
+
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value){
+   char *header = header_value(client, key);
+   if(header!=NULL){
+      snprintf(header, HOST_HTTP_MAX_HEADER, "%s", value);
+   }
+   return ESP_OK;
+}
+
+
+esp_err_t esp_http_client_delete_header(esp_http_client_handle_t client, const char *key){
+   char *header = header_value(client, key);
+   if(header!=NULL){
+      header[0]='\0';
+   }
+   return ESP_OK;
+}
+
+
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t client, const char *data, int len){
+   client->post_data=data;
+   client->post_len=len;
+   return ESP_OK;
+}
+
+
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client){
+   if(failing_performs>0){
+      failing_performs--;
+      client->connected=false;
+      dispatch_event(client, HTTP_EVENT_DISCONNECTED);
+      return ESP_FAIL;
+   }
+   if(!client->connected){
+      client->connected=true;
+      host_counters.http_connections++;
+      dispatch_event(client, HTTP_EVENT_ON_CONNECTED);
+   }
+   dispatch_event(client, HTTP_EVENT_HEADER_SENT);
+   size_t copy_len = client->post_len<HOST_HTTP_MAX_BODY ? (size_t)client->post_len : HOST_HTTP_MAX_BODY;
+   memcpy(last_body, client->post_data, copy_len);
+   last_body[copy_len]='\0';
+   last_length=copy_len;
+   snprintf(last_url, sizeof last_url, "%s", client->config.url);
+   memcpy(last_content_type, client->content_type, HOST_HTTP_MAX_HEADER);
+   memcpy(last_content_encoding, client->content_encoding, HOST_HTTP_MAX_HEADER);
+   host_counters.http_performs++;
+   host_counters.http_bytes+=client->post_len;
+   host_counters.http_wire_bytes+=request_head_length(client)+client->post_len;
+   client->status_code=200;
+   dispatch_event(client, HTTP_EVENT_ON_FINISH);
+   return ESP_OK;
+}
+
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len){
+   if(failing_performs>0){
+      failing_performs--;
+      return ESP_FAIL;
+   }
+   if(!client->connected){
+      client->connected=true;
+      host_counters.http_connections++;
+      dispatch_event(client, HTTP_EVENT_ON_CONNECTED);
+   }
+   dispatch_event(client, HTTP_EVENT_HEADER_SENT);
+   client->read_offset=0;
+   client->status_code=0;
+   return ESP_OK;
+}
+
+
+int esp_http_client_fetch_headers(esp_http_client_handle_t client){
+   if(!client->connected){
+      return ESP_FAIL;
+   }
+   client->response=response_of(client->config.url);
+   client->status_code=client->response->status;
+   return client->status_code==200 ? (int)client->response->length : 0;
+}
+
+
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len){
+   if(!client->connected || client->status_code!=200){
+      return -1;
+   }
+   size_t left = client->response->length-client->read_offset;
+   size_t length = left<(size_t)len ? left : (size_t)len;
+   if(length>HOST_HTTP_BUFFER_SIZE){
+      length=HOST_HTTP_BUFFER_SIZE;
+   }
+   memcpy(buffer, client->response->body+client->read_offset, length);
+   client->read_offset+=length;
+   return (int)length;
+}
+
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client){
+   return client->status_code;
+}
+
+
+int esp_http_client_get_content_length(esp_http_client_handle_t client){
+   return 0;
+}
+
+
+bool esp_http_client_is_chunked_response(esp_http_client_handle_t client){
+   return false;
+}
+
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client){
+   client->connected=false;
+   return ESP_OK;
+}
+
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client){
+   free(client->rx_buffer);
+   free(client->tx_buffer);
+   free(client);
+   return ESP_OK;
+}
@@ -0,0 +1,168 @@
+/*
+ * esp_ota_stub.c
+ * @description: Host stand-in for esp_ota_ops. Two app slots of the size
+ *    of partitions.csv are kept in memory, allocated on first use. The
+ *    running slot is the boot slot at the last host_ota_boot. esp_ota_end
+ *    fails unless every byte announced to esp_ota_begin was written, as a
+ *    truncated image fails the sdk's image check
+ * @author: @Retrocamara42
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_ota_ops.h"
+#include "host_stubs.h"
+
+#define HOST_OTA_SLOTS 2
+#define HOST_OTA_SLOT_SIZE 0xF0000
+
+static const esp_partition_t ota_partitions[HOST_OTA_SLOTS] = {
+   { ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x10000, HOST_OTA_SLOT_SIZE, "ota_0" },
+   { ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, 0x110000, HOST_OTA_SLOT_SIZE, "ota_1" },
+};
+static uint8_t *ota_slots[HOST_OTA_SLOTS];
+static uint8_t running_slot=0;
+static uint8_t boot_slot=0;
+// Write in progress, handle 0 is none
+static esp_ota_handle_t open_handle=0;
+static uint8_t open_slot;
+static size_t open_size;
+static size_t open_written;
+
+
+static int slot_of(const esp_partition_t* partition){
+   for(int i=0; i<HOST_OTA_SLOTS; i++){
+      if(partition==&ota_partitions[i]){
+         return i;
+      }
+   }
+   return -1;
+}
+
+
+static uint8_t* slot_data(int slot){
+   if(ota_slots[slot]==NULL){
+      ota_slots[slot] = malloc(HOST_OTA_SLOT_SIZE);
+      memset(ota_slots[slot], 0xFF, HOST_OTA_SLOT_SIZE);
+   }
+   return ota_slots[slot];
+}
+
+
+esp_err_t host_ota_load(const char* label, const uint8_t* image, size_t size){
+   const esp_partition_t *partition = host_ota_find(label);
+   if(partition==NULL || size>partition->size){
+      return ESP_ERR_INVALID_ARG;
+   }
+   uint8_t *data = slot_data(slot_of(partition));
+   memset(data, 0xFF, partition->size);
+   memcpy(data, image, size);
+   return ESP_OK;
+}
+
+
+const uint8_t* host_ota_image(const char* label){
+   const esp_partition_t *partition = host_ota_find(label);
+   return partition!=NULL ? slot_data(slot_of(partition)) : NULL;
+}
+
+
+void host_ota_boot(void){
+   running_slot=boot_slot;
+   open_handle=0;
+}
+
+
+const esp_partition_t* host_ota_find(const char* label){
+   for(int i=0; i<HOST_OTA_SLOTS; i++){
+      if(label==NULL || strcmp(label, ota_partitions[i].label)==0){
+         return &ota_partitions[i];
+      }
+   }
+   return NULL;
+}
+
+
+esp_err_t host_ota_read(const esp_partition_t* partition, size_t offset, void* dst, size_t size){
+   int slot = slot_of(partition);
+   if(slot<0 || offset+size>partition->size){
+      return ESP_ERR_INVALID_SIZE;
+   }
+   host_counters.flash_reads++;
+   memcpy(dst, slot_data(slot)+offset, size);
+   return ESP_OK;
+}
+
+
+esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t image_size,
+        esp_ota_handle_t* out_handle){
+   int slot = slot_of(partition);
+   if(slot<0){
+      return ESP_ERR_INVALID_ARG;
+   }
+   if(slot==running_slot){
+      return ESP_ERR_OTA_PARTITION_CONFLICT;
+   }
+   size_t erased = image_size==OTA_SIZE_UNKNOWN ? partition->size : image_size;
+   if(erased>partition->size){
+      return ESP_ERR_INVALID_SIZE;
+   }
+   memset(slot_data(slot), 0xFF, partition->size);
+   host_counters.flash_erases += (erased+4095)/4096;
+   open_slot=slot;
+   open_size=image_size;
+   open_written=0;
+   *out_handle=++open_handle;
+   return ESP_OK;
+}
+
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size){
+   if(handle==0 || handle!=open_handle){
+      return ESP_ERR_INVALID_ARG;
+   }
+   if(open_written+size>ota_partitions[open_slot].size){
+      return ESP_ERR_INVALID_SIZE;
+   }
+   memcpy(slot_data(open_slot)+open_written, data, size);
+   open_written+=size;
+   host_counters.flash_writes++;
+   return ESP_OK;
+}
+
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle){
+   if(handle==0 || handle!=open_handle){
+      return ESP_ERR_INVALID_ARG;
+   }
+   uint8_t complete = open_size==OTA_SIZE_UNKNOWN ? open_written>0 : open_written==open_size;
+   open_handle++;
+   return complete ? ESP_OK : ESP_ERR_OTA_VALIDATE_FAILED;
+}
+
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition){
+   int slot = slot_of(partition);
+   if(slot<0){
+      return ESP_ERR_INVALID_ARG;
+   }
+   boot_slot=slot;
+   return ESP_OK;
+}
+
+
+const esp_partition_t* esp_ota_get_boot_partition(void){
+   return &ota_partitions[boot_slot];
+}
+
+
+const esp_partition_t* esp_ota_get_running_partition(void){
+   return &ota_partitions[running_slot];
+}
+
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from){
+   int slot = slot_of(start_from!=NULL ? start_from : &ota_partitions[running_slot]);
+   return slot<0 ? NULL : &ota_partitions[(slot+1)%HOST_OTA_SLOTS];
+}
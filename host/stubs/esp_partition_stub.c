@@ -0,0 +1,113 @@
+/*
+ * esp_partition_stub.c
+ * @description: Host stand-in for esp_partition. A single data partition
+ *    is backed by a file and behaves like nor flash: writes only clear
+ *    bits, erases set whole sectors to 0xFF, writes must be word aligned.
+ *    App partitions are found and read in the slots of esp_ota_stub.c
+ * @author: @Retrocamara42
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_partition.h"
+#include "host_stubs.h"
+
+#define HOST_FLASH_SECTOR_SIZE 4096
+
+static esp_partition_t host_partition;
+static FILE *host_flash=NULL;
+
+
+esp_err_t host_flash_attach(const char* label, const char* path, uint32_t size){
+   if(host_flash!=NULL){
+      fclose(host_flash);
+   }
+   host_flash = path!=NULL ? fopen(path, "r+b") : NULL;
+   if(host_flash==NULL){
+      host_flash = path!=NULL ? fopen(path, "w+b") : tmpfile();
+      if(host_flash==NULL){
+         return ESP_FAIL;
+      }
+      uint8_t erased[HOST_FLASH_SECTOR_SIZE];
+      memset(erased, 0xFF, sizeof erased);
+      for(uint32_t offset=0; offset<size; offset+=sizeof erased){
+         fwrite(erased, 1, sizeof erased, host_flash);
+      }
+   }
+   memset(&host_partition, 0, sizeof host_partition);
+   host_partition.type = ESP_PARTITION_TYPE_DATA;
+   host_partition.subtype = ESP_PARTITION_SUBTYPE_ANY;
+   host_partition.size = size;
+   strncpy(host_partition.label, label, sizeof host_partition.label-1);
+   return ESP_OK;
+}
+
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+        esp_partition_subtype_t subtype, const char* label){
+   if(type==ESP_PARTITION_TYPE_APP){
+      return host_ota_find(label);
+   }
+   if(host_flash==NULL || type!=host_partition.type
+         || (label!=NULL && strcmp(label, host_partition.label)!=0)){
+      return NULL;
+   }
+   return &host_partition;
+}
+
+
+esp_err_t esp_partition_read(const esp_partition_t* partition,
+        size_t src_offset, void* dst, size_t size){
+   if(partition->type==ESP_PARTITION_TYPE_APP){
+      return host_ota_read(partition, src_offset, dst, size);
+   }
+   if(src_offset+size>partition->size){
+      return ESP_ERR_INVALID_SIZE;
+   }
+   host_counters.flash_reads++;
+   fseek(host_flash, src_offset, SEEK_SET);
+   return fread(dst, 1, size, host_flash)==size ? ESP_OK : ESP_FAIL;
+}
+
+
+esp_err_t esp_partition_write(const esp_partition_t* partition,
+        size_t dst_offset, const void* src, size_t size){
+   if(dst_offset+size>partition->size || dst_offset%4!=0 || size%4!=0){
+      return ESP_ERR_INVALID_SIZE;
+   }
+   uint8_t current[HOST_FLASH_SECTOR_SIZE];
+   const uint8_t *bytes = src;
+   while(size>0){
+      size_t chunk = size<sizeof current ? size : sizeof current;
+      fseek(host_flash, dst_offset, SEEK_SET);
+      fread(current, 1, chunk, host_flash);
+      for(size_t i=0; i<chunk; i++){
+         current[i] &= bytes[i];
+      }
+      fseek(host_flash, dst_offset, SEEK_SET);
+      fwrite(current, 1, chunk, host_flash);
+      dst_offset += chunk;
+      bytes += chunk;
+      size -= chunk;
+   }
+   host_counters.flash_writes++;
+   return ESP_OK;
+}
+
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition,
+        size_t start_addr, size_t size){
+   if(start_addr+size>partition->size || start_addr%HOST_FLASH_SECTOR_SIZE!=0
+         || size%HOST_FLASH_SECTOR_SIZE!=0){
+      return ESP_ERR_INVALID_SIZE;
+   }
+   uint8_t erased[HOST_FLASH_SECTOR_SIZE];
+   memset(erased, 0xFF, sizeof erased);
+   fseek(host_flash, start_addr, SEEK_SET);
+   for(size_t offset=0; offset<size; offset+=sizeof erased){
+      fwrite(erased, 1, sizeof erased, host_flash);
+      host_counters.flash_erases++;
+   }
+   return ESP_OK;
+}
@@ -0,0 +1,87 @@
+/*
+ * esp_stubs.c
+ * @description: Host stand-ins for the esp sdk system, logging and network
+ *    functions used by the firmware
+ * @author: @Retrocamara42
+ *
+ */
+#include <stdarg.h>
+#include <stdlib.h>
+
+#include "host_stubs.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_tls.h"
+#include "esp_event.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+host_stub_counters host_counters;
+
+static char log_buffer[256];
+
+
+void host_stubs_reset(void){
+   memset(&host_counters, 0, sizeof host_counters);
+}
+
+
+/******************* ESP SYSTEM *****************************************/
+const char *esp_err_to_name(esp_err_t code){
+   switch(code){
+      case ESP_OK: return "ESP_OK";
+      case ESP_FAIL: return "ESP_FAIL";
+      case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+      case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+      case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+      case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+      case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+      case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+      case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+      case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+      case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+      case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+      default: return "UNKNOWN ERROR";
+   }
+}
+
+
+void host_log_write(esp_log_level_t level, const char *tag, const char *format, ...){
+   static const char level_chars[] = "NEWIDV";
+   va_list args;
+   va_start(args, format);
+   vsnprintf(log_buffer, sizeof log_buffer, format, args);
+   va_end(args);
+   host_counters.log_lines++;
+   if(getenv("HOST_LOG_VERBOSE")){
+      // Same format as the device, time in ms since boot
+      fprintf(stderr, "%c (%u) %s: %s\n", level_chars[level],
+         (uint32_t)(esp_timer_get_time()/1000), tag, log_buffer);
+   }
+}
+
+
+uint32_t esp_get_free_heap_size(void){
+   return 40*1024;
+}
+
+
+uint32_t esp_get_minimum_free_heap_size(void){
+   return 36*1024;
+}
+
+
+esp_err_t esp_netif_init(void){
+   return ESP_OK;
+}
+
+
+esp_err_t esp_event_loop_create_default(void){
+   return ESP_OK;
+}
+
+
+esp_err_t esp_tls_get_and_clear_last_error(esp_tls_error_handle_t h,
+        int *esp_tls_code, int *esp_tls_flags){
+   return ESP_OK;
+}
@@ -0,0 +1,119 @@
+/*
+ * gpio_stubs.c
+ * @description: Host stand-ins for the gpio driver and the dht functions of
+ *    esp-idf-lib. Readings are set by host programs, see host_stubs.h
+ * @author: @Retrocamara42
+ *
+ */
+#include "host_stubs.h"
+#include "driver/gpio.h"
+#include <dht.h>
+
+static float dht_temperature=21.5;
+static float dht_humidity=48.2;
+static esp_err_t dht_result=ESP_OK;
+static uint32_t dht_failures=0;
+static esp_err_t dht_failure_error=ESP_OK;
+// Readings of the next good reads, before the one of host_dht_set_reading
+static float queued_readings[HOST_DHT_MAX_QUEUED][2];
+static uint8_t queued_count=0;
+static uint8_t queued_next=0;
+
+
+void host_dht_set_reading(float temperature, float humidity, esp_err_t result){
+   dht_temperature=temperature;
+   dht_humidity=humidity;
+   dht_result=result;
+}
+
+
+void host_dht_fail_next(uint32_t count, esp_err_t error){
+   dht_failures=count;
+   dht_failure_error=error;
+}
+
+
+void host_dht_queue_reading(float temperature, float humidity){
+   if(queued_count<HOST_DHT_MAX_QUEUED){
+      queued_readings[queued_count][0]=temperature;
+      queued_readings[queued_count][1]=humidity;
+      queued_count++;
+   }
+}
+
+
+/*
+ * dht_next_result: Result of a dht read, failures injected first, then
+ *    queued readings
+ */
+static esp_err_t dht_next_result(float *temperature, float *humidity){
+   host_counters.dht_reads++;
+   *temperature=dht_temperature;
+   *humidity=dht_humidity;
+   if(dht_failures>0){
+      dht_failures--;
+      return dht_failure_error;
+   }
+   if(queued_next<queued_count){
+      *temperature=queued_readings[queued_next][0];
+      *humidity=queued_readings[queued_next][1];
+      if(++queued_next==queued_count){
+         queued_next=queued_count=0;
+      }
+      return ESP_OK;
+   }
+   return dht_result;
+}
+
+
+/******************* DRIVERS *****************************************/
+esp_err_t gpio_config(const gpio_config_t *gpio_cfg){
+   return ESP_OK;
+}
+
+
+// No edges are generated, frames are decoded from traces by host programs
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode){
+   return ESP_OK;
+}
+
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level){
+   return ESP_OK;
+}
+
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type){
+   return ESP_OK;
+}
+
+
+esp_err_t gpio_install_isr_service(int no_use){
+   return ESP_OK;
+}
+
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args){
+   return ESP_OK;
+}
+
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num){
+   return ESP_OK;
+}
+
+
+esp_err_t dht_read_data(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        int16_t *humidity, int16_t *temperature){
+   float h, t;
+   esp_err_t err=dht_next_result(&t, &h);
+   *humidity=(int16_t)(h*10);
+   *temperature=(int16_t)(t*10);
+   return err;
+}
+
+
+esp_err_t dht_read_float_data(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        float *humidity, float *temperature){
+   return dht_next_result(temperature, humidity);
+}
@@ -0,0 +1,410 @@
+/*
+ * http_server_stub.c
+ * @description: Host stand-in for the ingestion server of the http
+ *    transport. Decodes the body of the last post by its Content-Encoding.
+ *    gzip (RFC 1952) and deflate (zlib, RFC 1950) bodies are inflated with
+ *    a decoder of every block type of RFC 1951, written apart from the
+ *    firmware's compressor so it checks it
+ * @author: @Retrocamara42
+ *
+ */
+#include <string.h>
+#include <strings.h>
+
+#include "host_stubs.h"
+
+#define GZIP_FLAG_HCRC 0x02
+#define GZIP_FLAG_EXTRA 0x04
+#define GZIP_FLAG_NAME 0x08
+#define GZIP_FLAG_COMMENT 0x10
+
+static const uint16_t length_base[29] = {
+   3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+   35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t length_extra[29] = {
+   0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+   3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t distance_base[30] = {
+   1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+   257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t distance_extra[30] = {
+   0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+   7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+// Order of the code length codes of a dynamic block
+static const uint8_t code_length_order[19] = {
+   16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+/*
+ * inflate_state: Input and output of a decode
+ */
+typedef struct {
+   const uint8_t *in;
+   size_t in_length;
+   size_t in_position;
+   uint32_t bits;
+   uint8_t bit_count;
+   uint8_t *out;
+   size_t out_size;
+   size_t out_length;
+   esp_err_t error;
+} inflate_state;
+
+/*
+ * huffman: Canonical code, codes of each length and symbols by code
+ */
+typedef struct {
+   uint16_t count[16];
+   uint16_t symbol[288];
+} huffman;
+
+
+static uint32_t get_bits(inflate_state *state, uint8_t count){
+   while(state->bit_count<count){
+      if(state->in_position>=state->in_length){
+         state->error = ESP_ERR_INVALID_SIZE;
+         return 0;
+      }
+      state->bits |= (uint32_t)state->in[state->in_position++]<<state->bit_count;
+      state->bit_count += 8;
+   }
+   uint32_t value = state->bits&((1U<<count)-1);
+   state->bits >>= count;
+   state->bit_count -= count;
+   return value;
+}
+
+
+static void put_out(inflate_state *state, uint8_t byte){
+   if(state->out_length>=state->out_size){
+      state->error = ESP_ERR_INVALID_SIZE;
+      return;
+   }
+   state->out[state->out_length++] = byte;
+}
+
+
+static esp_err_t build(huffman *code, const uint8_t *lengths, uint16_t n){
+   uint16_t offsets[16];
+   memset(code->count, 0, sizeof code->count);
+   for(uint16_t i=0; i<n; i++){
+      code->count[lengths[i]]++;
+   }
+   int left = 1;
+   for(uint8_t length=1; length<16; length++){
+      left = (left<<1)-code->count[length];
+      if(left<0){
+         return ESP_ERR_INVALID_SIZE;
+      }
+   }
+   offsets[1] = 0;
+   for(uint8_t length=1; length<15; length++){
+      offsets[length+1] = offsets[length]+code->count[length];
+   }
+   for(uint16_t i=0; i<n; i++){
+      if(lengths[i]!=0){
+         code->symbol[offsets[lengths[i]]++] = i;
+      }
+   }
+   return ESP_OK;
+}
+
+
+static int decode(inflate_state *state, const huffman *code){
+   int bits = 0;
+   int first = 0;
+   int index = 0;
+   for(uint8_t length=1; length<16 && state->error==ESP_OK; length++){
+      bits |= get_bits(state, 1);
+      int count = code->count[length];
+      if(bits-first<count){
+         return code->symbol[index+bits-first];
+      }
+      index += count;
+      first = (first+count)<<1;
+      bits <<= 1;
+   }
+   state->error = ESP_ERR_INVALID_SIZE;
+   return -1;
+}
+
+
+static void inflate_codes(inflate_state *state, const huffman *lengths, const huffman *distances){
+   int symbol;
+   do{
+      symbol = decode(state, lengths);
+      if(symbol<0 || state->error!=ESP_OK){
+         return;
+      }
+      if(symbol<256){
+         put_out(state, symbol);
+      }
+      else if(symbol>256){
+         symbol -= 257;
+         if(symbol>=29){
+            state->error = ESP_ERR_INVALID_SIZE;
+            return;
+         }
+         uint16_t length = length_base[symbol]+get_bits(state, length_extra[symbol]);
+         int code = decode(state, distances);
+         if(code<0 || code>=30){
+            state->error = ESP_ERR_INVALID_SIZE;
+            return;
+         }
+         size_t distance = distance_base[code]+get_bits(state, distance_extra[code]);
+         if(distance>state->out_length){
+            state->error = ESP_ERR_INVALID_SIZE;
+            return;
+         }
+         while(length-- && state->error==ESP_OK){
+            put_out(state, state->out[state->out_length-distance]);
+         }
+      }
+   }while(symbol!=256 && state->error==ESP_OK);
+}
+
+
+static void inflate_stored(inflate_state *state){
+   state->bits = 0;
+   state->bit_count = 0;
+   if(state->in_position+4>state->in_length){
+      state->error = ESP_ERR_INVALID_SIZE;
+      return;
+   }
+   const uint8_t *header = state->in+state->in_position;
+   uint16_t length = header[0]|(header[1]<<8);
+   if((uint16_t)~length!=(header[2]|(header[3]<<8))
+         || state->in_position+4+length>state->in_length){
+      state->error = ESP_ERR_INVALID_SIZE;
+      return;
+   }
+   state->in_position += 4;
+   while(length-- && state->error==ESP_OK){
+      put_out(state, state->in[state->in_position++]);
+   }
+}
+
+
+static void inflate_fixed(inflate_state *state){
+   static huffman lengths, distances;
+   uint8_t code_lengths[288];
+   for(uint16_t i=0; i<288; i++){
+      code_lengths[i] = i<144 ? 8 : i<256 ? 9 : i<280 ? 7 : 8;
+   }
+   build(&lengths, code_lengths, 288);
+   memset(code_lengths, 5, 30);
+   build(&distances, code_lengths, 30);
+   inflate_codes(state, &lengths, &distances);
+}
+
+
+static void inflate_dynamic(inflate_state *state){
+   static huffman lengths, distances;
+   uint8_t code_lengths[320];
+   uint16_t length_count = get_bits(state, 5)+257;
+   uint16_t distance_count = get_bits(state, 5)+1;
+   uint8_t code_count = get_bits(state, 4)+4;
+   if(length_count>286 || distance_count>30){
+      state->error = ESP_ERR_INVALID_SIZE;
+      return;
+   }
+   memset(code_lengths, 0, 19);
+   for(uint8_t i=0; i<code_count; i++){
+      code_lengths[code_length_order[i]] = get_bits(state, 3);
+   }
+   if(state->error!=ESP_OK || build(&lengths, code_lengths, 19)!=ESP_OK){
+      state->error = ESP_ERR_INVALID_SIZE;
+      return;
+   }
+   uint16_t i = 0;
+   while(i<length_count+distance_count && state->error==ESP_OK){
+      int symbol = decode(state, &lengths);
+      if(symbol<16){
+         code_lengths[i++] = symbol;
+         continue;
+      }
+      uint8_t repeated = 0;
+      uint8_t times;
+      if(symbol==16){
+         if(i==0){
+            state->error = ESP_ERR_INVALID_SIZE;
+            return;
+         }
+         repeated = code_lengths[i-1];
+         times = 3+get_bits(state, 2);
+      }
+      else if(symbol==17){
+         times = 3+get_bits(state, 3);
+      }
+      else{
+         times = 11+get_bits(state, 7);
+      }
+      if(i+times>length_count+distance_count){
+         state->error = ESP_ERR_INVALID_SIZE;
+         return;
+      }
+      while(times--){
+         code_lengths[i++] = repeated;
+      }
+   }
+   if(state->error!=ESP_OK || code_lengths[256]==0
+         || build(&lengths, code_lengths, length_count)!=ESP_OK
+         || build(&distances, code_lengths+length_count, distance_count)!=ESP_OK){
+      state->error = ESP_ERR_INVALID_SIZE;
+      return;
+   }
+   inflate_codes(state, &lengths, &distances);
+}
+
+
+/*
+ * inflate: Decode deflate blocks up to the final one
+ *    Returns:
+ *       - ESP_OK or ESP_ERR_INVALID_SIZE. in_position is the byte after
+ *          the last block
+ */
+static esp_err_t inflate(inflate_state *state){
+   uint8_t last;
+   do{
+      last = get_bits(state, 1);
+      uint8_t type = get_bits(state, 2);
+      if(state->error!=ESP_OK){
+         break;
+      }
+      if(type==0){
+         inflate_stored(state);
+      }
+      else if(type==1){
+         inflate_fixed(state);
+      }
+      else if(type==2){
+         inflate_dynamic(state);
+      }
+      else{
+         state->error = ESP_ERR_INVALID_SIZE;
+      }
+   }while(!last && state->error==ESP_OK);
+   return state->error;
+}
+
+
+static uint32_t crc32(const uint8_t *data, size_t length){
+   uint32_t crc = 0xffffffff;
+   while(length--){
+      crc ^= *data++;
+      for(uint8_t bit=0; bit<8; bit++){
+         crc = (crc>>1)^(0xEDB88320&-(crc&1));
+      }
+   }
+   return ~crc;
+}
+
+
+static uint32_t adler32(const uint8_t *data, size_t length){
+   uint32_t a = 1;
+   uint32_t b = 0;
+   while(length--){
+      a = (a+*data++)%65521;
+      b = (b+a)%65521;
+   }
+   return (b<<16)|a;
+}
+
+
+static uint32_t read_le32(const uint8_t *bytes){
+   return bytes[0]|(bytes[1]<<8)|(bytes[2]<<16)|((uint32_t)bytes[3]<<24);
+}
+
+
+/*
+ * gzip_header_length: Length of a gzip header, 0 if it isn't one
+ */
+static size_t gzip_header_length(const uint8_t *body, size_t length){
+   if(length<18 || body[0]!=0x1f || body[1]!=0x8b || body[2]!=8){
+      return 0;
+   }
+   uint8_t flags = body[3];
+   size_t position = 10;
+   if(flags&GZIP_FLAG_EXTRA){
+      position += 2+(body[10]|(body[11]<<8));
+   }
+   for(uint8_t field=GZIP_FLAG_NAME; field<=GZIP_FLAG_COMMENT; field<<=1){
+      if(flags&field){
+         while(position<length && body[position]!=0){
+            position++;
+         }
+         position++;
+      }
+   }
+   if(flags&GZIP_FLAG_HCRC){
+      position += 2;
+   }
+   return position<length ? position : 0;
+}
+
+
+/*
+ * host_http_decode_body: Decode the body of the last http post by its
+ *    Content-Encoding
+ *    Arguments:
+ *       - out: uint8_t*. Decoded body
+ *       - size: size_t. Size of out
+ *       - length: size_t*. Length of the decoded body
+ */
+esp_err_t host_http_decode_body(uint8_t *out, size_t size, size_t *length){
+   host_http_request request;
+   host_last_http_request(&request);
+   const char *encoding = request.content_encoding;
+   *length = 0;
+   if(encoding==NULL || strcasecmp(encoding, "identity")==0){
+      if(request.length>size){
+         return ESP_ERR_INVALID_SIZE;
+      }
+      memcpy(out, request.body, request.length);
+      *length = request.length;
+      return ESP_OK;
+   }
+   inflate_state state = {
+      .in = request.body,
+      .in_length = request.length,
+      .out = out,
+      .out_size = size,
+   };
+   uint8_t gzip = strcasecmp(encoding, "gzip")==0;
+   if(gzip){
+      state.in_position = gzip_header_length(request.body, request.length);
+      if(state.in_position==0){
+         return ESP_ERR_INVALID_SIZE;
+      }
+   }
+   else if(strcasecmp(encoding, "deflate")==0){
+      const uint8_t *header = request.body;
+      if(request.length<6 || (header[0]&0x0f)!=8 || (header[0]>>4)>7
+            || ((header[0]<<8)|header[1])%31!=0 || (header[1]&0x20)){
+         return ESP_ERR_INVALID_SIZE;
+      }
+      state.in_position = 2;
+   }
+   else{
+      return ESP_ERR_NOT_SUPPORTED;
+   }
+   if(inflate(&state)!=ESP_OK){
+      return ESP_ERR_INVALID_SIZE;
+   }
+   const uint8_t *trailer = request.body+state.in_position;
+   if(state.in_position+(gzip ? 8 : 4)!=request.length){
+      return ESP_ERR_INVALID_SIZE;
+   }
+   if(gzip ? read_le32(trailer)!=crc32(out, state.out_length)
+            || read_le32(trailer+4)!=(uint32_t)state.out_length
+         : ((uint32_t)trailer[0]<<24|trailer[1]<<16|trailer[2]<<8|trailer[3])
+            !=adler32(out, state.out_length)){
+      return ESP_ERR_INVALID_CRC;
+   }
+   *length = state.out_length;
+   return ESP_OK;
+}
@@ -0,0 +1,26 @@
+/*
+ * dht.h
+ * @description: Host stand-in for esp-idf-lib's dht component. Readings are
+ *    set with host_dht_set_reading
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_DHT
+#define HOST_DHT
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+typedef enum {
+    DHT_TYPE_DHT11 = 0,
+    DHT_TYPE_AM2301,
+    DHT_TYPE_SI7021
+} dht_sensor_type_t;
+
+esp_err_t dht_read_data(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        int16_t *humidity, int16_t *temperature);
+esp_err_t dht_read_float_data(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        float *humidity, float *temperature);
+
+#endif
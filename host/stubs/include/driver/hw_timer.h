@@ -0,0 +1,21 @@
+/*
+ * hw_timer.h
+ * @description: Host stand-in for the hardware timer driver
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_DRIVER_HW_TIMER
+#define HOST_DRIVER_HW_TIMER
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+typedef void (*hw_timer_callback_t)(void *arg);
+
+esp_err_t hw_timer_init(hw_timer_callback_t callback, void *arg);
+esp_err_t hw_timer_deinit(void);
+esp_err_t hw_timer_alarm_us(uint32_t value, bool reload);
+esp_err_t hw_timer_enable(bool en);
+
+#endif
@@ -0,0 +1,15 @@
+/*
+ * esp_attr.h
+ * @description: Host stand-in for esp_attr. Rtc memory is a section of its
+ *    own, host_rtc_data, so that host programs can keep it through a
+ *    simulated deep sleep
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_ESP_ATTR
+#define HOST_ESP_ATTR
+
+#define RTC_DATA_ATTR __attribute__((section("host_rtc_data")))
+#define IRAM_ATTR
+
+#endif
@@ -0,0 +1,45 @@
+/*
+ * esp_log.h
+ * @description: Host stand-in for esp logging. Messages are formatted into
+ *    a scratch buffer, so their cost shows up in benchmarks, and are only
+ *    printed when HOST_LOG_VERBOSE is set in the environment. Like the sdk,
+ *    calls above LOG_LOCAL_LEVEL are removed at compile time
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_ESP_LOG
+#define HOST_ESP_LOG
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+void host_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+      __attribute__((format(printf, 3, 4)));
+
+#ifndef LOG_LOCAL_LEVEL
+#define LOG_LOCAL_LEVEL ((esp_log_level_t)CONFIG_LOG_DEFAULT_LEVEL)
+#endif
+
+#define ESP_LOG_LEVEL_LOCAL(level, tag, format, ...) do { \
+      if(LOG_LOCAL_LEVEL>=level) host_log_write(level, tag, format, ##__VA_ARGS__); \
+   } while(0)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+#endif
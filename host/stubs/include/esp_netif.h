@@ -0,0 +1,14 @@
+/*
+ * esp_netif.h
+ * @description: Host stand-in for esp_netif
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_ESP_NETIF
+#define HOST_ESP_NETIF
+
+#include "esp_err.h"
+
+esp_err_t esp_netif_init(void);
+
+#endif
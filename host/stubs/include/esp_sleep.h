@@ -0,0 +1,17 @@
+/*
+ * esp_sleep.h
+ * @description: Host stand-in for the deep sleep functions
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_ESP_SLEEP
+#define HOST_ESP_SLEEP
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+void esp_deep_sleep(uint64_t time_in_us);
+bool esp_deep_sleep_set_rf_option(uint8_t option);
+
+#endif
@@ -0,0 +1,24 @@
+/*
+ * esp_system.h
+ * @description: Host stand-in for the system functions of esp_system.h
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_ESP_SYSTEM
+#define HOST_ESP_SYSTEM
+
+#include <stdint.h>
+
+typedef enum {
+   ESP_RST_UNKNOWN = 0,
+   ESP_RST_POWERON,
+   ESP_RST_SW,
+   ESP_RST_DEEPSLEEP,
+} esp_reset_reason_t;
+
+esp_reset_reason_t esp_reset_reason(void);
+void esp_restart(void);
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+
+#endif
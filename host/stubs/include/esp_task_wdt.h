@@ -0,0 +1,15 @@
+/*
+ * esp_task_wdt.h
+ * @description: Host stand-in for the task watchdog
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_ESP_TASK_WDT
+#define HOST_ESP_TASK_WDT
+
+#include "esp_err.h"
+
+esp_err_t esp_task_wdt_init(void);
+void esp_task_wdt_reset(void);
+
+#endif
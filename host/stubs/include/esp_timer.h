@@ -0,0 +1,38 @@
+/*
+ * esp_timer.h
+ * @description: Host stand-in for esp_timer. Callbacks run in a task, as
+ *    with ESP_TIMER_TASK
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_ESP_TIMER
+#define HOST_ESP_TIMER
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef struct esp_timer *esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef enum {
+   ESP_TIMER_TASK,
+} esp_timer_dispatch_t;
+
+typedef struct {
+   esp_timer_cb_t callback;
+   void *arg;
+   esp_timer_dispatch_t dispatch_method;
+   const char *name;
+} esp_timer_create_args_t;
+
+/*
+ * esp_timer_get_time: Microseconds since the program started
+ */
+int64_t esp_timer_get_time(void);
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+
+#endif
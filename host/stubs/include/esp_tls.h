@@ -0,0 +1,17 @@
+/*
+ * esp_tls.h
+ * @description: Host stand-in for esp_tls
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_ESP_TLS
+#define HOST_ESP_TLS
+
+#include "esp_err.h"
+
+typedef struct esp_tls_last_error *esp_tls_error_handle_t;
+
+esp_err_t esp_tls_get_and_clear_last_error(esp_tls_error_handle_t h,
+        int *esp_tls_code, int *esp_tls_flags);
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * esp_wifi.h
+ * @description: Host stand-in for the wifi station and tcpip_adapter
+ *    functions used by the firmware
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_ESP_WIFI
+#define HOST_ESP_WIFI
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_event.h"
+
+typedef enum {
+   WIFI_PS_NONE = 0,
+   WIFI_PS_MIN_MODEM,
+   WIFI_PS_MAX_MODEM,
+} wifi_ps_type_t;
+
+typedef enum {
+   WIFI_MODE_NULL = 0,
+   WIFI_MODE_STA,
+} wifi_mode_t;
+
+typedef enum {
+   ESP_IF_WIFI_STA = 0,
+} wifi_interface_t;
+
+typedef enum {
+   WIFI_AUTH_OPEN = 0,
+   WIFI_AUTH_WPA2_PSK = 3,
+} wifi_auth_mode_t;
+
+typedef struct {
+   int8_t rssi;
+   wifi_auth_mode_t authmode;
+} wifi_scan_threshold_t;
+
+typedef struct {
+   uint8_t ssid[32];
+   uint8_t password[64];
+   bool bssid_set;
+   uint8_t bssid[6];
+   uint8_t channel;
+   wifi_scan_threshold_t threshold;
+} wifi_sta_config_t;
+
+typedef union {
+   wifi_sta_config_t sta;
+} wifi_config_t;
+
+typedef struct {
+   int magic;
+} wifi_init_config_t;
+
+#define WIFI_INIT_CONFIG_DEFAULT() { 0 }
+
+extern esp_event_base_t WIFI_EVENT;
+extern esp_event_base_t IP_EVENT;
+
+typedef enum {
+   WIFI_EVENT_STA_START = 2,
+   WIFI_EVENT_STA_STOP,
+   WIFI_EVENT_STA_CONNECTED,
+   WIFI_EVENT_STA_DISCONNECTED,
+} wifi_event_t;
+
+typedef enum {
+   IP_EVENT_STA_GOT_IP = 0,
+   IP_EVENT_STA_LOST_IP,
+} ip_event_t;
+
+typedef struct {
+   uint8_t ssid[32];
+   uint8_t ssid_len;
+   uint8_t bssid[6];
+   uint8_t channel;
+   wifi_auth_mode_t authmode;
+} wifi_event_sta_connected_t;
+
+typedef struct {
+   uint8_t ssid[32];
+   uint8_t ssid_len;
+   uint8_t bssid[6];
+   uint8_t reason;
+} wifi_event_sta_disconnected_t;
+
+typedef struct {
+   uint32_t addr;
+} ip4_addr_t;
+
+typedef struct {
+   ip4_addr_t ip;
+   ip4_addr_t netmask;
+   ip4_addr_t gw;
+} tcpip_adapter_ip_info_t;
+
+typedef struct {
+   union {
+      ip4_addr_t ip4;
+   } u_addr;
+} ip_addr_t;
+
+typedef struct {
+   ip_addr_t ip;
+} tcpip_adapter_dns_info_t;
+
+typedef struct {
+   int if_index;
+   tcpip_adapter_ip_info_t ip_info;
+   bool ip_changed;
+} ip_event_got_ip_t;
+
+typedef enum {
+   TCPIP_ADAPTER_IF_STA = 0,
+} tcpip_adapter_if_t;
+
+typedef enum {
+   TCPIP_ADAPTER_DNS_MAIN = 0,
+} tcpip_adapter_dns_type_t;
+
+void tcpip_adapter_init(void);
+esp_err_t tcpip_adapter_dhcpc_start(tcpip_adapter_if_t tcpip_if);
+esp_err_t tcpip_adapter_dhcpc_stop(tcpip_adapter_if_t tcpip_if);
+esp_err_t tcpip_adapter_set_ip_info(tcpip_adapter_if_t tcpip_if, const tcpip_adapter_ip_info_t *ip_info);
+esp_err_t tcpip_adapter_get_ip_info(tcpip_adapter_if_t tcpip_if, tcpip_adapter_ip_info_t *ip_info);
+esp_err_t tcpip_adapter_set_dns_info(tcpip_adapter_if_t tcpip_if, tcpip_adapter_dns_type_t type,
+        tcpip_adapter_dns_info_t *dns);
+esp_err_t tcpip_adapter_get_dns_info(tcpip_adapter_if_t tcpip_if, tcpip_adapter_dns_type_t type,
+        tcpip_adapter_dns_info_t *dns);
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config);
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode);
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf);
+esp_err_t esp_wifi_start(void);
+esp_err_t esp_wifi_stop(void);
+esp_err_t esp_wifi_connect(void);
+esp_err_t esp_wifi_disconnect(void);
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type);
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+        esp_event_handler_t event_handler, void *event_handler_arg);
+esp_err_t esp_event_handler_unregister(esp_event_base_t event_base, int32_t event_id,
+        esp_event_handler_t event_handler);
+
+#endif
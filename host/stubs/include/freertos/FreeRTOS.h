@@ -0,0 +1,40 @@
+/*
+ * FreeRTOS.h
+ * @description: Host stand-in for the FreeRTOS types used by the firmware
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_FREERTOS
+#define HOST_FREERTOS
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_err.h"
+
+typedef uint32_t TickType_t;
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 10
+#define pdMS_TO_TICKS(ms) ((TickType_t)((ms) / portTICK_PERIOD_MS))
+
+// Host programs run one task of the firmware at a time, and interrupts
+// only inside calls to the sdk stand-ins
+#define portENTER_CRITICAL()
+#define portEXIT_CRITICAL()
+#define portYIELD_FROM_ISR()
+
+#define BIT0 0x00000001
+#define BIT1 0x00000002
+#define BIT2 0x00000004
+#define BIT3 0x00000008
+
+#endif
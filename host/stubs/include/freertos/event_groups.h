@@ -0,0 +1,21 @@
+/*
+ * event_groups.h
+ * @description: Host stand-in for FreeRTOS event groups
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_FREERTOS_EVENT_GROUPS
+#define HOST_FREERTOS_EVENT_GROUPS
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_event_group *EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+EventGroupHandle_t xEventGroupCreate(void);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits,
+        BaseType_t clear_on_exit, BaseType_t wait_for_all, TickType_t ticks);
+void vEventGroupDelete(EventGroupHandle_t group);
+
+#endif
@@ -0,0 +1,20 @@
+/*
+ * semphr.h
+ * @description: Host stand-in for FreeRTOS binary semaphores
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_FREERTOS_SEMPHR
+#define HOST_FREERTOS_SEMPHR
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_semaphore *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *higher_priority_task_woken);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+
+#endif
@@ -0,0 +1,37 @@
+/*
+ * task.h
+ * @description: Host stand-in for FreeRTOS task functions and task
+ *    notifications
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_FREERTOS_TASK
+#define HOST_FREERTOS_TASK
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+typedef enum {
+   eNoAction = 0,
+   eSetBits,
+   eIncrement,
+   eSetValueWithOverwrite,
+   eSetValueWithoutOverwrite,
+} eNotifyAction;
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth,
+        void *parameters, UBaseType_t priority, TaskHandle_t *created_task);
+void vTaskDelete(TaskHandle_t task);
+TickType_t xTaskGetTickCount(void);
+void vTaskDelay(TickType_t ticks);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action);
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action,
+        BaseType_t *higher_priority_task_woken);
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit,
+        uint32_t *value, TickType_t ticks);
+
+#endif
@@ -0,0 +1,252 @@
+/*
+ * host_stubs.h
+ * @description: Controls and counters of the host stand-ins. Lets host
+ *    programs inject sensor readings and inspect what the firmware sent
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_STUBS
+#define HOST_STUBS
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+
+/*
+ * host_stub_counters: Calls seen by the stand-ins
+ *    - mqtt_publishes: uint32_t. Calls to esp_mqtt_client_publish
+ *    - mqtt_bytes: uint32_t. Payload bytes published
+ *    - http_inits: uint32_t. Calls to esp_http_client_init
+ *    - http_connections: uint32_t. Connections opened by
+ *       esp_http_client_perform. Each one is a tcp + tls handshake on
+ *       the device
+ *    - http_performs: uint32_t. Calls to esp_http_client_perform
+ *    - http_bytes: uint32_t. Post body bytes sent
+ *    - http_wire_bytes: uint32_t. Bytes of posts, with their request line
+ *       and headers. Without tls records and responses
+ *    - wdt_resets: uint32_t. Calls to esp_task_wdt_reset
+ *    - log_lines: uint32_t. Log lines formatted
+ *    - dht_reads: uint32_t. Calls to dht_read_data and dht_read_float_data
+ *    - flash_reads: uint32_t. Calls to esp_partition_read
+ *    - flash_writes: uint32_t. Calls to esp_partition_write
+ *    - flash_erases: uint32_t. Sectors erased
+ *    - nvs_writes: uint32_t. Calls to nvs_set_blob
+ *    - delay_us: uint64_t. Time waited in vTaskDelay. Delays don't sleep,
+ *       they move the clock of xTaskGetTickCount and esp_timer_get_time
+ */
+typedef struct {
+   uint32_t mqtt_publishes;
+   uint32_t mqtt_bytes;
+   uint32_t http_inits;
+   uint32_t http_connections;
+   uint32_t http_performs;
+   uint32_t http_bytes;
+   uint32_t http_wire_bytes;
+   uint32_t wdt_resets;
+   uint32_t log_lines;
+   uint32_t dht_reads;
+   uint32_t flash_reads;
+   uint32_t flash_writes;
+   uint32_t flash_erases;
+   uint32_t nvs_writes;
+   uint64_t delay_us;
+} host_stub_counters;
+
+extern host_stub_counters host_counters;
+
+/*
+ * host_stubs_reset: Clear counters and recorded messages
+ */
+void host_stubs_reset(void);
+
+/*
+ * host_dht_set_reading: Set values returned by dht_read_float_data
+ *    Arguments:
+ *       - temperature: float. Temperature to return
+ *       - humidity: float. Humidity to return
+ *       - result: esp_err_t. Return code of the read
+ */
+void host_dht_set_reading(float temperature, float humidity, esp_err_t result);
+
+/*
+ * host_dht_fail_next: Make the next dht reads fail
+ *    Arguments:
+ *       - count: uint32_t. Reads that will fail
+ *       - error: esp_err_t. Return code of the failed reads
+ */
+void host_dht_fail_next(uint32_t count, esp_err_t error);
+
+/*
+ * host_dht_queue_reading: Queue values for the next good dht read, after
+ *    the failures of host_dht_fail_next. Reads go back to the values of
+ *    host_dht_set_reading once the queue is used
+ *    Arguments:
+ *       - temperature: float. Temperature to return
+ *       - humidity: float. Humidity to return
+ */
+#define HOST_DHT_MAX_QUEUED 8
+void host_dht_queue_reading(float temperature, float humidity);
+
+/*
+ * host_flash_attach: Back the data partition with a file. A new file is
+ *    created erased
+ *    Arguments:
+ *       - label: const char*. Label of the partition
+ *       - path: const char*. File, NULL for a temporary one
+ *       - size: uint32_t. Size of the partition, a multiple of 4096
+ */
+esp_err_t host_flash_attach(const char* label, const char* path, uint32_t size);
+
+/*
+ * host_nvs_clear: Erase every namespace of nvs
+ */
+void host_nvs_clear(void);
+
+/*
+ * host_ota_load: Put an image in an app slot, the rest of it erased
+ *    Arguments:
+ *       - label: const char*. Label of the slot, "ota_0" or "ota_1"
+ *       - image: const uint8_t*. Image
+ *       - size: size_t. Size of image
+ */
+esp_err_t host_ota_load(const char* label, const uint8_t* image, size_t size);
+
+/*
+ * host_ota_image: Contents of an app slot
+ *    Arguments:
+ *       - label: const char*. Label of the slot
+ *    Returns:
+ *       - data: const uint8_t*. Whole slot, NULL for an unknown label
+ */
+const uint8_t* host_ota_image(const char* label);
+
+/*
+ * host_ota_boot: Run the boot slot, as a restart does
+ */
+void host_ota_boot(void);
+
+/*
+ * host_ota_find: App slot of a label, first slot for NULL
+ */
+const esp_partition_t* host_ota_find(const char* label);
+
+/*
+ * host_ota_read: Read an app slot. Used by esp_partition_read
+ */
+esp_err_t host_ota_read(const esp_partition_t* partition, size_t offset, void* dst, size_t size);
+
+/*
+ * host_http_set_response: Set the response of the requests opened with
+ *    esp_http_client_open. Responses set for a url are cleared. The body
+ *    isn't copied
+ *    Arguments:
+ *       - status: int. Http status
+ *       - body: const uint8_t*. Body
+ *       - length: size_t. Length of body
+ */
+void host_http_set_response(int status, const uint8_t *body, size_t length);
+
+/*
+ * host_http_set_url_response: Set the response of the requests opened
+ *    with esp_http_client_open for a url. Other urls get the response of
+ *    host_http_set_response. The url and body aren't copied
+ *    Arguments:
+ *       - url: const char*. Url of the requests
+ *       - status: int. Http status
+ *       - body: const uint8_t*. Body
+ *       - length: size_t. Length of body
+ */
+#define HOST_HTTP_MAX_URL_RESPONSES 4
+void host_http_set_url_response(const char *url, int status, const uint8_t *body, size_t length);
+
+/*
+ * host_http_fail_next: Make the next calls to esp_http_client_perform fail
+ *    as if the server had closed the connection
+ *    Arguments:
+ *       - count: uint32_t. Calls that will fail
+ */
+void host_http_fail_next(uint32_t count);
+
+/*
+ * host_mqtt_ack: Deliver MQTT_EVENT_PUBLISHED for the oldest QoS 1
+ *    publishes, to the handler registered on the client
+ *    Arguments:
+ *       - count: uint32_t. Acks to deliver
+ *    Returns:
+ *       - acked: uint32_t. Acks delivered
+ */
+uint32_t host_mqtt_ack(uint32_t count);
+
+/*
+ * host_mqtt_deliver: Deliver MQTT_EVENT_DATA to the handler registered on
+ *    the client, split in fragments like esp-mqtt does with messages
+ *    larger than its buffer
+ *    Arguments:
+ *       - client: esp_mqtt_client_handle_t. Mqtt client
+ *       - topic: const char*. Topic
+ *       - data: const char*. Data
+ *       - length: int. Length of data
+ *       - fragment_size: int. Largest fragment
+ *       - msg_id: int. Message id, 0 for QoS 0
+ */
+struct esp_mqtt_client;
+void host_mqtt_deliver(struct esp_mqtt_client *client, const char *topic,
+        const char *data, int length, int fragment_size, int msg_id);
+
+/*
+ * host_last_mqtt_payload: Last payload published
+ *    Returns:
+ *       - payload: const char*. Null terminated copy of the payload
+ */
+const char* host_last_mqtt_payload(void);
+
+/*
+ * host_last_mqtt_topic: Topic of the last publish
+ */
+const char* host_last_mqtt_topic(void);
+
+/*
+ * host_last_http_body: Body of the last http post
+ */
+const char* host_last_http_body(void);
+
+/*
+ * host_http_request: Last http post, as the server gets it
+ *    - url: const char*. Url
+ *    - content_type: const char*. Content-Type header
+ *    - content_encoding: const char*. Content-Encoding header, NULL if
+ *       there is none
+ *    - body: const uint8_t*. Body as sent, the first HOST_HTTP_MAX_BODY
+ *       bytes
+ *    - length: size_t. Length of body
+ */
+typedef struct {
+   const char *url;
+   const char *content_type;
+   const char *content_encoding;
+   const uint8_t *body;
+   size_t length;
+} host_http_request;
+
+/*
+ * host_last_http_request: Get the last http post
+ */
+void host_last_http_request(host_http_request *request);
+
+/*
+ * host_http_decode_body: Decode the body of the last http post by its
+ *    Content-Encoding, as a server does. gzip and deflate bodies are
+ *    inflated and their checks verified. See http_server_stub.c
+ *    Arguments:
+ *       - out: uint8_t*. Decoded body
+ *       - size: size_t. Size of out
+ *       - length: size_t*. Length of the decoded body
+ *    Returns:
+ *       - ESP_OK, ESP_ERR_NOT_SUPPORTED for an unknown encoding,
+ *          ESP_ERR_INVALID_CRC if a check doesn't match or
+ *          ESP_ERR_INVALID_SIZE if the body is corrupt or doesn't fit out
+ */
+esp_err_t host_http_decode_body(uint8_t *out, size_t size, size_t *length);
+
+#endif
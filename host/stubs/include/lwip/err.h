@@ -0,0 +1,10 @@
+/*
+ * err.h
+ * @description: Host stand-in for lwip/err.h. Nothing of it is used
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_LWIP_ERR
+#define HOST_LWIP_ERR
+
+#endif
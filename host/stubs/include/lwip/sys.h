@@ -0,0 +1,10 @@
+/*
+ * sys.h
+ * @description: Host stand-in for lwip/sys.h. Nothing of it is used
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_LWIP_SYS
+#define HOST_LWIP_SYS
+
+#endif
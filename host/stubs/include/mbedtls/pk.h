@@ -0,0 +1,33 @@
+/*
+ * pk.h
+ * @description: Host stand-in for the public keys of mbedtls, the 2.x api
+ *    of the sdk. Pem keys are parsed and signatures checked with the
+ *    libcrypto of the host
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_MBEDTLS_PK
+#define HOST_MBEDTLS_PK
+
+#include <stddef.h>
+
+#define MBEDTLS_ERR_PK_KEY_INVALID_FORMAT -0x3D00
+#define MBEDTLS_ERR_PK_BAD_INPUT_DATA -0x3E80
+#define MBEDTLS_ERR_ECP_VERIFY_FAILED -0x4E00
+
+typedef enum {
+    MBEDTLS_MD_NONE = 0,
+    MBEDTLS_MD_SHA256 = 6,
+} mbedtls_md_type_t;
+
+typedef struct {
+    void *key;
+} mbedtls_pk_context;
+
+void mbedtls_pk_init(mbedtls_pk_context *ctx);
+void mbedtls_pk_free(mbedtls_pk_context *ctx);
+int mbedtls_pk_parse_public_key(mbedtls_pk_context *ctx, const unsigned char *key, size_t keylen);
+int mbedtls_pk_verify(mbedtls_pk_context *ctx, mbedtls_md_type_t md_alg,
+        const unsigned char *hash, size_t hash_len, const unsigned char *sig, size_t sig_len);
+
+#endif
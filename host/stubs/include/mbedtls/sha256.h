@@ -0,0 +1,24 @@
+/*
+ * sha256.h
+ * @description: Host stand-in for the sha256 of mbedtls, the 2.x api of
+ *    the sdk. Computed with the libcrypto of the host
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_MBEDTLS_SHA256
+#define HOST_MBEDTLS_SHA256
+
+#include <stddef.h>
+
+typedef struct {
+    void *digest;
+} mbedtls_sha256_context;
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx);
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx);
+int mbedtls_sha256_starts_ret(mbedtls_sha256_context *ctx, int is224);
+int mbedtls_sha256_update_ret(mbedtls_sha256_context *ctx, const unsigned char *input,
+        size_t ilen);
+int mbedtls_sha256_finish_ret(mbedtls_sha256_context *ctx, unsigned char output[32]);
+
+#endif
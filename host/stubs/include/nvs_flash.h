@@ -0,0 +1,14 @@
+/*
+ * nvs_flash.h
+ * @description: Host stand-in for the nvs initialization
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_NVS_FLASH
+#define HOST_NVS_FLASH
+
+#include "nvs.h"
+
+esp_err_t nvs_flash_init(void);
+
+#endif
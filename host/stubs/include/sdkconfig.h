@@ -0,0 +1,18 @@
+/*
+ * sdkconfig.h
+ * @description: Host stand-in for the options generated from sdkconfig.
+ *    The production profile is built with -DCONFIG_IOT_PRODUCTION=1, see
+ *    PROFILE in host/Makefile
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_SDKCONFIG
+#define HOST_SDKCONFIG
+
+// CONFIG_LOG_DEFAULT_LEVEL_INFO
+#define CONFIG_LOG_DEFAULT_LEVEL 3
+// Tickless idle, the sim doesn't wake the cpu for the tick with it
+#define CONFIG_PM_ENABLE 1
+#define CONFIG_ENABLE_FREERTOS_SLEEP 1
+
+#endif
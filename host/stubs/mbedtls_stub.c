@@ -0,0 +1,81 @@
+/*
+ * mbedtls_stub.c
+ * @description: Host stand-in for the sha256 and public keys of mbedtls,
+ *    on the libcrypto of the host, so signatures made with the openssl
+ *    command line are checked as on the device
+ * @author: @Retrocamara42
+ *
+ */
+#include <string.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+
+#include "mbedtls/sha256.h"
+#include "mbedtls/pk.h"
+
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx){
+   ctx->digest = EVP_MD_CTX_new();
+}
+
+
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx){
+   EVP_MD_CTX_free(ctx->digest);
+   ctx->digest = NULL;
+}
+
+
+int mbedtls_sha256_starts_ret(mbedtls_sha256_context *ctx, int is224){
+   return EVP_DigestInit_ex(ctx->digest, is224 ? EVP_sha224() : EVP_sha256(), NULL)==1 ? 0 : -1;
+}
+
+
+int mbedtls_sha256_update_ret(mbedtls_sha256_context *ctx, const unsigned char *input,
+        size_t ilen){
+   return EVP_DigestUpdate(ctx->digest, input, ilen)==1 ? 0 : -1;
+}
+
+
+int mbedtls_sha256_finish_ret(mbedtls_sha256_context *ctx, unsigned char output[32]){
+   return EVP_DigestFinal_ex(ctx->digest, output, NULL)==1 ? 0 : -1;
+}
+
+
+void mbedtls_pk_init(mbedtls_pk_context *ctx){
+   ctx->key = NULL;
+}
+
+
+void mbedtls_pk_free(mbedtls_pk_context *ctx){
+   EVP_PKEY_free(ctx->key);
+   ctx->key = NULL;
+}
+
+
+/*
+ * mbedtls_pk_parse_public_key: As mbedtls, a pem key has its terminating
+ *    null in keylen
+ */
+int mbedtls_pk_parse_public_key(mbedtls_pk_context *ctx, const unsigned char *key, size_t keylen){
+   if(keylen==0 || key[keylen-1]!='\0'){
+      return MBEDTLS_ERR_PK_KEY_INVALID_FORMAT;
+   }
+   BIO *bio = BIO_new_mem_buf(key, (int)keylen-1);
+   ctx->key = bio!=NULL ? PEM_read_bio_PUBKEY(bio, NULL, NULL, NULL) : NULL;
+   BIO_free(bio);
+   return ctx->key!=NULL ? 0 : MBEDTLS_ERR_PK_KEY_INVALID_FORMAT;
+}
+
+
+int mbedtls_pk_verify(mbedtls_pk_context *ctx, mbedtls_md_type_t md_alg,
+        const unsigned char *hash, size_t hash_len, const unsigned char *sig, size_t sig_len){
+   if(ctx->key==NULL || md_alg!=MBEDTLS_MD_SHA256){
+      return MBEDTLS_ERR_PK_BAD_INPUT_DATA;
+   }
+   EVP_PKEY_CTX *verify = EVP_PKEY_CTX_new(ctx->key, NULL);
+   int ok = verify!=NULL && EVP_PKEY_verify_init(verify)==1
+      && EVP_PKEY_CTX_set_signature_md(verify, EVP_sha256())==1
+      && EVP_PKEY_verify(verify, sig, sig_len, hash, hash_len)==1;
+   EVP_PKEY_CTX_free(verify);
+   return ok ? 0 : MBEDTLS_ERR_ECP_VERIFY_FAILED;
+}
@@ -0,0 +1,157 @@
+/*
+ * mqtt_client_stub.c
+ * @description: Host stand-in for esp-mqtt. Records publishes
+ * @author: @Retrocamara42
+ *
+ */
+#include <stdlib.h>
+
+#include "host_stubs.h"
+#include "mqtt_client.h"
+
+#define HOST_MQTT_MAX_PAYLOAD 2048
+#define HOST_MQTT_MAX_TOPIC 128
+// QoS 1 publishes waiting for host_mqtt_ack
+#define HOST_MQTT_MAX_PENDING 64
+
+struct esp_mqtt_client {
+   esp_mqtt_client_config_t config;
+   esp_event_handler_t event_handler;
+   void *event_handler_arg;
+   int next_msg_id;
+};
+
+static char last_payload[HOST_MQTT_MAX_PAYLOAD+1];
+static char last_topic[HOST_MQTT_MAX_TOPIC+1];
+static esp_mqtt_client_handle_t pending_client;
+static int pending_acks[HOST_MQTT_MAX_PENDING];
+static uint32_t pending_head=0;
+static uint32_t pending_count=0;
+
+
+const char* host_last_mqtt_payload(void){
+   return last_payload;
+}
+
+
+const char* host_last_mqtt_topic(void){
+   return last_topic;
+}
+
+
+uint32_t host_mqtt_ack(uint32_t count){
+   uint32_t acked=0;
+   while(acked<count && pending_count>0){
+      esp_mqtt_event_t event = {
+         .event_id = MQTT_EVENT_PUBLISHED,
+         .client = pending_client,
+         .msg_id = pending_acks[pending_head],
+      };
+      pending_head=(pending_head+1)%HOST_MQTT_MAX_PENDING;
+      pending_count--;
+      if(pending_client->event_handler){
+         pending_client->event_handler(pending_client->event_handler_arg,
+            "MQTT_EVENTS", MQTT_EVENT_PUBLISHED, &event);
+      }
+      acked++;
+   }
+   return acked;
+}
+
+
+void host_mqtt_deliver(esp_mqtt_client_handle_t client, const char *topic,
+        const char *data, int length, int fragment_size, int msg_id){
+   int offset=0;
+   do{
+      int data_len = length-offset<fragment_size ? length-offset : fragment_size;
+      // Topic only comes with the first fragment, as in esp-mqtt
+      esp_mqtt_event_t event = {
+         .event_id = MQTT_EVENT_DATA,
+         .client = client,
+         .data = (char*)data+offset,
+         .data_len = data_len,
+         .total_data_len = length,
+         .current_data_offset = offset,
+         .topic = offset==0 ? (char*)topic : NULL,
+         .topic_len = offset==0 ? (int)strlen(topic) : 0,
+         .msg_id = msg_id,
+      };
+      if(client->event_handler){
+         client->event_handler(client->event_handler_arg, "MQTT_EVENTS", MQTT_EVENT_DATA, &event);
+      }
+      offset+=data_len;
+   }while(offset<length);
+}
+
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config){
+   esp_mqtt_client_handle_t client = calloc(1, sizeof(struct esp_mqtt_client));
+   if(client){
+      client->config=*config;
+      client->next_msg_id=1;
+   }
+   return client;
+}
+
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client){
+   return ESP_OK;
+}
+
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client){
+   return ESP_OK;
+}
+
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client){
+   free(client);
+   return ESP_OK;
+}
+
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client,
+        esp_mqtt_event_id_t event, esp_event_handler_t event_handler,
+        void *event_handler_arg){
+   client->event_handler=event_handler;
+   client->event_handler_arg=event_handler_arg;
+   return ESP_OK;
+}
+
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos){
+   return client ? client->next_msg_id++ : -1;
+}
+
+
+int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *topic){
+   return client ? client->next_msg_id++ : -1;
+}
+
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic,
+        const char *data, int len, int qos, int retain){
+   if(len==0){
+      len=strlen(data);
+   }
+   size_t copy_len = len<HOST_MQTT_MAX_PAYLOAD ? (size_t)len : HOST_MQTT_MAX_PAYLOAD;
+   memcpy(last_payload, data, copy_len);
+   last_payload[copy_len]='\0';
+   strncpy(last_topic, topic, HOST_MQTT_MAX_TOPIC);
+   host_counters.mqtt_publishes++;
+   host_counters.mqtt_bytes+=len;
+   if(client==NULL){
+      return 0;
+   }
+   if(qos==0){
+      return 0;
+   }
+   // Acks beyond HOST_MQTT_MAX_PENDING are lost, as with a broker that
+   // doesn't answer
+   if(pending_count<HOST_MQTT_MAX_PENDING){
+      pending_client=client;
+      pending_acks[(pending_head+pending_count)%HOST_MQTT_MAX_PENDING]=client->next_msg_id;
+      pending_count++;
+   }
+   return client->next_msg_id++;
+}
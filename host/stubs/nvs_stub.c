@@ -0,0 +1,145 @@
+/*
+ * nvs_stub.c
+ * @description: Host stand-in for nvs. Blobs are kept in memory, commits
+ *    do nothing. host_nvs_clear erases everything, as a new flash
+ * @author: @Retrocamara42
+ *
+ */
+#include <string.h>
+
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "host_stubs.h"
+
+#define HOST_NVS_MAX_ENTRIES 16
+#define HOST_NVS_MAX_NAMESPACES 8
+#define HOST_NVS_MAX_BLOB 512
+#define HOST_NVS_MAX_NAME 16
+
+/*
+ * host_nvs_entry: Blob kept in nvs
+ */
+typedef struct {
+   uint8_t used;
+   uint8_t space;
+   char key[HOST_NVS_MAX_NAME];
+   uint32_t length;
+   uint8_t data[HOST_NVS_MAX_BLOB];
+} host_nvs_entry;
+
+static char nvs_namespaces[HOST_NVS_MAX_NAMESPACES][HOST_NVS_MAX_NAME];
+static host_nvs_entry nvs_entries[HOST_NVS_MAX_ENTRIES];
+
+
+void host_nvs_clear(void){
+   memset(nvs_namespaces, 0, sizeof nvs_namespaces);
+   memset(nvs_entries, 0, sizeof nvs_entries);
+}
+
+
+esp_err_t nvs_flash_init(void){
+   return ESP_OK;
+}
+
+
+/*
+ * nvs_find: Entry of a key
+ *    Returns:
+ *       - entry: host_nvs_entry*. NULL if the key isn't set
+ */
+static host_nvs_entry* nvs_find(nvs_handle handle, const char *key){
+   for(uint8_t i=0; i<HOST_NVS_MAX_ENTRIES; i++){
+      if(nvs_entries[i].used && nvs_entries[i].space==handle
+            && strncmp(nvs_entries[i].key, key, HOST_NVS_MAX_NAME)==0){
+         return &nvs_entries[i];
+      }
+   }
+   return NULL;
+}
+
+
+// Handles are the index of the namespace plus one
+esp_err_t nvs_open(const char *name, nvs_open_mode open_mode, nvs_handle *out_handle){
+   for(uint8_t i=0; i<HOST_NVS_MAX_NAMESPACES; i++){
+      if(strncmp(nvs_namespaces[i], name, HOST_NVS_MAX_NAME)==0){
+         *out_handle=i+1;
+         return ESP_OK;
+      }
+   }
+   // Read only opens of a namespace never written fail, as in the sdk
+   if(open_mode==NVS_READONLY){
+      return ESP_ERR_NVS_NOT_FOUND;
+   }
+   for(uint8_t i=0; i<HOST_NVS_MAX_NAMESPACES; i++){
+      if(nvs_namespaces[i][0]=='\0'){
+         strncpy(nvs_namespaces[i], name, HOST_NVS_MAX_NAME-1);
+         *out_handle=i+1;
+         return ESP_OK;
+      }
+   }
+   return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+}
+
+
+esp_err_t nvs_set_blob(nvs_handle handle, const char *key, const void *value, size_t length){
+   if(handle==0 || handle>HOST_NVS_MAX_NAMESPACES){
+      return ESP_ERR_NVS_INVALID_HANDLE;
+   }
+   if(length>HOST_NVS_MAX_BLOB){
+      return ESP_ERR_NVS_INVALID_LENGTH;
+   }
+   host_nvs_entry *entry = nvs_find(handle, key);
+   for(uint8_t i=0; i<HOST_NVS_MAX_ENTRIES && entry==NULL; i++){
+      if(!nvs_entries[i].used){
+         entry=&nvs_entries[i];
+      }
+   }
+   if(entry==NULL){
+      return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+   }
+   host_counters.nvs_writes++;
+   entry->used=1;
+   entry->space=handle;
+   strncpy(entry->key, key, HOST_NVS_MAX_NAME-1);
+   entry->length=length;
+   memcpy(entry->data, value, length);
+   return ESP_OK;
+}
+
+
+esp_err_t nvs_get_blob(nvs_handle handle, const char *key, void *out_value, size_t *length){
+   host_nvs_entry *entry = nvs_find(handle, key);
+   if(entry==NULL){
+      return ESP_ERR_NVS_NOT_FOUND;
+   }
+   if(out_value==NULL){
+      *length=entry->length;
+      return ESP_OK;
+   }
+   if(*length<entry->length){
+      *length=entry->length;
+      return ESP_ERR_NVS_INVALID_LENGTH;
+   }
+   memcpy(out_value, entry->data, entry->length);
+   *length=entry->length;
+   return ESP_OK;
+}
+
+
+esp_err_t nvs_erase_key(nvs_handle handle, const char *key){
+   host_nvs_entry *entry = nvs_find(handle, key);
+   if(entry==NULL){
+      return ESP_ERR_NVS_NOT_FOUND;
+   }
+   entry->used=0;
+   return ESP_OK;
+}
+
+
+esp_err_t nvs_commit(nvs_handle handle){
+   return ESP_OK;
+}
+
+
+void nvs_close(nvs_handle handle){
+}
@@ -0,0 +1,250 @@
+/*
+ * task_stubs.c
+ * @description: Host stand-ins for the FreeRTOS task functions, task
+ *    notifications, binary semaphores, esp_timer and the task watchdog.
+ *    Host programs run the firmware in a single thread, delays move a
+ *    virtual clock instead of sleeping. Waits for a notification jump to the
+ *    next armed timer. A restart ends the host program, it can't boot again
+ * @author: @Retrocamara42
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "host_stubs.h"
+#include "esp_system.h"
+#include "esp_task_wdt.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#define HOST_MAX_TIMERS 4
+
+/*
+ * esp_timer: Timer, armed if deadline_us isn't -1
+ */
+struct esp_timer {
+   esp_timer_create_args_t args;
+   int64_t deadline_us;
+};
+
+// Time added by vTaskDelay to the host clock, in us
+static int64_t virtual_delay_us=0;
+static struct esp_timer timers[HOST_MAX_TIMERS];
+static uint8_t timer_count=0;
+// Notification of the single task
+static uint32_t notify_value=0;
+static uint8_t notified=0;
+
+
+esp_err_t esp_task_wdt_init(void){
+   return ESP_OK;
+}
+
+
+void esp_task_wdt_reset(void){
+   host_counters.wdt_resets++;
+}
+
+
+void esp_restart(void){
+   fprintf(stderr, "esp_restart\n");
+   exit(1);
+}
+
+
+TickType_t xTaskGetTickCount(void){
+   return (TickType_t)(esp_timer_get_time()/1000/portTICK_PERIOD_MS);
+}
+
+
+// Delays don't sleep, so that benchmarks don't wait for sensor intervals
+void vTaskDelay(TickType_t ticks){
+   int64_t delay_us = (int64_t)ticks*portTICK_PERIOD_MS*1000;
+   virtual_delay_us += delay_us;
+   host_counters.delay_us += delay_us;
+}
+
+
+int64_t esp_timer_get_time(void){
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (int64_t)now.tv_sec*1000000 + now.tv_nsec/1000 + virtual_delay_us;
+}
+
+
+// Host has a single task, with the stack and heap of the device
+TaskHandle_t xTaskGetCurrentTaskHandle(void){
+   return (TaskHandle_t)&host_counters;
+}
+
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task){
+   return 2048;
+}
+
+
+/******************* NOTIFICATIONS *****************************************/
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action){
+   switch(action){
+      case eSetBits: notify_value|=value; break;
+      case eIncrement: notify_value++; break;
+      case eSetValueWithoutOverwrite:
+         if(notified){
+            return pdFAIL;
+         }
+         notify_value=value;
+         break;
+      case eSetValueWithOverwrite: notify_value=value; break;
+      default: break;
+   }
+   notified=1;
+   return pdPASS;
+}
+
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action,
+        BaseType_t *higher_priority_task_woken){
+   if(higher_priority_task_woken!=NULL){
+      *higher_priority_task_woken=pdFALSE;
+   }
+   return xTaskNotify(task, value, action);
+}
+
+
+/*
+ * next_timer: Armed timer that expires first
+ */
+static struct esp_timer* next_timer(void){
+   struct esp_timer *next=NULL;
+   for(uint8_t i=0; i<timer_count; i++){
+      if(timers[i].deadline_us>=0 && (next==NULL || timers[i].deadline_us<next->deadline_us)){
+         next=&timers[i];
+      }
+   }
+   return next;
+}
+
+
+// Nothing else runs while the task waits, so the clock jumps to the timers
+// that expire before the timeout
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit,
+        uint32_t *value, TickType_t ticks){
+   if(!notified){
+      notify_value&=~clear_on_entry;
+   }
+   int64_t start_us = esp_timer_get_time();
+   while(!notified){
+      struct esp_timer *timer = next_timer();
+      int64_t waited_us = esp_timer_get_time()-start_us;
+      if(timer==NULL || (ticks!=portMAX_DELAY
+            && timer->deadline_us-start_us>(int64_t)ticks*portTICK_PERIOD_MS*1000)){
+         if(ticks!=portMAX_DELAY){
+            vTaskDelay(ticks-waited_us/1000/portTICK_PERIOD_MS);
+         }
+         break;
+      }
+      int64_t now_us = esp_timer_get_time();
+      if(timer->deadline_us>now_us){
+         virtual_delay_us+=timer->deadline_us-now_us;
+      }
+      timer->deadline_us=-1;
+      timer->args.callback(timer->args.arg);
+   }
+   if(!notified){
+      return pdFALSE;
+   }
+   if(value!=NULL){
+      *value=notify_value;
+   }
+   notify_value&=~clear_on_exit;
+   notified=0;
+   return pdTRUE;
+}
+
+
+/******************* SEMAPHORES ********************************************/
+struct host_semaphore {
+   uint8_t count;
+};
+
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void){
+   return calloc(1, sizeof(struct host_semaphore));
+}
+
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore){
+   if(semaphore->count>0){
+      return pdFALSE;
+   }
+   semaphore->count=1;
+   return pdTRUE;
+}
+
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *higher_priority_task_woken){
+   if(higher_priority_task_woken!=NULL){
+      *higher_priority_task_woken=pdFALSE;
+   }
+   return xSemaphoreGive(semaphore);
+}
+
+
+// Nothing else runs while the task waits, so a semaphore not given yet
+// times out
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks){
+   if(semaphore->count>0){
+      semaphore->count=0;
+      return pdTRUE;
+   }
+   if(ticks!=portMAX_DELAY){
+      vTaskDelay(ticks);
+   }
+   return pdFALSE;
+}
+
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore){
+   free(semaphore);
+}
+
+
+/******************* ESP TIMER *********************************************/
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle){
+   if(timer_count>=HOST_MAX_TIMERS){
+      return ESP_ERR_NO_MEM;
+   }
+   struct esp_timer *timer = &timers[timer_count++];
+   timer->args=*create_args;
+   timer->deadline_us=-1;
+   *out_handle=timer;
+   return ESP_OK;
+}
+
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us){
+   if(timer->deadline_us>=0){
+      return ESP_ERR_INVALID_STATE;
+   }
+   timer->deadline_us=esp_timer_get_time()+(int64_t)timeout_us;
+   return ESP_OK;
+}
+
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer){
+   if(timer->deadline_us<0){
+      return ESP_ERR_INVALID_STATE;
+   }
+   timer->deadline_us=-1;
+   return ESP_OK;
+}
+
+
+// Slots of deleted timers aren't reused
+esp_err_t esp_timer_delete(esp_timer_handle_t timer){
+   timer->deadline_us=-1;
+   return ESP_OK;
+}
@@ -0,0 +1,410 @@
+/*
+ * delta_diff.c
+ * @description: Implementation of the generator of binary patches. The
+ *    search follows bsdiff 4: suffix sorting of the old image (Larsson and
+ *    Sadakane), then for each position of the new image the longest match
+ *    in the old one, extended forwards and backwards into approximate
+ *    matches whose byte differences are small and mostly zero
+ * @author: @Retrocamara42
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "delta_diff.h"
+#include "delta_patch.h"
+
+/*
+ * patch_buffer: Growing output of the generator
+ */
+typedef struct {
+   uint8_t *data;
+   size_t length;
+   size_t size;
+   uint8_t failed;
+} patch_buffer;
+
+
+static void put_bytes(patch_buffer *out, const uint8_t *bytes, size_t length){
+   if(out->failed){
+      return;
+   }
+   if(out->length+length>out->size){
+      size_t size = out->size*2>out->length+length ? out->size*2 : out->length+length+1024;
+      uint8_t *data = realloc(out->data, size);
+      if(data==NULL){
+         out->failed = 1;
+         return;
+      }
+      out->data = data;
+      out->size = size;
+   }
+   memcpy(out->data+out->length, bytes, length);
+   out->length += length;
+}
+
+
+static void put_varint(patch_buffer *out, uint32_t value){
+   uint8_t bytes[5];
+   uint8_t length = 0;
+   do{
+      bytes[length] = value&0x7f;
+      value >>= 7;
+      if(value!=0){
+         bytes[length] |= 0x80;
+      }
+      length++;
+   }while(value!=0);
+   put_bytes(out, bytes, length);
+}
+
+
+static void put_le32(patch_buffer *out, uint32_t value){
+   uint8_t bytes[4] = { value&0xff, (value>>8)&0xff, (value>>16)&0xff, value>>24 };
+   put_bytes(out, bytes, 4);
+}
+
+
+/******************* SUFFIX SORTING ****************************************/
+/*
+ * split: Sort the suffixes of group I[start, start+length) by the rank of
+ *    the suffix h positions later, and split it into groups of equal rank
+ */
+static void split(int32_t *I, int32_t *V, int32_t start, int32_t length, int32_t h){
+   int32_t i, j, k, x, swap;
+   if(length<16){
+      // Selection sort of small groups
+      for(k=start; k<start+length; k+=j){
+         j = 1;
+         x = V[I[k]+h];
+         for(i=1; k+i<start+length; i++){
+            if(V[I[k+i]+h]<x){
+               x = V[I[k+i]+h];
+               j = 0;
+            }
+            if(V[I[k+i]+h]==x){
+               swap = I[k+j]; I[k+j] = I[k+i]; I[k+i] = swap;
+               j++;
+            }
+         }
+         for(i=0; i<j; i++){
+            V[I[k+i]] = k+j-1;
+         }
+         if(j==1){
+            I[k] = -1;
+         }
+      }
+      return;
+   }
+
+   // Three way partition around the rank of the middle suffix
+   x = V[I[start+length/2]+h];
+   int32_t smaller = 0, equal = 0;
+   for(i=start; i<start+length; i++){
+      if(V[I[i]+h]<x) smaller++;
+      if(V[I[i]+h]==x) equal++;
+   }
+   int32_t jj = start+smaller;
+   int32_t kk = jj+equal;
+   i = start; j = 0; k = 0;
+   while(i<jj){
+      if(V[I[i]+h]<x){
+         i++;
+      }
+      else if(V[I[i]+h]==x){
+         swap = I[i]; I[i] = I[jj+j]; I[jj+j] = swap;
+         j++;
+      }
+      else{
+         swap = I[i]; I[i] = I[kk+k]; I[kk+k] = swap;
+         k++;
+      }
+   }
+   while(jj+j<kk){
+      if(V[I[jj+j]+h]==x){
+         j++;
+      }
+      else{
+         swap = I[jj+j]; I[jj+j] = I[kk+k]; I[kk+k] = swap;
+         k++;
+      }
+   }
+   if(jj>start){
+      split(I, V, start, jj-start, h);
+   }
+   for(i=0; i<kk-jj; i++){
+      V[I[jj+i]] = kk-1;
+   }
+   if(jj==kk-1){
+      I[jj] = -1;
+   }
+   if(start+length>kk){
+      split(I, V, kk, start+length-kk, h);
+   }
+}
+
+
+/*
+ * suffix_sort: Suffix array of the old image, size+1 entries with the empty
+ *    suffix first
+ */
+static void suffix_sort(int32_t *I, int32_t *V, const uint8_t *old_image, int32_t size){
+   int32_t buckets[256];
+   int32_t i, h, length;
+   memset(buckets, 0, sizeof buckets);
+   for(i=0; i<size; i++){
+      buckets[old_image[i]]++;
+   }
+   for(i=1; i<256; i++){
+      buckets[i] += buckets[i-1];
+   }
+   for(i=255; i>0; i--){
+      buckets[i] = buckets[i-1];
+   }
+   buckets[0] = 0;
+   for(i=0; i<size; i++){
+      I[++buckets[old_image[i]]] = i;
+   }
+   I[0] = size;
+   for(i=0; i<size; i++){
+      V[i] = buckets[old_image[i]];
+   }
+   V[size] = 0;
+   for(i=1; i<256; i++){
+      if(buckets[i]==buckets[i-1]+1){
+         I[buckets[i]] = -1;
+      }
+   }
+   I[0] = -1;
+
+   // Groups sorted by their first h bytes, doubling h. Sorted runs are
+   // marked by their negative length
+   for(h=1; I[0]!=-(size+1); h+=h){
+      length = 0;
+      for(i=0; i<size+1;){
+         if(I[i]<0){
+            length -= I[i];
+            i -= I[i];
+         }
+         else{
+            if(length){
+               I[i-length] = -length;
+            }
+            length = V[I[i]]+1-i;
+            split(I, V, i, length, h);
+            i += length;
+            length = 0;
+         }
+      }
+      if(length){
+         I[i-length] = -length;
+      }
+   }
+   for(i=0; i<size+1; i++){
+      I[V[i]] = i;
+   }
+}
+
+
+static int32_t match_length(const uint8_t *a, int32_t a_size, const uint8_t *b, int32_t b_size){
+   int32_t i;
+   for(i=0; i<a_size && i<b_size; i++){
+      if(a[i]!=b[i]){
+         break;
+      }
+   }
+   return i;
+}
+
+
+/*
+ * search: Longest match of the start of new_image among the suffixes
+ *    I[start, end] of the old image
+ */
+static int32_t search(const int32_t *I, const uint8_t *old_image, int32_t old_size,
+      const uint8_t *new_image, int32_t new_size, int32_t start, int32_t end, int32_t *position){
+   while(end-start>=2){
+      int32_t middle = start+(end-start)/2;
+      int32_t length = old_size-I[middle]<new_size ? old_size-I[middle] : new_size;
+      if(memcmp(old_image+I[middle], new_image, length)<0){
+         start = middle;
+      }
+      else{
+         end = middle;
+      }
+   }
+   int32_t x = match_length(old_image+I[start], old_size-I[start], new_image, new_size);
+   int32_t y = match_length(old_image+I[end], old_size-I[end], new_image, new_size);
+   if(x>y){
+      *position = I[start];
+      return x;
+   }
+   *position = I[end];
+   return y;
+}
+
+
+/******************* PATCH *************************************************/
+/*
+ * put_record: Write a record, its add bytes as runs of zeros and literals
+ */
+static void put_record(patch_buffer *out, const uint8_t *old_image, const uint8_t *new_image,
+      int32_t add, int32_t copy, int32_t seek, delta_diff_stats *stats){
+   put_varint(out, add);
+   put_varint(out, copy);
+   put_varint(out, ((uint32_t)seek<<1)^(uint32_t)(seek>>31));
+   int32_t i = 0;
+   while(i<add){
+      int32_t zeros = 0;
+      while(i+zeros<add && new_image[i+zeros]==old_image[i+zeros]){
+         zeros++;
+      }
+      // A literal run goes on over single equal bytes, a pair of varints
+      // costs more than one byte
+      int32_t literals = 0;
+      while(i+zeros+literals<add){
+         int32_t at = i+zeros+literals;
+         if(new_image[at]==old_image[at] && (at+1>=add || new_image[at+1]==old_image[at+1])){
+            break;
+         }
+         literals++;
+      }
+      put_varint(out, zeros);
+      put_varint(out, literals);
+      for(int32_t l=0; l<literals; l++){
+         int32_t at = i+zeros+l;
+         uint8_t diff = new_image[at]-old_image[at];
+         put_bytes(out, &diff, 1);
+         if(diff!=0){
+            stats->changed_bytes++;
+         }
+      }
+      i += zeros+literals;
+   }
+   put_bytes(out, new_image+add, copy);
+   stats->records++;
+   stats->add_bytes += add;
+   stats->copy_bytes += copy;
+}
+
+
+/*
+ * delta_diff: Make the patch from an old image to a new one
+ *    Arguments:
+ *       - old_image: uint8_t*. Old image
+ *       - old_size: size_t. Size of old_image
+ *       - new_image: uint8_t*. New image
+ *       - new_size: size_t. Size of new_image
+ *       - patch_size: size_t*. Size of the patch
+ *       - stats: delta_diff_stats*. Makeup of the patch, can be NULL
+ */
+uint8_t* delta_diff(const uint8_t *old_image, size_t old_image_size, const uint8_t *new_image,
+      size_t new_image_size, size_t *patch_size, delta_diff_stats *stats){
+   int32_t old_size = (int32_t)old_image_size;
+   int32_t new_size = (int32_t)new_image_size;
+   delta_diff_stats local_stats;
+   if(stats==NULL){
+      stats = &local_stats;
+   }
+   memset(stats, 0, sizeof *stats);
+   int32_t *I = malloc((old_size+1)*sizeof *I);
+   int32_t *V = malloc((old_size+1)*sizeof *V);
+   patch_buffer out = { 0 };
+   if(I==NULL || V==NULL){
+      free(I);
+      free(V);
+      return NULL;
+   }
+   suffix_sort(I, V, old_image, old_size);
+   free(V);
+
+   put_le32(&out, DELTA_MAGIC);
+   put_le32(&out, old_size);
+   put_le32(&out, delta_crc32(0, old_image, old_size));
+   put_le32(&out, new_size);
+   put_le32(&out, delta_crc32(0, new_image, new_size));
+
+   int32_t scan = 0, length = 0, position = 0;
+   int32_t last_scan = 0, last_position = 0, last_offset = 0;
+   while(scan<new_size){
+      int32_t old_score = 0;
+      int32_t scored;
+      // Next exact match that isn't just the old alignment going on
+      for(scored=scan+=length; scan<new_size; scan++){
+         length = search(I, old_image, old_size, new_image+scan, new_size-scan,
+            0, old_size, &position);
+         for(; scored<scan+length; scored++){
+            if(scored+last_offset<old_size && old_image[scored+last_offset]==new_image[scored]){
+               old_score++;
+            }
+         }
+         if((length==old_score && length!=0) || length>old_score+8){
+            break;
+         }
+         if(scan+last_offset<old_size && old_image[scan+last_offset]==new_image[scan]){
+            old_score--;
+         }
+      }
+      if(length==old_score && scan!=new_size){
+         continue;
+      }
+
+      // Extend the previous match forwards and this one backwards while
+      // more than half the bytes are equal
+      int32_t i, s, best, forward = 0, backward = 0;
+      for(s=0, best=0, i=0; last_scan+i<scan && last_position+i<old_size;){
+         if(old_image[last_position+i]==new_image[last_scan+i]){
+            s++;
+         }
+         i++;
+         if(s*2-i>best*2-forward){
+            best = s;
+            forward = i;
+         }
+      }
+      if(scan<new_size){
+         for(s=0, best=0, i=1; scan>=last_scan+i && position>=i; i++){
+            if(old_image[position-i]==new_image[scan-i]){
+               s++;
+            }
+            if(s*2-i>best*2-backward){
+               best = s;
+               backward = i;
+            }
+         }
+      }
+      if(last_scan+forward>scan-backward){
+         // Both extensions overlap, split the overlap where it fits best
+         int32_t overlap = last_scan+forward-(scan-backward);
+         int32_t split_at = 0;
+         for(s=0, best=0, i=0; i<overlap; i++){
+            if(new_image[last_scan+forward-overlap+i]==old_image[last_position+forward-overlap+i]){
+               s++;
+            }
+            if(new_image[scan-backward+i]==old_image[position-backward+i]){
+               s--;
+            }
+            if(s>best){
+               best = s;
+               split_at = i+1;
+            }
+         }
+         forward += split_at-overlap;
+         backward -= split_at;
+      }
+
+      int32_t copy = scan-backward-(last_scan+forward);
+      int32_t seek = position-backward-(last_position+forward);
+      put_record(&out, old_image+last_position, new_image+last_scan, forward, copy, seek, stats);
+      last_scan = scan-backward;
+      last_position = position-backward;
+      last_offset = position-scan;
+   }
+   free(I);
+   if(out.failed){
+      free(out.data);
+      return NULL;
+   }
+   *patch_size = out.length;
+   return out.data;
+}
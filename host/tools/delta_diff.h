@@ -0,0 +1,45 @@
+/*
+ * delta_diff.h
+ * @description: Definition of the generator of binary patches between two
+ *    firmware images, in the format applied by delta_patch.h. Matches are
+ *    found with a suffix array of the old image, as bsdiff does
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef HOST_DELTA_DIFF
+#define HOST_DELTA_DIFF
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * delta_diff_stats: Makeup of a patch
+ *    - records: uint32_t. Records of the patch
+ *    - add_bytes: uint32_t. Bytes of the new image made from the old one
+ *    - changed_bytes: uint32_t. Add bytes that differ from the old image
+ *    - copy_bytes: uint32_t. Bytes of the new image carried by the patch
+ */
+typedef struct {
+   uint32_t records;
+   uint32_t add_bytes;
+   uint32_t changed_bytes;
+   uint32_t copy_bytes;
+} delta_diff_stats;
+
+
+/*
+ * delta_diff: Make the patch from an old image to a new one
+ *    Arguments:
+ *       - old_image: uint8_t*. Old image
+ *       - old_size: size_t. Size of old_image
+ *       - new_image: uint8_t*. New image
+ *       - new_size: size_t. Size of new_image
+ *       - patch_size: size_t*. Size of the patch
+ *       - stats: delta_diff_stats*. Makeup of the patch, can be NULL
+ *    Returns:
+ *       - patch: uint8_t*. Patch, to be freed. NULL if out of memory
+ */
+uint8_t* delta_diff(const uint8_t *old_image, size_t old_size, const uint8_t *new_image,
+      size_t new_size, size_t *patch_size, delta_diff_stats *stats);
+
+#endif
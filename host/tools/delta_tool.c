@@ -0,0 +1,158 @@
+/*
+ * delta_tool.c
+ * @description: Makes and applies patches between firmware images, for
+ *    delta updates of the device (see ota_update.h). Patches are applied
+ *    with the streaming applier of the firmware, fed in small chunks, so a
+ *    patch that applies here applies on the device
+ * @author: @Retrocamara42
+ *
+ *    delta_tool diff old.bin new.bin patch.dlt
+ *    delta_tool apply old.bin patch.dlt new.bin
+ *
+ *    Images are the .bin files of the build, the old one being the image
+ *    running on the device
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "delta_diff.h"
+#include "delta_patch.h"
+
+// Bytes of the patch fed at once, as a download would
+#define FEED_SIZE 1024
+
+/*
+ * image_files: Files of an apply
+ *    - old_image: FILE*. Old image, read where the patch points to
+ *    - new_image: FILE*. New image, written in order
+ */
+typedef struct {
+   FILE *old_image;
+   FILE *new_image;
+} image_files;
+
+
+static void usage(const char *name){
+   fprintf(stderr, "usage: %s diff old new patch\n"
+      "       %s apply old patch new\n", name, name);
+}
+
+
+static uint8_t* read_file(const char *path, size_t *size){
+   FILE *file = fopen(path, "rb");
+   if(file==NULL){
+      perror(path);
+      return NULL;
+   }
+   fseek(file, 0, SEEK_END);
+   long length = ftell(file);
+   fseek(file, 0, SEEK_SET);
+   uint8_t *data = malloc(length>0 ? length : 1);
+   if(data==NULL || fread(data, 1, length, file)!=(size_t)length){
+      fprintf(stderr, "Can't read %s\n", path);
+      free(data);
+      fclose(file);
+      return NULL;
+   }
+   fclose(file);
+   *size = length;
+   return data;
+}
+
+
+static esp_err_t read_old(void *arg, uint32_t offset, uint8_t *data, size_t length){
+   image_files *files = arg;
+   if(fseek(files->old_image, offset, SEEK_SET)!=0
+         || fread(data, 1, length, files->old_image)!=length){
+      return ESP_FAIL;
+   }
+   return ESP_OK;
+}
+
+
+static esp_err_t write_new(void *arg, const uint8_t *data, size_t length){
+   image_files *files = arg;
+   return fwrite(data, 1, length, files->new_image)==length ? ESP_OK : ESP_FAIL;
+}
+
+
+static int diff(const char *old_path, const char *new_path, const char *patch_path){
+   size_t old_size, new_size, patch_size;
+   uint8_t *old_image = read_file(old_path, &old_size);
+   uint8_t *new_image = read_file(new_path, &new_size);
+   if(old_image==NULL || new_image==NULL){
+      free(old_image);
+      free(new_image);
+      return 1;
+   }
+   delta_diff_stats stats;
+   uint8_t *patch = delta_diff(old_image, old_size, new_image, new_size, &patch_size, &stats);
+   free(old_image);
+   free(new_image);
+   if(patch==NULL){
+      fprintf(stderr, "Out of memory\n");
+      return 1;
+   }
+   FILE *file = fopen(patch_path, "wb");
+   if(file==NULL || fwrite(patch, 1, patch_size, file)!=patch_size){
+      fprintf(stderr, "Can't write %s\n", patch_path);
+      free(patch);
+      if(file!=NULL){
+         fclose(file);
+      }
+      return 1;
+   }
+   fclose(file);
+   free(patch);
+   printf("%zu -> %zu bytes, patch %zu bytes (%.1f%%)\n", old_size, new_size, patch_size,
+      new_size>0 ? 100.0*patch_size/new_size : 0);
+   printf("%u records, %u bytes from the old image (%u changed), %u new\n",
+      stats.records, stats.add_bytes, stats.changed_bytes, stats.copy_bytes);
+   return 0;
+}
+
+
+static int apply(const char *old_path, const char *patch_path, const char *new_path){
+   image_files files = { fopen(old_path, "rb"), fopen(new_path, "wb") };
+   FILE *patch_file = fopen(patch_path, "rb");
+   if(files.old_image==NULL || files.new_image==NULL || patch_file==NULL){
+      fprintf(stderr, "Can't open %s, %s or %s\n", old_path, patch_path, new_path);
+      return 1;
+   }
+   static delta_patch patch;
+   uint8_t chunk[FEED_SIZE];
+   size_t length;
+   esp_err_t err = ESP_OK;
+   delta_patch_init(&patch, read_old, write_new, &files);
+   while(err==ESP_OK && (length=fread(chunk, 1, sizeof chunk, patch_file))>0){
+      err = delta_patch_feed(&patch, chunk, length);
+   }
+   if(err==ESP_OK){
+      err = delta_patch_finish(&patch);
+   }
+   fclose(patch_file);
+   fclose(files.old_image);
+   fclose(files.new_image);
+   if(err!=ESP_OK){
+      fprintf(stderr, "Patch failed: %s\n", err==ESP_ERR_INVALID_CRC ? "crc mismatch"
+         : err==ESP_ERR_INVALID_VERSION ? "not a patch"
+         : err==ESP_ERR_INVALID_SIZE ? "truncated or corrupt" : "io error");
+      remove(new_path);
+      return 1;
+   }
+   printf("%u bytes written\n", delta_patch_new_size(&patch));
+   return 0;
+}
+
+
+int main(int argc, char **argv){
+   if(argc==5 && strcmp(argv[1], "diff")==0){
+      return diff(argv[2], argv[3], argv[4]);
+   }
+   if(argc==5 && strcmp(argv[1], "apply")==0){
+      return apply(argv[2], argv[3], argv[4]);
+   }
+   usage(argv[0]);
+   return 2;
+}
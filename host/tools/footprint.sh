@@ -0,0 +1,47 @@
+#!/bin/sh
+#
+# footprint.sh
+# @description: Compares the development and production builds of the
+#    firmware on the host. Prints text (code and constants, format strings
+#    included), data and bss of each module, then runs a simulated day with
+#    each build and prints cpu time and log lines per cycle. Host sizes are
+#    x86 sizes, use them to compare modules and profiles. IRAM, DRAM and
+#    flash of the device come from "make footprint" at the project root
+# @author: @Retrocamara42
+#
+#    tools/footprint.sh development_dir production_dir [hours]
+#
+set -e
+cd "$(dirname "$0")/.."
+
+DEVELOPMENT=$1
+PRODUCTION=$2
+HOURS=${3:-24}
+if [ -z "$DEVELOPMENT" ] || [ -z "$PRODUCTION" ]; then
+   echo "usage: $0 development_dir production_dir [hours]" >&2
+   exit 1
+fi
+
+# size_of dir module: text data bss of an object of the simulation
+size_of() {
+   size "$1/sim_objs/$2.o" | awk 'NR==2 { print $1, $2, $3 }'
+}
+
+printf "%-18s %24s %24s\n" "" "development" "production"
+printf "%-18s %8s %7s %7s %8s %7s %7s\n" "module" "text" "data" "bss" "text" "data" "bss"
+for source in ../main/src/*.c; do
+   module=$(basename "$source" .c)
+   echo "$module" $(size_of "$DEVELOPMENT" "$module") $(size_of "$PRODUCTION" "$module")
+done | awk '{ printf "%-18s %8s %7s %7s %8s %7s %7s\n", $1, $2, $3, $4, $5, $6, $7
+      for(i=2; i<=7; i++) total[i]+=$i }
+   END { printf "%-18s %8d %7d %7d %8d %7d %7d\n", "total",
+      total[2], total[3], total[4], total[5], total[6], total[7] }'
+
+for profile in "$DEVELOPMENT" "$PRODUCTION"; do
+   state="$profile/footprint.state"
+   rm -f "$state" "$state.flash"
+   echo
+   echo "$profile, $HOURS simulated hours"
+   "$profile/sim" -t "$HOURS" -f "$state" | grep -E "^(boots|task cpu|log lines)"
+   rm -f "$state" "$state.flash"
+done
@@ -0,0 +1,332 @@
+/*
+ * power_model.c
+ * @description: Energy model of the device. Replays power traces published
+ *    on POWER_TRACE_TOPIC (see power_trace.h) with a current for each power
+ *    state, and projects the charge per day and the battery life for a sleep
+ *    time and a ratio of cycles that transmit
+ * @author: @Retrocamara42
+ *
+ *    power_model [-c state=mA]... [-s minutes] [-r cycles] [-b mAh] [trace]...
+ *
+ *    Traces are read in order, - or none reads stdin. Consecutive traces of
+ *    the same device can be concatenated, the first transition of a trace
+ *    repeats the last one of the previous trace
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "power_trace.h"
+
+#define LINE_SIZE 128
+
+// Rough averages for an esp01 with a dht22 at 3.3 V, in mA. Measure the
+// board and override them with -c
+static double currents[POWER_STATE_COUNT] = {
+   [POWER_STATE_AWAKE] = 15,
+   [POWER_STATE_CONNECT] = 80,
+   [POWER_STATE_ACTIVE] = 25,
+   [POWER_STATE_TX] = 140,
+   [POWER_STATE_MODEM_SLEEP] = 12,
+   [POWER_STATE_DEEP_SLEEP] = 0.02,
+};
+
+/*
+ * cycle_totals: Wake cycles of one kind
+ *    - count: uint32_t. Cycles
+ *    - awake_ms: double. Time out of sleep
+ *    - charge_mas: double. Charge out of sleep, in mA*s
+ */
+typedef struct {
+   uint32_t count;
+   double awake_ms;
+   double charge_mas;
+} cycle_totals;
+
+/*
+ * trace_model: Replay of the traces
+ *    - state_ms: double[]. Time in each state
+ *    - transitions: uint32_t. Transitions replayed
+ *    - breaks: uint32_t. Restarts of the clock, power on or reset
+ *    - report: cycle_totals. Cycles that transmitted
+ *    - quiet: cycle_totals. Cycles that only sampled
+ *    - cycle_starts: uint32_t. Wakes with a previous wake in the same run
+ *    - interval_ms: double. Time between those wakes
+ *    - last: power_state. State of the last transition
+ *    - last_ms: uint32_t. Time of the last transition
+ *    - last_wake_ms: uint32_t. Last wake, 0 if none
+ *    - in_cycle: uint8_t. 1 between a wake and the next sleep
+ *    - cycle_tx: uint8_t. 1 if the running cycle transmitted
+ *    - cycle: cycle_totals. Running cycle
+ */
+typedef struct {
+   double state_ms[POWER_STATE_COUNT];
+   uint32_t transitions;
+   uint32_t breaks;
+   cycle_totals report;
+   cycle_totals quiet;
+   uint32_t cycle_starts;
+   double interval_ms;
+   power_state last;
+   uint32_t last_ms;
+   uint32_t last_wake_ms;
+   uint8_t in_cycle;
+   uint8_t cycle_tx;
+   cycle_totals cycle;
+} trace_model;
+
+
+static uint8_t is_sleep(power_state state){
+   return state==POWER_STATE_MODEM_SLEEP || state==POWER_STATE_DEEP_SLEEP;
+}
+
+
+/*
+ * replay: Account the time since the last transition and enter a new state
+ *    Arguments:
+ *       - model: trace_model*. Replay
+ *       - state: power_state. New state
+ *       - time_ms: uint32_t. Time of the transition
+ */
+static void replay(trace_model *model, power_state state, uint32_t time_ms){
+   if(model->last<POWER_STATE_COUNT && time_ms<model->last_ms){
+      // Clock starts again at power on, cycles don't span it
+      model->breaks++;
+      model->last=POWER_STATE_COUNT;
+      model->in_cycle=0;
+      model->last_wake_ms=0;
+   }
+   if(model->last<POWER_STATE_COUNT){
+      if(state==model->last){
+         // Repeated at the start of the next trace
+         return;
+      }
+      double elapsed = time_ms-model->last_ms;
+      model->state_ms[model->last]+=elapsed;
+      if(model->in_cycle){
+         model->cycle.awake_ms+=elapsed;
+         model->cycle.charge_mas+=elapsed/1000*currents[model->last];
+      }
+   }
+   if(model->in_cycle && is_sleep(state)){
+      cycle_totals *totals = model->cycle_tx ? &model->report : &model->quiet;
+      totals->count++;
+      totals->awake_ms+=model->cycle.awake_ms;
+      totals->charge_mas+=model->cycle.charge_mas;
+      model->in_cycle=0;
+   }
+   if(model->last<POWER_STATE_COUNT && is_sleep(model->last) && !is_sleep(state)){
+      // Cycles are only counted from a wake
+      if(model->last_wake_ms>0){
+         model->cycle_starts++;
+         model->interval_ms+=time_ms-model->last_wake_ms;
+      }
+      model->last_wake_ms=time_ms;
+      model->in_cycle=1;
+      model->cycle_tx=0;
+      memset(&model->cycle, 0, sizeof model->cycle);
+   }
+   if(state==POWER_STATE_TX){
+      model->cycle_tx=1;
+   }
+   model->last=state;
+   model->last_ms=time_ms;
+   model->transitions++;
+}
+
+
+/*
+ * read_trace: Replay the transitions of a trace
+ *    Returns:
+ *       - 0, or -1 if a line is malformed
+ */
+static int read_trace(trace_model *model, FILE *file, const char* name){
+   char line[LINE_SIZE];
+   uint32_t number=0;
+   while(fgets(line, sizeof line, file)!=NULL){
+      number++;
+      char *text = line+strspn(line, " \t");
+      if(*text=='#' || *text=='\n' || *text=='\r' || *text=='\0'){
+         continue;
+      }
+      char *end;
+      unsigned long time_ms = strtoul(text, &end, 10);
+      char *state_name = end+strspn(end, " \t");
+      size_t length = strcspn(state_name, " \t\r\n");
+      power_state state = power_state_from_name(state_name, length);
+      if(end==text || state_name==end || state==POWER_STATE_COUNT || time_ms>UINT32_MAX){
+         fprintf(stderr, "%s:%u: malformed transition: %s", name, number, line);
+         return -1;
+      }
+      replay(model, state, (uint32_t)time_ms);
+   }
+   return 0;
+}
+
+
+/*
+ * set_current: Parse a state=mA option
+ */
+static int set_current(const char* option){
+   const char* equals = strchr(option, '=');
+   if(equals==NULL){
+      return -1;
+   }
+   power_state state = power_state_from_name(option, equals-option);
+   char *end;
+   double current = strtod(equals+1, &end);
+   if(state==POWER_STATE_COUNT || end==equals+1 || *end!='\0' || current<0){
+      return -1;
+   }
+   currents[state]=current;
+   return 0;
+}
+
+
+static void usage(const char* program){
+   fprintf(stderr,
+      "usage: %s [-c state=mA]... [-s minutes] [-r cycles] [-b mAh] [trace]...\n"
+      "   -c state=mA  Current of a state: awake, connect, active, tx,\n"
+      "                modem_sleep, deep_sleep\n"
+      "   -s minutes   Sleep time of the projection, SLEEP_TIME. Default: the\n"
+      "                traced one\n"
+      "   -r cycles    One cycle in that many transmits, e.g. BATCH_SIZE or the\n"
+      "                share of reports the deadband lets through. Default: the\n"
+      "                traced one\n"
+      "   -b mAh       Battery capacity, default 2000\n", program);
+}
+
+
+int main(int argc, char **argv){
+   double sleep_minutes=-1;
+   double cycles_per_report=-1;
+   double battery_mah=2000;
+   int option;
+   while((option=getopt(argc, argv, "c:s:r:b:h"))!=-1){
+      switch(option){
+         case 'c':
+            if(set_current(optarg)!=0){
+               fprintf(stderr, "Bad current: %s\n", optarg);
+               return 2;
+            }
+            break;
+         case 's':
+            sleep_minutes=atof(optarg);
+            break;
+         case 'r':
+            cycles_per_report=atof(optarg);
+            break;
+         case 'b':
+            battery_mah=atof(optarg);
+            break;
+         default:
+            usage(argv[0]);
+            return option=='h' ? 0 : 2;
+      }
+   }
+   if(cycles_per_report!=-1 && cycles_per_report<1){
+      fprintf(stderr, "Cycles per report must be at least 1\n");
+      return 2;
+   }
+
+   trace_model model;
+   memset(&model, 0, sizeof model);
+   model.last=POWER_STATE_COUNT;
+   if(optind>=argc){
+      if(read_trace(&model, stdin, "stdin")!=0){
+         return 1;
+      }
+   }
+   for(int i=optind; i<argc; i++){
+      FILE *file = strcmp(argv[i], "-")==0 ? stdin : fopen(argv[i], "r");
+      if(file==NULL){
+         perror(argv[i]);
+         return 1;
+      }
+      int err = read_trace(&model, file, argv[i]);
+      if(file!=stdin){
+         fclose(file);
+      }
+      if(err!=0){
+         return 1;
+      }
+   }
+
+   /******************* TRACE *************************************************/
+   double total_ms=0;
+   double total_mas=0;
+   for(uint8_t i=0; i<POWER_STATE_COUNT; i++){
+      total_ms+=model.state_ms[i];
+      total_mas+=model.state_ms[i]/1000*currents[i];
+   }
+   printf("%u transitions, %.1f s traced, %u restarts\n\n",
+      model.transitions, total_ms/1000, model.breaks);
+   printf("%-12s %10s %7s %8s %10s %7s\n", "state", "time s", "time %", "mA", "mAs", "mAs %");
+   for(uint8_t i=0; i<POWER_STATE_COUNT; i++){
+      double charge = model.state_ms[i]/1000*currents[i];
+      printf("%-12s %10.1f %7.2f %8.3f %10.1f %7.2f\n", power_state_name(i),
+         model.state_ms[i]/1000, total_ms>0 ? 100*model.state_ms[i]/total_ms : 0,
+         currents[i], charge, total_mas>0 ? 100*charge/total_mas : 0);
+   }
+   if(total_ms>0){
+      printf("%-12s %10.1f %7.2f %8.3f %10.1f %7.2f\n", "average",
+         total_ms/1000, 100.0, total_mas/(total_ms/1000), total_mas, 100.0);
+   }
+
+   /******************* CYCLES ************************************************/
+   uint32_t cycles = model.report.count+model.quiet.count;
+   printf("\n%u cycles: %u transmit, %u only sample\n", cycles,
+      model.report.count, model.quiet.count);
+   if(cycles==0){
+      fprintf(stderr, "No complete wake cycle in the trace, nothing to project\n");
+      return 1;
+   }
+   cycle_totals *kinds[2] = { &model.report, &model.quiet };
+   const char* kind_names[2] = { "transmit", "sample" };
+   double awake_ms[2];
+   double charge_mas[2];
+   for(uint8_t i=0; i<2; i++){
+      // A kind missing from the trace costs as much as the other one
+      cycle_totals *totals = kinds[i]->count>0 ? kinds[i] : kinds[1-i];
+      awake_ms[i]=totals->awake_ms/totals->count;
+      charge_mas[i]=totals->charge_mas/totals->count;
+      printf("   %-8s cycle: %8.2f s awake, %8.2f mAs%s\n", kind_names[i],
+         awake_ms[i]/1000, charge_mas[i], kinds[i]->count>0 ? "" : " (not traced, assumed)");
+   }
+
+   // Sleep between cycles is the one the trace spent most time in
+   power_state sleep_state = model.state_ms[POWER_STATE_MODEM_SLEEP]>model.state_ms[POWER_STATE_DEEP_SLEEP]
+      ? POWER_STATE_MODEM_SLEEP : POWER_STATE_DEEP_SLEEP;
+   double traced_sleep_s = model.cycle_starts>0
+      ? model.interval_ms/model.cycle_starts/1000
+         -(model.report.awake_ms+model.quiet.awake_ms)/cycles/1000
+      : 0;
+   double sleep_s = sleep_minutes>=0 ? sleep_minutes*60 : traced_sleep_s;
+   double ratio = cycles_per_report>=1 ? cycles_per_report
+      : model.report.count>0 ? (double)cycles/model.report.count : 0;
+   if(sleep_s<=0){
+      fprintf(stderr, "Sleep time isn't in the trace, give it with -s\n");
+      return 1;
+   }
+   if(ratio<1){
+      fprintf(stderr, "No cycle transmitted, give the ratio with -r\n");
+      return 1;
+   }
+
+   /******************* PROJECTION ********************************************/
+   double report_share = 1/ratio;
+   double cycle_awake_s = (report_share*awake_ms[0]+(1-report_share)*awake_ms[1])/1000;
+   double cycle_mas = report_share*charge_mas[0]+(1-report_share)*charge_mas[1];
+   double cycles_per_day = 86400/(sleep_s+cycle_awake_s);
+   double awake_mah = cycles_per_day*cycle_mas/3600;
+   double sleep_mah = cycles_per_day*sleep_s*currents[sleep_state]/3600;
+   double day_mah = awake_mah+sleep_mah;
+   printf("\nprojection: %.1f min of %s, 1 in %.2f cycles transmits\n",
+      sleep_s/60, power_state_name(sleep_state), ratio);
+   printf("   %.1f cycles/day, %.1f transmit\n", cycles_per_day, cycles_per_day*report_share);
+   printf("   awake %.3f mAh/day, sleep %.3f mAh/day, total %.3f mAh/day (%.3f mA average)\n",
+      awake_mah, sleep_mah, day_mah, day_mah/24);
+   printf("   %.0f mAh battery: %.1f days\n", battery_mah, battery_mah/day_mah);
+   return 0;
+}
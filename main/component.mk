@@ -1,2 +1,3 @@
 COMPONENT_SRCDIRS := src
-COMPONENT_EMBED_TXTFILES := credentials/AmazonRootCA1.pem credentials/iot_multisensor_certificate.pem.crt credentials/iot_multisensor_private.pem.key
+COMPONENT_EMBED_TXTFILES := credentials/AmazonRootCA1.pem credentials/iot_multisensor_certificate.pem.crt credentials/iot_multisensor_private.pem.key \
+   credentials/ota_server_cert.pem credentials/ota_signing_key.pub.pem
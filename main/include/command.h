@@ -0,0 +1,223 @@
+/*
+ * command.h
+ * @description: Definition of the parser and dispatcher of remote commands.
+ *    Commands are flat json objects, e.g.
+ *    {"cmd":"set_period","sensor":0,"seconds":300}. Fields point into the
+ *    received data, nothing is copied.
+ *    Messages received in another task are copied to the command queue with
+ *    command_queue_push, and run by the task that owns the state they change
+ *    with command_queue_run
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_COMMAND
+#define IOT_COMMAND
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_log.h"
+
+// Fields of a command
+#define COMMAND_MAX_FIELDS 8
+// Field with the name of the command. Without it, the first key is the name
+#define COMMAND_NAME_KEY "cmd"
+// Messages waiting in the command queue
+#define COMMAND_QUEUE_SIZE 2
+// Longest message of the command queue, an update url fits
+#define COMMAND_QUEUE_MAX_LENGTH 256
+
+
+/*
+ * command_value_type: Type of the value of a field
+ *    - COMMAND_VALUE_STRING: String, without quotes. Escapes are kept
+ *    - COMMAND_VALUE_NUMBER: Number
+ *    - COMMAND_VALUE_BOOL: true or false
+ *    - COMMAND_VALUE_NULL: null
+ *    - COMMAND_VALUE_ARRAY: Flat array of numbers or strings, without brackets
+ */
+typedef enum {
+   COMMAND_VALUE_STRING = 0,
+   COMMAND_VALUE_NUMBER,
+   COMMAND_VALUE_BOOL,
+   COMMAND_VALUE_NULL,
+   COMMAND_VALUE_ARRAY,
+} command_value_type;
+
+
+/*
+ * command_field: Key and value of a command. Both point into the data
+ *    - key: const char*. Key, without quotes
+ *    - key_length: uint8_t. Length of key
+ *    - type: command_value_type. Type of value
+ *    - value: const char*. Value
+ *    - value_length: uint16_t. Length of value
+ */
+typedef struct {
+   const char* key;
+   uint8_t key_length;
+   command_value_type type;
+   const char* value;
+   uint16_t value_length;
+} command_field;
+
+
+/*
+ * command_message: Parsed command
+ *    - field_count: uint8_t. Fields of the command
+ *    - fields: command_field[]. Fields, in order
+ */
+typedef struct {
+   uint8_t field_count;
+   command_field fields[COMMAND_MAX_FIELDS];
+} command_message;
+
+
+/*
+ * command_handler: Function that runs a command
+ *    Arguments:
+ *       - message: command_message*. Parsed command
+ *       - arg: void*. Argument given to command_dispatch
+ *    Returns:
+ *       - ESP_OK if the command was run
+ */
+typedef esp_err_t (*command_handler)(const command_message *message, void *arg);
+
+
+/*
+ * command_entry: Command of a dispatch table
+ *    - name: char*. Name of the command
+ *    - handler: command_handler. Function that runs it
+ */
+typedef struct {
+   const char* name;
+   command_handler handler;
+} command_entry;
+
+
+/*
+ * command_stats: Counters of the dispatcher since power on
+ *    - received: uint32_t. Messages given to command_dispatch
+ *    - run: uint32_t. Commands run without error
+ *    - malformed: uint32_t. Messages that couldn't be parsed
+ *    - unknown: uint32_t. Commands not in the table
+ *    - failed: uint32_t. Commands whose handler returned an error
+ *    - dropped: uint32_t. Messages that didn't fit the command queue
+ */
+typedef struct {
+   uint32_t received;
+   uint32_t run;
+   uint32_t malformed;
+   uint32_t unknown;
+   uint32_t failed;
+   uint32_t dropped;
+} command_stats;
+
+
+/*
+ * command_parse: Parse a flat json object
+ *    Arguments:
+ *       - data: const char*. Data, doesn't need to be null terminated
+ *       - length: size_t. Length of data
+ *       - message: command_message*. Where fields are written to
+ *    Returns:
+ *       - ESP_OK, ESP_ERR_INVALID_ARG if data is malformed,
+ *          ESP_ERR_INVALID_SIZE if it has more than COMMAND_MAX_FIELDS
+ */
+esp_err_t command_parse(const char* data, size_t length, command_message *message);
+
+
+/*
+ * command_find: Find a field by key
+ *    Returns:
+ *       - field: command_field*. NULL if not found
+ */
+const command_field* command_find(const command_message *message, const char* key);
+
+
+/*
+ * command_equals: Compare a key or string value with a null terminated string
+ *    Arguments:
+ *       - text: const char*. Key or value
+ *       - length: size_t. Length of text
+ *       - expected: const char*. String to compare with
+ */
+uint8_t command_equals(const char* text, size_t length, const char* expected);
+
+
+/*
+ * command_get_number: Get the number of a field
+ *    Arguments:
+ *       - message: command_message*. Parsed command
+ *       - key: const char*. Key of the field
+ *       - number: float*. Where the number is written to
+ *    Returns:
+ *       - ESP_OK, ESP_ERR_NOT_FOUND, ESP_ERR_INVALID_ARG if it isn't a number
+ */
+esp_err_t command_get_number(const command_message *message, const char* key, float *number);
+
+
+/*
+ * command_get_numbers: Get the numbers of an array field
+ *    Arguments:
+ *       - message: command_message*. Parsed command
+ *       - key: const char*. Key of the field
+ *       - numbers: float*. Where the numbers are written to
+ *       - max: uint8_t. Size of numbers
+ *    Returns:
+ *       - count: int. Numbers written, -1 if the field is missing or holds
+ *          something else
+ */
+int command_get_numbers(const command_message *message, const char* key, float *numbers, uint8_t max);
+
+
+/*
+ * command_dispatch: Parse a message and run its command
+ *    Arguments:
+ *       - table: command_entry*. Known commands
+ *       - table_size: uint8_t. Entries of table
+ *       - data: const char*. Message
+ *       - length: size_t. Length of message
+ *       - arg: void*. Argument given to the handler
+ *    Returns:
+ *       - ESP_OK, a parse error, ESP_ERR_NOT_SUPPORTED for an unknown
+ *          command, or the error of the handler
+ */
+esp_err_t command_dispatch(const command_entry *table, uint8_t table_size,
+         const char* data, size_t length, void *arg);
+
+
+/*
+ * command_queue_push: Copy a message to the command queue. Can be called by
+ *    a task other than the one running the queue
+ *    Arguments:
+ *       - data: const char*. Message
+ *       - length: size_t. Length of message
+ *    Returns:
+ *       - ESP_OK, ESP_ERR_INVALID_SIZE if it is longer than
+ *          COMMAND_QUEUE_MAX_LENGTH, ESP_ERR_NO_MEM if the queue is full
+ */
+esp_err_t command_queue_push(const char* data, size_t length);
+
+
+/*
+ * command_queue_run: Dispatch the messages of the command queue, oldest
+ *    first, in the calling task
+ *    Arguments:
+ *       - table: command_entry*. Known commands
+ *       - table_size: uint8_t. Entries of table
+ *       - arg: void*. Argument given to the handlers
+ *    Returns:
+ *       - count: uint8_t. Messages dispatched
+ */
+uint8_t command_queue_run(const command_entry *table, uint8_t table_size, void *arg);
+
+
+/*
+ * get_command_stats: Get counters of the dispatcher
+ *    Arguments:
+ *       - stats: command_stats*. Where counters are copied to
+ */
+void get_command_stats(command_stats *stats);
+
+#endif
@@ -7,24 +7,83 @@
 #ifndef IOT_CONFIGURATION
 #define IOT_CONFIGURATION
 
+/*
+ * http_content_encoding: Content-Encoding of bulk http bodies
+ *    - HTTP_ENCODING_IDENTITY: Records as they are
+ *    - HTTP_ENCODING_GZIP: gzip, see deflate_stream.h
+ *    - HTTP_ENCODING_DEFLATE: deflate, zlib wrapped
+ */
+typedef enum {
+   HTTP_ENCODING_IDENTITY = 0,
+   HTTP_ENCODING_GZIP = 1,
+   HTTP_ENCODING_DEFLATE = 2,
+}http_content_encoding;
+
 /*
  * http_server_configuration: Organize http endpoints where device will send data
  *    - temperature_url: char*. Endpoint for temperature url
  *    - humidity_url: char*. Endpoint for humidity url
+ *    - bulk_url: char*. Endpoint for batches of samples, see http_bulk.h
+ *    - bulk_encoding: http_content_encoding. Encoding of batches
  */
 typedef struct {
    char* temperature_url;
    char* humidity_url;
+   char* bulk_url;
+   http_content_encoding bulk_encoding;
 }http_server_configuration;
 
 /*
- * active_devices: Indicates which devices will be active
+ * active_devices: Identifies the device. Sensors are listed in the sensor
+ *    registry, see sensor_registry.h
  *    - device_name: char*. Device name. To differentiate between devices
- *    - dhtActive: uint8_t. Indicates if dht sensor will be used
  */
 typedef struct {
    char* device_name;
-   uint8_t dhtActive;
 }active_devices;
 
+/*
+ * mqtt_report_mode: How readings are published with mqtt
+ *    - MQTT_REPORT_SPLIT: One publish per value, each one on its own topic
+ *    - MQTT_REPORT_COMBINED: One publish per cycle with the values of every
+ *       active sensor, on a topic of the device
+ */
+typedef enum {
+   MQTT_REPORT_SPLIT = 0,
+   MQTT_REPORT_COMBINED = 1,
+}mqtt_report_mode;
+
+/*
+ * payload_format: Encoding of combined reports
+ *    - PAYLOAD_FORMAT_JSON: Json object, see payload_encoder.h
+ *    - PAYLOAD_FORMAT_BINARY: Binary frame, see telemetry_frame.h
+ */
+typedef enum {
+   PAYLOAD_FORMAT_JSON = 0,
+   PAYLOAD_FORMAT_BINARY = 1,
+}payload_format;
+
+/*
+ * batch_transport: How batches of samples are uploaded
+ *    - BATCH_TRANSPORT_MQTT: One json batch per publish, see sample_buffer.h
+ *    - BATCH_TRANSPORT_HTTP: One post of ndjson records, compressed, see
+ *       http_bulk.h
+ */
+typedef enum {
+   BATCH_TRANSPORT_MQTT = 0,
+   BATCH_TRANSPORT_HTTP = 1,
+}batch_transport;
+
+/*
+ * sleep_mode: How the device waits between cycles
+ *    - SLEEP_MODE_LIGHT: Cpu and wifi stay on in modem sleep. The device can
+ *       be woken up with a message on the subscribe topic
+ *    - SLEEP_MODE_DEEP: Device deep sleeps and restarts every cycle. Loop
+ *       state is kept in rtc memory. Remote wakeups aren't possible
+ */
+typedef enum {
+   SLEEP_MODE_LIGHT = 0,
+   SLEEP_MODE_DEEP = 1,
+}sleep_mode;
+
 #endif
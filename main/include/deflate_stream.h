@@ -0,0 +1,126 @@
+/*
+ * deflate_stream.h
+ * @description: Definition of a streaming deflate compressor (RFC 1951)
+ *    with a small fixed window, for http bodies sent with a Content-Encoding.
+ *    Input is written in pieces of any size and compressed into a buffer of
+ *    the caller. Matches are found with a single entry hash of 3 bytes over
+ *    the last DEFLATE_WINDOW_SIZE bytes, and coded in one block with the
+ *    fixed huffman codes, so no tables are built or sent. Doesn't depend on
+ *    the sdk
+ *
+ *    Formats, by the Content-Encoding they are sent with:
+ *       DEFLATE_FORMAT_RAW    bare deflate block
+ *       DEFLATE_FORMAT_ZLIB   "deflate": zlib header and adler32 (RFC 1950)
+ *       DEFLATE_FORMAT_GZIP   "gzip": gzip header, crc32 and size (RFC 1952)
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_DEFLATE_STREAM
+#define IOT_DEFLATE_STREAM
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Bytes back a match can point to. A power of two from 512 to 16384
+#define DEFLATE_WINDOW_SIZE 512
+// Bits of the hash of 3 bytes that finds matches
+#define DEFLATE_HASH_BITS 8
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+
+typedef enum {
+   DEFLATE_FORMAT_RAW = 0,
+   DEFLATE_FORMAT_ZLIB = 1,
+   DEFLATE_FORMAT_GZIP = 2,
+} deflate_format;
+
+
+/*
+ * deflate_stream: State of a compression
+ *    - out: uint8_t*. Buffer of the compressed data
+ *    - out_size: size_t. Size of out
+ *    - out_length: size_t. Bytes written to out
+ *    - format: deflate_format. Header and trailer around the block
+ *    - bits: uint32_t. Bits not yet written to out, first bit lowest
+ *    - bit_count: uint8_t. Bits in bits
+ *    - check: uint32_t. Crc32 or adler32 of the input, by format
+ *    - total_in: uint32_t. Bytes of input
+ *    - fill: uint16_t. Bytes in window
+ *    - position: uint16_t. Next byte of window to compress
+ *    - head: uint16_t[]. Position plus one of the last 3 bytes of each
+ *       hash, 0 if none
+ *    - window: uint8_t[]. Bytes compressed, which matches point to, and
+ *       bytes waiting for enough lookahead
+ *    - error: esp_err_t. First error, every call fails after it
+ */
+typedef struct {
+   uint8_t *out;
+   size_t out_size;
+   size_t out_length;
+   deflate_format format;
+   uint32_t bits;
+   uint8_t bit_count;
+   uint32_t check;
+   uint32_t total_in;
+   uint16_t fill;
+   uint16_t position;
+   uint16_t head[1<<DEFLATE_HASH_BITS];
+   uint8_t window[2*DEFLATE_WINDOW_SIZE];
+   esp_err_t error;
+} deflate_stream;
+
+
+/*
+ * deflate_stream_init: Start a compression. The header is written to out
+ *    Arguments:
+ *       - stream: deflate_stream*. State to initialize
+ *       - format: deflate_format. Header and trailer of the data
+ *       - out: uint8_t*. Buffer of the compressed data
+ *       - out_size: size_t. Size of out
+ *    Returns:
+ *       - ESP_OK or ESP_ERR_NO_MEM if the header doesn't fit
+ */
+esp_err_t deflate_stream_init(deflate_stream *stream, deflate_format format,
+      uint8_t *out, size_t out_size);
+
+
+/*
+ * deflate_stream_fits: Check that some more input can be written and the
+ *    stream still finished without running out of room. Assumes the worst
+ *    case of 9 bits per byte, so it holds for any input
+ *    Arguments:
+ *       - stream: deflate_stream*. Compression
+ *       - length: size_t. Bytes of input still to write
+ *    Returns:
+ *       - fits: uint8_t. 1 if they fit
+ */
+uint8_t deflate_stream_fits(const deflate_stream *stream, size_t length);
+
+
+/*
+ * deflate_stream_write: Compress more input. The last DEFLATE_MAX_MATCH
+ *    bytes wait in the window until more input or deflate_stream_finish
+ *    Arguments:
+ *       - stream: deflate_stream*. Compression
+ *       - data: uint8_t*. Input
+ *       - length: size_t. Length of data
+ *    Returns:
+ *       - ESP_OK or ESP_ERR_NO_MEM if out is full. The stream can't be
+ *          used after an error
+ */
+esp_err_t deflate_stream_write(deflate_stream *stream, const uint8_t *data, size_t length);
+
+
+/*
+ * deflate_stream_finish: Compress the input left and write the end of the
+ *    block and the trailer
+ *    Arguments:
+ *       - stream: deflate_stream*. Compression
+ *    Returns:
+ *       - ESP_OK or ESP_ERR_NO_MEM if out is full. out_length is the
+ *          length of the compressed data
+ */
+esp_err_t deflate_stream_finish(deflate_stream *stream);
+
+#endif
@@ -0,0 +1,177 @@
+/*
+ * delta_patch.h
+ * @description: Definition of the streaming applier of binary patches
+ *    (bsdiff-style) between two firmware images. The patch is fed in chunks
+ *    as it is downloaded, the old image is read where the patch points to,
+ *    and the new image is written in order through a window of
+ *    DELTA_WINDOW_SIZE bytes, the only buffer it needs. Doesn't depend on the
+ *    sdk, the host tool that makes patches applies them with the same code
+ *    (see host/tools/delta_tool.c)
+ *
+ *    Patch layout, multi-byte fields of the header are little endian:
+ *       bytes 0-3     DELTA_MAGIC
+ *       bytes 4-7     old_size, size of the old image
+ *       bytes 8-11    old_crc, crc32 of the old image
+ *       bytes 12-15   new_size, size of the new image
+ *       bytes 16-19   new_crc, crc32 of the new image
+ *       records       until new_size bytes are written
+ *
+ *    A record is three varints (7 bits per byte, least significant first)
+ *    and its data:
+ *       add           bytes of the old image to add the diff to
+ *       copy          bytes taken from the patch as is
+ *       seek          zigzag coded move of the old position after the record
+ *       diff          add bytes, as pairs of varints (zeros, literals)
+ *                     followed by literals bytes. Bytes of the old image
+ *                     under zeros are copied unchanged, the others have
+ *                     the literal added
+ *       data          copy bytes
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_DELTA_PATCH
+#define IOT_DELTA_PATCH
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// "DLT1"
+#define DELTA_MAGIC 0x31544c44
+// Size of the patch header
+#define DELTA_HEADER_SIZE 20
+// Bytes of the new image written at once
+#define DELTA_WINDOW_SIZE 512
+
+
+/*
+ * delta_read_cb: Read bytes of the old image
+ *    Arguments:
+ *       - arg: void*. Argument given to delta_patch_init
+ *       - offset: uint32_t. Offset in the old image
+ *       - data: uint8_t*. Where bytes are written to
+ *       - length: size_t. Bytes to read
+ *    Returns:
+ *       - ESP_OK or an error, which stops the patch
+ */
+typedef esp_err_t (*delta_read_cb)(void *arg, uint32_t offset, uint8_t *data, size_t length);
+
+
+/*
+ * delta_write_cb: Write the next bytes of the new image
+ *    Arguments:
+ *       - arg: void*. Argument given to delta_patch_init
+ *       - data: uint8_t*. Bytes
+ *       - length: size_t. Length of data
+ *    Returns:
+ *       - ESP_OK or an error, which stops the patch
+ */
+typedef esp_err_t (*delta_write_cb)(void *arg, const uint8_t *data, size_t length);
+
+
+/*
+ * delta_patch: State of a patch being applied
+ *    - read_old: delta_read_cb. Reads the old image
+ *    - write_new: delta_write_cb. Writes the new image
+ *    - arg: void*. Argument of both
+ *    - state: uint8_t. Part of the patch expected next
+ *    - error: esp_err_t. First error, kept once the patch stops
+ *    - header: uint8_t[]. Header received so far
+ *    - received: uint32_t. Bytes of the patch received
+ *    - old_size, old_crc, new_size, new_crc: uint32_t. Fields of the header
+ *    - varint: uint32_t. Varint being read
+ *    - varint_shift: uint8_t. Bits of it read
+ *    - add, copy, literals: uint32_t. Bytes left of each part of the record
+ *    - seek: int32_t. Move of the old position at the end of the record
+ *    - old_position: uint32_t. Next byte of the old image
+ *    - written: uint32_t. Bytes of the new image written or in the window
+ *    - crc: uint32_t. Crc32 of the bytes of the new image written
+ *    - window_length: uint16_t. Bytes in window
+ *    - window: uint8_t[]. Next bytes of the new image
+ */
+typedef struct {
+   delta_read_cb read_old;
+   delta_write_cb write_new;
+   void *arg;
+   uint8_t state;
+   esp_err_t error;
+   uint8_t header[DELTA_HEADER_SIZE];
+   uint32_t received;
+   uint32_t old_size;
+   uint32_t old_crc;
+   uint32_t new_size;
+   uint32_t new_crc;
+   uint32_t varint;
+   uint8_t varint_shift;
+   uint32_t add;
+   uint32_t copy;
+   uint32_t literals;
+   int32_t seek;
+   uint32_t old_position;
+   uint32_t written;
+   uint32_t crc;
+   uint16_t window_length;
+   uint8_t window[DELTA_WINDOW_SIZE];
+} delta_patch;
+
+
+/*
+ * delta_crc32: Update a crc32 (ieee 802.3) with some bytes
+ *    Arguments:
+ *       - crc: uint32_t. Crc of the previous bytes, 0 to start
+ *       - data: uint8_t*. Bytes
+ *       - length: size_t. Length of data
+ *    Returns:
+ *       - crc: uint32_t. Crc of every byte so far
+ */
+uint32_t delta_crc32(uint32_t crc, const uint8_t *data, size_t length);
+
+
+/*
+ * delta_patch_init: Start applying a patch
+ *    Arguments:
+ *       - patch: delta_patch*. State of the patch
+ *       - read_old: delta_read_cb. Reads the old image
+ *       - write_new: delta_write_cb. Writes the new image
+ *       - arg: void*. Argument of both
+ */
+void delta_patch_init(delta_patch *patch, delta_read_cb read_old, delta_write_cb write_new,
+      void *arg);
+
+
+/*
+ * delta_patch_feed: Apply the next bytes of a patch. Once the header is
+ *    complete, the crc of the old image is checked before anything is
+ *    written
+ *    Arguments:
+ *       - patch: delta_patch*. State of the patch
+ *       - data: uint8_t*. Bytes of the patch
+ *       - length: size_t. Length of data
+ *    Returns:
+ *       - ESP_OK, ESP_ERR_INVALID_VERSION if it isn't a patch,
+ *          ESP_ERR_INVALID_CRC if the old image isn't the one of the patch,
+ *          ESP_ERR_INVALID_SIZE if the patch reads or writes out of the
+ *          images or goes on after the new image, or the error of a
+ *          callback. Errors are kept, later calls return them
+ */
+esp_err_t delta_patch_feed(delta_patch *patch, const uint8_t *data, size_t length);
+
+
+/*
+ * delta_patch_finish: Write the rest of the window and check the new image
+ *    Arguments:
+ *       - patch: delta_patch*. State of the patch
+ *    Returns:
+ *       - ESP_OK, ESP_ERR_INVALID_SIZE if the patch is truncated,
+ *          ESP_ERR_INVALID_CRC if the new image is wrong, or the error
+ *          that stopped the patch
+ */
+esp_err_t delta_patch_finish(delta_patch *patch);
+
+
+/*
+ * delta_patch_new_size: Size of the new image, 0 until the header is read
+ */
+uint32_t delta_patch_new_size(const delta_patch *patch);
+
+#endif
@@ -14,21 +14,66 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_task_wdt.h"
+#include "esp_timer.h"
 
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "esp_attr.h"
 
 #include "configuration.h"
 #include "http_request.h"
 #include "mqtt_client.h"
+#include "mqtt_pipeline.h"
+#include "payload_encoder.h"
+#include "telemetry_frame.h"
+#include "sensor_registry.h"
+#include "event_loop.h"
 
 #include <dht.h>
 
 // Amount of cycles to be transmitted
 #define CYCLES_READ 40
 
-// Number of retrys when reading dht data
-#define MAX_DHT_READING 5
+// Good frames per reading. The reading is their median. Every extra frame
+// keeps the device awake DHT_MIN_READ_INTERVAL more seconds, so by default
+// a reading is one good frame and later frames only replace bad ones
+#ifndef DHT_OVERSAMPLE
+#define DHT_OVERSAMPLE 1
+#endif
+
+// Maximum frames requested from the sensor per reading, 2 retries. A
+// reading that fails keeps the cpu awake for all of them
+#define MAX_DHT_READING (DHT_OVERSAMPLE+2)
+
+// Read frames with the edge capture decoder, see dht_capture_frame. With 0,
+// frames are read with dht_read_float_data, which bit-bangs them with
+// interrupts disabled
+#ifndef DHT_EDGE_CAPTURE
+#define DHT_EDGE_CAPTURE 1
+#endif
+
+// Falling edges of a frame: response, start of first bit and end of each bit
+#define DHT_FRAME_EDGES 42
+#define DHT_MAX_EDGES 48
+// Time between falling edges of a bit, in us. 0 bits take about 78 us and
+// 1 bits about 120 us
+#define DHT_BIT_THRESHOLD_US 100
+#define DHT_MIN_BIT_US 60
+#define DHT_MAX_BIT_US 160
+// Time the line is held low to request a frame, in ms. DHT11 needs 18 ms
+#define DHT_START_SIGNAL_MS 20
+// Time given to the sensor to send a frame, in ms. Frames take about 5 ms
+#define DHT_FRAME_TIMEOUT_MS 10
+
+// Frames farther than this from the median are rejected as outliers
+#define DHT_OUTLIER_TEMPERATURE 2.0
+#define DHT_OUTLIER_HUMIDITY 5.0
+
+// Digits reserved in payloads for the integer part of dht values
+#define DHT_INTEGER_DIGITS 3
+
+// Minimum seconds between reads. DHT22 needs 2 s, DHT11 1 s
+#define DHT_MIN_READ_INTERVAL 2
 
 
 // Gpio level enum
@@ -44,40 +89,150 @@ typedef enum{
 }Dht_Type;
 
 
+/*
+ * dht_edge_capture: Falling edges seen by the gpio interrupt during a frame
+ *    - count: uint8_t. Edges captured
+ *    - edges: uint32_t[]. Time of each edge, in us
+ */
+typedef struct {
+   volatile uint8_t count;
+   uint32_t edges[DHT_MAX_EDGES];
+} dht_edge_capture;
+
+
+/*
+ * dht_read_stats: Counters of dht_read_and_process_data
+ *    - readings: uint32_t. Calls to dht_read_and_process_data
+ *    - failed_readings: uint32_t. Readings without any good frame
+ *    - frames: uint32_t. Frames requested from the sensor
+ *    - retries: uint32_t. Frames requested to replace a bad one
+ *    - timeouts: uint32_t. Frames lost to timing errors
+ *    - checksum_errors: uint32_t. Frames with a bad checksum
+ *    - out_of_range: uint32_t. Frames outside the range of the sensor
+ *    - outliers: uint32_t. Frames too far from the median
+ *    - last_error: esp_err_t. Failure reason of the last bad frame
+ *    - last_latency_us: uint32_t. Duration of the last reading, waits for
+ *       the minimum read interval included
+ *    - max_latency_us: uint32_t. Longest reading
+ */
+typedef struct {
+   uint32_t readings;
+   uint32_t failed_readings;
+   uint32_t frames;
+   uint32_t retries;
+   uint32_t timeouts;
+   uint32_t checksum_errors;
+   uint32_t out_of_range;
+   uint32_t outliers;
+   esp_err_t last_error;
+   uint32_t last_latency_us;
+   uint32_t max_latency_us;
+} dht_read_stats;
+
+
 /*
  * DhtSensor: Contains configuration and values read from dht sensor
  *    - dht_pin: uint8_t. Pin used by dht sensor
  *    - dht_type: Dht_Type. DHT_11 or DHT_22
  *    - temperature: float. Stores temperature value
  *    - humidity: float. Stores humidity value
- *    - decimal_place: uint8_t. Decimal places to show for temperature
- *          and humidity
+ *    - temperature_payload: payload_encoder. Temperature payload, built
+ *          by dht_config
+ *    - humidity_payload: payload_encoder. Humidity payload, built
+ *          by dht_config
+ *    - report_field: uint8_t. Index of the temperature value in the combined
+ *          report, humidity follows it. See dht_add_report_fields
+ *    - last_frame_us: int64_t. Time of the last frame requested, to respect
+ *          the minimum read interval
+ *    - stats: dht_read_stats. Counters of readings
  */
 typedef struct DhtSensor {
    gpio_num_t  dht_pin;
    dht_sensor_type_t dht_type;
    float temperature;
    float humidity;
+   payload_encoder temperature_payload;
+   payload_encoder humidity_payload;
+   uint8_t report_field;
+   int64_t last_frame_us;
+   dht_read_stats stats;
 } DhtSensor;
 
 
 /*
- * dht_config: Configure gpio port for dht sensor. Additionally, it initializes
- *    temperature and humidity to -99
+ * dht_config: Configure gpio port for dht sensor and build its payloads.
+ *    Additionally, it initializes temperature and humidity to -99
  *       Arguments:
  *          -dht_sensor: DhtSensor struct. Contains configuration options
  *             for dht sensor.
+ *          -device_name: char*. Name of the device. To be part of the payload
+ */
+void dht_config(DhtSensor **dht_sensor, char* device_name);
+
+
+/*
+ * dht_decimal_places: Decimal places given by a dht sensor type. 0 for
+ *    DHT11, 1 for the rest
+ *       Arguments:
+ *          -dht_type: dht_sensor_type_t. Type of sensor
+ */
+uint8_t dht_decimal_places(dht_sensor_type_t dht_type);
+
+
+/*
+ * dht_telemetry_type: Sensor type of binary frames for a dht sensor type
+ *       Arguments:
+ *          -dht_type: dht_sensor_type_t. Type of sensor
+ */
+uint8_t dht_telemetry_type(dht_sensor_type_t dht_type);
+
+
+/*
+ * dht_decode_edges: Decode a frame from the time of its falling edges. The
+ *    response edge may be missing
+ *       Arguments:
+ *          -edges: uint32_t*. Time of each falling edge, in us
+ *          -count: uint8_t. Edges
+ *          -dht_type: dht_sensor_type_t. Type of sensor
+ *          -humidity: float*. Output
+ *          -temperature: float*. Output
+ *       Returns:
+ *          -ESP_OK, ESP_ERR_TIMEOUT if edges are missing or bits have a
+ *             wrong duration, or ESP_ERR_INVALID_CRC
  */
-void dht_config(DhtSensor **dht_sensor);
+esp_err_t dht_decode_edges(const uint32_t *edges, uint8_t count,
+         dht_sensor_type_t dht_type, float *humidity, float *temperature);
 
 
 /*
- * dht_read_and_process_data: Get temperature and humidity values from sensors
+ * dht_capture_frame: Request a frame and decode it. Edges are captured by
+ *    a gpio interrupt and decoded in the calling task, which sleeps while
+ *    the sensor sends. Interrupts stay enabled, so wifi isn't stalled
+ *       Arguments:
+ *          -dht_sensor: DhtSensor struct. Configured with dht_config
+ *          -humidity: float*. Output
+ *          -temperature: float*. Output
+ *       Returns:
+ *          -ESP_OK or the error of dht_decode_edges
+ */
+esp_err_t dht_capture_frame(DhtSensor *dht_sensor, float *humidity, float *temperature);
+
+
+/*
+ * dht_read_and_process_data: Get temperature and humidity values from sensors.
+ *    Requests up to MAX_DHT_READING frames, waiting the minimum read interval
+ *    between them, until DHT_OVERSAMPLE are good. Values are the median of
+ *    the good frames, without outliers
  *       Arguments:
  *          -dht_sensor: DhtSensor struct. Use dht_sensor.temperature and
- *             dht.humidity to retrive read data
+ *             dht.humidity to retrive read data. Both are -99 if no frame
+ *             was good or the good frames don't agree
+ *       Returns:
+ *          -ESP_OK, the failure reason of the last frame if no frame
+ *             was good, or ESP_ERR_INVALID_RESPONSE if every good frame
+ *             is an outlier
  */
-void dht_read_and_process_data(DhtSensor **dht_sensor);
+esp_err_t dht_read_and_process_data(DhtSensor **dht_sensor);
 
 
 /*
@@ -85,12 +240,11 @@ void dht_read_and_process_data(DhtSensor **dht_sensor);
  *       Arguments:
  *          -dht_sensor: DhtSensor struct. Use dht_sensor.temperature and
  *             dht.humidity to retrive read data
- *          -device_name: char*. Name of the device. To be part of the payload
  *          -http_server_configuration: http_server_configuration struct.
  *             Information of the server where to send the data to
  */
  void send_dht_data_with_http(DhtSensor *dht_sensor,
-          char* device_name, http_server_configuration http_server_configuration);
+          http_server_configuration http_server_configuration);
 
 
 /*
@@ -98,7 +252,6 @@ void dht_read_and_process_data(DhtSensor **dht_sensor);
  *       Arguments:
  *          -dht_sensor: DhtSensor struct. Use dht_sensor.temperature and
  *             dht.humidity to retrive read data
- *          -device_name: char*. Name of the device. To be part of the payload
  *          -client: esp_mqtt_client_handle_t. Mqtt client.
  *          -mqtt_configuration: esp_mqtt_client_config_t struct.
  *             Mqtt broker configuration
@@ -106,9 +259,53 @@ void dht_read_and_process_data(DhtSensor **dht_sensor);
  *          -topic_humid: char*. Name of the topic to publish humidity data
  */
 void send_dht_data_with_mqtt(DhtSensor *dht_sensor,
-         char* device_name,
          esp_mqtt_client_handle_t client,
          esp_mqtt_client_config_t mqtt_configuration,
          char* topic_temp, char* topic_humid);
 
+
+
+/*
+ * dht_add_report_fields: Add temperature and humidity to a combined report
+ *       Arguments:
+ *          -dht_sensor: DhtSensor struct. Configured with dht_config
+ *          -report: payload_encoder*. Report with the values of every sensor
+ *       Returns:
+ *          -ESP_OK or the error of payload_encoder_add_field
+ */
+esp_err_t dht_add_report_fields(DhtSensor *dht_sensor, payload_encoder *report);
+
+
+/*
+ * dht_write_report_values: Write last read values in a combined report
+ *       Arguments:
+ *          -dht_sensor: DhtSensor struct. Use dht_sensor.temperature and
+ *             dht.humidity to retrive read data
+ *          -report: payload_encoder*. Report prepared with dht_add_report_fields
+ */
+void dht_write_report_values(DhtSensor *dht_sensor, payload_encoder *report);
+
+
+/*
+ * dht_encode_frame: Encode last read values as a binary telemetry frame
+ *       Arguments:
+ *          -dht_sensor: DhtSensor struct. Use dht_sensor.temperature and
+ *             dht.humidity to retrive read data
+ *          -device_id: const char*. Device id of the frame or NULL
+ *          -out: uint8_t*. Output buffer
+ *          -out_size: size_t. Size of out
+ *       Returns:
+ *          -length: size_t. Length of the frame, 0 if it doesn't fit
+ */
+size_t dht_encode_frame(DhtSensor *dht_sensor, const char* device_id,
+         uint8_t *out, size_t out_size);
+
+
+/*
+ * dht_sensor_driver: Driver of dht sensors for the sensor registry. Sensor
+ *    state is a DhtSensor with dht_pin and dht_type set. Values are
+ *    temperature and humidity
+ */
+extern const sensor_driver dht_sensor_driver;
+
 #endif
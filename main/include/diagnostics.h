@@ -0,0 +1,152 @@
+/*
+ * diagnostics.h
+ * @description: Definition of the timing, stack and heap telemetry of each
+ *    wake cycle. Stages are timed with spans, and a record is published
+ *    every few cycles. Build with -DDIAGNOSTICS=0 (e.g. CFLAGS in
+ *    component.mk) to remove it completely
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_DIAGNOSTICS
+#define IOT_DIAGNOSTICS
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifndef DIAGNOSTICS
+#define DIAGNOSTICS 1
+#endif
+
+// Tasks whose stack is watched
+#define DIAGNOSTICS_MAX_TASKS 3
+// Size of a record, see diagnostics_encode
+#define DIAGNOSTICS_RECORD_SIZE 320
+
+
+/*
+ * diagnostics_stage: Stages of a wake cycle timed with spans
+ *    - DIAG_STAGE_WIFI: Wifi connection, in app_main
+ *    - DIAG_STAGE_MQTT_CONNECT: From connection attempt to CONNACK, tls
+ *       handshake included
+ *    - DIAG_STAGE_SENSORS: Sensor reads of the scheduler
+ *    - DIAG_STAGE_PUBLISH: Outbox replay and report publishes
+ *    - DIAG_STAGE_ACKS: Wait for the acks of the publishes
+ *    - DIAG_STAGE_CYCLE: Whole cycle of transmit_data_task, from wake to
+ *       sleep
+ */
+typedef enum {
+   DIAG_STAGE_WIFI = 0,
+   DIAG_STAGE_MQTT_CONNECT,
+   DIAG_STAGE_SENSORS,
+   DIAG_STAGE_PUBLISH,
+   DIAG_STAGE_ACKS,
+   DIAG_STAGE_CYCLE,
+   DIAG_STAGE_COUNT,
+} diagnostics_stage;
+
+
+/*
+ * diagnostics_span: Times of a stage, kept through deep sleep. Spans
+ *    longer than UINT16_MAX ms are kept as UINT16_MAX
+ *    - last_ms: uint16_t. Duration of the last span
+ *    - max_ms: uint16_t. Longest span since the last record
+ */
+typedef struct {
+   uint16_t last_ms;
+   uint16_t max_ms;
+} diagnostics_span;
+
+
+#if DIAGNOSTICS
+#define DIAG_INIT(resumed) diagnostics_init(resumed)
+#define DIAG_SPAN_BEGIN(stage) diagnostics_span_begin(stage)
+#define DIAG_SPAN_END(stage) diagnostics_span_end(stage)
+#define DIAG_WATCH_TASK(name) diagnostics_watch_task(name)
+#else
+#define DIAG_INIT(resumed)
+#define DIAG_SPAN_BEGIN(stage)
+#define DIAG_SPAN_END(stage)
+#define DIAG_WATCH_TASK(name)
+#endif
+
+
+#if DIAGNOSTICS
+/*
+ * diagnostics_init: Reset the counters, unless waking from deep sleep
+ *    Arguments:
+ *       - resumed: uint8_t. 1 after a wake from deep sleep
+ */
+void diagnostics_init(uint8_t resumed);
+
+
+/*
+ * diagnostics_span_begin: Start timing a stage
+ *    Arguments:
+ *       - stage: diagnostics_stage. Stage
+ */
+void diagnostics_span_begin(diagnostics_stage stage);
+
+
+/*
+ * diagnostics_span_end: Stop timing a stage. Does nothing if it wasn't
+ *    started
+ *    Arguments:
+ *       - stage: diagnostics_stage. Stage
+ */
+void diagnostics_span_end(diagnostics_stage stage);
+
+
+/*
+ * diagnostics_get_span: Get the times of a stage
+ */
+const diagnostics_span* diagnostics_get_span(diagnostics_stage stage);
+
+
+/*
+ * diagnostics_watch_task: Watch the stack of the calling task. Calling it
+ *    again from the same task does nothing
+ *    Arguments:
+ *       - name: const char*. Name in the records, must be a literal
+ */
+void diagnostics_watch_task(const char* name);
+
+
+/*
+ * diagnostics_end_cycle: Sample stacks and heap at the end of a cycle
+ *    Arguments:
+ *       - period: uint16_t. Cycles between records
+ *    Returns:
+ *       - due: uint8_t. 1 if a record has to be published
+ */
+uint8_t diagnostics_end_cycle(uint16_t period);
+
+
+/*
+ * diagnostics_encode: Write a record of the cycles since the last one.
+ *    Times in ms, stack and heap in bytes, e.g.
+ *    {"fw":"1.0.0","n":12,"wifi":[812,812],...,"heap":30120,"heap_min":28800,
+ *    "stack":{"transmit":1320,"mqtt":2210}}. Each stage has the last and the
+ *    longest span
+ *    Arguments:
+ *       - firmware: const char*. Firmware version
+ *       - out: char*. Where the record is written to
+ *       - size: size_t. Size of out, DIAGNOSTICS_RECORD_SIZE fits it
+ *    Returns:
+ *       - length: size_t. Length of the record, 0 if it didn't fit
+ */
+size_t diagnostics_encode(const char* firmware, char* out, size_t size);
+
+
+/*
+ * diagnostics_record_sent: Start the maximums of the next record
+ */
+void diagnostics_record_sent();
+#endif
+
+#endif
@@ -0,0 +1,116 @@
+/*
+ * event_loop.h
+ * @description: Definition of the event loop of transmit_data_task. Events
+ *    are bits of the notification value of the task, so tasks and
+ *    interrupts post them without locks or allocation, and events of the
+ *    same kind posted before the task runs are merged. A single one-shot
+ *    timer wakes the task when its next sensor is due, the task doesn't run
+ *    in between. With tickless idle (CONFIG_PM_ENABLE and
+ *    CONFIG_ENABLE_FREERTOS_SLEEP in sdkconfig) the idle task sleeps
+ *    through the freertos tick, so the cpu doesn't wake in between either
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_EVENT_LOOP
+#define IOT_EVENT_LOOP
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Wake timer expired
+#define EVENT_LOOP_TIMER BIT0
+// A remote command wants a cycle now
+#define EVENT_LOOP_COMMAND BIT1
+// Client connected to the broker
+#define EVENT_LOOP_CONNECTED BIT2
+// A sensor finished a frame, only waited for while reading it
+#define EVENT_LOOP_SENSOR BIT3
+// Events that wake the task from sleep
+#define EVENT_LOOP_ALL (EVENT_LOOP_TIMER|EVENT_LOOP_COMMAND|EVENT_LOOP_CONNECTED)
+
+
+/*
+ * event_loop_stats: Wakes of the task
+ *    - wakeups: uint32_t. Times the task woke with events
+ *    - timers: uint32_t. Expiries of the wake timer
+ *    - commands: uint32_t. Command events
+ *    - connections: uint32_t. Connection events
+ */
+typedef struct {
+   uint32_t wakeups;
+   uint32_t timers;
+   uint32_t commands;
+   uint32_t connections;
+} event_loop_stats;
+
+
+/*
+ * event_loop_init: Make the calling task the one events are posted to, and
+ *    create the wake timer. Events posted before are dropped, and
+ *    notifications the task already had are cleared
+ *    Returns:
+ *       - ESP_OK or the error of esp_timer_create
+ */
+esp_err_t event_loop_init(void);
+
+
+/*
+ * event_loop_post: Post events from a task
+ *    Arguments:
+ *       - events: uint32_t. EVENT_LOOP_ bits
+ */
+void event_loop_post(uint32_t events);
+
+
+/*
+ * event_loop_post_from_isr: Post events from an interrupt
+ *    Arguments:
+ *       - events: uint32_t. EVENT_LOOP_ bits
+ */
+void event_loop_post_from_isr(uint32_t events);
+
+
+/*
+ * event_loop_set_timer: Arm the wake timer, replacing the previous time.
+ *    Can be called from any task
+ *    Arguments:
+ *       - seconds: uint32_t. Time from now
+ */
+void event_loop_set_timer(uint32_t seconds);
+
+
+/*
+ * event_loop_wait: Wait for some events. Other events received meanwhile
+ *    are kept for later waits
+ *    Arguments:
+ *       - events: uint32_t. EVENT_LOOP_ bits to wait for
+ *       - ticks: TickType_t. Longest wait
+ *    Returns:
+ *       - events: uint32_t. Bits received, 0 on timeout
+ */
+uint32_t event_loop_wait(uint32_t events, TickType_t ticks);
+
+
+/*
+ * event_loop_sleep: Arm the wake timer and wait for any event. An expiry of
+ *    the timer while the task was awake is dropped
+ *    Arguments:
+ *       - seconds: uint32_t. Time until the timer wakes the task
+ *    Returns:
+ *       - events: uint32_t. Bits received
+ */
+uint32_t event_loop_sleep(uint32_t seconds);
+
+
+/*
+ * get_event_loop_stats: Get the wakes of the task
+ *    Arguments:
+ *       - stats: event_loop_stats*. Output
+ */
+void get_event_loop_stats(event_loop_stats *stats);
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * http_bulk.h
+ * @description: Definition of the bulk mode of the http transport. A batch
+ *    of samples (see sample_buffer.h) is sent in a single post of newline
+ *    delimited json records, one per sample:
+ *       {"boot":3,"t":86400,"temp":21.5,"humid":55.0}
+ *    Records are compressed with deflate_stream as they are written, and
+ *    sent with Content-Type application/x-ndjson and the Content-Encoding of
+ *    bulk_encoding. send_dht_data_with_http takes a post per value instead,
+ *    two per sample. "t" counts seconds from the power on numbered "boot",
+ *    see rtc_state.
+ *    Records that don't fit HTTP_BULK_MAX_BODY go in another post. When one
+ *    of the posts of a batch fails the whole batch is kept, so records can
+ *    reach the server twice; their boot and timestamp tell them apart
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_HTTP_BULK
+#define IOT_HTTP_BULK
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "configuration.h"
+#include "http_request.h"
+#include "sample_buffer.h"
+#include "deflate_stream.h"
+
+#define HTTP_BULK_CONTENT_TYPE "application/x-ndjson"
+// Size of the body of a post. A full batch of samples compressed fits
+#define HTTP_BULK_MAX_BODY 2048
+// Longest record
+#define HTTP_BULK_RECORD_SIZE 64
+
+
+/*
+ * http_bulk_stats: Counters of http_bulk_send
+ *    - posts: uint32_t. Posts sent, including failed ones
+ *    - records: uint32_t. Records sent
+ *    - raw_bytes: uint32_t. Bytes of records before compression
+ *    - body_bytes: uint32_t. Bytes of bodies sent
+ *    - failures: uint32_t. Posts that failed
+ */
+typedef struct {
+   uint32_t posts;
+   uint32_t records;
+   uint32_t raw_bytes;
+   uint32_t body_bytes;
+   uint32_t failures;
+} http_bulk_stats;
+
+
+/*
+ * http_bulk_send: Post a batch of samples as ndjson records to bulk_url.
+ *    Can be used as a sample_buffer_samples_cb through a function that
+ *    passes the configuration
+ *    Arguments:
+ *       - samples: const sensor_sample*. Samples, oldest first
+ *       - count: uint16_t. Samples in the batch
+ *       - boot: uint16_t. Boot of the timestamps
+ *       - config: const http_server_configuration*. bulk_url and
+ *          bulk_encoding are used
+ *    Returns:
+ *       - ESP_OK once every record was posted, or the error of the first
+ *          post that failed
+ */
+esp_err_t http_bulk_send(const sensor_sample *samples, uint16_t count, uint16_t boot,
+      const http_server_configuration *config);
+
+
+/*
+ * get_http_bulk_stats: Get counters of http_bulk_send
+ *    Arguments:
+ *       - stats: http_bulk_stats*. Where counters are copied to
+ */
+void get_http_bulk_stats(http_bulk_stats *stats);
+
+#endif
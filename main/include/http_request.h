@@ -14,12 +14,41 @@
 #include "esp_netif.h"
 #include "esp_tls.h"
 #include "esp_task_wdt.h"
+#include "esp_timer.h"
 
 #include "esp_http_client.h"
 
 #define MAX_HTTP_RECV_BUFFER 512
 #define MAX_HTTP_OUTPUT_BUFFER 2048
 
+// Hosts with a client kept open between requests
+#define MAX_HTTP_PERSISTENT_CLIENTS 2
+// Maximum length of scheme, host and port of an url
+#define MAX_HTTP_HOST_LENGTH 64
+
+
+/*
+ * http_request_stats: Counters of send_http_post_request
+ *    - requests: uint32_t. Post requests performed
+ *    - handshakes: uint32_t. Requests that had to open a connection
+ *       (tcp and tls handshakes)
+ *    - handshakes_avoided: uint32_t. Requests sent on an open connection
+ *    - reconnects: uint32_t. Requests retried on a new connection after
+ *       an error on the open one
+ *    - handshake_latency_us: uint64_t. Total time of requests that opened
+ *       a connection
+ *    - reused_latency_us: uint64_t. Total time of requests sent on an
+ *       open connection
+ */
+typedef struct {
+   uint32_t requests;
+   uint32_t handshakes;
+   uint32_t handshakes_avoided;
+   uint32_t reconnects;
+   uint64_t handshake_latency_us;
+   uint64_t reused_latency_us;
+} http_request_stats;
+
 
 /*
  * _http_event_handler: Event handler for http request
@@ -30,7 +59,8 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt);
 
 
 /*
- * send_http_post_request: Send a http request
+ * send_http_post_request: Send a http request. Clients are kept open per
+ *    host, so consecutive requests to a host reuse its connection
  *    Arguments:
  *       - post_data: char*. Body of post request
  *       - web_url: char*. Complete url (with path) of post request
@@ -38,4 +68,50 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt);
 void send_http_post_request(char* post_data, char* web_url);
 
 
+/*
+ * send_http_post_data: Send a http request with any body. Uses the same
+ *    clients as send_http_post_request
+ *    Arguments:
+ *       - post_data: const char*. Body of post request
+ *       - length: size_t. Length of body
+ *       - content_type: const char*. Content-Type header of the body
+ *       - web_url: char*. Complete url (with path) of post request
+ */
+void send_http_post_data(const char* post_data, size_t length,
+      const char* content_type, char* web_url);
+
+
+/*
+ * send_http_post_encoded: Send a http request with a body encoded with a
+ *    Content-Encoding. Uses the same clients as send_http_post_request
+ *    Arguments:
+ *       - post_data: const char*. Body of post request
+ *       - length: size_t. Length of body
+ *       - content_type: const char*. Content-Type header of the body
+ *       - content_encoding: const char*. Content-Encoding header, such as
+ *          "gzip", NULL for none
+ *       - web_url: char*. Complete url (with path) of post request
+ *    Returns:
+ *       - ESP_OK for a 2xx status, ESP_ERR_INVALID_RESPONSE for another
+ *          one, or the error of the client
+ */
+esp_err_t send_http_post_encoded(const char* post_data, size_t length,
+      const char* content_type, const char* content_encoding, char* web_url);
+
+
+/*
+ * close_http_clients: Close the connections kept open by
+ *    send_http_post_request. Should be run before turning off wifi
+ */
+void close_http_clients();
+
+
+/*
+ * get_http_request_stats: Get counters of send_http_post_request
+ *    Arguments:
+ *       - stats: http_request_stats*. Where counters are copied to
+ */
+void get_http_request_stats(http_request_stats *stats);
+
+
 #endif
@@ -0,0 +1,68 @@
+/*
+ * log_levels.h
+ * @description: Log level of each module, applied at compile time. A
+ *    source defines LOG_LOCAL_LEVEL as its level before its first include,
+ *    and esp_log.h drops every ESP_LOGx call above it from the build, format
+ *    strings and arguments included. esp_log_level_set can't bring them back.
+ *    The production profile (CONFIG_IOT_PRODUCTION, see sdkconfig.production)
+ *    keeps warnings and errors. A level can be set for one build with
+ *    -DLOG_LEVEL_<MODULE>=ESP_LOG_<LEVEL>
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_LOG_LEVELS
+#define IOT_LOG_LEVELS
+
+#include "sdkconfig.h"
+
+#ifdef CONFIG_IOT_PRODUCTION
+// Levels of the production profile
+#define LOG_LEVEL_PROFILE ESP_LOG_WARN
+// Hot path of every cycle, its warnings repeat on each retry
+#define LOG_LEVEL_PROFILE_HOT ESP_LOG_ERROR
+#else
+#define LOG_LEVEL_PROFILE ((esp_log_level_t)CONFIG_LOG_DEFAULT_LEVEL)
+#define LOG_LEVEL_PROFILE_HOT ((esp_log_level_t)CONFIG_LOG_DEFAULT_LEVEL)
+#endif
+
+#ifndef LOG_LEVEL_MAIN
+#define LOG_LEVEL_MAIN LOG_LEVEL_PROFILE
+#endif
+#ifndef LOG_LEVEL_WIFI
+#define LOG_LEVEL_WIFI LOG_LEVEL_PROFILE
+#endif
+#ifndef LOG_LEVEL_MQTT
+#define LOG_LEVEL_MQTT LOG_LEVEL_PROFILE_HOT
+#endif
+#ifndef LOG_LEVEL_PIPELINE
+#define LOG_LEVEL_PIPELINE LOG_LEVEL_PROFILE_HOT
+#endif
+#ifndef LOG_LEVEL_HTTP
+#define LOG_LEVEL_HTTP LOG_LEVEL_PROFILE
+#endif
+#ifndef LOG_LEVEL_DHT
+#define LOG_LEVEL_DHT LOG_LEVEL_PROFILE_HOT
+#endif
+#ifndef LOG_LEVEL_SENSOR
+#define LOG_LEVEL_SENSOR LOG_LEVEL_PROFILE_HOT
+#endif
+#ifndef LOG_LEVEL_SAMPLES
+#define LOG_LEVEL_SAMPLES LOG_LEVEL_PROFILE
+#endif
+#ifndef LOG_LEVEL_OUTBOX
+#define LOG_LEVEL_OUTBOX LOG_LEVEL_PROFILE
+#endif
+#ifndef LOG_LEVEL_COMMAND
+#define LOG_LEVEL_COMMAND LOG_LEVEL_PROFILE
+#endif
+#ifndef LOG_LEVEL_SETTINGS
+#define LOG_LEVEL_SETTINGS LOG_LEVEL_PROFILE
+#endif
+#ifndef LOG_LEVEL_RTC
+#define LOG_LEVEL_RTC LOG_LEVEL_PROFILE
+#endif
+#ifndef LOG_LEVEL_OTA
+#define LOG_LEVEL_OTA LOG_LEVEL_PROFILE
+#endif
+
+#endif
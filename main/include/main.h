@@ -10,24 +10,84 @@
 #include <stdio.h>
 #include <esp_task_wdt.h>
 #include "esp_sleep.h"
-#include "driver/hw_timer.h"
 #include "credentials.h"
 #include "configuration.h"
 #include "wifi.h"
 #include "dht_driver.h"
 #include "mqtt_client.h"
 #include "mqtt_ssl.h"
+#include "sample_buffer.h"
+#include "rtc_state.h"
+#include "sensor_registry.h"
+#include "outbox.h"
+#include "command.h"
+#include "settings.h"
+#include "diagnostics.h"
+#include "power_trace.h"
+#include "event_loop.h"
+#include "ota_update.h"
+#include "http_bulk.h"
 #include <dht.h>
 
 /******************* DHT SENSOR CONFIGURATION ************************************/
+#define FIRMWARE_VERSION "1.0.0"
 #define DEC_PLACE_MULTIPLIER 100
 #define CONFIG_BROKER_URI IOT_CORE_MQTT_URI
 #define DEVICE_NAME "iot_ms"
 #define TEMPERATURE_TOPIC "temperature"
 #define HUMIDITY_TOPIC "humidity"
+// Topic of remote commands: sample_now, set_period, set_deadband and flush.
+// See remote_commands in main.c
 #define SUBSCRIBE_TOPIC "remote_action"
+// Topic of combined reports, one per device
+#define REPORT_TOPIC "devices/" DEVICE_NAME "/readings"
+// MQTT_REPORT_SPLIT publishes on TEMPERATURE_TOPIC and HUMIDITY_TOPIC, which
+// existing subscribers read. MQTT_REPORT_COMBINED publishes one report on
+// REPORT_TOPIC instead
+#define MQTT_REPORT_MODE MQTT_REPORT_SPLIT
+// Encoding of combined reports. Binary reports go to REPORT_BINARY_TOPIC
+#define PAYLOAD_FORMAT PAYLOAD_FORMAT_JSON
+#define REPORT_BINARY_TOPIC "devices/" DEVICE_NAME "/readings/bin"
 // Sleep time in minutes
 #define SLEEP_TIME 15
+// Samples uploaded together in a single message. With more than one, the
+// device samples every SAMPLE_TIME minutes and only uploads every BATCH_SIZE
+// samples. Samples are kept in a sample_buffer meanwhile
+#define BATCH_SIZE 1
+// Time between samples in minutes, used when BATCH_SIZE is more than one
+#define SAMPLE_TIME 1
+// Topic of batches of samples
+#define BATCH_TOPIC "devices/" DEVICE_NAME "/batch"
+// BATCH_TRANSPORT_HTTP posts batches to the bulk_url of http_cfg instead,
+// as compressed ndjson records, see http_bulk.h
+#define BATCH_TRANSPORT BATCH_TRANSPORT_MQTT
+// Scheme and host of the http endpoints
+#define HTTP_SERVER_URL "https://example.com"
+// SLEEP_MODE_DEEP needs GPIO16 wired to RST
+#define SLEEP_MODE SLEEP_MODE_LIGHT
+// Time to wait for the broker after waking from deep sleep, in ms
+#define MQTT_CONNECT_TIMEOUT 10000
+// Reports are published with QoS 1. Up to MQTT_INFLIGHT_WINDOW of them wait
+// for their ack at once. Device sleeps once every ack arrived or after
+// MQTT_ACK_TIMEOUT ms. Reports without ack go to the outbox before a deep
+// sleep or while disconnected, connected clients retransmit them
+#define MQTT_INFLIGHT_WINDOW 4
+#define MQTT_ACK_TIMEOUT 5000
+// Reports queued in the outbox while the broker is unreachable that are
+// replayed per wake
+#define OUTBOX_REPLAY_MAX 32
+// Timing, stack and heap record published every DIAGNOSTICS_PERIOD cycles,
+// see diagnostics.h
+#define DIAGNOSTICS_TOPIC "devices/" DEVICE_NAME "/diagnostics"
+#define DIAGNOSTICS_PERIOD 24
+// Trace of power state transitions, published once POWER_TRACE_EXPORT of
+// them are kept, at most POWER_TRACE_SIZE. host/tools/power_model estimates
+// the battery life from it. 0 doesn't publish it
+#define POWER_TRACE_TOPIC "devices/" DEVICE_NAME "/power"
+#define POWER_TRACE_EXPORT 6
+// Mqtt keepalive in seconds. The client pings the broker while the device
+// sleeps, which keeps the tls session open between report cycles
+#define MQTT_KEEPALIVE 120
 
 // Certificate for AWS IoT Core
 extern const uint8_t iot_cert_pem_start[]   asm("_binary_AmazonRootCA1_pem_start");
@@ -39,14 +99,29 @@ extern const uint8_t iot_client_cert_pem_end[]   asm("_binary_iot_multisensor_ce
 extern const uint8_t iot_key_pem_start[]   asm("_binary_iot_multisensor_private_pem_key_start");
 extern const uint8_t iot_key_pem_end[]   asm("_binary_iot_multisensor_private_pem_key_end");
 
-esp_mqtt_client_handle_t client;
+esp_mqtt_client_handle_t client=NULL;
 
 /******************* AVAILABLE DEVICES ************************************/
 const active_devices iot_active_devices={
    DEVICE_NAME,
-   1,
 };
 
+/******************* SENSORS ************************************/
+// Seconds between reads of each sensor. Sensors are added to the registry
+// in transmit_data_task, each one can have its own period
+#define DHT_READ_PERIOD (60*(BATCH_SIZE>1 ? SAMPLE_TIME : SLEEP_TIME))
+// Longest period accepted by the set_period command, in seconds
+#define MAX_READ_PERIOD (24*3600)
+// Send-on-delta, opt-in. With 1, readings are only published when a value
+// moves at least its deadband since the last report, or every
+// REPORT_HEARTBEAT readings. With 0 every reading is published. Not used
+// with batches, which keep every sample
+#define REPORT_ON_DELTA 0
+#define REPORT_HEARTBEAT 12
+// Deadbands of the dht sensor, temperature in C and humidity in %
+#define DHT_DEADBAND_TEMPERATURE 0.5
+#define DHT_DEADBAND_HUMIDITY 2.0
+
 /******************* WIFI CONFIGURATION *****************************************/
 wifi_config_t custom_wifi_config = {
    .sta = {
@@ -55,29 +130,46 @@ wifi_config_t custom_wifi_config = {
    },
 };
 
+/******************* HTTP CONFIGURATION *****************************************/
+const http_server_configuration http_cfg = {
+   .temperature_url = HTTP_SERVER_URL "/temperature",
+   .humidity_url = HTTP_SERVER_URL "/humidity",
+   .bulk_url = HTTP_SERVER_URL "/devices/" DEVICE_NAME "/samples",
+   .bulk_encoding = HTTP_ENCODING_GZIP,
+};
+
 /******************* MQTT CONFIGURATION *****************************************/
 const esp_mqtt_client_config_t mqtt_cfg = {
     .uri = CONFIG_BROKER_URI,
     .cert_pem = (const char *)iot_cert_pem_start,
     .client_cert_pem = (const char *)iot_client_cert_pem_start,
     .client_key_pem = (const char *)iot_key_pem_start,
+    .keepalive = MQTT_KEEPALIVE,
 };
 
 
 /******************* FUNCTION DEFINITIONS *****************************************/
 /*
- * hw_timer_sleep
- *   Description: Sends task to sleep
+ * my_custom_mqtt_on_event_data_cb
+ *   Description: Mqtt function that executes when receiving data
  */
-void hw_timer_sleep(void *arg);
+void my_custom_mqtt_on_event_data_cb(uint16_t topic_len, char* topic, uint32_t data_len, char* data);
 
 
 /*
- * my_custom_mqtt_on_event_data_cb
- *   Description: Mqtt function that executes when receiving data
+ * my_custom_mqtt_on_connected_cb
+ *   Description: Mqtt function that executes when connecting to the broker
  */
-void my_custom_mqtt_on_event_data_cb(uint8_t topic_len, char* topic, uint8_t data_len, char* data);
+void my_custom_mqtt_on_connected_cb();
+
+
 
+/*
+ * deep_sleep
+ *   Description: Stops mqtt and wifi, then deep sleeps until next cycle.
+ *     Radio is only turned on for wakes that will transmit
+ */
+static void deep_sleep();
 
 
 /*
@@ -0,0 +1,154 @@
+/*
+ * mqtt_pipeline.h
+ * @description: Definition of a QoS 1 publish pipeline. Up to a window of
+ *    publishes wait for their PUBACK at once, so reports don't go lock-step
+ *    with the broker. Acks are matched by message id in MQTT_EVENT_PUBLISHED,
+ *    which wakes the task waiting for a slot or an ack
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_MQTT_PIPELINE
+#define IOT_MQTT_PIPELINE
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "mqtt_client.h"
+
+// Largest window accepted by mqtt_pipeline_init
+#define MQTT_PIPELINE_MAX_WINDOW 8
+// Messages up to this size are copied, so they can be given back to
+// the expired callback when no ack arrives. Larger ones are lost when they
+// expire, unless the caller keeps them until mqtt_pipeline_wait_ack
+#define MQTT_PIPELINE_MAX_PAYLOAD 256
+#define MQTT_PIPELINE_MAX_TOPIC 64
+
+
+/*
+ * mqtt_pipeline_expired_cb: Function that takes back a message whose ack
+ *    didn't arrive before the deadline
+ *    Arguments:
+ *       - topic: const char*. Null terminated topic
+ *       - payload: const char*. Payload
+ *       - length: size_t. Length of payload
+ *       - arg: void*. Argument given to mqtt_pipeline_set_expired_cb
+ */
+typedef void (*mqtt_pipeline_expired_cb)(const char* topic, const char* payload,
+         size_t length, void* arg);
+
+
+/*
+ * mqtt_pipeline_stats: Counters of the pipeline since power on
+ *    - published: uint32_t. Messages published with QoS 1
+ *    - acked: uint32_t. Messages retired by their PUBACK
+ *    - expired: uint32_t. Messages without ack before the deadline
+ *    - failed: uint32_t. Publishes refused by the client
+ *    - window_waits: uint32_t. Publishes that waited for a free slot
+ *    - unknown_acks: uint32_t. Acks of messages not in the window, late
+ *       acks of expired messages
+ *    - max_in_flight: uint8_t. Most messages waiting for ack at once
+ *    - last_ack_latency_us: uint32_t. Time from publish to ack
+ *    - max_ack_latency_us: uint32_t. Worst time from publish to ack
+ *    - total_ack_latency_us: uint64_t. Sum of latencies, divide by acked
+ *       for the mean
+ */
+typedef struct {
+   uint32_t published;
+   uint32_t acked;
+   uint32_t expired;
+   uint32_t failed;
+   uint32_t window_waits;
+   uint32_t unknown_acks;
+   uint8_t max_in_flight;
+   uint32_t last_ack_latency_us;
+   uint32_t max_ack_latency_us;
+   uint64_t total_ack_latency_us;
+} mqtt_pipeline_stats;
+
+
+/*
+ * mqtt_pipeline_init: Configure the pipeline
+ *    Arguments:
+ *       - window: uint8_t. Messages waiting for ack at once, up to
+ *          MQTT_PIPELINE_MAX_WINDOW. 1 is lock-step
+ *       - ack_timeout_ms: uint32_t. Time a message waits for its ack
+ *          before it expires
+ */
+void mqtt_pipeline_init(uint8_t window, uint32_t ack_timeout_ms);
+
+
+/*
+ * mqtt_pipeline_set_expired_cb: Function that takes back expired messages
+ *    Arguments:
+ *       - expired_cb: mqtt_pipeline_expired_cb. NULL to drop them
+ *       - arg: void*. Argument given to expired_cb
+ */
+void mqtt_pipeline_set_expired_cb(mqtt_pipeline_expired_cb expired_cb, void* arg);
+
+
+/*
+ * mqtt_pipeline_publish: Publish with QoS 1. Waits for a free slot while the
+ *    window is full, the oldest message expires at its deadline
+ *    Arguments:
+ *       - client: esp_mqtt_client_handle_t. Mqtt client
+ *       - topic: const char*. Topic
+ *       - payload: const char*. Payload
+ *       - length: size_t. Length of payload
+ *    Returns:
+ *       - msg_id: int. Message id, -1 if the client refused it
+ */
+int mqtt_pipeline_publish(esp_mqtt_client_handle_t client, const char* topic,
+         const char* payload, size_t length);
+
+
+/*
+ * mqtt_pipeline_on_published: Retire a message. Runs in the mqtt task on
+ *    MQTT_EVENT_PUBLISHED
+ *    Arguments:
+ *       - msg_id: int. Id of the acked message
+ */
+void mqtt_pipeline_on_published(int msg_id);
+
+
+/*
+ * mqtt_pipeline_wait_ack: Wait for the ack of a message. A message that
+ *    expires here isn't given to the expired callback, the caller still
+ *    has it
+ *    Arguments:
+ *       - msg_id: int. Id returned by mqtt_pipeline_publish
+ *    Returns:
+ *       - ESP_OK once it is acked, or ESP_ERR_TIMEOUT if it expired
+ */
+esp_err_t mqtt_pipeline_wait_ack(int msg_id);
+
+
+/*
+ * mqtt_pipeline_in_flight: Messages waiting for ack
+ */
+uint8_t mqtt_pipeline_in_flight();
+
+
+/*
+ * mqtt_pipeline_drain: Wait until every message is acked or the deadline
+ *    passes. Messages still waiting then expire. Should be run before sleeping
+ *    Arguments:
+ *       - timeout_ms: uint32_t. Maximum time to wait
+ *    Returns:
+ *       - expired: uint8_t. Messages that expired
+ */
+uint8_t mqtt_pipeline_drain(uint32_t timeout_ms);
+
+
+/*
+ * get_mqtt_pipeline_stats: Get counters of the pipeline
+ *    Arguments:
+ *       - stats: mqtt_pipeline_stats*. Where counters are copied to
+ */
+void get_mqtt_pipeline_stats(mqtt_pipeline_stats *stats);
+
+#endif
@@ -14,19 +14,69 @@
 #include "esp_event.h"
 
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "mqtt_client.h"
+#include "mqtt_pipeline.h"
+
+// Buffers of the pool used to reassemble messages delivered in fragments.
+// Messages that arrive whole are given to the callback without a copy
+#define MQTT_RX_POOL_SIZE 2
+// Largest fragmented message, bigger ones are dropped
+#define MQTT_RX_BUFFER_SIZE 1024
+#define MQTT_RX_MAX_TOPIC 64
+
+
+/*
+ * mqtt_session_stats: Counters of the tls session used by the mqtt client
+ *    - handshakes: uint32_t. Connection attempts. Each one is a full tls
+ *       handshake with client certificate
+ *    - connects: uint32_t. Successful connections
+ *    - disconnects: uint32_t. Connections lost
+ *    - cycles: uint32_t. Report cycles, see mqtt_session_begin_cycle
+ *    - cycles_reused: uint32_t. Report cycles served by the session opened
+ *       in a previous cycle, without any handshake in between
+ */
+typedef struct {
+   uint32_t handshakes;
+   uint32_t connects;
+   uint32_t disconnects;
+   uint32_t cycles;
+   uint32_t cycles_reused;
+} mqtt_session_stats;
+
+
+/*
+ * mqtt_rx_stats: Counters of received messages
+ *    - messages: uint32_t. Messages given to the data callback
+ *    - zero_copy: uint32_t. Messages that arrived whole, given without a copy
+ *    - fragments: uint32_t. Fragments copied to the buffer pool
+ *    - too_large: uint32_t. Messages dropped for not fitting a buffer
+ *    - incomplete: uint32_t. Messages dropped because a fragment was
+ *       missing or the connection was lost
+ *    - pool_exhausted: uint32_t. Messages dropped without a free buffer
+ */
+typedef struct {
+   uint32_t messages;
+   uint32_t zero_copy;
+   uint32_t fragments;
+   uint32_t too_large;
+   uint32_t incomplete;
+   uint32_t pool_exhausted;
+} mqtt_rx_stats;
 
 
 /*
  * mqtt_on_event_data_cb: Callback function that acts when event data received is
- *   active
+ *   active. Gets whole messages, fragments are put together first. Topic and
+ *   data are only valid during the call
  *    Arguments:
- *       - topic_len: uint8_t. Length of topic
+ *       - topic_len: uint16_t. Length of topic
  *       - topic: char*. Topic's name
- *       - data_len: uint8_t. Length of data received
+ *       - data_len: uint32_t. Length of data received
  *       - data: char*. Data
  */
-typedef void (*mqtt_on_event_data_cb)(uint8_t topic_len, char* topic, uint8_t data_len, char* data);
+typedef void (*mqtt_on_event_data_cb)(uint16_t topic_len, char* topic, uint32_t data_len, char* data);
 
 
 /*
@@ -34,7 +84,23 @@ typedef void (*mqtt_on_event_data_cb)(uint8_t topic_len, char* topic, uint8_t da
  *    Arguments:
  *       - on_event_data_cb: void*. Custom function to run when data is received
  */
-void set_mqtt_on_event_data_cb(void (*on_event_data_cb)(uint8_t topic_len, char* topic, uint8_t data_len, char* data));
+void set_mqtt_on_event_data_cb(void (*on_event_data_cb)(uint16_t topic_len, char* topic, uint32_t data_len, char* data));
+
+
+/*
+ * mqtt_on_connected_cb: Callback function that acts when the client
+ *   connects to the broker. Runs in the mqtt task
+ */
+typedef void (*mqtt_on_connected_cb)();
+
+
+/*
+ * set_mqtt_on_connected_cb: Function that runs when the event MQTT_EVENT_CONNECTED
+ *   is active
+ *    Arguments:
+ *       - on_connected_cb: void*. Custom function to run on each connection
+ */
+void set_mqtt_on_connected_cb(void (*on_connected_cb)());
 
 
 /*
@@ -47,6 +113,40 @@ void set_mqtt_on_event_data_cb(void (*on_event_data_cb)(uint8_t topic_len, char*
 esp_mqtt_client_handle_t mqtt_app_start(const esp_mqtt_client_config_t* mqtt_cfg);
 
 
+/*
+ * mqtt_is_connected: Check connection to the broker
+ *    Returns:
+ *       - connected: uint8_t. 1 if connected
+ */
+uint8_t mqtt_is_connected();
+
+
+/*
+ * mqtt_session_begin_cycle: Account a report cycle in mqtt_session_stats.
+ *    Should be run once per cycle, before publishing
+ *    Returns:
+ *       - reused: uint8_t. 1 if the session of the previous cycle is
+ *          still open
+ */
+uint8_t mqtt_session_begin_cycle();
+
+
+/*
+ * get_mqtt_session_stats: Get counters of the mqtt tls session
+ *    Arguments:
+ *       - stats: mqtt_session_stats*. Where counters are copied to
+ */
+void get_mqtt_session_stats(mqtt_session_stats *stats);
+
+
+/*
+ * get_mqtt_rx_stats: Get counters of received messages
+ *    Arguments:
+ *       - stats: mqtt_rx_stats*. Where counters are copied to
+ */
+void get_mqtt_rx_stats(mqtt_rx_stats *stats);
+
+
 /*
  * mqtt_subscribe: Subscribe to mqtt topic
  *    Arguments:
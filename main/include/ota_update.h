@@ -0,0 +1,146 @@
+/*
+ * ota_update.h
+ * @description: Definition of delta firmware updates over two app slots
+ *    (ota_0 and ota_1, see partitions.csv). A patch made by
+ *    host/tools/delta_tool from the running image to the new one is
+ *    downloaded over https and applied as it arrives, see delta_patch.h: the
+ *    running slot is read where the patch points to, and the new image is
+ *    written to the other slot. Only the patch window and one download chunk
+ *    are kept in ram.
+ *    Downloads only trust the pinned certificate of the update server. The
+ *    new image must be signed: <url>.sig holds a signature of its sha256
+ *    with the private key of ota_signing_key.pub.pem, e.g.
+ *       openssl dgst -sha256 -sign ota_signing_key.pem -out patch.dlt.sig new.bin
+ *    The boot slot only changes once the signature is checked
+ *    The new image boots on trial. Every boot that brings up the radio
+ *    counts as an attempt until ota_update_mark_valid is called, once the
+ *    broker is reached. After OTA_MAX_BOOT_ATTEMPTS attempts, or
+ *    OTA_TRIAL_TIME seconds without reaching it, the previous slot is booted
+ *    again
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_OTA_UPDATE
+#define IOT_OTA_UPDATE
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "nvs.h"
+
+// Certificate of the update server. Downloads don't trust any other one
+extern const uint8_t ota_server_cert_pem_start[]   asm("_binary_ota_server_cert_pem_start");
+extern const uint8_t ota_server_cert_pem_end[]   asm("_binary_ota_server_cert_pem_end");
+// Public key of the signatures of new images
+extern const uint8_t ota_signing_key_pem_start[]   asm("_binary_ota_signing_key_pub_pem_start");
+extern const uint8_t ota_signing_key_pem_end[]   asm("_binary_ota_signing_key_pub_pem_end");
+
+// Nvs namespace of the state of the update
+#define OTA_NAMESPACE "ota"
+// Boots of a new image without reaching the broker before rolling back
+#define OTA_MAX_BOOT_ATTEMPTS 3
+// Seconds a new image has to reach the broker after a boot
+#define OTA_TRIAL_TIME 600
+// Longest url of a patch
+#define OTA_URL_SIZE 192
+// Added to the url of a patch to get the signature of the new image
+#define OTA_SIGNATURE_SUFFIX ".sig"
+// Longest signature, an ecdsa p-256 one takes 72 bytes, rsa-2048 256
+#define OTA_SIGNATURE_MAX_SIZE 256
+// Bytes of the patch read from the connection at once
+#define OTA_DOWNLOAD_CHUNK 512
+// Http timeout of the download in ms
+#define OTA_HTTP_TIMEOUT 10000
+
+// Running image is the one the device was flashed with, or an update
+// that reached the broker
+#define OTA_STATE_VALID 0
+// Running image is an update on trial
+#define OTA_STATE_PENDING 1
+
+
+/*
+ * ota_boot_record: State of the update kept in nvs
+ *    - state: uint8_t. OTA_STATE_
+ *    - attempts: uint8_t. Boots of the new image on trial
+ *    - previous: char[]. Label of the slot to go back to
+ */
+typedef struct {
+   uint8_t state;
+   uint8_t attempts;
+   char previous[17];
+} ota_boot_record;
+
+
+/*
+ * ota_update_stats: Last update applied since power on
+ *    - patch_bytes: uint32_t. Bytes of the patch downloaded
+ *    - image_bytes: uint32_t. Bytes of the new image written
+ *    - duration_ms: uint32_t. Time of the download and apply
+ *    - result: esp_err_t. Result of ota_update_apply
+ */
+typedef struct {
+   uint32_t patch_bytes;
+   uint32_t image_bytes;
+   uint32_t duration_ms;
+   esp_err_t result;
+} ota_update_stats;
+
+
+/*
+ * ota_update_check_boot: Count a boot of an image on trial, and boot the
+ *    previous slot once it has used its attempts. Call it after
+ *    nvs_flash_init
+ *    Arguments:
+ *       - radio_on: uint8_t. 1 if this boot brings up the radio. Wakes
+ *          that only sample can't reach the broker and aren't counted
+ *    Returns:
+ *       - ESP_OK. Doesn't return if it rolls back
+ */
+esp_err_t ota_update_check_boot(uint8_t radio_on);
+
+
+/*
+ * ota_update_mark_valid: Keep the running image. Flash is only written for
+ *    an image on trial
+ */
+void ota_update_mark_valid(void);
+
+
+/*
+ * ota_update_trial_expired: Check if an image on trial ran OTA_TRIAL_TIME
+ *    seconds since boot without reaching the broker
+ *    Returns:
+ *       - expired: uint8_t. 1 if the device should restart
+ */
+uint8_t ota_update_trial_expired(void);
+
+
+/*
+ * ota_update_apply: Download a patch and write the new image to the slot
+ *    that isn't running. Once it is complete, checked and its signature
+ *    verified, it is set as the boot slot on trial. The caller restarts the
+ *    device
+ *    Arguments:
+ *       - url: const char*. Https url of the patch
+ *    Returns:
+ *       - ESP_OK, ESP_ERR_INVALID_ARG if the url isn't https,
+ *          ESP_ERR_INVALID_CRC if the patch wasn't made from the running
+ *          image or the new image is wrong, ESP_ERR_INVALID_SIZE if it is
+ *          truncated or corrupt, ESP_ERR_OTA_VALIDATE_FAILED if the
+ *          signature doesn't match the new image, ESP_ERR_INVALID_RESPONSE
+ *          for an http status other than 200, or the error of http, nvs or
+ *          the ota functions. The boot slot only changes on ESP_OK
+ */
+esp_err_t ota_update_apply(const char *url);
+
+
+/*
+ * get_ota_update_stats: Get the last update applied
+ *    Arguments:
+ *       - stats: ota_update_stats*. Where it is copied to
+ */
+void get_ota_update_stats(ota_update_stats *stats);
+
+#endif
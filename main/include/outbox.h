@@ -0,0 +1,121 @@
+/*
+ * outbox.h
+ * @description: Definition of a store-and-forward outbox. Messages that
+ *    can't be published while the broker is unreachable are appended to a
+ *    log in a flash partition and replayed, oldest first, once it is back.
+ *    The log is a ring of sectors, each one erased once per lap
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_OUTBOX
+#define IOT_OUTBOX
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_partition.h"
+#include "esp_task_wdt.h"
+
+// Data partition of the log, see partitions.csv
+#define OUTBOX_PARTITION_LABEL "outbox"
+#define OUTBOX_PARTITION_SUBTYPE 0x40
+// Erase unit of the flash
+#define OUTBOX_SECTOR_SIZE 4096
+// Maximum size of a record: header, topic and payload. Replay uses a
+// single buffer of this size
+#define OUTBOX_MAX_RECORD 256
+#define OUTBOX_MAX_TOPIC 64
+
+
+/*
+ * outbox_send_cb: Function that publishes a message of the outbox
+ *    Arguments:
+ *       - topic: const char*. Null terminated topic
+ *       - payload: const char*. Payload
+ *       - length: size_t. Length of payload
+ *       - boot: uint16_t. Boot the message was queued in
+ *       - timestamp: uint32_t. Time the message was queued, see
+ *          rtc_state_clock
+ *       - arg: void*. Argument given to outbox_replay
+ *    Returns:
+ *       - ESP_OK if the message was published, replay stops otherwise
+ */
+typedef esp_err_t (*outbox_send_cb)(const char* topic, const char* payload,
+         size_t length, uint16_t boot, uint32_t timestamp, void* arg);
+
+
+/*
+ * outbox_stats: Counters of the outbox since power on
+ *    - appended: uint32_t. Messages queued
+ *    - replayed: uint32_t. Messages published by outbox_replay
+ *    - dropped: uint32_t. Messages lost because the log was full
+ *    - corrupted: uint32_t. Records skipped because of a bad checksum
+ *    - erases: uint32_t. Sectors erased
+ */
+typedef struct {
+   uint32_t appended;
+   uint32_t replayed;
+   uint32_t dropped;
+   uint32_t corrupted;
+   uint32_t erases;
+} outbox_stats;
+
+
+/*
+ * outbox_init: Find the outbox partition. After a wake from deep sleep the
+ *    position of the log is kept in rtc memory, otherwise the log is scanned
+ *    Arguments:
+ *       - resumed: uint8_t. 1 after a wake from deep sleep
+ *    Returns:
+ *       - ESP_OK or ESP_ERR_NOT_FOUND if there is no outbox partition
+ */
+esp_err_t outbox_init(uint8_t resumed);
+
+
+/*
+ * outbox_append: Queue a message. When the log is full, the sector with the
+ *    oldest messages is erased
+ *    Arguments:
+ *       - topic: const char*. Topic, up to OUTBOX_MAX_TOPIC characters
+ *       - payload: const char*. Payload
+ *       - length: size_t. Length of payload
+ *       - boot: uint16_t. Boot of the timestamp, timestamps of different
+ *          boots can repeat
+ *       - timestamp: uint32_t. Time of the message
+ *    Returns:
+ *       - ESP_OK, ESP_ERR_INVALID_SIZE if the message doesn't fit a record,
+ *          ESP_ERR_INVALID_STATE if there is no outbox or the flash error
+ */
+esp_err_t outbox_append(const char* topic, const char* payload, size_t length,
+         uint16_t boot, uint32_t timestamp);
+
+
+/*
+ * outbox_count: Messages waiting in the outbox
+ */
+uint32_t outbox_count();
+
+
+/*
+ * outbox_replay: Publish queued messages, oldest first. Each one is marked
+ *    as sent in flash once send returns ESP_OK
+ *    Arguments:
+ *       - send: outbox_send_cb. Function that publishes each message
+ *       - arg: void*. Argument for send
+ *       - max_messages: uint32_t. Messages to publish at most
+ *    Returns:
+ *       - ESP_OK or the error of send. Messages not sent stay queued
+ */
+esp_err_t outbox_replay(outbox_send_cb send, void* arg, uint32_t max_messages);
+
+
+/*
+ * get_outbox_stats: Get counters of the outbox
+ *    Arguments:
+ *       - stats: outbox_stats*. Output
+ */
+void get_outbox_stats(outbox_stats *stats);
+
+#endif
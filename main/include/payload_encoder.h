@@ -0,0 +1,97 @@
+/*
+ * payload_encoder.h
+ * @description: Definition of a json payload encoder for sensor readings.
+ *    The payload skeleton is built once and each reading only rewrites the
+ *    bytes of its value in place, so encoding doesn't allocate or format
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_PAYLOAD_ENCODER
+#define IOT_PAYLOAD_ENCODER
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Maximum size of a payload, including the null terminator
+#define PAYLOAD_MAX_LENGTH 96
+// Maximum number of values in a payload
+#define PAYLOAD_MAX_FIELDS 4
+// Maximum length of the device name
+#define PAYLOAD_MAX_DEVICE_NAME 32
+// Maximum number of decimal places of a value
+#define PAYLOAD_MAX_DECIMAL_PLACES 3
+
+
+/*
+ * payload_field: Location of a value inside the payload
+ *    - offset: uint8_t. Position of the first byte of the value
+ *    - width: uint8_t. Bytes reserved for the value
+ *    - integer_digits: uint8_t. Digits before the decimal point
+ *    - decimal_places: uint8_t. Digits after the decimal point
+ */
+typedef struct {
+   uint8_t offset;
+   uint8_t width;
+   uint8_t integer_digits;
+   uint8_t decimal_places;
+} payload_field;
+
+
+/*
+ * payload_encoder: Json payload with fixed width values
+ *    - buffer: char[]. Null terminated payload
+ *    - length: uint8_t. Length of the payload, without null terminator
+ *    - field_count: uint8_t. Number of values in the payload
+ *    - fields: payload_field[]. Location of each value
+ */
+typedef struct {
+   char buffer[PAYLOAD_MAX_LENGTH];
+   uint8_t length;
+   uint8_t field_count;
+   payload_field fields[PAYLOAD_MAX_FIELDS];
+} payload_encoder;
+
+
+/*
+ * payload_encoder_init: Start a payload. Writes {"dev_name":"<device_name>"
+ *    or only { if device_name is NULL
+ *    Arguments:
+ *       - encoder: payload_encoder*. Encoder to initialize
+ *       - device_name: const char*. Name of the device or NULL. Can't contain
+ *          characters that need escaping in json
+ *    Returns:
+ *       - ESP_OK, ESP_ERR_INVALID_SIZE if the name is too long or
+ *          ESP_ERR_INVALID_ARG if it has invalid characters
+ */
+esp_err_t payload_encoder_init(payload_encoder *encoder, const char* device_name);
+
+
+/*
+ * payload_encoder_add_field: Append a value to the payload. Until the first
+ *    call to payload_encoder_set_value, the value is 0
+ *    Arguments:
+ *       - encoder: payload_encoder*. Encoder
+ *       - key: const char*. Json key of the value
+ *       - integer_digits: uint8_t. Digits reserved before the decimal point
+ *       - decimal_places: uint8_t. Digits after the decimal point
+ *    Returns:
+ *       - ESP_OK or ESP_ERR_INVALID_SIZE if the payload doesn't fit
+ */
+esp_err_t payload_encoder_add_field(payload_encoder *encoder, const char* key,
+         uint8_t integer_digits, uint8_t decimal_places);
+
+
+/*
+ * payload_encoder_set_value: Write a value in the payload. It is rounded
+ *    to the decimal places of the field and clamped to its digits, nan is
+ *    written as 0. The value is right aligned, unused bytes are filled with
+ *    spaces
+ *    Arguments:
+ *       - encoder: payload_encoder*. Encoder
+ *       - field: uint8_t. Index of the value, in order of addition
+ *       - value: float. Value to write
+ */
+void payload_encoder_set_value(payload_encoder *encoder, uint8_t field, float value);
+
+#endif
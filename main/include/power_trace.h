@@ -0,0 +1,107 @@
+/*
+ * power_trace.h
+ * @description: Definition of the trace of power state transitions. Each
+ *    transition is kept in rtc memory with the time it happened, packed in
+ *    4 bytes, and the trace is published as text for the energy model of
+ *    host/tools
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_POWER_TRACE
+#define IOT_POWER_TRACE
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Transitions kept. Oldest are overwritten when it is full. A cycle that
+// transmits takes about 6
+#define POWER_TRACE_SIZE 8
+// Size of an exported trace, see power_trace_export
+#define POWER_TRACE_EXPORT_SIZE (POWER_TRACE_SIZE*24)
+
+
+/*
+ * power_state: Power states of the device
+ *    - POWER_STATE_AWAKE: Cpu on, radio off. Boot and wakes that only sample
+ *    - POWER_STATE_CONNECT: Radio on, wifi association and mqtt connection
+ *    - POWER_STATE_ACTIVE: Radio on with WIFI_PS_MIN_MODEM, idle or receiving
+ *    - POWER_STATE_TX: Radio on, publishing and waiting for acks
+ *    - POWER_STATE_MODEM_SLEEP: Radio on with WIFI_PS_MAX_MODEM, light sleep
+ *       between cycles
+ *    - POWER_STATE_DEEP_SLEEP: Deep sleep between cycles
+ */
+typedef enum {
+   POWER_STATE_AWAKE = 0,
+   POWER_STATE_CONNECT,
+   POWER_STATE_ACTIVE,
+   POWER_STATE_TX,
+   POWER_STATE_MODEM_SLEEP,
+   POWER_STATE_DEEP_SLEEP,
+   POWER_STATE_COUNT,
+} power_state;
+
+
+/*
+ * power_trace_init: Clear the trace, unless waking from deep sleep
+ *    Arguments:
+ *       - resumed: uint8_t. 1 after a wake from deep sleep
+ */
+void power_trace_init(uint8_t resumed);
+
+
+/*
+ * power_trace_enter: Record a transition. Does nothing if the device is
+ *    already in that state
+ *    Arguments:
+ *       - state: power_state. New state
+ *       - now_ms: uint32_t. Milliseconds since power on, see
+ *          rtc_state_clock_ms
+ */
+void power_trace_enter(power_state state, uint32_t now_ms);
+
+
+/*
+ * power_trace_state: Get the current state
+ */
+power_state power_trace_state();
+
+
+/*
+ * power_trace_count: Get the transitions waiting to be exported
+ */
+uint8_t power_trace_count();
+
+
+/*
+ * power_trace_export: Write the trace, oldest first, one transition per
+ *    line: "<ms> <state>\n", e.g. "61250 tx"
+ *    Arguments:
+ *       - out: char*. Where the trace is written to
+ *       - size: size_t. Size of out, POWER_TRACE_EXPORT_SIZE fits it
+ *    Returns:
+ *       - length: size_t. Length of the trace, 0 if it didn't fit
+ */
+size_t power_trace_export(char* out, size_t size);
+
+
+/*
+ * power_trace_clear: Drop the exported transitions. The current state is
+ *    kept as the first transition of the next trace
+ */
+void power_trace_clear();
+
+
+/*
+ * power_state_name: Name of a state in the trace
+ */
+const char* power_state_name(power_state state);
+
+
+/*
+ * power_state_from_name: State of a name in the trace
+ *    Returns:
+ *       - state: power_state. POWER_STATE_COUNT if it is unknown
+ */
+power_state power_state_from_name(const char* name, size_t length);
+
+#endif
@@ -0,0 +1,32 @@
+/*
+ * rtc_budget.h
+ * @description: Split of the rtc user memory between the modules that keep
+ *    state through deep sleep. Each module checks its RTC_DATA_ATTR
+ *    variables against its budget, and the budgets are checked against the
+ *    512 bytes of the esp8266 here, so an overflow fails the build instead
+ *    of corrupting state on wake
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_RTC_BUDGET
+#define IOT_RTC_BUDGET
+
+// Rtc memory of the esp8266 left to the application
+#define RTC_USER_MEMORY_SIZE 512
+
+// Bytes of rtc memory of each module
+#define RTC_BUDGET_RTC_STATE 28
+#define RTC_BUDGET_WIFI 32
+#define RTC_BUDGET_OUTBOX 20
+#define RTC_BUDGET_SAMPLE_BUFFER 164
+#define RTC_BUDGET_SENSOR_REGISTRY 56
+#define RTC_BUDGET_POWER_TRACE 44
+#define RTC_BUDGET_DIAGNOSTICS 40
+
+#define RTC_BUDGET_TOTAL (RTC_BUDGET_RTC_STATE+RTC_BUDGET_WIFI+RTC_BUDGET_OUTBOX \
+   +RTC_BUDGET_SAMPLE_BUFFER+RTC_BUDGET_SENSOR_REGISTRY+RTC_BUDGET_POWER_TRACE \
+   +RTC_BUDGET_DIAGNOSTICS)
+
+_Static_assert(RTC_BUDGET_TOTAL<=RTC_USER_MEMORY_SIZE, "rtc budgets don't fit the rtc user memory");
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * rtc_state.h
+ * @description: Definition of the state kept in rtc memory between deep
+ *    sleeps, and of the functions to enter deep sleep
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_RTC_STATE
+#define IOT_RTC_STATE
+
+#include <stdint.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+// Nvs namespace of the boot counter
+#define RTC_STATE_NAMESPACE "rtc_state"
+// rf option of esp_deep_sleep_set_rf_option. Radio on without calibration
+#define RTC_RF_ON 2
+// rf option of esp_deep_sleep_set_rf_option. Radio off
+#define RTC_RF_OFF 4
+
+// Pending command: take a sample as soon as possible
+#define RTC_COMMAND_SAMPLE_NOW BIT0
+// Pending command: upload buffered samples or the last report as soon as
+// possible
+#define RTC_COMMAND_FLUSH BIT1
+// Pending command: apply a firmware update. Only set while awake, the url
+// isn't kept in rtc memory
+#define RTC_COMMAND_UPDATE BIT2
+
+
+/*
+ * rtc_state: State of the main loop that survives deep sleep
+ *    - magic: uint32_t. Marks valid contents
+ *    - wake_count: uint32_t. Wakes from deep sleep since power on
+ *    - clock: uint32_t. Seconds elapsed before the current wake, deep sleeps
+ *       included. See rtc_state_clock
+ *    - last_temperature: float. Last temperature read
+ *    - last_humidity: float. Last humidity read
+ *    - pending_commands: uint32_t. RTC_COMMAND_ flags to run on next wake
+ *    - radio_on: uint8_t. 1 if radio was left on for this wake
+ *    - boot: uint16_t. Power ons counted in flash. The clock restarts at
+ *       each one, so the boot tells apart times of different ones
+ */
+typedef struct {
+   uint32_t magic;
+   uint32_t wake_count;
+   uint32_t clock;
+   float last_temperature;
+   float last_humidity;
+   uint32_t pending_commands;
+   uint8_t radio_on;
+   uint16_t boot;
+} rtc_state;
+
+
+/*
+ * rtc_state_restore: Check the state kept in rtc memory. It is reset unless
+ *    the device woke from deep sleep, and the boot counter is incremented
+ *    then. Nvs must be initialized
+ *    Returns:
+ *       - resumed: uint8_t. 1 if the device woke from deep sleep with a
+ *          valid state
+ */
+uint8_t rtc_state_restore();
+
+
+/*
+ * rtc_state_get: Get the state kept in rtc memory
+ *    Returns:
+ *       - state: rtc_state*. Changes are kept through deep sleep
+ */
+rtc_state* rtc_state_get();
+
+
+/*
+ * rtc_state_clock: Seconds since power on, deep sleeps included
+ */
+uint32_t rtc_state_clock();
+
+
+/*
+ * rtc_state_clock_ms: Milliseconds since power on, deep sleeps included
+ */
+uint32_t rtc_state_clock_ms();
+
+
+/*
+ * rtc_state_deep_sleep: Enter deep sleep. Doesn't return, the device
+ *    restarts on wake. GPIO16 must be wired to RST
+ *    Arguments:
+ *       - seconds: uint32_t. Time to sleep
+ *       - radio_on: uint8_t. 1 to have the radio on after waking
+ */
+void rtc_state_deep_sleep(uint32_t seconds, uint8_t radio_on);
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * sample_buffer.h
+ * @description: Definition of a buffer of sensor samples. Samples are kept
+ *    in rtc memory, so they survive sleeps, and spilled to flash in blocks
+ *    when it fills up. Blocks are compressed with series_codec. Used to
+ *    upload many samples in a single message
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_SAMPLE_BUFFER
+#define IOT_SAMPLE_BUFFER
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "nvs.h"
+#include "series_codec.h"
+
+// Bytes of rtc memory taken by the compressed block of samples
+#define SAMPLE_BUFFER_BLOCK_SIZE 128
+// Most samples of a block, bounds the batch payload. Samples of a dht22
+// read every minute take about a byte each
+#define SAMPLE_BUFFER_CAPACITY 96
+// Values of each sample
+#define SAMPLE_VALUES 2
+// Blocks that can be spilled to flash
+#define SAMPLE_BUFFER_MAX_SPILLS 4
+// Nvs namespace of spilled blocks
+#define SAMPLE_BUFFER_NAMESPACE "samples"
+// Size of a batch payload. Fits a full block of samples and the boot
+#define SAMPLE_BATCH_MAX_LENGTH (32+SAMPLE_BUFFER_CAPACITY*(13+SAMPLE_VALUES*8))
+
+
+/*
+ * sensor_sample: Values read in a wake
+ *    - timestamp: uint32_t. Seconds since power on, see rtc_state_clock.
+ *       Blocks and batches carry the boot they belong to
+ *    - values: int16_t[]. Values in tenths, in the order of the report
+ *       (temperature, humidity)
+ */
+typedef struct {
+   uint32_t timestamp;
+   int16_t values[SAMPLE_VALUES];
+} sensor_sample;
+
+
+/*
+ * sample_buffer_send_cb: Function that sends a batch
+ *    Arguments:
+ *       - payload: const char*. Json batch
+ *       - length: size_t. Length of payload
+ *       - arg: void*. Argument given to sample_buffer_flush
+ *    Returns:
+ *       - ESP_OK once the batch is delivered, samples are cleared then.
+ *          Samples are kept otherwise
+ */
+typedef esp_err_t (*sample_buffer_send_cb)(const char* payload, size_t length, void* arg);
+
+
+/*
+ * sample_buffer_samples_cb: Function that sends a batch of samples in its
+ *    own encoding
+ *    Arguments:
+ *       - samples: const sensor_sample*. Samples, oldest first
+ *       - count: uint16_t. Samples in the batch
+ *       - boot: uint16_t. Boot of the timestamps
+ *       - arg: void*. Argument given to sample_buffer_flush_samples
+ *    Returns:
+ *       - ESP_OK if the batch was sent, samples are kept otherwise
+ */
+typedef esp_err_t (*sample_buffer_samples_cb)(const sensor_sample *samples, uint16_t count,
+      uint16_t boot, void* arg);
+
+
+/*
+ * sample_buffer_init: Check samples kept in rtc memory. After a power on
+ *    they are discarded and the state of spilled blocks is loaded from
+ *    flash. Samples of an earlier boot that survived a reset are spilled,
+ *    so each block has samples of a single boot. Nvs must be initialized
+ *    Arguments:
+ *       - boot: uint16_t. Boot of the samples pushed from now on, see
+ *          rtc_state
+ */
+void sample_buffer_init(uint16_t boot);
+
+
+/*
+ * sample_to_tenths: Convert a value to the fixed point of sensor_sample
+ *    Arguments:
+ *       - value: float. Value to convert
+ *    Returns:
+ *       - tenths: int16_t. Value in tenths, rounded and clamped, 0 for nan
+ */
+int16_t sample_to_tenths(float value);
+
+
+/*
+ * sample_buffer_push: Add a sample. When the block in rtc memory is full,
+ *    it is spilled to flash. When flash is full too, the oldest samples of
+ *    the block are lost
+ *    Arguments:
+ *       - sample: sensor_sample*. Sample to add
+ */
+void sample_buffer_push(const sensor_sample *sample);
+
+
+/*
+ * sample_buffer_count: Samples in the buffer, including spilled ones
+ *    Returns:
+ *       - count: uint16_t.
+ */
+uint16_t sample_buffer_count(void);
+
+
+/*
+ * sample_buffer_flush: Send buffered samples as json batches of the form
+ *    {"boot":1,"samples":[[timestamp,temperature,humidity],...]}. Spilled blocks are
+ *    sent first, one batch each, then the samples in rtc memory in one batch
+ *    Arguments:
+ *       - send: sample_buffer_send_cb. Function that sends each batch
+ *       - arg: void*. Argument for send
+ *    Returns:
+ *       - ESP_OK if every sample was sent or the error of send. Samples not
+ *          sent stay in the buffer
+ */
+esp_err_t sample_buffer_flush(sample_buffer_send_cb send, void *arg);
+
+
+/*
+ * sample_buffer_flush_samples: Send buffered samples in batches like
+ *    sample_buffer_flush, with send given the samples instead of json
+ *    Arguments:
+ *       - send: sample_buffer_samples_cb. Function that sends each batch
+ *       - arg: void*. Argument for send
+ *    Returns:
+ *       - ESP_OK if every sample was sent or the error of send. Samples not
+ *          sent stay in the buffer
+ */
+esp_err_t sample_buffer_flush_samples(sample_buffer_samples_cb send, void *arg);
+
+#endif
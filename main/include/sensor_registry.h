@@ -0,0 +1,253 @@
+/*
+ * sensor_registry.h
+ * @description: Definition of the sensor driver interface, the registry of
+ *    sensors of the board and the scheduler that reads each one on its own
+ *    period. Sensors due in the same wake are read together, so they share
+ *    a single transmission
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_SENSOR_REGISTRY
+#define IOT_SENSOR_REGISTRY
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_task_wdt.h"
+
+#include "payload_encoder.h"
+#include "telemetry_frame.h"
+
+// Maximum number of sensors of a board. Each one keeps 20 bytes of rtc
+// memory, RTC_BUDGET_SENSOR_REGISTRY must grow with it
+#define SENSOR_REGISTRY_MAX 2
+// Maximum number of values of a sensor
+#define SENSOR_MAX_VALUES 2
+// Sensors due within this many seconds are read in the same wake
+#define SENSOR_COALESCE_WINDOW 5
+
+
+/*
+ * sensor_driver: Operations of a type of sensor
+ *    - name: const char*. Name of the driver, for logs
+ *    - min_read_interval: uint32_t. Minimum seconds between reads
+ *    - value_count: uint8_t. Values given by each read
+ *    - telemetry_type: Get the TELEMETRY_SENSOR_ type of binary frames
+ *    - init: Configure the sensor
+ *    - read: Read the sensor. Writes value_count values
+ *    - encode: Add the values of the sensor to a report, in the order
+ *       given by read
+ */
+typedef struct {
+   const char* name;
+   uint32_t min_read_interval;
+   uint8_t value_count;
+   uint8_t (*telemetry_type)(void *sensor);
+   esp_err_t (*init)(void *sensor, char* device_name);
+   esp_err_t (*read)(void *sensor, float *values);
+   esp_err_t (*encode)(void *sensor, payload_encoder *report);
+} sensor_driver;
+
+
+/*
+ * sensor_instance: Sensor of the board
+ *    - driver: sensor_driver*. Driver of the sensor
+ *    - sensor: void*. State of the sensor, given to the driver
+ *    - period: uint32_t. Seconds between reads
+ *    - first_field: uint8_t. Index of its first value in the report
+ *    - fresh: uint8_t. 1 if it was read in the last scheduler run. Failed
+ *       reads aren't fresh and keep the previous values
+ *    - deadband: float[]. Change of each value needed for a report, see
+ *       sensor_registry_report_due
+ */
+typedef struct {
+   const sensor_driver *driver;
+   void *sensor;
+   uint32_t period;
+   uint8_t first_field;
+   uint8_t fresh;
+   float deadband[SENSOR_MAX_VALUES];
+} sensor_instance;
+
+
+/*
+ * sensor_report_stats: Reports decided by sensor_registry_report_due
+ *    - sent: uint32_t. Reports sent
+ *    - suppressed: uint32_t. Reports skipped, values within the deadband
+ *    - heartbeats: uint32_t. Reports sent only because of the heartbeat
+ */
+typedef struct {
+   uint32_t sent;
+   uint32_t suppressed;
+   uint32_t heartbeats;
+} sensor_report_stats;
+
+
+/*
+ * sensor_registry_add: Add a sensor to the registry
+ *    Arguments:
+ *       - driver: sensor_driver*. Driver of the sensor
+ *       - sensor: void*. State of the sensor, must outlive the registry
+ *       - period: uint32_t. Seconds between reads. Raised to the minimum
+ *          read interval of the driver
+ *    Returns:
+ *       - ESP_OK or ESP_ERR_NO_MEM if the registry is full
+ */
+esp_err_t sensor_registry_add(const sensor_driver *driver, void *sensor, uint32_t period);
+
+
+/*
+ * sensor_registry_set_deadband: Set the change of each value of a sensor
+ *    needed for a report. Deadbands are 0 by default, any change is reported
+ *    Arguments:
+ *       - index: uint8_t. Index of the sensor, in order of addition
+ *       - deadband: float*. One threshold per value of the sensor
+ */
+void sensor_registry_set_deadband(uint8_t index, const float *deadband);
+
+
+/*
+ * sensor_registry_set_period: Change the time between reads of a sensor.
+ *    A shorter period is used from now, a longer one after the next read
+ *    Arguments:
+ *       - index: uint8_t. Index of the sensor, in order of addition
+ *       - period: uint32_t. Seconds between reads
+ *       - now: uint32_t. Current time in seconds
+ *    Returns:
+ *       - ESP_OK, ESP_ERR_INVALID_ARG if there is no such sensor
+ */
+esp_err_t sensor_registry_set_period(uint8_t index, uint32_t period, uint32_t now);
+
+
+/*
+ * sensor_registry_init: Configure every sensor and add their values to
+ *    the report
+ *    Arguments:
+ *       - device_name: char*. Name of the device
+ *       - report: payload_encoder*. Combined report, already initialized
+ *       - resumed: uint8_t. 1 after a wake from deep sleep. Schedule, last
+ *          values and last reported values of the previous wake are kept,
+ *          and last values are written in the report. Otherwise every
+ *          sensor is due
+ */
+void sensor_registry_init(char* device_name, payload_encoder *report, uint8_t resumed);
+
+
+/*
+ * sensor_registry_count: Number of sensors in the registry
+ */
+uint8_t sensor_registry_count();
+
+
+/*
+ * sensor_registry_get: Get a sensor of the registry
+ *    Arguments:
+ *       - index: uint8_t. Index, in order of addition
+ *    Returns:
+ *       - instance: sensor_instance*. NULL if index is out of range
+ */
+sensor_instance* sensor_registry_get(uint8_t index);
+
+
+/*
+ * sensor_scheduler_run: Read every sensor that is due and write its values
+ *    in the report
+ *    Arguments:
+ *       - now: uint32_t. Current time in seconds
+ *       - report: payload_encoder*. Combined report
+ *    Returns:
+ *       - read: uint8_t. Number of sensors read without error
+ */
+uint8_t sensor_scheduler_run(uint32_t now, payload_encoder *report);
+
+
+/*
+ * sensor_scheduler_due: Count the sensors the next run reads
+ *    Arguments:
+ *       - now: uint32_t. Current time in seconds
+ *    Returns:
+ *       - due: uint8_t. Sensors due, within SENSOR_COALESCE_WINDOW
+ */
+uint8_t sensor_scheduler_due(uint32_t now);
+
+
+/*
+ * sensor_scheduler_expire: Make every sensor due, so that the next run
+ *    reads all of them. Their periods restart from that read
+ */
+void sensor_scheduler_expire();
+
+
+/*
+ * sensor_scheduler_next_read: Time until the next sensor is due
+ *    Arguments:
+ *       - now: uint32_t. Current time in seconds
+ *    Returns:
+ *       - seconds: uint32_t. At least 1
+ */
+uint32_t sensor_scheduler_next_read(uint32_t now);
+
+
+/*
+ * sensor_registry_report_due: Send-on-delta. Decide if the values read in
+ *    the last scheduler run have to be reported. They are when a value
+ *    moved at least its deadband since the last report, or as a heartbeat
+ *    when nothing was reported in heartbeat_cycles calls
+ *    Arguments:
+ *       - heartbeat_cycles: uint16_t. Maximum calls without a report
+ *    Returns:
+ *       - due: uint8_t. 1 if the report has to be sent. Call
+ *          sensor_registry_report_sent once it is
+ */
+uint8_t sensor_registry_report_due(uint16_t heartbeat_cycles);
+
+
+/*
+ * sensor_registry_heartbeat_next: Check if the next call to
+ *    sensor_registry_report_due will report regardless of the values
+ *    Arguments:
+ *       - heartbeat_cycles: uint16_t. Maximum calls without a report
+ */
+uint8_t sensor_registry_heartbeat_next(uint16_t heartbeat_cycles);
+
+
+/*
+ * sensor_registry_report_sent: Keep current values as the last reported
+ */
+void sensor_registry_report_sent();
+
+
+/*
+ * get_sensor_report_stats: Get counters of sent and suppressed reports
+ *    Arguments:
+ *       - stats: sensor_report_stats*. Output
+ */
+void get_sensor_report_stats(sensor_report_stats *stats);
+
+
+/*
+ * sensor_registry_values: Last values of every sensor in tenths, in
+ *    order of the report
+ *    Arguments:
+ *       - tenths: int16_t*. Output
+ *       - max: uint8_t. Size of tenths
+ *    Returns:
+ *       - count: uint8_t. Values written
+ */
+uint8_t sensor_registry_values(int16_t *tenths, uint8_t max);
+
+
+/*
+ * sensor_registry_encode_frame: Encode last values of every sensor as a
+ *    binary telemetry frame, in tenths. Sensor type is the one of the
+ *    sensor when the board has only one
+ *    Arguments:
+ *       - out: uint8_t*. Output buffer
+ *       - out_size: size_t. Size of out
+ *    Returns:
+ *       - length: size_t. Length of the frame, 0 if it doesn't fit
+ */
+size_t sensor_registry_encode_frame(uint8_t *out, size_t out_size);
+
+#endif
@@ -0,0 +1,155 @@
+/*
+ * series_codec.h
+ * @description: Definition of a streaming compressor for sensor time
+ *    series and its decoder. Samples are appended one at a time to a block,
+ *    so the block can live in rtc memory between wakes. Doesn't depend on
+ *    the sdk, so ingestion services can build it as a library (see
+ *    host/Makefile)
+ *
+ *    Block layout, multi-byte fields are little endian:
+ *       byte 0      SERIES_MAGIC
+ *       byte 1      version, SERIES_VERSION
+ *       byte 2      m, number of values of each sample
+ *       bytes 3-4   n, number of samples
+ *       bits        samples, most significant bit of each byte first
+ *
+ *    The first sample is 32 bits of timestamp and 16 bits per value. Then,
+ *    each timestamp is coded as the change of its delta to the previous
+ *    timestamp, and each value as its delta to the previous value. Both are
+ *    zigzag coded, and a code other than 0 is packed minus one in the
+ *    smallest of a few widths, by prefix:
+ *       timestamp   0: same delta. 10: 7 bits. 110: 12 bits. 1110: 20 bits.
+ *                   1111: 32 bits of absolute timestamp
+ *       value       0: same value. 10: 2 bits. 110: 5 bits. 1110: 9 bits.
+ *                   1111: 17 bits
+ *    Samples read at a fixed period take 1 bit of timestamp, and values
+ *    that didn't move 1 bit each
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_SERIES_CODEC
+#define IOT_SERIES_CODEC
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define SERIES_MAGIC 0xD8
+#define SERIES_VERSION 1
+// Size of the block header
+#define SERIES_HEADER_SIZE 5
+// Maximum number of values of each sample
+#define SERIES_MAX_VALUES 4
+// Size of the largest sample, the first one of a block
+#define SERIES_MAX_SAMPLE_SIZE (4+2*SERIES_MAX_VALUES)
+
+
+/*
+ * series_encoder: State of a block being written. Kept with the block, in
+ *    rtc memory if the block is
+ *    - bits: uint32_t. Bits of samples written after the header
+ *    - count: uint16_t. Samples in the block
+ *    - value_count: uint8_t. Values of each sample
+ *    - timestamp: uint32_t. Timestamp of the last sample
+ *    - delta: int32_t. Delta of the last timestamp to the previous one
+ *    - values: int16_t[]. Values of the last sample
+ */
+typedef struct {
+   uint32_t bits;
+   uint16_t count;
+   uint8_t value_count;
+   uint32_t timestamp;
+   int32_t delta;
+   int16_t values[SERIES_MAX_VALUES];
+} series_encoder;
+
+
+/*
+ * series_decoder: State of a block being read
+ *    - block: uint8_t*. Block
+ *    - length: size_t. Length of block
+ *    - position: uint32_t. Next bit to read, from the start of block
+ *    - count: uint16_t. Samples in the block
+ *    - index: uint16_t. Samples read
+ *    - value_count: uint8_t. Values of each sample
+ *    - timestamp: uint32_t. Timestamp of the last sample read
+ *    - delta: int32_t. Delta of the last timestamp read to the previous one
+ *    - values: int16_t[]. Values of the last sample read
+ */
+typedef struct {
+   const uint8_t *block;
+   size_t length;
+   uint32_t position;
+   uint16_t count;
+   uint16_t index;
+   uint8_t value_count;
+   uint32_t timestamp;
+   int32_t delta;
+   int16_t values[SERIES_MAX_VALUES];
+} series_decoder;
+
+
+/*
+ * series_encoder_init: Start an empty block
+ *    Arguments:
+ *       - encoder: series_encoder*. State of the block
+ *       - block: uint8_t*. Block, its header is written
+ *       - size: size_t. Size of block, at least SERIES_HEADER_SIZE
+ *       - value_count: uint8_t. Values of each sample, up to
+ *          SERIES_MAX_VALUES
+ *    Returns:
+ *       - ESP_OK or ESP_ERR_INVALID_ARG
+ */
+esp_err_t series_encoder_init(series_encoder *encoder, uint8_t *block, size_t size,
+      uint8_t value_count);
+
+
+/*
+ * series_append: Append a sample to a block
+ *    Arguments:
+ *       - encoder: series_encoder*. State of the block
+ *       - block: uint8_t*. Block
+ *       - size: size_t. Size of block
+ *       - timestamp: uint32_t. Timestamp of the sample
+ *       - values: int16_t*. value_count values in fixed point
+ *    Returns:
+ *       - ESP_OK, or ESP_ERR_NO_MEM if the sample doesn't fit. The block is
+ *          left as it was
+ */
+esp_err_t series_append(series_encoder *encoder, uint8_t *block, size_t size,
+      uint32_t timestamp, const int16_t *values);
+
+
+/*
+ * series_length: Length of a block, header included
+ */
+size_t series_length(const series_encoder *encoder);
+
+
+/*
+ * series_decoder_init: Start reading a block
+ *    Arguments:
+ *       - decoder: series_decoder*. State of the reader
+ *       - block: uint8_t*. Block
+ *       - length: size_t. Length of block
+ *    Returns:
+ *       - ESP_OK, ESP_ERR_INVALID_VERSION if magic or version don't match,
+ *          ESP_ERR_INVALID_SIZE if the header is truncated,
+ *          ESP_ERR_INVALID_ARG if the value count is out of range
+ */
+esp_err_t series_decoder_init(series_decoder *decoder, const uint8_t *block, size_t length);
+
+
+/*
+ * series_next: Read the next sample of a block
+ *    Arguments:
+ *       - decoder: series_decoder*. State of the reader
+ *       - timestamp: uint32_t*. Timestamp of the sample
+ *       - values: int16_t*. value_count values of the sample
+ *    Returns:
+ *       - ESP_OK, ESP_ERR_NOT_FOUND after the last sample,
+ *          ESP_ERR_INVALID_SIZE if the block is truncated
+ */
+esp_err_t series_next(series_decoder *decoder, uint32_t *timestamp, int16_t *values);
+
+#endif
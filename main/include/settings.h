@@ -0,0 +1,55 @@
+/*
+ * settings.h
+ * @description: Definition of the settings of each sensor kept in flash.
+ *    Remote commands change them, and they are applied to the sensor
+ *    registry on every start
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_SETTINGS
+#define IOT_SETTINGS
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+#include "sensor_registry.h"
+
+// Nvs namespace of the settings
+#define SETTINGS_NAMESPACE "settings"
+
+
+/*
+ * sensor_settings: Settings of a sensor
+ *    - period: uint32_t. Seconds between reads
+ *    - deadband: float[]. Change of each value needed for a report
+ */
+typedef struct {
+   uint32_t period;
+   float deadband[SENSOR_MAX_VALUES];
+} sensor_settings;
+
+
+/*
+ * settings_load: Apply the settings kept in flash to the sensors of the
+ *    registry. Sensors without settings keep the ones they were added with
+ *    Arguments:
+ *       - now: uint32_t. Current time in seconds, see rtc_state_clock
+ *    Returns:
+ *       - loaded: uint8_t. Sensors with settings in flash
+ */
+uint8_t settings_load(uint32_t now);
+
+
+/*
+ * settings_save_sensor: Keep the period and deadband of a sensor in flash.
+ *    Flash is only written if they changed
+ *    Arguments:
+ *       - index: uint8_t. Index of the sensor in the registry
+ *    Returns:
+ *       - ESP_OK or the nvs error
+ */
+esp_err_t settings_save_sensor(uint8_t index);
+
+#endif
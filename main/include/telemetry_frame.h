@@ -0,0 +1,110 @@
+/*
+ * telemetry_frame.h
+ * @description: Definition of a compact binary payload for sensor readings
+ *    and its decoder. Doesn't depend on the sdk, so ingestion services can
+ *    build it as a library (see host/Makefile)
+ *
+ *    Frame layout, multi-byte fields are little endian:
+ *       byte 0      TELEMETRY_FRAME_MAGIC
+ *       byte 1      version, TELEMETRY_FRAME_VERSION
+ *       byte 2      flags, TELEMETRY_FLAG_
+ *       byte 3      n, length of device id
+ *       n bytes     device id, not null terminated. Can be empty when the
+ *                   topic already names the device
+ *       1 byte      sensor type, TELEMETRY_SENSOR_
+ *       1 byte      decimal places of the values
+ *       1 byte      m, number of values
+ *       2*m bytes   values, int16 in fixed point: value*10^decimal places
+ *       4 bytes     timestamp in seconds, if TELEMETRY_FLAG_TIMESTAMP
+ *       2 bytes     boot the timestamp belongs to, if TELEMETRY_FLAG_BOOT
+ * @author: @Retrocamara42
+ *
+ */
+#ifndef IOT_TELEMETRY_FRAME
+#define IOT_TELEMETRY_FRAME
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define TELEMETRY_FRAME_MAGIC 0xD7
+#define TELEMETRY_FRAME_VERSION 1
+// Maximum length of device id
+#define TELEMETRY_MAX_DEVICE_ID 32
+// Maximum number of values in a frame
+#define TELEMETRY_MAX_VALUES 8
+// Size of the largest frame
+#define TELEMETRY_FRAME_MAX_SIZE (4+TELEMETRY_MAX_DEVICE_ID+3+2*TELEMETRY_MAX_VALUES+4+2)
+
+// Frame has a timestamp
+#define TELEMETRY_FLAG_TIMESTAMP 0x01
+// Frame has the boot of its timestamp. Timestamps count from power on, see
+// rtc_state_clock
+#define TELEMETRY_FLAG_BOOT 0x02
+
+// Sensor types
+#define TELEMETRY_SENSOR_UNKNOWN 0
+#define TELEMETRY_SENSOR_DHT11 1
+#define TELEMETRY_SENSOR_AM2301 2
+#define TELEMETRY_SENSOR_SI7021 3
+
+
+/*
+ * telemetry_frame: Decoded frame
+ *    - flags: uint8_t. TELEMETRY_FLAG_ flags
+ *    - device_id: char[]. Null terminated device id
+ *    - sensor_type: uint8_t. TELEMETRY_SENSOR_ type
+ *    - decimal_places: uint8_t. Decimal places of values
+ *    - value_count: uint8_t. Number of values
+ *    - values: int16_t[]. Values in fixed point
+ *    - timestamp: uint32_t. Seconds, valid with TELEMETRY_FLAG_TIMESTAMP
+ *    - boot: uint16_t. Boot of the timestamp, valid with TELEMETRY_FLAG_BOOT
+ */
+typedef struct {
+   uint8_t flags;
+   char device_id[TELEMETRY_MAX_DEVICE_ID+1];
+   uint8_t sensor_type;
+   uint8_t decimal_places;
+   uint8_t value_count;
+   int16_t values[TELEMETRY_MAX_VALUES];
+   uint32_t timestamp;
+   uint16_t boot;
+} telemetry_frame;
+
+
+/*
+ * telemetry_frame_encode: Encode a frame
+ *    Arguments:
+ *       - frame: telemetry_frame*. Frame to encode
+ *       - out: uint8_t*. Output buffer
+ *       - out_size: size_t. Size of out. TELEMETRY_FRAME_MAX_SIZE always fits
+ *    Returns:
+ *       - length: size_t. Length of the frame or 0 if frame is invalid or
+ *          doesn't fit
+ */
+size_t telemetry_frame_encode(const telemetry_frame *frame, uint8_t *out, size_t out_size);
+
+
+/*
+ * telemetry_frame_decode: Decode a frame
+ *    Arguments:
+ *       - data: uint8_t*. Received frame
+ *       - length: size_t. Length of data
+ *       - frame: telemetry_frame*. Decoded frame
+ *    Returns:
+ *       - ESP_OK, ESP_ERR_INVALID_VERSION if magic or version don't match,
+ *          ESP_ERR_INVALID_SIZE if data is truncated or has trailing bytes,
+ *          ESP_ERR_INVALID_ARG if a field is out of range
+ */
+esp_err_t telemetry_frame_decode(const uint8_t *data, size_t length, telemetry_frame *frame);
+
+
+/*
+ * telemetry_frame_value: Get a value as float
+ *    Arguments:
+ *       - frame: telemetry_frame*. Decoded frame
+ *       - index: uint8_t. Index of value
+ */
+float telemetry_frame_value(const telemetry_frame *frame, uint8_t index);
+
+#endif
@@ -20,49 +20,64 @@
 
 #include "esp_system.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
 #include "nvs.h"
 #include "nvs_flash.h"
 
 #include "lwip/err.h"
 #include "lwip/sys.h"
 
-// Program continues after semaphore is released
-SemaphoreHandle_t wifi_semaphore;
-
 #define WIFI_CONNECTED_BIT BIT0
 #define WIFI_FAIL_BIT      BIT1
 
 #define ESP_MAXIMUM_RETRY  3
 
-/*
- * wifi_init_sta: Setup wifi connection
- *    Arguments:
- *       - wifi_config: wifi_config_t. Struct with information
- *          to start wifi connection
- */
-void wifi_init_sta(wifi_config_t wifi_config);
+// Nvs namespace of the fast connect cache
+#define WIFI_CACHE_NAMESPACE "wifi_cache"
+// Seconds a cached ip lease is reused before asking dhcp for a new one. Dhcp
+// clients renew at half the lease, 1 h keeps the device within it for leases
+// of 2 h or more
+#define WIFI_CACHE_MAX_LEASE_AGE 3600
 
 
 /*
- * create_wifi_semaphore: Create wifi semaphore. Used to stop the program to
- *    continue if wifi isn't connected yet
+ * wifi_fast_connect_cache: Last good connection. Lets the station skip the
+ *    scan and dhcp. Kept in rtc memory and nvs
+ *    - magic: uint32_t. Marks valid contents
+ *    - bssid: uint8_t[6]. Access point
+ *    - channel: uint8_t. Channel of the access point
+ *    - lease_time: uint32_t. Time the ip lease was obtained, see
+ *       rtc_state_clock
+ *    - ip_info: tcpip_adapter_ip_info_t. Ip, netmask and gateway
+ *    - dns: tcpip_adapter_dns_info_t. Main dns server
  */
-void create_wifi_semaphore();
-
+typedef struct {
+   uint32_t magic;
+   uint8_t bssid[6];
+   uint8_t channel;
+   uint32_t lease_time;
+   tcpip_adapter_ip_info_t ip_info;
+   tcpip_adapter_dns_info_t dns;
+} wifi_fast_connect_cache;
 
 /*
- * take_from_wifi_semaphore: Increases semaphore count by one. Should be run after
- *   function wifi_init_sta
+ * wifi_init_sta: Setup wifi connection. If a previous connection was cached,
+ *    it connects directly to the same access point and channel with a static
+ *    ip. Falls back to scan and dhcp if that fails
  *    Arguments:
- *       - ticks: TickType_t. Timeout before the semaphore releases by itself
+ *       - wifi_config: wifi_config_t. Struct with information
+ *          to start wifi connection
  */
-void take_from_wifi_semaphore(TickType_t ticks);
+void wifi_init_sta(wifi_config_t wifi_config);
 
 
 /*
- * delete_wifi_semaphore: Delete wifi semaphore. Used after controller
- *   connected to wifi succesfully
+ * wifi_last_connect_time: Time from the start of the connection to getting
+ *    an ip, of the last connection
+ *    Returns:
+ *       - time: uint32_t. Time in ms
  */
-void delete_wifi_semaphore();
+uint32_t wifi_last_connect_time();
 
 #endif
@@ -0,0 +1,471 @@
+/*
+ * command.c
+ * @description: Implementation of the parser and dispatcher of remote
+ *    commands
+ * @author: @Retrocamara42
+ *
+ */
+#define LOG_LOCAL_LEVEL LOG_LEVEL_COMMAND
+#include "log_levels.h"
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "command.h"
+
+static const char *COMMAND_TAG = "command";
+static command_stats counters;
+
+/*
+ * queued_command: Message of the command queue
+ *    - length: uint16_t. Length of data
+ *    - data: char[]. Message
+ */
+typedef struct {
+   uint16_t length;
+   char data[COMMAND_QUEUE_MAX_LENGTH];
+} queued_command;
+
+// Written by the task that pushes, slots are only reused once run
+static queued_command queue[COMMAND_QUEUE_SIZE];
+static uint8_t queue_first;
+static volatile uint8_t queue_count;
+
+/*
+ * command_cursor: Position of the parser in the data
+ *    - data: const char*. Data
+ *    - position: size_t. Next character
+ *    - length: size_t. Length of data
+ */
+typedef struct {
+   const char* data;
+   size_t position;
+   size_t length;
+} command_cursor;
+
+
+/*
+ * skip_spaces: Move past blanks, returns the next character or 0 at the end
+ */
+static char skip_spaces(command_cursor *cursor){
+   while(cursor->position<cursor->length){
+      char c = cursor->data[cursor->position];
+      if(c!=' ' && c!='\t' && c!='\r' && c!='\n'){
+         return c;
+      }
+      cursor->position++;
+   }
+   return 0;
+}
+
+
+/*
+ * at_end: Move past blanks, returns 1 if nothing is left. A null character
+ *    is data like any other, not the end
+ */
+static uint8_t at_end(command_cursor *cursor){
+   skip_spaces(cursor);
+   return cursor->position>=cursor->length;
+}
+
+
+/*
+ * scan_string: Move past a string. Cursor is on the opening quote
+ */
+static esp_err_t scan_string(command_cursor *cursor, const char** text, size_t *length){
+   size_t start = ++cursor->position;
+   while(cursor->position<cursor->length){
+      char c = cursor->data[cursor->position];
+      if(c=='"'){
+         *text = cursor->data+start;
+         *length = cursor->position-start;
+         cursor->position++;
+         return ESP_OK;
+      }
+      if((unsigned char)c<0x20){
+         return ESP_ERR_INVALID_ARG;
+      }
+      // Escaped characters are kept, but can't end the string
+      cursor->position += c=='\\' ? 2 : 1;
+   }
+   return ESP_ERR_INVALID_ARG;
+}
+
+
+/*
+ * scan_number: Move past a number, checking its format
+ */
+static esp_err_t scan_number(command_cursor *cursor){
+   const char* data = cursor->data;
+   size_t i = cursor->position;
+   if(i<cursor->length && data[i]=='-'){
+      i++;
+   }
+   size_t digits = i;
+   while(i<cursor->length && data[i]>='0' && data[i]<='9') i++;
+   if(i==digits){
+      return ESP_ERR_INVALID_ARG;
+   }
+   if(i<cursor->length && data[i]=='.'){
+      digits = ++i;
+      while(i<cursor->length && data[i]>='0' && data[i]<='9') i++;
+      if(i==digits){
+         return ESP_ERR_INVALID_ARG;
+      }
+   }
+   if(i<cursor->length && (data[i]=='e' || data[i]=='E')){
+      i++;
+      if(i<cursor->length && (data[i]=='+' || data[i]=='-')){
+         i++;
+      }
+      digits = i;
+      while(i<cursor->length && data[i]>='0' && data[i]<='9') i++;
+      if(i==digits){
+         return ESP_ERR_INVALID_ARG;
+      }
+   }
+   cursor->position = i;
+   return ESP_OK;
+}
+
+
+/*
+ * scan_literal: Move past true, false or null
+ */
+static esp_err_t scan_literal(command_cursor *cursor, const char* literal){
+   size_t length = strlen(literal);
+   if(cursor->length-cursor->position<length
+         || memcmp(cursor->data+cursor->position, literal, length)!=0){
+      return ESP_ERR_INVALID_ARG;
+   }
+   cursor->position += length;
+   return ESP_OK;
+}
+
+
+/*
+ * scan_array: Move past a flat array of numbers or strings. Cursor is on
+ *    the opening bracket
+ */
+static esp_err_t scan_array(command_cursor *cursor){
+   cursor->position++;
+   if(skip_spaces(cursor)==']'){
+      cursor->position++;
+      return ESP_OK;
+   }
+   while(1){
+      char c = skip_spaces(cursor);
+      const char* text;
+      size_t length;
+      esp_err_t err = c=='"' ? scan_string(cursor, &text, &length) : scan_number(cursor);
+      if(err!=ESP_OK){
+         return err;
+      }
+      c = skip_spaces(cursor);
+      cursor->position++;
+      if(c==']'){
+         return ESP_OK;
+      }
+      if(c!=','){
+         return ESP_ERR_INVALID_ARG;
+      }
+   }
+}
+
+
+/*
+ * scan_value: Move past the value of a field and fill it in
+ */
+static esp_err_t scan_value(command_cursor *cursor, command_field *field){
+   char c = skip_spaces(cursor);
+   size_t start = cursor->position;
+   esp_err_t err;
+   if(c=='"'){
+      const char* text;
+      size_t length;
+      err = scan_string(cursor, &text, &length);
+      field->type = COMMAND_VALUE_STRING;
+      field->value = text;
+      field->value_length = length;
+      return err;
+   }
+   if(c=='['){
+      err = scan_array(cursor);
+      field->type = COMMAND_VALUE_ARRAY;
+      field->value = cursor->data+start+1;
+      field->value_length = cursor->position-start-2;
+      return err;
+   }
+   if(c=='t' || c=='f'){
+      err = scan_literal(cursor, c=='t' ? "true" : "false");
+      field->type = COMMAND_VALUE_BOOL;
+   }
+   else if(c=='n'){
+      err = scan_literal(cursor, "null");
+      field->type = COMMAND_VALUE_NULL;
+   }
+   else{
+      err = scan_number(cursor);
+      field->type = COMMAND_VALUE_NUMBER;
+   }
+   field->value = cursor->data+start;
+   field->value_length = cursor->position-start;
+   return err;
+}
+
+
+/*
+ * command_parse: Parse a flat json object
+ *    Arguments:
+ *       - data: const char*. Data, doesn't need to be null terminated
+ *       - length: size_t. Length of data
+ *       - message: command_message*. Where fields are written to
+ */
+esp_err_t command_parse(const char* data, size_t length, command_message *message){
+   command_cursor cursor = { data, 0, length };
+   message->field_count = 0;
+   if(data==NULL || length>UINT16_MAX || skip_spaces(&cursor)!='{'){
+      return ESP_ERR_INVALID_ARG;
+   }
+   cursor.position++;
+   if(skip_spaces(&cursor)=='}'){
+      cursor.position++;
+      return at_end(&cursor) ? ESP_OK : ESP_ERR_INVALID_ARG;
+   }
+   while(1){
+      if(message->field_count>=COMMAND_MAX_FIELDS){
+         return ESP_ERR_INVALID_SIZE;
+      }
+      command_field *field = &message->fields[message->field_count];
+      const char* key;
+      size_t key_length;
+      if(skip_spaces(&cursor)!='"' || scan_string(&cursor, &key, &key_length)!=ESP_OK
+            || key_length>UINT8_MAX || skip_spaces(&cursor)!=':'){
+         return ESP_ERR_INVALID_ARG;
+      }
+      cursor.position++;
+      field->key = key;
+      field->key_length = key_length;
+      if(scan_value(&cursor, field)!=ESP_OK){
+         return ESP_ERR_INVALID_ARG;
+      }
+      message->field_count++;
+      char c = skip_spaces(&cursor);
+      cursor.position++;
+      if(c=='}'){
+         // Nothing but blanks after the object
+         return at_end(&cursor) ? ESP_OK : ESP_ERR_INVALID_ARG;
+      }
+      if(c!=','){
+         return ESP_ERR_INVALID_ARG;
+      }
+   }
+}
+
+
+/*
+ * command_equals: Compare a key or string value with a null terminated string
+ */
+uint8_t command_equals(const char* text, size_t length, const char* expected){
+   return strlen(expected)==length && memcmp(text, expected, length)==0;
+}
+
+
+/*
+ * command_find: Find a field by key
+ */
+const command_field* command_find(const command_message *message, const char* key){
+   for(uint8_t i=0; i<message->field_count; i++){
+      if(command_equals(message->fields[i].key, message->fields[i].key_length, key)){
+         return &message->fields[i];
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ * to_number: Convert a number checked by scan_number
+ */
+static float to_number(const char* text, size_t length){
+   size_t i=0;
+   float sign=1;
+   float number=0;
+   if(text[i]=='-'){
+      sign=-1;
+      i++;
+   }
+   while(i<length && text[i]>='0' && text[i]<='9'){
+      number = number*10+(text[i++]-'0');
+   }
+   if(i<length && text[i]=='.'){
+      float scale=0.1f;
+      for(i++; i<length && text[i]>='0' && text[i]<='9'; i++){
+         number += (text[i]-'0')*scale;
+         scale *= 0.1f;
+      }
+   }
+   if(i<length && (text[i]=='e' || text[i]=='E')){
+      int exponent=0;
+      int exponent_sign=1;
+      i++;
+      if(text[i]=='+' || text[i]=='-'){
+         exponent_sign = text[i++]=='-' ? -1 : 1;
+      }
+      while(i<length && exponent<64){
+         exponent = exponent*10+(text[i++]-'0');
+      }
+      while(exponent-->0){
+         number = exponent_sign>0 ? number*10 : number/10;
+      }
+   }
+   return sign*number;
+}
+
+
+/*
+ * command_get_number: Get the number of a field
+ */
+esp_err_t command_get_number(const command_message *message, const char* key, float *number){
+   const command_field *field = command_find(message, key);
+   if(field==NULL){
+      return ESP_ERR_NOT_FOUND;
+   }
+   if(field->type!=COMMAND_VALUE_NUMBER){
+      return ESP_ERR_INVALID_ARG;
+   }
+   *number = to_number(field->value, field->value_length);
+   return ESP_OK;
+}
+
+
+/*
+ * command_get_numbers: Get the numbers of an array field
+ */
+int command_get_numbers(const command_message *message, const char* key, float *numbers, uint8_t max){
+   const command_field *field = command_find(message, key);
+   if(field==NULL || field->type!=COMMAND_VALUE_ARRAY){
+      return -1;
+   }
+   command_cursor cursor = { field->value, 0, field->value_length };
+   int count=0;
+   while(skip_spaces(&cursor)!=0){
+      size_t start = cursor.position;
+      if(cursor.data[start]=='"' || scan_number(&cursor)!=ESP_OK){
+         return -1;
+      }
+      if(count<max){
+         numbers[count++] = to_number(cursor.data+start, cursor.position-start);
+      }
+      if(skip_spaces(&cursor)==','){
+         cursor.position++;
+      }
+   }
+   return count;
+}
+
+
+/*
+ * command_dispatch: Parse a message and run its command
+ *    Arguments:
+ *       - table: command_entry*. Known commands
+ *       - table_size: uint8_t. Entries of table
+ *       - data: const char*. Message
+ *       - length: size_t. Length of message
+ *       - arg: void*. Argument given to the handler
+ */
+esp_err_t command_dispatch(const command_entry *table, uint8_t table_size,
+      const char* data, size_t length, void *arg){
+   command_message message;
+   counters.received++;
+   esp_err_t err = command_parse(data, length, &message);
+   if(err!=ESP_OK || message.field_count==0){
+      counters.malformed++;
+      ESP_LOGW(COMMAND_TAG, "Malformed command: %.*s", (int)length, data);
+      return err!=ESP_OK ? err : ESP_ERR_INVALID_ARG;
+   }
+   const command_field *name = command_find(&message, COMMAND_NAME_KEY);
+   const char* name_text = message.fields[0].key;
+   size_t name_length = message.fields[0].key_length;
+   if(name!=NULL && name->type==COMMAND_VALUE_STRING){
+      name_text = name->value;
+      name_length = name->value_length;
+   }
+   for(uint8_t i=0; i<table_size; i++){
+      if(command_equals(name_text, name_length, table[i].name)){
+         err = table[i].handler(&message, arg);
+         if(err==ESP_OK){
+            counters.run++;
+         }
+         else{
+            counters.failed++;
+            ESP_LOGW(COMMAND_TAG, "Command %s failed: %s", table[i].name, esp_err_to_name(err));
+         }
+         return err;
+      }
+   }
+   counters.unknown++;
+   ESP_LOGW(COMMAND_TAG, "Unknown command: %.*s", (int)name_length, name_text);
+   return ESP_ERR_NOT_SUPPORTED;
+}
+
+
+/*
+ * command_queue_push: Copy a message to the command queue
+ *    Arguments:
+ *       - data: const char*. Message
+ *       - length: size_t. Length of message
+ */
+esp_err_t command_queue_push(const char* data, size_t length){
+   if(length>COMMAND_QUEUE_MAX_LENGTH){
+      counters.dropped++;
+      return ESP_ERR_INVALID_SIZE;
+   }
+   portENTER_CRITICAL();
+   uint8_t count = queue_count;
+   uint8_t slot = (queue_first+count)%COMMAND_QUEUE_SIZE;
+   portEXIT_CRITICAL();
+   if(count>=COMMAND_QUEUE_SIZE){
+      counters.dropped++;
+      ESP_LOGW(COMMAND_TAG, "Command queue full, dropped: %.*s", (int)length, data);
+      return ESP_ERR_NO_MEM;
+   }
+   memcpy(queue[slot].data, data, length);
+   queue[slot].length = length;
+   portENTER_CRITICAL();
+   queue_count++;
+   portEXIT_CRITICAL();
+   return ESP_OK;
+}
+
+
+/*
+ * command_queue_run: Dispatch the messages of the command queue
+ *    Arguments:
+ *       - table: command_entry*. Known commands
+ *       - table_size: uint8_t. Entries of table
+ *       - arg: void*. Argument given to the handlers
+ */
+uint8_t command_queue_run(const command_entry *table, uint8_t table_size, void *arg){
+   uint8_t run = 0;
+   while(queue_count>0){
+      // The slot isn't written again until it leaves the queue
+      queued_command *command = &queue[queue_first];
+      command_dispatch(table, table_size, command->data, command->length, arg);
+      portENTER_CRITICAL();
+      queue_first = (queue_first+1)%COMMAND_QUEUE_SIZE;
+      queue_count--;
+      portEXIT_CRITICAL();
+      run++;
+   }
+   return run;
+}
+
+
+/*
+ * get_command_stats: Get counters of the dispatcher
+ *    Arguments:
+ *       - stats: command_stats*. Where counters are copied to
+ */
+void get_command_stats(command_stats *stats){
+   *stats=counters;
+}
@@ -0,0 +1,314 @@
+/*
+ * deflate_stream.c
+ * @description: Implementation of a streaming deflate compressor with a
+ *    small fixed window
+ * @author: @Retrocamara42
+ *
+ */
+#include <string.h>
+
+#include "deflate_stream.h"
+#include "delta_patch.h"
+
+#define GZIP_HEADER_SIZE 10
+#define ZLIB_HEADER_SIZE 2
+
+// Lengths and distances of each symbol, and their extra bits (RFC 1951 3.2.5)
+static const uint16_t length_base[29] = {
+   3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+   35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t length_extra[29] = {
+   0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+   3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t distance_base[30] = {
+   1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+   257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t distance_extra[30] = {
+   0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+   7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+
+/*
+ * put_bits: Write bits, first bit lowest
+ */
+static void put_bits(deflate_stream *stream, uint32_t value, uint8_t count){
+   stream->bits |= value<<stream->bit_count;
+   stream->bit_count += count;
+   while(stream->bit_count>=8){
+      if(stream->out_length<stream->out_size){
+         stream->out[stream->out_length++] = stream->bits;
+      }
+      else{
+         stream->error = ESP_ERR_NO_MEM;
+      }
+      stream->bits >>= 8;
+      stream->bit_count -= 8;
+   }
+}
+
+
+/*
+ * put_code: Write a huffman code. Codes go most significant bit first
+ */
+static void put_code(deflate_stream *stream, uint16_t code, uint8_t length){
+   uint16_t reversed = 0;
+   for(uint8_t i=0; i<length; i++){
+      reversed = (reversed<<1)|(code&1);
+      code >>= 1;
+   }
+   put_bits(stream, reversed, length);
+}
+
+
+/*
+ * put_symbol: Write a literal/length symbol with the fixed codes
+ */
+static void put_symbol(deflate_stream *stream, uint16_t symbol){
+   if(symbol<144){
+      put_code(stream, 0x30+symbol, 8);
+   }
+   else if(symbol<256){
+      put_code(stream, 0x190+symbol-144, 9);
+   }
+   else if(symbol<280){
+      put_code(stream, symbol-256, 7);
+   }
+   else{
+      put_code(stream, 0xC0+symbol-280, 8);
+   }
+}
+
+
+/*
+ * put_match: Write the length and distance of a match
+ */
+static void put_match(deflate_stream *stream, uint16_t length, uint16_t distance){
+   uint8_t i = 0;
+   while(i<28 && length_base[i+1]<=length){
+      i++;
+   }
+   put_symbol(stream, 257+i);
+   put_bits(stream, length-length_base[i], length_extra[i]);
+   i = 0;
+   while(i<29 && distance_base[i+1]<=distance){
+      i++;
+   }
+   put_code(stream, i, 5);
+   put_bits(stream, distance-distance_base[i], distance_extra[i]);
+}
+
+
+static void put_byte(deflate_stream *stream, uint8_t byte){
+   put_bits(stream, byte, 8);
+}
+
+
+static void put_le32(deflate_stream *stream, uint32_t value){
+   for(uint8_t i=0; i<4; i++){
+      put_byte(stream, value>>(8*i));
+   }
+}
+
+
+static uint32_t adler32(uint32_t adler, const uint8_t *data, size_t length){
+   uint32_t a = adler&0xffff;
+   uint32_t b = adler>>16;
+   while(length>0){
+      // Largest run that can't overflow b
+      size_t run = length<5552 ? length : 5552;
+      length -= run;
+      while(run--){
+         a += *data++;
+         b += a;
+      }
+      a %= 65521;
+      b %= 65521;
+   }
+   return (b<<16)|a;
+}
+
+
+/*
+ * hash: Hash of the 3 bytes at a position of the window
+ */
+static uint16_t hash(const uint8_t *bytes){
+   uint32_t key = (bytes[0]<<16)|(bytes[1]<<8)|bytes[2];
+   return (key*2654435761U)>>(32-DEFLATE_HASH_BITS);
+}
+
+
+/*
+ * compress: Code the bytes of the window that have a full lookahead, or
+ *    all of them
+ *    Arguments:
+ *       - flush: uint8_t. 1 to code every byte
+ */
+static void compress(deflate_stream *stream, uint8_t flush){
+   while(stream->error==ESP_OK){
+      uint16_t position = stream->position;
+      uint16_t lookahead = stream->fill-position;
+      if(lookahead==0 || (!flush && lookahead<DEFLATE_MAX_MATCH)){
+         return;
+      }
+      uint16_t length = 0;
+      uint16_t distance = 0;
+      if(lookahead>=DEFLATE_MIN_MATCH){
+         uint16_t key = hash(stream->window+position);
+         uint16_t candidate = stream->head[key];
+         stream->head[key] = position+1;
+         if(candidate>0 && position-(candidate-1)<=DEFLATE_WINDOW_SIZE){
+            candidate--;
+            uint16_t longest = lookahead<DEFLATE_MAX_MATCH ? lookahead : DEFLATE_MAX_MATCH;
+            while(length<longest && stream->window[candidate+length]==stream->window[position+length]){
+               length++;
+            }
+            distance = position-candidate;
+         }
+      }
+      if(length<DEFLATE_MIN_MATCH){
+         put_symbol(stream, stream->window[position]);
+         stream->position++;
+         continue;
+      }
+      put_match(stream, length, distance);
+      // Bytes inside the match can start later matches
+      for(uint16_t i=position+1; i<position+length && stream->fill-i>=DEFLATE_MIN_MATCH; i++){
+         stream->head[hash(stream->window+i)] = i+1;
+      }
+      stream->position += length;
+   }
+}
+
+
+/*
+ * slide: Drop the first half of the window, which matches can't reach
+ *    anymore
+ */
+static void slide(deflate_stream *stream){
+   memmove(stream->window, stream->window+DEFLATE_WINDOW_SIZE, stream->fill-DEFLATE_WINDOW_SIZE);
+   stream->fill -= DEFLATE_WINDOW_SIZE;
+   stream->position -= DEFLATE_WINDOW_SIZE;
+   for(uint16_t i=0; i<(1<<DEFLATE_HASH_BITS); i++){
+      stream->head[i] = stream->head[i]>DEFLATE_WINDOW_SIZE ? stream->head[i]-DEFLATE_WINDOW_SIZE : 0;
+   }
+}
+
+
+/*
+ * deflate_stream_init: Start a compression
+ *    Arguments:
+ *       - stream: deflate_stream*. State to initialize
+ *       - format: deflate_format. Header and trailer of the data
+ *       - out: uint8_t*. Buffer of the compressed data
+ *       - out_size: size_t. Size of out
+ */
+esp_err_t deflate_stream_init(deflate_stream *stream, deflate_format format,
+      uint8_t *out, size_t out_size){
+   memset(stream, 0, sizeof *stream);
+   stream->out = out;
+   stream->out_size = out_size;
+   stream->format = format;
+   if(format==DEFLATE_FORMAT_GZIP){
+      // No name, time or extra fields, unknown os
+      const uint8_t header[GZIP_HEADER_SIZE] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 255};
+      for(uint8_t i=0; i<GZIP_HEADER_SIZE; i++){
+         put_byte(stream, header[i]);
+      }
+   }
+   else if(format==DEFLATE_FORMAT_ZLIB){
+      // Method 8 with the window size, check bits make the header a
+      // multiple of 31
+      uint8_t window_bits = 0;
+      for(uint32_t size=256; size<DEFLATE_WINDOW_SIZE; size<<=1){
+         window_bits++;
+      }
+      uint8_t method = 8|(window_bits<<4);
+      put_byte(stream, method);
+      put_byte(stream, 31-(method<<8)%31);
+      stream->check = 1;
+   }
+   // Single final block with the fixed codes
+   put_bits(stream, 1, 1);
+   put_bits(stream, 1, 2);
+   return stream->error;
+}
+
+
+/*
+ * deflate_stream_fits: Check that some more input can be written and the
+ *    stream still finished without running out of room
+ *    Arguments:
+ *       - stream: deflate_stream*. Compression
+ *       - length: size_t. Bytes of input still to write
+ */
+uint8_t deflate_stream_fits(const deflate_stream *stream, size_t length){
+   size_t trailer = stream->format==DEFLATE_FORMAT_GZIP ? 8
+      : stream->format==DEFLATE_FORMAT_ZLIB ? 4 : 0;
+   // Bytes waiting in the window, at most 9 bits each, and the end of block
+   size_t bits = stream->bit_count+(stream->fill-stream->position+length)*9+7;
+   return stream->error==ESP_OK
+      && stream->out_length+(bits+7)/8+trailer<=stream->out_size;
+}
+
+
+/*
+ * deflate_stream_write: Compress more input
+ *    Arguments:
+ *       - stream: deflate_stream*. Compression
+ *       - data: uint8_t*. Input
+ *       - length: size_t. Length of data
+ */
+esp_err_t deflate_stream_write(deflate_stream *stream, const uint8_t *data, size_t length){
+   if(stream->error!=ESP_OK){
+      return stream->error;
+   }
+   if(stream->format==DEFLATE_FORMAT_GZIP){
+      stream->check = delta_crc32(stream->check, data, length);
+   }
+   else if(stream->format==DEFLATE_FORMAT_ZLIB){
+      stream->check = adler32(stream->check, data, length);
+   }
+   stream->total_in += length;
+   while(length>0 && stream->error==ESP_OK){
+      if(stream->fill==sizeof stream->window){
+         slide(stream);
+      }
+      size_t room = sizeof stream->window-stream->fill;
+      size_t chunk = length<room ? length : room;
+      memcpy(stream->window+stream->fill, data, chunk);
+      stream->fill += chunk;
+      data += chunk;
+      length -= chunk;
+      compress(stream, 0);
+   }
+   return stream->error;
+}
+
+
+/*
+ * deflate_stream_finish: Compress the input left and write the end of the
+ *    block and the trailer
+ *    Arguments:
+ *       - stream: deflate_stream*. Compression
+ */
+esp_err_t deflate_stream_finish(deflate_stream *stream){
+   compress(stream, 1);
+   put_symbol(stream, 256);
+   if(stream->bit_count>0){
+      put_bits(stream, 0, 8-stream->bit_count);
+   }
+   if(stream->format==DEFLATE_FORMAT_GZIP){
+      put_le32(stream, stream->check);
+      put_le32(stream, stream->total_in);
+   }
+   else if(stream->format==DEFLATE_FORMAT_ZLIB){
+      for(int8_t i=3; i>=0; i--){
+         put_byte(stream, stream->check>>(8*i));
+      }
+   }
+   return stream->error;
+}
@@ -0,0 +1,343 @@
+/*
+ * delta_patch.c
+ * @description: Implementation of the streaming applier of binary patches
+ * @author: @Retrocamara42
+ *
+ */
+#include <string.h>
+
+#include "delta_patch.h"
+
+// Part of the patch expected next
+#define DELTA_STATE_HEADER 0
+#define DELTA_STATE_ADD 1
+#define DELTA_STATE_COPY 2
+#define DELTA_STATE_SEEK 3
+#define DELTA_STATE_ZEROS 4
+#define DELTA_STATE_LITERALS 5
+#define DELTA_STATE_LITERAL_BYTES 6
+#define DELTA_STATE_DATA 7
+#define DELTA_STATE_DONE 8
+
+// Crc32 of each value of a nibble, reflected polynomial 0xEDB88320
+static const uint32_t crc_nibbles[16] = {
+   0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+   0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+
+/*
+ * delta_crc32: Update a crc32 (ieee 802.3) with some bytes
+ *    Arguments:
+ *       - crc: uint32_t. Crc of the previous bytes, 0 to start
+ *       - data: uint8_t*. Bytes
+ *       - length: size_t. Length of data
+ */
+uint32_t delta_crc32(uint32_t crc, const uint8_t *data, size_t length){
+   crc = ~crc;
+   for(size_t i=0; i<length; i++){
+      crc ^= data[i];
+      crc = (crc>>4)^crc_nibbles[crc&0xf];
+      crc = (crc>>4)^crc_nibbles[crc&0xf];
+   }
+   return ~crc;
+}
+
+
+static uint32_t read_le32(const uint8_t *bytes){
+   return bytes[0]|(bytes[1]<<8)|(bytes[2]<<16)|((uint32_t)bytes[3]<<24);
+}
+
+
+/*
+ * delta_patch_init: Start applying a patch
+ *    Arguments:
+ *       - patch: delta_patch*. State of the patch
+ *       - read_old: delta_read_cb. Reads the old image
+ *       - write_new: delta_write_cb. Writes the new image
+ *       - arg: void*. Argument of both
+ */
+void delta_patch_init(delta_patch *patch, delta_read_cb read_old, delta_write_cb write_new,
+      void *arg){
+   memset(patch, 0, sizeof *patch);
+   patch->read_old = read_old;
+   patch->write_new = write_new;
+   patch->arg = arg;
+   patch->state = DELTA_STATE_HEADER;
+}
+
+
+/*
+ * flush_window: Write the bytes of the window to the new image
+ */
+static esp_err_t flush_window(delta_patch *patch){
+   if(patch->window_length==0){
+      return ESP_OK;
+   }
+   patch->crc = delta_crc32(patch->crc, patch->window, patch->window_length);
+   esp_err_t err = patch->write_new(patch->arg, patch->window, patch->window_length);
+   patch->window_length = 0;
+   return err;
+}
+
+
+/*
+ * emit_old: Put bytes of the old image in the window, with a diff added
+ *    Arguments:
+ *       - patch: delta_patch*. State of the patch
+ *       - length: uint32_t. Bytes, checked against both images by the caller
+ *       - diff: uint8_t*. Bytes added to each one, NULL for none
+ */
+static esp_err_t emit_old(delta_patch *patch, uint32_t length, const uint8_t *diff){
+   while(length>0){
+      if(patch->window_length==DELTA_WINDOW_SIZE){
+         esp_err_t err = flush_window(patch);
+         if(err!=ESP_OK){
+            return err;
+         }
+      }
+      uint32_t room = DELTA_WINDOW_SIZE-patch->window_length;
+      uint32_t chunk = length<room ? length : room;
+      uint8_t *out = patch->window+patch->window_length;
+      esp_err_t err = patch->read_old(patch->arg, patch->old_position, out, chunk);
+      if(err!=ESP_OK){
+         return err;
+      }
+      if(diff!=NULL){
+         for(uint32_t i=0; i<chunk; i++){
+            out[i] += diff[i];
+         }
+         diff += chunk;
+      }
+      patch->window_length += chunk;
+      patch->old_position += chunk;
+      patch->written += chunk;
+      length -= chunk;
+   }
+   return ESP_OK;
+}
+
+
+/*
+ * emit_data: Put bytes of the patch in the window
+ */
+static esp_err_t emit_data(delta_patch *patch, const uint8_t *data, uint32_t length){
+   while(length>0){
+      if(patch->window_length==DELTA_WINDOW_SIZE){
+         esp_err_t err = flush_window(patch);
+         if(err!=ESP_OK){
+            return err;
+         }
+      }
+      uint32_t room = DELTA_WINDOW_SIZE-patch->window_length;
+      uint32_t chunk = length<room ? length : room;
+      memcpy(patch->window+patch->window_length, data, chunk);
+      patch->window_length += chunk;
+      patch->written += chunk;
+      data += chunk;
+      length -= chunk;
+   }
+   return ESP_OK;
+}
+
+
+/*
+ * check_old_image: Compare the crc of the old image with the one of the
+ *    header. The window is free before the first record and is used to read
+ */
+static esp_err_t check_old_image(delta_patch *patch){
+   uint32_t crc = 0;
+   for(uint32_t offset=0; offset<patch->old_size; offset+=DELTA_WINDOW_SIZE){
+      uint32_t left = patch->old_size-offset;
+      uint32_t chunk = left<DELTA_WINDOW_SIZE ? left : DELTA_WINDOW_SIZE;
+      esp_err_t err = patch->read_old(patch->arg, offset, patch->window, chunk);
+      if(err!=ESP_OK){
+         return err;
+      }
+      crc = delta_crc32(crc, patch->window, chunk);
+   }
+   return crc==patch->old_crc ? ESP_OK : ESP_ERR_INVALID_CRC;
+}
+
+
+/*
+ * read_header: Check a complete header
+ */
+static esp_err_t read_header(delta_patch *patch){
+   if(read_le32(patch->header)!=DELTA_MAGIC){
+      return ESP_ERR_INVALID_VERSION;
+   }
+   patch->old_size = read_le32(patch->header+4);
+   patch->old_crc = read_le32(patch->header+8);
+   patch->new_size = read_le32(patch->header+12);
+   patch->new_crc = read_le32(patch->header+16);
+   esp_err_t err = check_old_image(patch);
+   patch->state = patch->new_size>0 ? DELTA_STATE_ADD : DELTA_STATE_DONE;
+   return err;
+}
+
+
+/*
+ * end_record: Apply the seek of a record and go to the next one
+ */
+static esp_err_t end_record(delta_patch *patch){
+   int64_t position = (int64_t)patch->old_position+patch->seek;
+   if(position<0 || position>patch->old_size){
+      return ESP_ERR_INVALID_SIZE;
+   }
+   patch->old_position = (uint32_t)position;
+   patch->state = patch->written==patch->new_size ? DELTA_STATE_DONE : DELTA_STATE_ADD;
+   return ESP_OK;
+}
+
+
+/*
+ * next_part: Go to the part of the record after the diff runs of the add
+ *    bytes left
+ */
+static esp_err_t next_part(delta_patch *patch){
+   if(patch->add>0){
+      patch->state = DELTA_STATE_ZEROS;
+      return ESP_OK;
+   }
+   if(patch->copy>0){
+      patch->state = DELTA_STATE_DATA;
+      return ESP_OK;
+   }
+   return end_record(patch);
+}
+
+
+/*
+ * read_varint_field: A varint of the patch is complete, use it
+ */
+static esp_err_t read_varint_field(delta_patch *patch, uint32_t value){
+   switch(patch->state){
+      case DELTA_STATE_ADD:
+         patch->add = value;
+         patch->state = DELTA_STATE_COPY;
+         return ESP_OK;
+      case DELTA_STATE_COPY:
+         patch->copy = value;
+         patch->state = DELTA_STATE_SEEK;
+         return ESP_OK;
+      case DELTA_STATE_SEEK:
+         patch->seek = (int32_t)((value>>1)^(0-(value&1)));
+         // Bytes of both images used by the record are checked once, here
+         if(patch->add>patch->new_size-patch->written
+               || patch->copy>patch->new_size-patch->written-patch->add
+               || patch->add>patch->old_size-patch->old_position){
+            return ESP_ERR_INVALID_SIZE;
+         }
+         return next_part(patch);
+      case DELTA_STATE_ZEROS:
+         if(value>patch->add){
+            return ESP_ERR_INVALID_SIZE;
+         }
+         patch->add -= value;
+         patch->state = DELTA_STATE_LITERALS;
+         return emit_old(patch, value, NULL);
+      case DELTA_STATE_LITERALS:
+         if(value>patch->add){
+            return ESP_ERR_INVALID_SIZE;
+         }
+         patch->literals = value;
+         patch->add -= value;
+         if(value>0){
+            patch->state = DELTA_STATE_LITERAL_BYTES;
+            return ESP_OK;
+         }
+         return next_part(patch);
+      default:
+         return ESP_ERR_INVALID_STATE;
+   }
+}
+
+
+/*
+ * delta_patch_feed: Apply the next bytes of a patch
+ *    Arguments:
+ *       - patch: delta_patch*. State of the patch
+ *       - data: uint8_t*. Bytes of the patch
+ *       - length: size_t. Length of data
+ */
+esp_err_t delta_patch_feed(delta_patch *patch, const uint8_t *data, size_t length){
+   while(length>0 && patch->error==ESP_OK){
+      esp_err_t err = ESP_OK;
+      size_t used = 1;
+      if(patch->state==DELTA_STATE_HEADER){
+         size_t left = DELTA_HEADER_SIZE-patch->received;
+         used = length<left ? length : left;
+         memcpy(patch->header+patch->received, data, used);
+         if(used==left){
+            err = read_header(patch);
+         }
+      }
+      else if(patch->state==DELTA_STATE_LITERAL_BYTES){
+         used = length<patch->literals ? length : patch->literals;
+         err = emit_old(patch, used, data);
+         patch->literals -= used;
+         if(err==ESP_OK && patch->literals==0){
+            err = next_part(patch);
+         }
+      }
+      else if(patch->state==DELTA_STATE_DATA){
+         used = length<patch->copy ? length : patch->copy;
+         err = emit_data(patch, data, used);
+         patch->copy -= used;
+         if(err==ESP_OK && patch->copy==0){
+            err = end_record(patch);
+         }
+      }
+      else if(patch->state==DELTA_STATE_DONE){
+         err = ESP_ERR_INVALID_SIZE;
+      }
+      else{
+         // Varints of the records
+         patch->varint |= (uint32_t)(data[0]&0x7f)<<patch->varint_shift;
+         patch->varint_shift += 7;
+         if(!(data[0]&0x80)){
+            uint32_t value = patch->varint;
+            patch->varint = 0;
+            patch->varint_shift = 0;
+            err = read_varint_field(patch, value);
+         }
+         else if(patch->varint_shift>=32){
+            err = ESP_ERR_INVALID_SIZE;
+         }
+      }
+      patch->received += used;
+      data += used;
+      length -= used;
+      patch->error = err;
+   }
+   return patch->error;
+}
+
+
+/*
+ * delta_patch_finish: Write the rest of the window and check the new image
+ *    Arguments:
+ *       - patch: delta_patch*. State of the patch
+ */
+esp_err_t delta_patch_finish(delta_patch *patch){
+   if(patch->error!=ESP_OK){
+      return patch->error;
+   }
+   if(patch->state!=DELTA_STATE_DONE){
+      return patch->error = ESP_ERR_INVALID_SIZE;
+   }
+   patch->error = flush_window(patch);
+   if(patch->error==ESP_OK && patch->crc!=patch->new_crc){
+      patch->error = ESP_ERR_INVALID_CRC;
+   }
+   return patch->error;
+}
+
+
+/*
+ * delta_patch_new_size: Size of the new image, 0 until the header is read
+ */
+uint32_t delta_patch_new_size(const delta_patch *patch){
+   return patch->state==DELTA_STATE_HEADER ? 0 : patch->new_size;
+}
@@ -5,18 +5,25 @@
  * @author: @Retrocamara42
  *
  */
+#define LOG_LOCAL_LEVEL LOG_LEVEL_DHT
+#include "log_levels.h"
+#include <stdio.h>
+
 #include "dht_driver.h"
 
 static char *DHT_TAG = "dht";
+// Only one frame is captured at a time
+static dht_edge_capture dht_capture;
 
 /*
- * dht_config: Configure gpio port for dht sensor. Additionally, it initializes
- *    temperature and humidity to -99
+ * dht_config: Configure gpio port for dht sensor and build its payloads.
+ *    Additionally, it initializes temperature and humidity to -99
  *       Arguments:
  *          -dht_sensor: DhtSensor struct. Contains configuration options
  *             for dht sensor.
+ *          -device_name: char*. Name of the device. To be part of the payload
  */
-void dht_config(DhtSensor **dht_sensor){
+void dht_config(DhtSensor **dht_sensor, char* device_name){
    esp_task_wdt_reset();
    //ESP_LOGI(DHT_TAG, "dht_config init");
    uint32_t dht_pin=(*dht_sensor)->dht_pin;
@@ -24,14 +31,215 @@ void dht_config(DhtSensor **dht_sensor){
    gpio_config_t io_conf;
    io_conf.intr_type = GPIO_INTR_DISABLE;
    io_conf.mode = GPIO_MODE_INPUT;
-   uint32_t gpio_mask = dht_pin;
+   uint32_t gpio_mask = 1<<dht_pin;
    io_conf.pin_bit_mask = gpio_mask;
-   io_conf.pull_down_en = 1;
-   io_conf.pull_up_en = 0;
+   // Data line idles high
+   io_conf.pull_down_en = 0;
+   io_conf.pull_up_en = 1;
    gpio_config(&io_conf);
+   if(DHT_EDGE_CAPTURE){
+      // Fails if it was already installed, which is fine
+      gpio_install_isr_service(0);
+   }
+
+   // Payloads are built once, readings only rewrite their digits
+   uint8_t dht_dec_place=dht_decimal_places((*dht_sensor)->dht_type);
+   payload_encoder *temp_payload=&(*dht_sensor)->temperature_payload;
+   payload_encoder *humid_payload=&(*dht_sensor)->humidity_payload;
+   if(payload_encoder_init(temp_payload, device_name)!=ESP_OK
+         || payload_encoder_init(humid_payload, device_name)!=ESP_OK){
+      ESP_LOGE(DHT_TAG, "Invalid device name, sending payloads without it");
+      payload_encoder_init(temp_payload, NULL);
+      payload_encoder_init(humid_payload, NULL);
+   }
+   payload_encoder_add_field(temp_payload, "temp", DHT_INTEGER_DIGITS, dht_dec_place);
+   payload_encoder_add_field(humid_payload, "humid", DHT_INTEGER_DIGITS, dht_dec_place);
 
    (*dht_sensor)->temperature=-99;
    (*dht_sensor)->humidity=-99;
+   // The sensor needs the read interval after power on too
+   (*dht_sensor)->last_frame_us=0;
+   memset(&(*dht_sensor)->stats, 0, sizeof (*dht_sensor)->stats);
+}
+
+
+/*
+ * dht_decimal_places: Decimal places given by a dht sensor type. 0 for
+ *    DHT11, 1 for the rest
+ *       Arguments:
+ *          -dht_type: dht_sensor_type_t. Type of sensor
+ */
+uint8_t dht_decimal_places(dht_sensor_type_t dht_type){
+   return dht_type==DHT_TYPE_DHT11 ? 0 : 1;
+}
+
+
+/*
+ * dht_telemetry_type: Sensor type of binary frames for a dht sensor type
+ *       Arguments:
+ *          -dht_type: dht_sensor_type_t. Type of sensor
+ */
+uint8_t dht_telemetry_type(dht_sensor_type_t dht_type){
+   switch(dht_type){
+      case DHT_TYPE_DHT11: return TELEMETRY_SENSOR_DHT11;
+      case DHT_TYPE_AM2301: return TELEMETRY_SENSOR_AM2301;
+      case DHT_TYPE_SI7021: return TELEMETRY_SENSOR_SI7021;
+      default: return TELEMETRY_SENSOR_UNKNOWN;
+   }
+}
+
+
+/*
+ * dht_edge_isr: Keep the time of a falling edge of the data line. The
+ *    reading task is woken by the last edge of a frame
+ */
+static void IRAM_ATTR dht_edge_isr(void *arg){
+   uint8_t count=dht_capture.count;
+   if(count<DHT_MAX_EDGES){
+      dht_capture.edges[count]=(uint32_t)esp_timer_get_time();
+      dht_capture.count=count+1;
+      if(count+1==DHT_FRAME_EDGES){
+         event_loop_post_from_isr(EVENT_LOOP_SENSOR);
+      }
+   }
+}
+
+
+/*
+ * dht_convert: Convert two bytes of a frame to a value. Same as esp-idf-lib
+ */
+static float dht_convert(dht_sensor_type_t dht_type, uint8_t msb, uint8_t lsb){
+   if(dht_type==DHT_TYPE_DHT11){
+      return msb;
+   }
+   int16_t value=((msb&0x7F)<<8)|lsb;
+   return (msb&0x80 ? -value : value)/10.0f;
+}
+
+
+/*
+ * dht_decode_edges: Decode a frame from the time of its falling edges
+ *       Arguments:
+ *          -edges: uint32_t*. Time of each falling edge, in us
+ *          -count: uint8_t. Edges
+ *          -dht_type: dht_sensor_type_t. Type of sensor
+ *          -humidity: float*. Output
+ *          -temperature: float*. Output
+ */
+esp_err_t dht_decode_edges(const uint32_t *edges, uint8_t count,
+         dht_sensor_type_t dht_type, float *humidity, float *temperature){
+   // Bits are read from the last edges, the response edge is not needed
+   if(count<DHT_FRAME_EDGES-1){
+      return ESP_ERR_TIMEOUT;
+   }
+   const uint32_t *bit_edges=edges+count-(DHT_FRAME_EDGES-1);
+   uint8_t data[5]={0};
+   for(uint8_t i=0; i<40; i++){
+      uint32_t duration=bit_edges[i+1]-bit_edges[i];
+      if(duration<DHT_MIN_BIT_US || duration>DHT_MAX_BIT_US){
+         return ESP_ERR_TIMEOUT;
+      }
+      data[i/8]=(data[i/8]<<1)|(duration>DHT_BIT_THRESHOLD_US);
+   }
+   if(((data[0]+data[1]+data[2]+data[3])&0xFF)!=data[4]){
+      return ESP_ERR_INVALID_CRC;
+   }
+   *humidity=dht_convert(dht_type, data[0], data[1]);
+   *temperature=dht_convert(dht_type, data[2], data[3]);
+   return ESP_OK;
+}
+
+
+/*
+ * dht_log_edges: Log the us between the edges of a captured frame, in the
+ *    format of the fixtures of host/bench/dht_edge_traces.h. Only built
+ *    with the verbose level
+ */
+static void dht_log_edges(const dht_edge_capture *capture){
+   if(LOG_LOCAL_LEVEL<ESP_LOG_VERBOSE){
+      return;
+   }
+   static char line[DHT_MAX_EDGES*6];
+   size_t length=0;
+   line[0]='\0';
+   for(uint8_t i=1; i<capture->count && length<sizeof line; i++){
+      length+=snprintf(line+length, sizeof line-length, "%u,",
+         (unsigned)(capture->edges[i]-capture->edges[i-1]));
+   }
+   ESP_LOGV(DHT_TAG, "%d edges: %s", capture->count, line);
+}
+
+
+/*
+ * dht_capture_frame: Request a frame and decode it
+ *       Arguments:
+ *          -dht_sensor: DhtSensor struct. Configured with dht_config
+ *          -humidity: float*. Output
+ *          -temperature: float*. Output
+ */
+esp_err_t dht_capture_frame(DhtSensor *dht_sensor, float *humidity, float *temperature){
+   gpio_num_t pin=dht_sensor->dht_pin;
+   // Start signal, the task sleeps instead of busy waiting
+   gpio_set_direction(pin, GPIO_MODE_OUTPUT_OD);
+   gpio_set_level(pin, 0);
+   vTaskDelay(pdMS_TO_TICKS(DHT_START_SIGNAL_MS)+1);
+   dht_capture.count=0;
+   gpio_set_intr_type(pin, GPIO_INTR_NEGEDGE);
+   gpio_isr_handler_add(pin, dht_edge_isr, NULL);
+   // Released line is pulled up, then the sensor answers. Frames without
+   // the response edge end by timeout
+   gpio_set_level(pin, 1);
+   event_loop_wait(EVENT_LOOP_SENSOR, pdMS_TO_TICKS(DHT_FRAME_TIMEOUT_MS)+1);
+   gpio_isr_handler_remove(pin);
+   gpio_set_intr_type(pin, GPIO_INTR_DISABLE);
+   // A frame that ended after the timeout doesn't wake the next one
+   event_loop_wait(EVENT_LOOP_SENSOR, 0);
+   dht_log_edges(&dht_capture);
+   return dht_decode_edges(dht_capture.edges, dht_capture.count,
+      dht_sensor->dht_type, humidity, temperature);
+}
+
+
+/*
+ * dht_in_range: Check a frame against the range of the sensor type
+ */
+static uint8_t dht_in_range(dht_sensor_type_t dht_type, float temperature, float humidity){
+   if(dht_type==DHT_TYPE_DHT11){
+      return temperature>=0 && temperature<=50 && humidity>=20 && humidity<=90;
+   }
+   return temperature>=-40 && temperature<=80 && humidity>=0 && humidity<=100;
+}
+
+
+/*
+ * dht_median: Median of up to DHT_OVERSAMPLE values
+ */
+static float dht_median(const float *values, uint8_t count){
+   if(count<=1){
+      return values[0];
+   }
+   float sorted[DHT_OVERSAMPLE];
+   for(uint8_t i=0; i<count; i++){
+      float value=values[i];
+      int8_t j=i-1;
+      for(; j>=0 && sorted[j]>value; j--){
+         sorted[j+1]=sorted[j];
+      }
+      sorted[j+1]=value;
+   }
+   return count%2 ? sorted[count/2] : (sorted[count/2-1]+sorted[count/2])/2;
+}
+
+
+/*
+ * dht_wait_read_interval: Wait until the sensor can give another frame
+ */
+static void dht_wait_read_interval(DhtSensor *dht_sensor){
+   int64_t wait_us=dht_sensor->last_frame_us+(int64_t)DHT_MIN_READ_INTERVAL*1000000
+      -esp_timer_get_time();
+   if(wait_us>0){
+      vTaskDelay(wait_us/1000/portTICK_PERIOD_MS+1);
+   }
 }
 
 
@@ -41,18 +249,87 @@ void dht_config(DhtSensor **dht_sensor){
  *          -dht_sensor: DhtSensor struct. Use dht_sensor.temperature and
  *             dht.humidity to retrive read data
  */
-void dht_read_and_process_data(DhtSensor **dht_sensor){
-   esp_task_wdt_reset();
-   float temperature=0;
-   float humidity=0;
-   if (dht_read_float_data((**dht_sensor).dht_type, (**dht_sensor).dht_pin, &humidity, &temperature) != ESP_OK){
-      (*dht_sensor)->temperature=-99;
-      (*dht_sensor)->humidity=-99;
+esp_err_t dht_read_and_process_data(DhtSensor **dht_sensor){
+   DhtSensor *sensor=*dht_sensor;
+   dht_read_stats *stats=&sensor->stats;
+   int64_t start=esp_timer_get_time();
+   float temperatures[DHT_OVERSAMPLE];
+   float humidities[DHT_OVERSAMPLE];
+   uint8_t good=0;
+   esp_err_t err=ESP_FAIL;
+   stats->readings++;
+   for(uint8_t frame=0; frame<MAX_DHT_READING && good<DHT_OVERSAMPLE; frame++){
+      esp_task_wdt_reset();
+      if(frame>=DHT_OVERSAMPLE){
+         stats->retries++;
+      }
+      dht_wait_read_interval(sensor);
+      float temperature=0;
+      float humidity=0;
+      err=DHT_EDGE_CAPTURE ? dht_capture_frame(sensor, &humidity, &temperature)
+         : dht_read_float_data(sensor->dht_type, sensor->dht_pin, &humidity, &temperature);
+      sensor->last_frame_us=esp_timer_get_time();
+      stats->frames++;
+      if(err==ESP_OK && !dht_in_range(sensor->dht_type, temperature, humidity)){
+         err=ESP_ERR_INVALID_RESPONSE;
+         stats->out_of_range++;
+      }
+      else if(err==ESP_ERR_TIMEOUT){
+         stats->timeouts++;
+      }
+      else if(err==ESP_ERR_INVALID_CRC){
+         stats->checksum_errors++;
+      }
+      if(err!=ESP_OK){
+         stats->last_error=err;
+         continue;
+      }
+      temperatures[good]=temperature;
+      humidities[good]=humidity;
+      good++;
+   }
+
+   if(good==0){
+      ESP_LOGW(DHT_TAG, "No good frame in %d, last error %s", MAX_DHT_READING, esp_err_to_name(err));
+      stats->failed_readings++;
+      sensor->temperature=-99;
+      sensor->humidity=-99;
    }
    else{
-      (*dht_sensor)->temperature=temperature;
-      (*dht_sensor)->humidity=humidity;
+      // Median of the frames that agree with the first median
+      float temperature_median=dht_median(temperatures, good);
+      float humidity_median=dht_median(humidities, good);
+      uint8_t inliers=0;
+      for(uint8_t i=0; i<good; i++){
+         if(fabsf(temperatures[i]-temperature_median)>DHT_OUTLIER_TEMPERATURE
+               || fabsf(humidities[i]-humidity_median)>DHT_OUTLIER_HUMIDITY){
+            stats->outliers++;
+            continue;
+         }
+         temperatures[inliers]=temperatures[i];
+         humidities[inliers]=humidities[i];
+         inliers++;
+      }
+      if(inliers==0){
+         // Frames too far apart to tell which one is right
+         ESP_LOGW(DHT_TAG, "No agreement between %d good frames", good);
+         stats->failed_readings++;
+         sensor->temperature=-99;
+         sensor->humidity=-99;
+         err=ESP_ERR_INVALID_RESPONSE;
+      }
+      else{
+         sensor->temperature=dht_median(temperatures, inliers);
+         sensor->humidity=dht_median(humidities, inliers);
+         err=ESP_OK;
+      }
    }
+
+   stats->last_latency_us=(uint32_t)(esp_timer_get_time()-start);
+   if(stats->last_latency_us>stats->max_latency_us){
+      stats->max_latency_us=stats->last_latency_us;
+   }
+   return err;
 }
 
 
@@ -63,55 +340,24 @@ void dht_read_and_process_data(DhtSensor **dht_sensor){
  *
  *    @param dht_sensor: DhtSensor struct. Use dht_sensor.temperature and
  *        dht.humidity to retrive read data
- *    @param device_name: char*. Name of the device. To be part of the payload
  *    @ param http_server_configuration: http_server_configuration struct.
  *        Information of the server where to send the data to
  */
 void send_dht_data_with_http(DhtSensor *dht_sensor,
-         char* device_name, http_server_configuration http_server_configuration){
+         http_server_configuration http_server_configuration){
    esp_task_wdt_reset();
-   uint8_t dht_dec_place=dht_sensor->dht_type==DHT_TYPE_DHT11?0:2;
    /******************** TEMPERATURE ***********************/
-   // PROCESSING
-   char chTemp[7];
-   float temperature=(float)dht_sensor->temperature;
-   int dec_temp;
-   if(dht_dec_place==0)
-      dec_temp=0;
-   else
-      dec_temp=(int)((dht_dec_place*abs(temperature))%dht_dec_place);
-
-   snprintf(chTemp, sizeof chTemp, "%d.%d", (int)floor(temperature), dec_temp);
-   // SENDING
-   char post_data_temp[48];
-   strcpy(post_data_temp, "{\"dev_name\":\"");
-   strcat(post_data_temp, device_name);
-   strcat(post_data_temp, "\",\"temp\":");
-   strcat(post_data_temp, chTemp);
-   strcat(post_data_temp, "}");
-   //ESP_LOGI(DHT_TAG, "Sending temperature data: %s",post_data_temp);
-   esp_task_wdt_reset();
-   send_http_post_request(post_data_temp, http_server_configuration.temperature_url);
-   // PROCESSING
-   char chHumid[7];
-   float humidity=dht_sensor->humidity;
-   int dec_humid;
-   if(dht_dec_place==0)
-      dec_humid=0;
-   else
-      dec_humid=(int)((dht_dec_place*abs(humidity))%dht_dec_place);
-
-   snprintf(chHumid, sizeof chHumid, "%d.%d", (int)floor(humidity), dec_humid);
-   // SENDING
-   char post_data_hum[48];
-   strcpy(post_data_hum, "{\"dev_name\":\"");
-   strcat(post_data_hum, device_name);
-   strcat(post_data_hum, "\",\"humid\":");
-   strcat(post_data_hum, chHumid);
-   strcat(post_data_hum, "}");
-   //ESP_LOGI(DHT_TAG, "Sending humidity data: %s",post_data_hum);
+   payload_encoder *temp_payload=&dht_sensor->temperature_payload;
+   payload_encoder_set_value(temp_payload, 0, dht_sensor->temperature);
+   //ESP_LOGD(DHT_TAG, "Sending temperature data: %s",temp_payload->buffer);
+   send_http_post_request(temp_payload->buffer, http_server_configuration.temperature_url);
+
+   /******************** HUMIDITY ***********************/
+   payload_encoder *humid_payload=&dht_sensor->humidity_payload;
+   payload_encoder_set_value(humid_payload, 0, dht_sensor->humidity);
+   //ESP_LOGD(DHT_TAG, "Sending humidity data: %s",humid_payload->buffer);
    esp_task_wdt_reset();
-   send_http_post_request(post_data_hum, http_server_configuration.humidity_url);
+   send_http_post_request(humid_payload->buffer, http_server_configuration.humidity_url);
 }
 
 
@@ -121,7 +367,6 @@ void send_dht_data_with_http(DhtSensor *dht_sensor,
  *       Arguments:
  *          -dht_sensor: DhtSensor struct. Use dht_sensor.temperature and
  *             dht.humidity to retrive read data
- *          -device_name: char*. Name of the device. To be part of the payload
  *          -client: esp_mqtt_client_handle_t. Mqtt client.
  *          -mqtt_configuration: esp_mqtt_client_config_t struct.
  *             Mqtt broker configuration
@@ -129,55 +374,133 @@ void send_dht_data_with_http(DhtSensor *dht_sensor,
  *          -topic_humid: char*. Name of the topic to publish humidity data
  */
 void send_dht_data_with_mqtt(DhtSensor *dht_sensor,
-         char* device_name,
          esp_mqtt_client_handle_t client,
          esp_mqtt_client_config_t mqtt_configuration,
          char* topic_temp, char* topic_humid){
    esp_task_wdt_reset();
-   uint8_t dht_dec_place=dht_sensor->dht_type==DHT_TYPE_DHT11?0:2;
    /******************** TEMPERATURE ***********************/
-   // PROCESSING
-   char chTemp[7];
-   float temperature=(float)dht_sensor->temperature;
-   uint8_t dec_temp;
-   if(dht_dec_place==0)
-      dec_temp=0;
-   else
-      dec_temp=(int)((dht_dec_place*abs(temperature))%dht_dec_place);
-
-   snprintf(chTemp, sizeof chTemp, "%d.%d", (int)floor(temperature), dec_temp);
-   // SENDING
-   char post_data_temp[48];
-   strcpy(post_data_temp, "{\"dev_name\":\"");
-   strcat(post_data_temp, device_name);
-   strcat(post_data_temp, "\",\"temp\":");
-   strcat(post_data_temp, chTemp);
-   strcat(post_data_temp, "}");
-   ESP_LOGI(DHT_TAG, "Sending temperature data: %s",post_data_temp);
-   esp_task_wdt_reset();
-   uint8_t msg_id = esp_mqtt_client_publish(client, topic_temp, post_data_temp, 0, 0, 0);
-   ESP_LOGI(DHT_TAG, "temp publish successful, msg_id=%d", msg_id);
+   payload_encoder *temp_payload=&dht_sensor->temperature_payload;
+   payload_encoder_set_value(temp_payload, 0, dht_sensor->temperature);
+   ESP_LOGD(DHT_TAG, "Sending temperature data: %s",temp_payload->buffer);
+   int msg_id = mqtt_pipeline_publish(client, topic_temp,
+      temp_payload->buffer, temp_payload->length);
+   ESP_LOGD(DHT_TAG, "temp publish successful, msg_id=%d", msg_id);
 
    /******************** HUMIDITY ***********************/
-   // PROCESSING
-   char chHumid[7];
-   float humidity=dht_sensor->humidity;
-   uint8_t dec_humid;
-   if(dht_dec_place==0)
-      dec_humid=0;
-   else
-      dec_humid=(int)((dht_dec_place*abs(humidity))%dht_dec_place);
-
-   snprintf(chHumid, sizeof chHumid, "%d.%d", (int)floor(humidity), dec_humid);
-   // SENDING
-   char post_data_hum[48];
-   strcpy(post_data_hum, "{\"dev_name\":\"");
-   strcat(post_data_hum, device_name);
-   strcat(post_data_hum, "\",\"humid\":");
-   strcat(post_data_hum, chHumid);
-   strcat(post_data_hum, "}");
-   ESP_LOGI(DHT_TAG, "Sending humidity data: %s",post_data_hum);
+   payload_encoder *humid_payload=&dht_sensor->humidity_payload;
+   payload_encoder_set_value(humid_payload, 0, dht_sensor->humidity);
+   ESP_LOGD(DHT_TAG, "Sending humidity data: %s",humid_payload->buffer);
    esp_task_wdt_reset();
-   msg_id = esp_mqtt_client_publish(client, topic_humid, post_data_hum, 0, 0, 0);
-   ESP_LOGI(DHT_TAG, "humid publish successful, msg_id=%d", msg_id);
+   msg_id = mqtt_pipeline_publish(client, topic_humid,
+      humid_payload->buffer, humid_payload->length);
+   ESP_LOGD(DHT_TAG, "humid publish successful, msg_id=%d", msg_id);
+}
+
+
+
+/*
+ * dht_add_report_fields: Add temperature and humidity to a combined report
+ *       Arguments:
+ *          -dht_sensor: DhtSensor struct. Configured with dht_config
+ *          -report: payload_encoder*. Report with the values of every sensor
+ */
+esp_err_t dht_add_report_fields(DhtSensor *dht_sensor, payload_encoder *report){
+   uint8_t dht_dec_place=dht_decimal_places(dht_sensor->dht_type);
+   dht_sensor->report_field=report->field_count;
+   esp_err_t err=payload_encoder_add_field(report, "temp", DHT_INTEGER_DIGITS, dht_dec_place);
+   if(err==ESP_OK){
+      err=payload_encoder_add_field(report, "humid", DHT_INTEGER_DIGITS, dht_dec_place);
+   }
+   return err;
+}
+
+
+/*
+ * dht_write_report_values: Write last read values in a combined report
+ *       Arguments:
+ *          -dht_sensor: DhtSensor struct. Use dht_sensor.temperature and
+ *             dht.humidity to retrive read data
+ *          -report: payload_encoder*. Report prepared with dht_add_report_fields
+ */
+void dht_write_report_values(DhtSensor *dht_sensor, payload_encoder *report){
+   payload_encoder_set_value(report, dht_sensor->report_field, dht_sensor->temperature);
+   payload_encoder_set_value(report, dht_sensor->report_field+1, dht_sensor->humidity);
+}
+
+
+
+/*
+ * dht_to_fixed_point: Convert a value to fixed point with the decimal
+ *    places of the sensor, clamped to int16. Nan is 0
+ */
+static int16_t dht_to_fixed_point(float value, uint8_t decimal_places){
+   for(uint8_t i=0; i<decimal_places; i++){
+      value*=10;
+   }
+   if(isnan(value)) return 0;
+   if(value>=INT16_MAX) return INT16_MAX;
+   if(value<=INT16_MIN) return INT16_MIN;
+   return (int16_t)(value<0 ? value-0.5f : value+0.5f);
 }
+
+
+/*
+ * dht_encode_frame: Encode last read values as a binary telemetry frame
+ *       Arguments:
+ *          -dht_sensor: DhtSensor struct. Use dht_sensor.temperature and
+ *             dht.humidity to retrive read data
+ *          -device_id: const char*. Device id of the frame or NULL
+ *          -out: uint8_t*. Output buffer
+ *          -out_size: size_t. Size of out
+ */
+size_t dht_encode_frame(DhtSensor *dht_sensor, const char* device_id,
+         uint8_t *out, size_t out_size){
+   telemetry_frame frame;
+   frame.flags=0;
+   frame.device_id[0]='\0';
+   if(device_id!=NULL){
+      strncpy(frame.device_id, device_id, TELEMETRY_MAX_DEVICE_ID);
+      frame.device_id[TELEMETRY_MAX_DEVICE_ID]='\0';
+   }
+   frame.sensor_type=dht_telemetry_type(dht_sensor->dht_type);
+   frame.decimal_places=dht_decimal_places(dht_sensor->dht_type);
+   frame.value_count=2;
+   frame.values[0]=dht_to_fixed_point(dht_sensor->temperature, frame.decimal_places);
+   frame.values[1]=dht_to_fixed_point(dht_sensor->humidity, frame.decimal_places);
+   return telemetry_frame_encode(&frame, out, out_size);
+}
+
+
+
+/******************** SENSOR REGISTRY DRIVER ***********************/
+static uint8_t dht_driver_telemetry_type(void *sensor){
+   return dht_telemetry_type(((DhtSensor*)sensor)->dht_type);
+}
+
+static esp_err_t dht_driver_init(void *sensor, char* device_name){
+   DhtSensor *dht_sensor=(DhtSensor*)sensor;
+   dht_config(&dht_sensor, device_name);
+   return ESP_OK;
+}
+
+static esp_err_t dht_driver_read(void *sensor, float *values){
+   DhtSensor *dht_sensor=(DhtSensor*)sensor;
+   esp_err_t err=dht_read_and_process_data(&dht_sensor);
+   values[0]=dht_sensor->temperature;
+   values[1]=dht_sensor->humidity;
+   return err;
+}
+
+static esp_err_t dht_driver_encode(void *sensor, payload_encoder *report){
+   return dht_add_report_fields((DhtSensor*)sensor, report);
+}
+
+const sensor_driver dht_sensor_driver={
+   .name="dht",
+   .min_read_interval=DHT_MIN_READ_INTERVAL,
+   .value_count=2,
+   .telemetry_type=dht_driver_telemetry_type,
+   .init=dht_driver_init,
+   .read=dht_driver_read,
+   .encode=dht_driver_encode,
+};
@@ -0,0 +1,191 @@
+/*
+ * diagnostics.c
+ * @description: Implementation of the timing, stack and heap telemetry of
+ *    each wake cycle
+ * @author: @Retrocamara42
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "diagnostics.h"
+#include "esp_attr.h"
+#include "rtc_budget.h"
+
+#if DIAGNOSTICS
+
+// Marks valid contents of rtc memory
+#define DIAGNOSTICS_MAGIC 0x44494147
+
+static const char* const stage_names[DIAG_STAGE_COUNT] = {
+   "wifi", "mqtt", "read", "pub", "ack", "cycle",
+};
+
+/*
+ * diagnostics_state: Counters kept through deep sleep
+ *    - magic: uint32_t. DIAGNOSTICS_MAGIC if the contents are valid
+ *    - cycles: uint32_t. Cycles since power on
+ *    - min_free_heap: uint32_t. Lowest free heap seen
+ *    - cycles_since_record: uint16_t. Cycles since the last record
+ *    - spans: diagnostics_span[]. Times of each stage
+ */
+typedef struct {
+   uint32_t magic;
+   uint32_t cycles;
+   uint32_t min_free_heap;
+   uint16_t cycles_since_record;
+   diagnostics_span spans[DIAG_STAGE_COUNT];
+} diagnostics_state;
+
+/*
+ * watched_task: Task whose stack is watched
+ *    - handle: TaskHandle_t. Task
+ *    - name: const char*. Name in the records
+ *    - min_free_stack: uint32_t. Lowest free stack seen
+ */
+typedef struct {
+   TaskHandle_t handle;
+   const char* name;
+   uint32_t min_free_stack;
+} watched_task;
+
+static RTC_DATA_ATTR diagnostics_state state;
+_Static_assert(sizeof(diagnostics_state)<=RTC_BUDGET_DIAGNOSTICS, "diagnostics over its rtc budget");
+// Start of the running span of each stage, 0 if not running. Spans don't
+// continue through deep sleep or a restart
+static int64_t started_us[DIAG_STAGE_COUNT];
+static watched_task tasks[DIAGNOSTICS_MAX_TASKS];
+static uint8_t task_count=0;
+
+
+/*
+ * diagnostics_init: Reset the counters, unless waking from deep sleep
+ *    Arguments:
+ *       - resumed: uint8_t. 1 after a wake from deep sleep
+ */
+void diagnostics_init(uint8_t resumed){
+   if(!resumed || state.magic!=DIAGNOSTICS_MAGIC){
+      memset(&state, 0, sizeof state);
+      state.magic=DIAGNOSTICS_MAGIC;
+      state.min_free_heap=UINT32_MAX;
+   }
+}
+
+
+/*
+ * diagnostics_span_begin: Start timing a stage
+ *    Arguments:
+ *       - stage: diagnostics_stage. Stage
+ */
+void diagnostics_span_begin(diagnostics_stage stage){
+   started_us[stage]=esp_timer_get_time();
+}
+
+
+/*
+ * diagnostics_span_end: Stop timing a stage
+ *    Arguments:
+ *       - stage: diagnostics_stage. Stage
+ */
+void diagnostics_span_end(diagnostics_stage stage){
+   if(started_us[stage]==0){
+      return;
+   }
+   int64_t elapsed_ms = (esp_timer_get_time()-started_us[stage])/1000;
+   started_us[stage]=0;
+   diagnostics_span *span = &state.spans[stage];
+   span->last_ms = elapsed_ms<UINT16_MAX ? (uint16_t)elapsed_ms : UINT16_MAX;
+   if(span->last_ms>span->max_ms){
+      span->max_ms=span->last_ms;
+   }
+}
+
+
+/*
+ * diagnostics_get_span: Get the times of a stage
+ */
+const diagnostics_span* diagnostics_get_span(diagnostics_stage stage){
+   return &state.spans[stage];
+}
+
+
+/*
+ * diagnostics_watch_task: Watch the stack of the calling task
+ *    Arguments:
+ *       - name: const char*. Name in the records, must be a literal
+ */
+void diagnostics_watch_task(const char* name){
+   TaskHandle_t handle = xTaskGetCurrentTaskHandle();
+   for(uint8_t i=0; i<task_count; i++){
+      if(tasks[i].handle==handle){
+         return;
+      }
+   }
+   if(task_count<DIAGNOSTICS_MAX_TASKS){
+      tasks[task_count].handle=handle;
+      tasks[task_count].name=name;
+      tasks[task_count].min_free_stack=uxTaskGetStackHighWaterMark(handle);
+      task_count++;
+   }
+}
+
+
+/*
+ * diagnostics_end_cycle: Sample stacks and heap at the end of a cycle
+ *    Arguments:
+ *       - period: uint16_t. Cycles between records
+ */
+uint8_t diagnostics_end_cycle(uint16_t period){
+   state.cycles++;
+   state.cycles_since_record++;
+   uint32_t min_free_heap = esp_get_minimum_free_heap_size();
+   if(min_free_heap<state.min_free_heap){
+      state.min_free_heap=min_free_heap;
+   }
+   // High water marks never go up, the task only reads its own
+   for(uint8_t i=0; i<task_count; i++){
+      tasks[i].min_free_stack=uxTaskGetStackHighWaterMark(tasks[i].handle);
+   }
+   return state.cycles_since_record>=period;
+}
+
+
+/*
+ * diagnostics_encode: Write a record of the cycles since the last one
+ *    Arguments:
+ *       - firmware: const char*. Firmware version
+ *       - out: char*. Where the record is written to
+ *       - size: size_t. Size of out
+ */
+size_t diagnostics_encode(const char* firmware, char* out, size_t size){
+   int length = snprintf(out, size, "{\"fw\":\"%s\",\"n\":%u", firmware, state.cycles);
+   for(uint8_t i=0; i<DIAG_STAGE_COUNT && length>0 && (size_t)length<size; i++){
+      length += snprintf(out+length, size-length, ",\"%s\":[%u,%u]", stage_names[i],
+         state.spans[i].last_ms, state.spans[i].max_ms);
+   }
+   if(length>0 && (size_t)length<size){
+      length += snprintf(out+length, size-length, ",\"heap\":%u,\"heap_min\":%u,\"stack\":{",
+         esp_get_free_heap_size(), state.min_free_heap);
+   }
+   for(uint8_t i=0; i<task_count && length>0 && (size_t)length<size; i++){
+      length += snprintf(out+length, size-length, "%s\"%s\":%u", i>0 ? "," : "",
+         tasks[i].name, tasks[i].min_free_stack);
+   }
+   if(length>0 && (size_t)length<size){
+      length += snprintf(out+length, size-length, "}}");
+   }
+   return length>0 && (size_t)length<size ? (size_t)length : 0;
+}
+
+
+/*
+ * diagnostics_record_sent: Start the maximums of the next record
+ */
+void diagnostics_record_sent(){
+   state.cycles_since_record=0;
+   for(uint8_t i=0; i<DIAG_STAGE_COUNT; i++){
+      state.spans[i].max_ms=0;
+   }
+}
+
+#endif
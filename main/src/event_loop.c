@@ -0,0 +1,150 @@
+/*
+ * event_loop.c
+ * @description: Implementation of the event loop of transmit_data_task
+ * @author: @Retrocamara42
+ *
+ */
+#include "event_loop.h"
+
+// Task events are posted to
+static TaskHandle_t loop_task = NULL;
+static esp_timer_handle_t wake_timer = NULL;
+// Events received and not waited for yet. Only used by loop_task
+static uint32_t pending = 0;
+static event_loop_stats loop_stats;
+
+
+/*
+ * wake_timer_expired: Callback of the wake timer, run in the timer task
+ */
+static void wake_timer_expired(void *arg){
+   event_loop_post(EVENT_LOOP_TIMER);
+}
+
+
+/*
+ * event_loop_init: Make the calling task the one events are posted to
+ */
+esp_err_t event_loop_init(void){
+   const esp_timer_create_args_t timer_args = {
+      .callback = wake_timer_expired,
+      .dispatch_method = ESP_TIMER_TASK,
+      .name = "wake",
+   };
+   esp_err_t err = esp_timer_create(&timer_args, &wake_timer);
+   if(err==ESP_OK){
+      // Notifications the task got before are not events of the loop
+      xTaskNotifyWait(UINT32_MAX, UINT32_MAX, NULL, 0);
+      pending = 0;
+      loop_task = xTaskGetCurrentTaskHandle();
+   }
+   return err;
+}
+
+
+/*
+ * event_loop_post: Post events from a task
+ *    Arguments:
+ *       - events: uint32_t. EVENT_LOOP_ bits
+ */
+void event_loop_post(uint32_t events){
+   if(loop_task!=NULL){
+      xTaskNotify(loop_task, events, eSetBits);
+   }
+}
+
+
+/*
+ * event_loop_post_from_isr: Post events from an interrupt
+ *    Arguments:
+ *       - events: uint32_t. EVENT_LOOP_ bits
+ */
+void IRAM_ATTR event_loop_post_from_isr(uint32_t events){
+   BaseType_t woken = pdFALSE;
+   if(loop_task!=NULL){
+      xTaskNotifyFromISR(loop_task, events, eSetBits, &woken);
+   }
+   if(woken==pdTRUE){
+      portYIELD_FROM_ISR();
+   }
+}
+
+
+/*
+ * event_loop_set_timer: Arm the wake timer
+ *    Arguments:
+ *       - seconds: uint32_t. Time from now
+ */
+void event_loop_set_timer(uint32_t seconds){
+   if(wake_timer==NULL){
+      return;
+   }
+   esp_timer_stop(wake_timer);
+   esp_timer_start_once(wake_timer, (uint64_t)seconds*1000000);
+}
+
+
+/*
+ * receive: Keep events of a notification as pending
+ */
+static void receive(uint32_t events){
+   pending |= events;
+   if(events&EVENT_LOOP_TIMER) loop_stats.timers++;
+   if(events&EVENT_LOOP_COMMAND) loop_stats.commands++;
+   if(events&EVENT_LOOP_CONNECTED) loop_stats.connections++;
+}
+
+
+/*
+ * event_loop_wait: Wait for some events
+ *    Arguments:
+ *       - events: uint32_t. EVENT_LOOP_ bits to wait for
+ *       - ticks: TickType_t. Longest wait
+ */
+uint32_t event_loop_wait(uint32_t events, TickType_t ticks){
+   TickType_t start = xTaskGetTickCount();
+   while(!(pending&events)){
+      // Events already posted are received even once the time is over
+      TickType_t left = portMAX_DELAY;
+      if(ticks!=portMAX_DELAY){
+         TickType_t waited = xTaskGetTickCount()-start;
+         left = waited<ticks ? ticks-waited : 0;
+      }
+      uint32_t received;
+      if(xTaskNotifyWait(0, UINT32_MAX, &received, left)!=pdTRUE){
+         break;
+      }
+      if(left>0){
+         loop_stats.wakeups++;
+      }
+      receive(received);
+   }
+   uint32_t woken = pending&events;
+   pending &= ~woken;
+   return woken;
+}
+
+
+/*
+ * event_loop_sleep: Arm the wake timer and wait for any event
+ *    Arguments:
+ *       - seconds: uint32_t. Time until the timer wakes the task
+ */
+uint32_t event_loop_sleep(uint32_t seconds){
+   // Sensors due before now were read by the cycle that just ran
+   event_loop_wait(EVENT_LOOP_TIMER, 0);
+   event_loop_set_timer(seconds);
+   uint32_t woken = event_loop_wait(EVENT_LOOP_ALL, portMAX_DELAY);
+   esp_timer_stop(wake_timer);
+   return woken;
+}
+
+
+/*
+ * get_event_loop_stats: Get the wakes of the task
+ *    Arguments:
+ *       - stats: event_loop_stats*. Output
+ */
+void get_event_loop_stats(event_loop_stats *stats){
+   *stats = loop_stats;
+}
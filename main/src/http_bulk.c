@@ -0,0 +1,161 @@
+/*
+ * http_bulk.c
+ * @description: Implementation of the bulk mode of the http transport
+ * @author: @Retrocamara42
+ *
+ */
+#define LOG_LOCAL_LEVEL LOG_LEVEL_HTTP
+#include "log_levels.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "http_bulk.h"
+
+static const char *BULK_TAG = "http_bulk";
+
+/*
+ * bulk_body: Body of a post being written
+ *    - encoding: http_content_encoding. Encoding of the body
+ *    - length: size_t. Length of an identity body
+ *    - stream: deflate_stream. Compression of other encodings
+ */
+typedef struct {
+   http_content_encoding encoding;
+   size_t length;
+   deflate_stream stream;
+} bulk_body;
+
+// Static, the window of the compression doesn't fit in the stack of the task
+static bulk_body body;
+static uint8_t body_buffer[HTTP_BULK_MAX_BODY];
+static http_bulk_stats bulk_stats;
+
+
+/*
+ * encoding_name: Content-Encoding header of an encoding, NULL for identity
+ */
+static const char* encoding_name(http_content_encoding encoding){
+   switch(encoding){
+      case HTTP_ENCODING_GZIP: return "gzip";
+      case HTTP_ENCODING_DEFLATE: return "deflate";
+      default: return NULL;
+   }
+}
+
+
+/*
+ * write_record: Write a sample as a record, with its newline
+ *    Returns:
+ *       - length: size_t. Length of the record
+ */
+static size_t write_record(char *out, const sensor_sample *sample, uint16_t boot){
+   int16_t temperature = sample->values[0];
+   int16_t humidity = sample->values[1];
+   int length = snprintf(out, HTTP_BULK_RECORD_SIZE,
+      "{\"boot\":%u,\"t\":%u,\"temp\":%s%d.%d,\"humid\":%s%d.%d}\n", boot, (unsigned)sample->timestamp,
+      temperature<0 ? "-" : "", abs(temperature)/10, abs(temperature)%10,
+      humidity<0 ? "-" : "", abs(humidity)/10, abs(humidity)%10);
+   return length>0 && length<HTTP_BULK_RECORD_SIZE ? (size_t)length : 0;
+}
+
+
+static void body_begin(http_content_encoding encoding){
+   body.encoding = encoding;
+   body.length = 0;
+   if(encoding!=HTTP_ENCODING_IDENTITY){
+      deflate_stream_init(&body.stream,
+         encoding==HTTP_ENCODING_GZIP ? DEFLATE_FORMAT_GZIP : DEFLATE_FORMAT_ZLIB,
+         body_buffer, sizeof body_buffer);
+   }
+}
+
+
+/*
+ * body_append: Add a record to the body if it still fits
+ *    Returns:
+ *       - appended: uint8_t. 0 if the body is full
+ */
+static uint8_t body_append(const char *record, size_t length){
+   if(body.encoding==HTTP_ENCODING_IDENTITY){
+      if(body.length+length>sizeof body_buffer){
+         return 0;
+      }
+      memcpy(body_buffer+body.length, record, length);
+      body.length += length;
+      return 1;
+   }
+   if(!deflate_stream_fits(&body.stream, length)){
+      return 0;
+   }
+   return deflate_stream_write(&body.stream, (const uint8_t*)record, length)==ESP_OK;
+}
+
+
+/*
+ * body_finish: End the body
+ *    Returns:
+ *       - length: size_t. Length of the body, 0 if it couldn't be ended
+ */
+static size_t body_finish(void){
+   if(body.encoding==HTTP_ENCODING_IDENTITY){
+      return body.length;
+   }
+   return deflate_stream_finish(&body.stream)==ESP_OK ? body.stream.out_length : 0;
+}
+
+
+/*
+ * http_bulk_send: Post a batch of samples as ndjson records to bulk_url
+ *    Arguments:
+ *       - samples: const sensor_sample*. Samples, oldest first
+ *       - count: uint16_t. Samples in the batch
+ *       - boot: uint16_t. Boot of the timestamps
+ *       - config: const http_server_configuration*. Bulk endpoint
+ */
+esp_err_t http_bulk_send(const sensor_sample *samples, uint16_t count, uint16_t boot,
+      const http_server_configuration *config){
+   char record[HTTP_BULK_RECORD_SIZE];
+   uint16_t sent = 0;
+   while(sent<count){
+      uint16_t records = 0;
+      uint32_t raw_bytes = 0;
+      body_begin(config->bulk_encoding);
+      while(sent+records<count){
+         size_t length = write_record(record, &samples[sent+records], boot);
+         if(!body_append(record, length)){
+            break;
+         }
+         records++;
+         raw_bytes += length;
+      }
+      size_t length = body_finish();
+      if(records==0 || length==0){
+         return ESP_ERR_INVALID_SIZE;
+      }
+      ESP_LOGI(BULK_TAG, "Posting %d records, %d bytes in %d", records, (int)raw_bytes, (int)length);
+      esp_err_t err = send_http_post_encoded((const char*)body_buffer, length,
+         HTTP_BULK_CONTENT_TYPE, encoding_name(config->bulk_encoding), config->bulk_url);
+      bulk_stats.posts++;
+      if(err!=ESP_OK){
+         bulk_stats.failures++;
+         ESP_LOGW(BULK_TAG, "Bulk post failed: %s", esp_err_to_name(err));
+         return err;
+      }
+      bulk_stats.records += records;
+      bulk_stats.raw_bytes += raw_bytes;
+      bulk_stats.body_bytes += length;
+      sent += records;
+   }
+   return ESP_OK;
+}
+
+
+/*
+ * get_http_bulk_stats: Get counters of http_bulk_send
+ *    Arguments:
+ *       - stats: http_bulk_stats*. Where counters are copied to
+ */
+void get_http_bulk_stats(http_bulk_stats *stats){
+   *stats = bulk_stats;
+}
@@ -5,24 +5,42 @@
  * @author: @Retrocamara42
  *
  */
+#define LOG_LOCAL_LEVEL LOG_LEVEL_HTTP
+#include "log_levels.h"
 #include "http_request.h"
 
 static const char *HTTP_TAG = "http_client";
 
 /*
- * _http_event_handler: Event handler for http request
+ * http_persistent_client: Client kept open for a host
+ *    - host: char[]. Scheme, host and port of the urls sent with client
+ *    - client: esp_http_client_handle_t. Client, NULL if slot is free
+ */
+typedef struct {
+   char host[MAX_HTTP_HOST_LENGTH];
+   esp_http_client_handle_t client;
+} http_persistent_client;
+
+static http_persistent_client http_clients[MAX_HTTP_PERSISTENT_CLIENTS];
+static uint8_t next_evicted_client=0;
+static http_request_stats http_stats;
+// Set by the event handler when a request opens a connection
+static uint8_t http_connection_opened=0;
+
+/*
+ * _http_event_handler: Event handler for http request. Response bodies are
+ *    skipped, only the status of a post is used
  *    Arguments:
  *       - evt: esp_http_client_event_t. Http event.
  */
 esp_err_t _http_event_handler(esp_http_client_event_t *evt){
-    static char *output_buffer;
-    static int output_len;
     switch(evt->event_id) {
         case HTTP_EVENT_ERROR:
             //ESP_LOGD(HTTP_TAG, "HTTP_EVENT_ERROR");
             break;
         case HTTP_EVENT_ON_CONNECTED:
             //ESP_LOGD(HTTP_TAG, "HTTP_EVENT_ON_CONNECTED");
+            http_connection_opened=1;
             break;
         case HTTP_EVENT_HEADER_SENT:
             //ESP_LOGD(HTTP_TAG, "HTTP_EVENT_HEADER_SENT");
@@ -33,33 +51,10 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt){
         case HTTP_EVENT_ON_DATA:
             esp_task_wdt_reset();
             ESP_LOGD(HTTP_TAG, "HTTP_EVENT_ON_DATA, len=%d", evt->data_len);
-            if (!esp_http_client_is_chunked_response(evt->client)) {
-                esp_task_wdt_reset();
-                if (evt->user_data) {
-                    memcpy(evt->user_data + output_len, evt->data, evt->data_len);
-                } else {
-                    if (output_buffer == NULL) {
-                        output_buffer = (char *) malloc(esp_http_client_get_content_length(evt->client));
-                        output_len = 0;
-                        if (output_buffer == NULL) {
-                            ESP_LOGE(HTTP_TAG, "Failed to allocate memory for output buffer");
-                            return ESP_FAIL;
-                        }
-                    }
-                    memcpy(output_buffer + output_len, evt->data, evt->data_len);
-                }
-                output_len += evt->data_len;
-            }
-
             break;
         case HTTP_EVENT_ON_FINISH:
             esp_task_wdt_reset();
             //ESP_LOGD(HTTP_TAG, "HTTP_EVENT_ON_FINISH");
-            if (output_buffer != NULL) {
-                free(output_buffer);
-                output_buffer = NULL;
-                output_len = 0;
-            }
             break;
         case HTTP_EVENT_DISCONNECTED:
             esp_task_wdt_reset();
@@ -67,11 +62,6 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt){
             int mbedtls_err = 0;
             esp_err_t err = esp_tls_get_and_clear_last_error(evt->data, &mbedtls_err, NULL);
             if (err != 0) {
-                if (output_buffer != NULL) {
-                    free(output_buffer);
-                    output_buffer = NULL;
-                    output_len = 0;
-                }
                 ESP_LOGI(HTTP_TAG, "Last esp error code: 0x%x", err);
                 //ESP_LOGI(HTTP_TAG, "Last mbedtls failure: 0x%x", mbedtls_err);
             }
@@ -82,37 +72,209 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt){
 
 
 /*
- * send_http_post_request: Send a http request
+ * url_host_length: Length of the scheme, host and port part of an url
  *    Arguments:
- *       - post_data: Char*. Body of post request
- *       - web_url: Char*. Complete url (with path) of post request
+ *       - web_url: char*. Url
  */
-void send_http_post_request(char* post_data, char* web_url){
-   esp_task_wdt_reset();
-   // Initialize client
-   char local_response_buffer[MAX_HTTP_OUTPUT_BUFFER] = {0};
+static size_t url_host_length(const char* web_url){
+   const char* host = strstr(web_url, "://");
+   host = host ? host+3 : web_url;
+   const char* path = strchr(host, '/');
+   return path ? (size_t)(path-web_url) : strlen(web_url);
+}
+
+
+/*
+ * get_http_client: Get the client kept open for the host of an url. A new
+ *    one is created if there is none. When every slot is in use, one of them
+ *    is closed
+ *    Arguments:
+ *       - web_url: char*. Url of the request
+ *    Returns:
+ *       - slot: http_persistent_client*. Slot of the client or NULL if
+ *          the client couldn't be created
+ */
+static http_persistent_client* get_http_client(char* web_url){
+   size_t host_length = url_host_length(web_url);
+   http_persistent_client *slot = NULL;
+   for(uint8_t i=0; i<MAX_HTTP_PERSISTENT_CLIENTS; i++){
+      http_persistent_client *candidate = &http_clients[i];
+      if(candidate->client!=NULL && strlen(candidate->host)==host_length
+            && strncmp(candidate->host, web_url, host_length)==0){
+         return candidate;
+      }
+      if(slot==NULL && candidate->client==NULL){
+         slot = candidate;
+      }
+   }
+   if(slot==NULL){
+      slot = &http_clients[next_evicted_client];
+      next_evicted_client = (next_evicted_client+1)%MAX_HTTP_PERSISTENT_CLIENTS;
+      esp_http_client_cleanup(slot->client);
+      slot->client = NULL;
+   }
+
    esp_http_client_config_t config = {
       .url = web_url,
       .event_handler = _http_event_handler,
-      .user_data = local_response_buffer,
    };
-   esp_http_client_handle_t client = esp_http_client_init(&config);
+   slot->client = esp_http_client_init(&config);
+   if(slot->client==NULL){
+      return NULL;
+   }
+   // Hosts too long to be remembered get a client each time
+   if(host_length<MAX_HTTP_HOST_LENGTH){
+      memcpy(slot->host, web_url, host_length);
+      slot->host[host_length] = '\0';
+   }
+   else{
+      slot->host[0] = '\0';
+   }
+   return slot;
+}
+
 
-   // Request post
+/*
+ * perform_post_request: Perform a post request with a client and update
+ *    counters. Only successful requests count as handshakes or
+ *    handshakes avoided
+ *    Returns:
+ *       - err: esp_err_t. Result of esp_http_client_perform
+ */
+static esp_err_t perform_post_request(esp_http_client_handle_t client, const char* post_data,
+      size_t length, const char* content_type, const char* content_encoding, char* web_url){
+   esp_http_client_set_url(client, web_url);
    esp_http_client_set_method(client, HTTP_METHOD_POST);
-   esp_http_client_set_header(client, "Content-Type", "application/json");
-   esp_http_client_set_post_field(client, post_data, strlen(post_data));
+   esp_http_client_set_header(client, "Content-Type", content_type);
+   // Headers stay on the client, a previous request may have set one
+   if(content_encoding!=NULL){
+      esp_http_client_set_header(client, "Content-Encoding", content_encoding);
+   }
+   else{
+      esp_http_client_delete_header(client, "Content-Encoding");
+   }
+   esp_http_client_set_post_field(client, post_data, length);
+   esp_task_wdt_reset();
+
+   http_connection_opened=0;
+   int64_t start = esp_timer_get_time();
+   esp_err_t err = esp_http_client_perform(client);
+   int64_t latency = esp_timer_get_time()-start;
+   http_stats.requests++;
+   if(err!=ESP_OK){
+      return err;
+   }
+   if(http_connection_opened){
+      http_stats.handshakes++;
+      http_stats.handshake_latency_us+=latency;
+   }
+   else{
+      http_stats.handshakes_avoided++;
+      http_stats.reused_latency_us+=latency;
+   }
+   return err;
+}
+
+
+/*
+ * send_http_post_request: Send a http request. Clients are kept open per
+ *    host, so consecutive requests to a host reuse its connection
+ *    Arguments:
+ *       - post_data: Char*. Body of post request
+ *       - web_url: Char*. Complete url (with path) of post request
+ */
+void send_http_post_request(char* post_data, char* web_url){
+   send_http_post_data(post_data, strlen(post_data), "application/json", web_url);
+}
+
+
+/*
+ * send_http_post_data: Send a http request with any body
+ *    Arguments:
+ *       - post_data: const char*. Body of post request
+ *       - length: size_t. Length of body
+ *       - content_type: const char*. Content-Type header of the body
+ *       - web_url: char*. Complete url (with path) of post request
+ */
+void send_http_post_data(const char* post_data, size_t length,
+      const char* content_type, char* web_url){
+   send_http_post_encoded(post_data, length, content_type, NULL, web_url);
+}
+
+
+/*
+ * send_http_post_encoded: Send a http request with a body encoded with a
+ *    Content-Encoding
+ *    Arguments:
+ *       - post_data: const char*. Body of post request
+ *       - length: size_t. Length of body
+ *       - content_type: const char*. Content-Type header of the body
+ *       - content_encoding: const char*. Content-Encoding header, NULL for
+ *          none
+ *       - web_url: char*. Complete url (with path) of post request
+ */
+esp_err_t send_http_post_encoded(const char* post_data, size_t length,
+      const char* content_type, const char* content_encoding, char* web_url){
    esp_task_wdt_reset();
+   http_persistent_client *slot = get_http_client(web_url);
+   if(slot==NULL){
+      ESP_LOGE(HTTP_TAG, "Failed to create http client");
+      return ESP_ERR_NO_MEM;
+   }
+
    // Perform http request
-   int err = esp_http_client_perform(client);
+   esp_err_t err = perform_post_request(slot->client, post_data, length, content_type,
+      content_encoding, web_url);
+   if(err != ESP_OK && !http_connection_opened){
+      // Server may have closed the open connection, retry on a new one
+      ESP_LOGW(HTTP_TAG, "HTTP POST on open connection failed: %s, reconnecting", esp_err_to_name(err));
+      esp_http_client_close(slot->client);
+      http_stats.reconnects++;
+      err = perform_post_request(slot->client, post_data, length, content_type,
+         content_encoding, web_url);
+   }
    if(err == ESP_OK) {
-      ESP_LOGI(HTTP_TAG, "HTTP POST Status = %d, content_length = %d",
-         esp_http_client_get_status_code(client),
-         esp_http_client_get_content_length(client));
+      int status = esp_http_client_get_status_code(slot->client);
+      ESP_LOGI(HTTP_TAG, "HTTP POST Status = %d, content_length = %d", status,
+         esp_http_client_get_content_length(slot->client));
+      if(status<200 || status>=300){
+         err = ESP_ERR_INVALID_RESPONSE;
+      }
    }
    else{
       ESP_LOGE(HTTP_TAG, "HTTP POST request failed: %s", esp_err_to_name(err));
+      // Start from a clean client next time
+      esp_http_client_cleanup(slot->client);
+      slot->client = NULL;
    }
    esp_task_wdt_reset();
-   esp_http_client_cleanup(client);
+   if(slot->client!=NULL && slot->host[0]=='\0'){
+      esp_http_client_cleanup(slot->client);
+      slot->client = NULL;
+   }
+   return err;
+}
+
+
+/*
+ * close_http_clients: Close the connections kept open by
+ *    send_http_post_request
+ */
+void close_http_clients(){
+   for(uint8_t i=0; i<MAX_HTTP_PERSISTENT_CLIENTS; i++){
+      if(http_clients[i].client!=NULL){
+         esp_http_client_cleanup(http_clients[i].client);
+         http_clients[i].client = NULL;
+      }
+   }
+}
+
+
+/*
+ * get_http_request_stats: Get counters of send_http_post_request
+ *    Arguments:
+ *       - stats: http_request_stats*. Where counters are copied to
+ */
+void get_http_request_stats(http_request_stats *stats){
+   *stats = http_stats;
 }
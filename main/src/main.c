@@ -5,112 +5,649 @@
  * @author: @Retrocamara42
  *
  */
+#define LOG_LOCAL_LEVEL LOG_LEVEL_MAIN
+#include "log_levels.h"
 #include "main.h"
 
 static const char *MAIN_TAG = "main";
-static SemaphoreHandle_t sleep_semaphore;
-static uint32_t sleep_semaphore_count=0;
-// Sleep time in minutes
-static uint16_t sleep_time=SLEEP_TIME;
-static const dht_sensor_type_t sensor_type = DHT_TYPE_DHT11;
-static const gpio_num_t dht_gpio = GPIO_NUM_0;
+// Sleep time in seconds, until the next sensor is due
+static uint32_t sleep_time=60*SLEEP_TIME;
+static DhtSensor dht_sensor = {
+   .dht_pin = GPIO_NUM_0,
+   .dht_type = DHT_TYPE_DHT11,
+};
+static const float dht_deadband[2] = {
+   DHT_DEADBAND_TEMPERATURE,
+   DHT_DEADBAND_HUMIDITY,
+};
+// Values of every sensor, published once per cycle
+static payload_encoder report_payload;
+static uint8_t report_frame[TELEMETRY_FRAME_MAX_SIZE];
+#if DIAGNOSTICS
+static char diagnostics_record[DIAGNOSTICS_RECORD_SIZE];
+#endif
+static char power_trace_record[POWER_TRACE_EXPORT_SIZE];
+// Url of the patch of the update command, see RTC_COMMAND_UPDATE
+static char update_url[OTA_URL_SIZE];
 
 
 /*
- * hw_timer_sleep
- *   Description: Sends task to sleep
+ * power_enter
+ *   Description: Records a power state transition in the trace
  */
-void hw_timer_sleep(void *arg){
-    esp_task_wdt_reset();
-    sleep_semaphore_count++;
-    if(sleep_semaphore_count>(60*sleep_time)){
-      sleep_semaphore_count=0;
-      xSemaphoreGive(sleep_semaphore);
-    }
+static void power_enter(power_state state){
+   power_trace_enter(state, rtc_state_clock_ms());
 }
 
 
+/*
+ * pend_command
+ *   Description: Leaves a command to the cycle of transmit_data_task.
+ *     Commands run at the start of a cycle, or before a deep sleep, which
+ *     then runs another cycle
+ *     Arguments:
+ *       - command: uint32_t. RTC_COMMAND_ flag run by the cycle
+ */
+static void pend_command(uint32_t command){
+   if(SLEEP_MODE==SLEEP_MODE_DEEP || command!=RTC_COMMAND_SAMPLE_NOW){
+      rtc_state_get()->pending_commands|=command;
+   }
+}
+
+
+/*
+ * command_sample_now
+ *   Description: Reads every sensor now. {"cmd":"sample_now"}
+ */
+static esp_err_t command_sample_now(const command_message *message, void *arg){
+   ESP_LOGI(MAIN_TAG, "Waking up device");
+   sensor_scheduler_expire();
+   pend_command(RTC_COMMAND_SAMPLE_NOW);
+   return ESP_OK;
+}
+
+
+/*
+ * command_sensor_index
+ *   Description: Index of the sensor of a command, 0 by default
+ */
+static int command_sensor_index(const command_message *message){
+   float sensor=0;
+   if(command_get_number(message, "sensor", &sensor)==ESP_ERR_INVALID_ARG
+         || sensor<0 || sensor>=sensor_registry_count() || sensor!=(int)sensor){
+      return -1;
+   }
+   return (int)sensor;
+}
+
+
+/*
+ * command_set_period
+ *   Description: Changes the time between reads of a sensor.
+ *     {"cmd":"set_period","sensor":0,"seconds":300}
+ */
+static esp_err_t command_set_period(const command_message *message, void *arg){
+   int index = command_sensor_index(message);
+   float seconds;
+   if(index<0 || command_get_number(message, "seconds", &seconds)!=ESP_OK
+         || seconds<1 || seconds>MAX_READ_PERIOD){
+      return ESP_ERR_INVALID_ARG;
+   }
+   // The sleep of the cycle is computed with the new due time
+   sensor_registry_set_period(index, (uint32_t)seconds, rtc_state_clock());
+   ESP_LOGI(MAIN_TAG, "Sensor %d read every %d s", index, sensor_registry_get(index)->period);
+   return settings_save_sensor(index);
+}
+
+
+/*
+ * command_set_deadband
+ *   Description: Changes the deadband of the values of a sensor.
+ *     {"cmd":"set_deadband","sensor":0,"values":[0.5,2]}
+ */
+static esp_err_t command_set_deadband(const command_message *message, void *arg){
+   int index = command_sensor_index(message);
+   float values[SENSOR_MAX_VALUES];
+   int count = command_get_numbers(message, "values", values, SENSOR_MAX_VALUES);
+   if(index<0 || count<=0){
+      return ESP_ERR_INVALID_ARG;
+   }
+   sensor_instance *instance = sensor_registry_get(index);
+   float deadband[SENSOR_MAX_VALUES];
+   for(uint8_t v=0; v<SENSOR_MAX_VALUES; v++){
+      if(v<count && values[v]<0){
+         return ESP_ERR_INVALID_ARG;
+      }
+      // Values not given keep their deadband
+      deadband[v] = v<count ? values[v] : instance->deadband[v];
+   }
+   sensor_registry_set_deadband(index, deadband);
+   return settings_save_sensor(index);
+}
+
+
+/*
+ * command_flush
+ *   Description: Uploads buffered samples and the outbox now. {"cmd":"flush"}
+ */
+static esp_err_t command_flush(const command_message *message, void *arg){
+   pend_command(RTC_COMMAND_FLUSH);
+   return ESP_OK;
+}
+
+
+/*
+ * command_update
+ *   Description: Updates the firmware with a patch made from the running
+ *     image by host/tools/delta_tool, then restarts on the new image.
+ *     {"cmd":"update","url":"https://example.com/iot_ms-1.0.1.dlt"}
+ */
+static esp_err_t command_update(const command_message *message, void *arg){
+   const command_field *url = command_find(message, "url");
+   if(url==NULL || url->type!=COMMAND_VALUE_STRING || url->value_length==0
+         || url->value_length>=OTA_URL_SIZE || memchr(url->value, '\\', url->value_length)!=NULL){
+      return ESP_ERR_INVALID_ARG;
+   }
+   if(rtc_state_get()->pending_commands&RTC_COMMAND_UPDATE){
+      // The url of the pending update is still in use
+      return ESP_ERR_INVALID_STATE;
+   }
+   memcpy(update_url, url->value, url->value_length);
+   update_url[url->value_length]='\0';
+   pend_command(RTC_COMMAND_UPDATE);
+   return ESP_OK;
+}
+
+
+// Commands accepted on SUBSCRIBE_TOPIC. "q" is the wake message of older
+// clients, {"q":...}
+static const command_entry remote_commands[] = {
+   { "sample_now", command_sample_now },
+   { "set_period", command_set_period },
+   { "set_deadband", command_set_deadband },
+   { "flush", command_flush },
+   { "update", command_update },
+   { "q", command_sample_now },
+};
+
+
 /*
  * my_custom_mqtt_on_event_data_cb
- *   Description: Mqtt function that executes when receiving data
+ *   Description: Mqtt function that executes when receiving data. Runs in
+ *     the mqtt task, so commands are queued and run by transmit_data_task,
+ *     which owns the registry, the scheduler and the settings
+ */
+void my_custom_mqtt_on_event_data_cb(uint16_t topic_len, char* topic, uint32_t data_len, char* data){
+   if(!command_equals(topic, topic_len, SUBSCRIBE_TOPIC)){
+      return;
+   }
+   if(command_queue_push(data, data_len)==ESP_OK){
+      event_loop_post(EVENT_LOOP_COMMAND);
+   }
+}
+
+
+/*
+ * run_commands
+ *   Description: Runs the commands received since the last call
+ *     Returns:
+ *       - count: uint8_t. Commands run
+ */
+static uint8_t run_commands(){
+   return command_queue_run(remote_commands,
+      sizeof remote_commands/sizeof remote_commands[0], NULL);
+}
+
+
+
+/*
+ * my_custom_mqtt_on_connected_cb
+ *   Description: Mqtt function that executes when connecting to the broker.
+ *     Wakes the task to subscribe and replay the outbox
  */
-void my_custom_mqtt_on_event_data_cb(uint8_t topic_len, char* topic, uint8_t data_len, char* data){
-   for(uint8_t i=0; (i+2)<data_len; i++){
-      if(data[i]=='q' && data[i+2]==':'){
-         ESP_LOGI(MAIN_TAG, "Waking up device");
-         xSemaphoreGive(sleep_semaphore);
+void my_custom_mqtt_on_connected_cb(){
+   if(outbox_count()>0){
+      ESP_LOGI(MAIN_TAG, "Broker is back, %d reports waiting", outbox_count());
+   }
+   event_loop_post(EVENT_LOOP_CONNECTED);
+}
+
+
+/*
+ * publish_report
+ *   Description: Publishes a report. While the broker is unreachable, it is
+ *     queued in the outbox
+ */
+static void publish_report(const char* topic, const char* payload, size_t length){
+   if(mqtt_is_connected()){
+      int msg_id = mqtt_pipeline_publish(client, topic, payload, length);
+      if(msg_id>=0){
+         ESP_LOGD(MAIN_TAG, "report publish successful, msg_id=%d", msg_id);
+         return;
       }
    }
+   esp_err_t err = outbox_append(topic, payload, length, rtc_state_get()->boot,
+      rtc_state_clock());
+   ESP_LOGW(MAIN_TAG, "Broker not connected, report queued: %s, %d waiting",
+      esp_err_to_name(err), outbox_count());
 }
 
 
+/*
+ * requeue_unacked_report
+ *   Description: Queues a report whose ack didn't arrive in the outbox. Used
+ *     by the mqtt pipeline. Only when the client is stopped before a deep
+ *     sleep or already disconnected: otherwise esp-mqtt still holds the
+ *     message and retransmits it, and a copy would reach the broker twice
+ */
+static void requeue_unacked_report(const char* topic, const char* payload,
+      size_t length, void* arg){
+   if(SLEEP_MODE==SLEEP_MODE_LIGHT && mqtt_is_connected()){
+      ESP_LOGW(MAIN_TAG, "Ack late on %s, left to mqtt retransmission", topic);
+      return;
+   }
+   outbox_append(topic, payload, length, rtc_state_get()->boot, rtc_state_clock());
+}
+
+
+/*
+ * send_outbox_with_mqtt
+ *   Description: Publishes a queued report with the boot and time it was
+ *     taken. Used by outbox_replay
+ */
+static esp_err_t send_outbox_with_mqtt(const char* topic, const char* payload,
+      size_t length, uint16_t boot, uint32_t timestamp, void* arg){
+   static char stamped[OUTBOX_MAX_RECORD+32];
+   int stamped_length = 0;
+   telemetry_frame frame;
+   if(strcmp(topic, REPORT_BINARY_TOPIC)==0
+         && telemetry_frame_decode((const uint8_t*)payload, length, &frame)==ESP_OK){
+      frame.flags |= TELEMETRY_FLAG_TIMESTAMP|TELEMETRY_FLAG_BOOT;
+      frame.timestamp = timestamp;
+      frame.boot = boot;
+      stamped_length = telemetry_frame_encode(&frame, (uint8_t*)stamped, sizeof stamped);
+   }
+   else if(length>2 && payload[0]=='{'){
+      stamped_length = snprintf(stamped, sizeof stamped, "{\"boot\":%u,\"t\":%u,%.*s",
+         boot, timestamp, (int)length-1, payload+1);
+   }
+   if(stamped_length<=0 || stamped_length>=(int)sizeof stamped){
+      memcpy(stamped, payload, length);
+      stamped_length = length;
+   }
+   int msg_id = mqtt_pipeline_publish(client, topic, stamped, stamped_length);
+   return msg_id<0 ? ESP_FAIL : ESP_OK;
+}
+
+
+/*
+ * send_batch_with_mqtt
+ *   Description: Publishes a batch of samples. Used by sample_buffer_flush.
+ *     Batches are larger than the copies of the pipeline, so the samples
+ *     are only cleared once the broker acks them
+ */
+static esp_err_t send_batch_with_mqtt(const char* payload, size_t length, void* arg){
+   ESP_LOGI(MAIN_TAG, "Sending batch of %d bytes", (int)length);
+   int msg_id = mqtt_pipeline_publish(client, BATCH_TOPIC, payload, length);
+   if(msg_id<0){
+      return ESP_FAIL;
+   }
+   return mqtt_pipeline_wait_ack(msg_id);
+}
+
+
+/*
+ * send_batch_with_http
+ *   Description: Posts a batch of samples to the bulk endpoint. Used by
+ *     sample_buffer_flush_samples
+ */
+static esp_err_t send_batch_with_http(const sensor_sample *samples, uint16_t count,
+      uint16_t boot, void* arg){
+   ESP_LOGI(MAIN_TAG, "Posting batch of %d samples", count);
+   return http_bulk_send(samples, count, boot, &http_cfg);
+}
+
+
+/*
+ * deep_sleep
+ *   Description: Stops mqtt and wifi, then deep sleeps until next cycle.
+ *     Radio is only turned on for wakes that will transmit
+ */
+static void deep_sleep(){
+   uint8_t radio_on = BATCH_SIZE<=1 || sample_buffer_count()+1>=BATCH_SIZE;
+   if(REPORT_ON_DELTA && BATCH_SIZE<=1){
+      // Wakes that only check the deadband don't need the radio
+      radio_on = sensor_registry_heartbeat_next(REPORT_HEARTBEAT);
+   }
+   if(client!=NULL){
+      if(BATCH_TRANSPORT==BATCH_TRANSPORT_HTTP){
+         close_http_clients();
+      }
+      esp_mqtt_client_stop(client);
+      esp_wifi_stop();
+   }
+   power_enter(POWER_STATE_DEEP_SLEEP);
+   rtc_state_deep_sleep(sleep_time, radio_on);
+}
+
+
+/*
+ * start_radio
+ *   Description: Connects to wifi and starts the mqtt client. After a deep
+ *     sleep, it waits for the broker before the cycle publishes
+ */
+static void start_radio(){
+   ESP_ERROR_CHECK(esp_netif_init());
+   ESP_ERROR_CHECK(esp_event_loop_create_default());
+   esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+   /********************* WIFI CONNECT ********************************/
+   power_enter(POWER_STATE_CONNECT);
+   DIAG_SPAN_BEGIN(DIAG_STAGE_WIFI);
+   // Returns once connected, or after the retries failed
+   wifi_init_sta(custom_wifi_config);
+   DIAG_SPAN_END(DIAG_STAGE_WIFI);
+
+   /********************* MQTT SETUP **********************************/
+   set_mqtt_on_event_data_cb(&my_custom_mqtt_on_event_data_cb);
+   set_mqtt_on_connected_cb(&my_custom_mqtt_on_connected_cb);
+   client = mqtt_app_start(&mqtt_cfg);
+   if(SLEEP_MODE==SLEEP_MODE_DEEP){
+      // Every wake starts a new connection, wait for it before publishing
+      if(event_loop_wait(EVENT_LOOP_CONNECTED, pdMS_TO_TICKS(MQTT_CONNECT_TIMEOUT))){
+         mqtt_subscribe(client, SUBSCRIBE_TOPIC, 1);
+      }
+   }
+   if(mqtt_is_connected()){
+      power_enter(POWER_STATE_ACTIVE);
+   }
+}
+
 
 /*
  * transmit_data_task
- *   Description: Reads data from sensors and send them to server
+ *   Description: Reads data from sensors and send them to server. Sleeps
+ *     in its event loop between cycles
  */
 static void transmit_data_task(){
-   // Init variables
-   //ESP_LOGI(MAIN_TAG, "Creating data pointer with size %d",sizeof(DhtSensor));
-   DhtSensor *dht_sensor;
-   if(iot_active_devices.dhtActive){
-      dht_sensor = (DhtSensor*)malloc(sizeof(DhtSensor));
-      dht_sensor->dht_pin = dht_gpio;
-      dht_sensor->dht_type = sensor_type;
-      dht_config(&dht_sensor);
+   event_loop_init();
+   // After a deep sleep the radio comes up once the sensors are read, see
+   // RADIO. Wakes that only sample don't bring it up
+   if(rtc_state_get()->radio_on && SLEEP_MODE!=SLEEP_MODE_DEEP){
+      start_radio();
+   }
+   // Sensors of the board
+   sensor_registry_add(&dht_sensor_driver, &dht_sensor, DHT_READ_PERIOD);
+   sensor_registry_set_deadband(0, dht_deadband);
+   // Periods and deadbands changed by remote commands
+   settings_load(rtc_state_clock());
+   // The device name is part of the report topic
+   payload_encoder_init(&report_payload, NULL);
+   uint8_t resumed = rtc_state_get()->wake_count>0;
+   sensor_registry_init(iot_active_devices.device_name, &report_payload, resumed);
+   if(resumed){
+      dht_sensor.temperature=rtc_state_get()->last_temperature;
+      dht_sensor.humidity=rtc_state_get()->last_humidity;
+      // The sensor stayed powered while the cpu slept, its last frame is
+      // older than the read interval
+      dht_sensor.last_frame_us=-(int64_t)DHT_MIN_READ_INTERVAL*1000000;
+   }
+   if(BATCH_SIZE>1){
+      sample_buffer_init(rtc_state_get()->boot);
    }
-   sleep_semaphore = xSemaphoreCreateBinary();
+   outbox_init(resumed);
+   mqtt_pipeline_init(MQTT_INFLIGHT_WINDOW, MQTT_ACK_TIMEOUT);
+   mqtt_pipeline_set_expired_cb(requeue_unacked_report, NULL);
+
+   DIAG_WATCH_TASK("transmit");
 
    // Transmission
    while (1){
+      DIAG_SPAN_BEGIN(DIAG_STAGE_CYCLE);
       esp_task_wdt_reset();
-      ESP_LOGI(MAIN_TAG, "Reading data from sensors");
-      /******** DHT ***********/
-      if(iot_active_devices.dhtActive){
-         dht_read_and_process_data(&dht_sensor);
-         send_dht_data_with_mqtt(dht_sensor,
-            iot_active_devices.device_name,
-            client, mqtt_cfg, TEMPERATURE_TOPIC,HUMIDITY_TOPIC);
+      // In light sleep, mqtt connects while the first cycle runs
+      if(power_trace_state()==POWER_STATE_CONNECT && mqtt_is_connected()){
+         power_enter(POWER_STATE_ACTIVE);
+      }
+      /********** COMMANDS ************/
+      run_commands();
+      // This cycle is the sample asked for
+      rtc_state_get()->pending_commands&=~RTC_COMMAND_SAMPLE_NOW;
+      ESP_LOGD(MAIN_TAG, "Reading data from sensors");
+      // Sensors due together share this cycle's transmission
+      DIAG_SPAN_BEGIN(DIAG_STAGE_SENSORS);
+      uint8_t sensors_due = sensor_scheduler_due(rtc_state_clock());
+      uint8_t sensors_read = sensor_scheduler_run(rtc_state_clock(), &report_payload);
+      DIAG_SPAN_END(DIAG_STAGE_SENSORS);
+      if(sensor_registry_get(0)->fresh){
+         rtc_state_get()->last_temperature=dht_sensor.temperature;
+         rtc_state_get()->last_humidity=dht_sensor.humidity;
+         ESP_LOGI(MAIN_TAG, "dht read in %d ms, %d retries, %d outliers, %d failed readings",
+            dht_sensor.stats.last_latency_us/1000, dht_sensor.stats.retries,
+            dht_sensor.stats.outliers, dht_sensor.stats.failed_readings);
+      }
+      if(sensors_read>0 && BATCH_SIZE>1){
+         sensor_sample sample = {
+            .timestamp = rtc_state_clock(),
+         };
+         sensor_registry_values(sample.values, SAMPLE_VALUES);
+         sample_buffer_push(&sample);
+      }
+
+      /********** RADIO ************/
+      if(SLEEP_MODE==SLEEP_MODE_DEEP && client==NULL && rtc_state_get()->radio_on){
+         // A wake whose reads all failed has nothing to send
+         if(sensors_due>0 && sensors_read==0 && outbox_count()==0
+               && rtc_state_get()->pending_commands==0){
+            ESP_LOGW(MAIN_TAG, "No sensor read, radio stays off");
+         }
+         else{
+            start_radio();
+         }
+      }
+
+      /******** DEADBAND ***********/
+      // A report left by a wake without radio is sent as is
+      uint8_t report_due = sensors_read>0;
+      uint8_t report_left = rtc_state_get()->pending_commands&RTC_COMMAND_FLUSH;
+      if(report_left){
+         rtc_state_get()->pending_commands&=~RTC_COMMAND_FLUSH;
+         report_due = 1;
+      }
+      else if(report_due && REPORT_ON_DELTA && BATCH_SIZE<=1){
+         report_due = sensor_registry_report_due(REPORT_HEARTBEAT);
+         if(report_due && client==NULL){
+            // Radio can only be turned on by waking again
+            ESP_LOGI(MAIN_TAG, "Values out of deadband, waking with radio");
+            rtc_state_get()->pending_commands|=RTC_COMMAND_FLUSH;
+            power_enter(POWER_STATE_DEEP_SLEEP);
+            rtc_state_deep_sleep(1, 1);
+         }
+      }
+
+      DIAG_SPAN_BEGIN(DIAG_STAGE_PUBLISH);
+      /******** OUTBOX ***********/
+      // Reports queued while the broker was unreachable go first, in order
+      if(client!=NULL && mqtt_is_connected() && outbox_count()>0){
+         power_enter(POWER_STATE_TX);
+         esp_err_t err = outbox_replay(send_outbox_with_mqtt, NULL, OUTBOX_REPLAY_MAX);
+         ESP_LOGI(MAIN_TAG, "Outbox replayed: %s, %d waiting", esp_err_to_name(err), outbox_count());
+      }
+
+      /******** TRANSMISSION ***********/
+      // Radio is only used once every BATCH_SIZE samples. After deep sleep,
+      // it is only on for wakes that transmit
+      if(client!=NULL && report_due
+            && (BATCH_SIZE<=1 || sample_buffer_count()>=BATCH_SIZE || report_left)){
+         power_enter(POWER_STATE_TX);
+         if(!mqtt_session_begin_cycle()){
+            ESP_LOGI(MAIN_TAG, "Transmitting on a new tls session");
+         }
+         if(BATCH_SIZE>1){
+            esp_err_t err = BATCH_TRANSPORT==BATCH_TRANSPORT_HTTP
+               ? sample_buffer_flush_samples(send_batch_with_http, NULL)
+               : sample_buffer_flush(send_batch_with_mqtt, NULL);
+            if(err!=ESP_OK){
+               ESP_LOGW(MAIN_TAG, "Batch not sent, %d samples kept", sample_buffer_count());
+            }
+         }
+         else if(MQTT_REPORT_MODE==MQTT_REPORT_COMBINED && PAYLOAD_FORMAT==PAYLOAD_FORMAT_BINARY){
+            // Device is named by the topic, frame has no device id
+            size_t length = sensor_registry_encode_frame(report_frame, sizeof report_frame);
+            if(length>0){
+               publish_report(REPORT_BINARY_TOPIC, (const char*)report_frame, length);
+            }
+         }
+         else if(MQTT_REPORT_MODE==MQTT_REPORT_COMBINED){
+            if(report_payload.field_count>0){
+               ESP_LOGD(MAIN_TAG, "Sending report: %s", report_payload.buffer);
+               publish_report(REPORT_TOPIC, report_payload.buffer, report_payload.length);
+            }
+         }
+         else{
+            // Split topics are only defined for the dht sensor. A failed
+            // read leaves -99 in dht_sensor, so only fresh values are sent
+            sensor_instance *dht_instance = sensor_registry_get(0);
+            if(dht_instance!=NULL && dht_instance->fresh){
+               // Queued in the outbox like the combined report while mqtt
+               // still connects, the read can end before it
+               payload_encoder *temperature = &dht_sensor.temperature_payload;
+               payload_encoder *humidity = &dht_sensor.humidity_payload;
+               payload_encoder_set_value(temperature, 0, dht_sensor.temperature);
+               payload_encoder_set_value(humidity, 0, dht_sensor.humidity);
+               publish_report(TEMPERATURE_TOPIC, temperature->buffer, temperature->length);
+               publish_report(HUMIDITY_TOPIC, humidity->buffer, humidity->length);
+            }
+         }
+         if(REPORT_ON_DELTA && BATCH_SIZE<=1){
+            sensor_registry_report_sent();
+         }
+         mqtt_session_stats session_stats;
+         get_mqtt_session_stats(&session_stats);
+         ESP_LOGI(MAIN_TAG, "tls session reused in %d of %d cycles, %d handshakes",
+            session_stats.cycles_reused, session_stats.cycles, session_stats.handshakes);
+      }
+      else if(!report_due && sensors_read>0 && REPORT_ON_DELTA && BATCH_SIZE<=1){
+         sensor_report_stats report_stats;
+         get_sensor_report_stats(&report_stats);
+         ESP_LOGI(MAIN_TAG, "Report suppressed, %d sent, %d suppressed, %d heartbeats",
+            report_stats.sent, report_stats.suppressed, report_stats.heartbeats);
+      }
+
+      DIAG_SPAN_END(DIAG_STAGE_PUBLISH);
+
+      /********** ACKS ************/
+      // Sleep once every report is acked, or at the deadline
+      if(client!=NULL && mqtt_pipeline_in_flight()>0){
+         DIAG_SPAN_BEGIN(DIAG_STAGE_ACKS);
+         uint8_t expired = mqtt_pipeline_drain(MQTT_ACK_TIMEOUT);
+         DIAG_SPAN_END(DIAG_STAGE_ACKS);
+         mqtt_pipeline_stats pipeline_stats;
+         get_mqtt_pipeline_stats(&pipeline_stats);
+         ESP_LOGI(MAIN_TAG, "%d acks, %d expired now, ack in %d ms, %d ms max",
+            pipeline_stats.acked, expired, pipeline_stats.last_ack_latency_us/1000,
+            pipeline_stats.max_ack_latency_us/1000);
+      }
+      if(power_trace_state()==POWER_STATE_TX){
+         power_enter(POWER_STATE_ACTIVE);
+      }
+
+      /********** UPDATE ************/
+      // An image on trial is kept once it reaches the broker
+      if(client!=NULL && mqtt_is_connected()){
+         ota_update_mark_valid();
+      }
+      else if(ota_update_trial_expired()){
+         ESP_LOGE(MAIN_TAG, "Broker not reached on trial, restarting");
+         esp_restart();
+      }
+      // Runs after the acks, reports of the cycle aren't delayed by it
+      if(rtc_state_get()->pending_commands&RTC_COMMAND_UPDATE){
+         char url[OTA_URL_SIZE];
+         strcpy(url, update_url);
+         rtc_state_get()->pending_commands&=~RTC_COMMAND_UPDATE;
+         // The url is lost if the device slept since the command
+         if(client!=NULL && mqtt_is_connected() && url[0]!='\0'){
+            power_enter(POWER_STATE_TX);
+            if(ota_update_apply(url)==ESP_OK){
+               ESP_LOGI(MAIN_TAG, "Restarting on the new image");
+               esp_restart();
+            }
+            power_enter(POWER_STATE_ACTIVE);
+         }
+      }
+
+#if DIAGNOSTICS
+      /******** DIAGNOSTICS ********/
+      // The record of this cycle has the previous cycle as its last span
+      if(diagnostics_end_cycle(DIAGNOSTICS_PERIOD) && client!=NULL && mqtt_is_connected()){
+         size_t length = diagnostics_encode(FIRMWARE_VERSION,
+            diagnostics_record, sizeof diagnostics_record);
+         if(length>0 && esp_mqtt_client_publish(client, DIAGNOSTICS_TOPIC,
+               diagnostics_record, length, 0, 0)>=0){
+            diagnostics_record_sent();
+         }
+      }
+      DIAG_SPAN_END(DIAG_STAGE_CYCLE);
+#endif
+
+      /******** POWER TRACE ********/
+      if(POWER_TRACE_EXPORT>0 && power_trace_count()>=POWER_TRACE_EXPORT
+            && client!=NULL && mqtt_is_connected()){
+         size_t length = power_trace_export(power_trace_record, sizeof power_trace_record);
+         if(length>0 && esp_mqtt_client_publish(client, POWER_TRACE_TOPIC,
+               power_trace_record, length, 0, 0)>=0){
+            power_trace_clear();
+         }
       }
 
       /********** SLEEP ************/
-      ESP_LOGI(MAIN_TAG, "Going to sleep");
+      if(SLEEP_MODE==SLEEP_MODE_DEEP){
+         // Commands received during this cycle run before sleeping. In
+         // light sleep, their event ends the sleep instead
+         run_commands();
+      }
+      sleep_time = sensor_scheduler_next_read(rtc_state_clock());
+      if(SLEEP_MODE==SLEEP_MODE_DEEP){
+         if(rtc_state_get()->pending_commands
+               &(RTC_COMMAND_SAMPLE_NOW|RTC_COMMAND_FLUSH|RTC_COMMAND_UPDATE)){
+            rtc_state_get()->pending_commands&=~RTC_COMMAND_SAMPLE_NOW;
+            continue;
+         }
+         deep_sleep();
+      }
+      ESP_LOGI(MAIN_TAG, "Going to sleep for %d s", sleep_time);
       esp_task_wdt_reset();
       esp_wifi_set_ps(WIFI_PS_MAX_MODEM);
-      hw_timer_init(hw_timer_sleep, NULL);
-      hw_timer_alarm_us(1000000, true);
-      xSemaphoreTake(sleep_semaphore, portMAX_DELAY);
-      hw_timer_deinit();
+      power_enter(POWER_STATE_MODEM_SLEEP);
+      // Only the wake timer, commands and the broker wake the cpu, the idle
+      // task feeds the watchdog meanwhile
+      uint32_t events = event_loop_sleep(sleep_time);
       esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+      power_enter(client!=NULL ? POWER_STATE_ACTIVE : POWER_STATE_AWAKE);
+      if(events&EVENT_LOOP_CONNECTED){
+         // The session of a new connection has no subscriptions
+         mqtt_subscribe(client, SUBSCRIBE_TOPIC, 1);
+      }
    }
 }
 
 
 /*
  * app_main
- *   Description: Starts wifi connection and creates transmit_data_task
+ *   Description: Restores the state kept in rtc memory and creates
+ *     transmit_data_task, which connects to wifi
  */
 void app_main(){
    // Start watchdog
    esp_task_wdt_init();
    /********************* DEFAULT CONFIG ******************************/
    ESP_ERROR_CHECK(nvs_flash_init());
-   ESP_ERROR_CHECK(esp_netif_init());
-   ESP_ERROR_CHECK(esp_event_loop_create_default());
-   esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
-   /********************* WIFI CONNECT ********************************/
-   create_wifi_semaphore();
-   wifi_init_sta(custom_wifi_config);
-   // Waits indefenitely for wifi to connect
-   take_from_wifi_semaphore(portMAX_DELAY);
-   delete_wifi_semaphore();
-
-   /********************* MQTT SETUP **********************************/
-   client = mqtt_app_start(&mqtt_cfg);
-
-   // Subscribe to topics
-   set_mqtt_on_event_data_cb(&my_custom_mqtt_on_event_data_cb);
-   mqtt_subscribe(client, SUBSCRIBE_TOPIC, 1);
+   uint8_t resumed = rtc_state_restore();
+   // Rolls back an update that didn't reach the broker, doesn't return then
+   ota_update_check_boot(rtc_state_get()->radio_on);
+   DIAG_INIT(resumed);
+   power_trace_init(resumed);
+   power_enter(POWER_STATE_AWAKE);
 
    // Create task to transmit data
    xTaskCreate(transmit_data_task, "transmit_data_task", 2048*2, NULL, 15, NULL);
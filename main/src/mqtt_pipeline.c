@@ -0,0 +1,366 @@
+/*
+ * mqtt_pipeline.c
+ * @description: Implementation of a QoS 1 publish pipeline with an in-flight
+ *    window
+ * @author: @Retrocamara42
+ *
+ */
+#define LOG_LOCAL_LEVEL LOG_LEVEL_PIPELINE
+#include "log_levels.h"
+#include <string.h>
+
+#include "mqtt_pipeline.h"
+
+static const char *PIPELINE_TAG = "pipeline";
+
+/*
+ * slot_state: State of a slot of the window
+ *    - SLOT_FREE: Not used
+ *    - SLOT_SENDING: Reserved, publish hasn't returned the message id yet
+ *    - SLOT_IN_FLIGHT: Waiting for the ack of msg_id
+ */
+typedef enum {
+   SLOT_FREE = 0,
+   SLOT_SENDING,
+   SLOT_IN_FLIGHT,
+} slot_state;
+
+/*
+ * pipeline_slot: Message waiting for ack
+ *    - state: slot_state. State of the slot
+ *    - msg_id: int. Message id given by the client
+ *    - sent_us: int64_t. Time of the publish
+ *    - length: uint16_t. Length of payload, 0 if the message wasn't copied
+ *    - topic: char[]. Copy of the topic
+ *    - payload: char[]. Copy of the payload
+ */
+typedef struct {
+   slot_state state;
+   int msg_id;
+   int64_t sent_us;
+   uint16_t length;
+   char topic[MQTT_PIPELINE_MAX_TOPIC];
+   char payload[MQTT_PIPELINE_MAX_PAYLOAD];
+} pipeline_slot;
+
+static pipeline_slot slots[MQTT_PIPELINE_MAX_WINDOW];
+static uint8_t window_size=1;
+static uint8_t in_flight=0;
+static int64_t ack_timeout_us=5000000;
+// Acks that arrived before publish returned their message id
+static int early_acks[MQTT_PIPELINE_MAX_WINDOW];
+static uint8_t early_ack_count=0;
+static mqtt_pipeline_expired_cb custom_expired_cb=NULL;
+static void* custom_expired_cb_arg=NULL;
+static mqtt_pipeline_stats counters;
+// Given on every ack, the publishing task blocks on it instead of polling
+static SemaphoreHandle_t ack_signal=NULL;
+
+
+/*
+ * mqtt_pipeline_init: Configure the pipeline
+ *    Arguments:
+ *       - window: uint8_t. Messages waiting for ack at once
+ *       - ack_timeout_ms: uint32_t. Time a message waits for its ack
+ */
+void mqtt_pipeline_init(uint8_t window, uint32_t ack_timeout_ms){
+   window_size = window<1 ? 1 : window;
+   if(window_size>MQTT_PIPELINE_MAX_WINDOW){
+      window_size=MQTT_PIPELINE_MAX_WINDOW;
+   }
+   ack_timeout_us=(int64_t)ack_timeout_ms*1000;
+   if(ack_signal==NULL){
+      ack_signal=xSemaphoreCreateBinary();
+   }
+}
+
+
+/*
+ * mqtt_pipeline_set_expired_cb: Function that takes back expired messages
+ *    Arguments:
+ *       - expired_cb: mqtt_pipeline_expired_cb. NULL to drop them
+ *       - arg: void*. Argument given to expired_cb
+ */
+void mqtt_pipeline_set_expired_cb(mqtt_pipeline_expired_cb expired_cb, void* arg){
+   custom_expired_cb=expired_cb;
+   custom_expired_cb_arg=arg;
+}
+
+
+/*
+ * retire_slot: Free the slot of an acked message. Called in a critical section
+ */
+static void retire_slot(pipeline_slot *slot, int64_t now){
+   uint32_t latency = (uint32_t)(now-slot->sent_us);
+   counters.acked++;
+   counters.last_ack_latency_us=latency;
+   counters.total_ack_latency_us+=latency;
+   if(latency>counters.max_ack_latency_us){
+      counters.max_ack_latency_us=latency;
+   }
+   slot->state=SLOT_FREE;
+   in_flight--;
+}
+
+
+/*
+ * take_early_ack: Remove msg_id from the early acks. Called in a critical
+ *    section
+ *    Returns:
+ *       - found: uint8_t. 1 if the ack had already arrived
+ */
+static uint8_t take_early_ack(int msg_id){
+   for(uint8_t i=0; i<early_ack_count; i++){
+      if(early_acks[i]==msg_id){
+         early_acks[i]=early_acks[--early_ack_count];
+         return 1;
+      }
+   }
+   return 0;
+}
+
+
+/*
+ * expire_slot: Give up on the ack of a message. Runs in the publishing task
+ */
+static void expire_slot(pipeline_slot *slot){
+   portENTER_CRITICAL();
+   uint8_t waiting = slot->state==SLOT_IN_FLIGHT;
+   if(waiting){
+      slot->state=SLOT_SENDING;
+   }
+   portEXIT_CRITICAL();
+   if(!waiting){
+      return;
+   }
+   counters.expired++;
+   ESP_LOGW(PIPELINE_TAG, "No ack for msg_id=%d", slot->msg_id);
+   if(custom_expired_cb!=NULL && slot->length>0){
+      custom_expired_cb(slot->topic, slot->payload, slot->length, custom_expired_cb_arg);
+   }
+   portENTER_CRITICAL();
+   slot->state=SLOT_FREE;
+   in_flight--;
+   portEXIT_CRITICAL();
+}
+
+
+/*
+ * expire_overdue: Expire messages older than the ack timeout
+ */
+static void expire_overdue(int64_t now){
+   for(uint8_t i=0; i<MQTT_PIPELINE_MAX_WINDOW; i++){
+      if(slots[i].state==SLOT_IN_FLIGHT && now-slots[i].sent_us>=ack_timeout_us){
+         expire_slot(&slots[i]);
+      }
+   }
+}
+
+
+/*
+ * wait_for_ack: Block until an ack arrives or a deadline passes. Acks given
+ *    before the wait return at once, callers check the slots again
+ *    Arguments:
+ *       - deadline: int64_t. Time to stop waiting at
+ */
+static void wait_for_ack(int64_t deadline){
+   int64_t wait_us = deadline-esp_timer_get_time();
+   // Rounded up, so the deadline has passed when the wait times out
+   TickType_t ticks = wait_us>0 ? pdMS_TO_TICKS((wait_us+999)/1000)+1 : 1;
+   xSemaphoreTake(ack_signal, ticks);
+}
+
+
+/*
+ * oldest_deadline: Time the oldest message waiting for its ack expires at
+ */
+static int64_t oldest_deadline(int64_t now){
+   int64_t deadline = now+ack_timeout_us;
+   portENTER_CRITICAL();
+   for(uint8_t i=0; i<MQTT_PIPELINE_MAX_WINDOW; i++){
+      if(slots[i].state==SLOT_IN_FLIGHT && slots[i].sent_us+ack_timeout_us<deadline){
+         deadline=slots[i].sent_us+ack_timeout_us;
+      }
+   }
+   portEXIT_CRITICAL();
+   return deadline;
+}
+
+
+/*
+ * reserve_slot: Take a free slot, waiting while the window is full
+ */
+static pipeline_slot* reserve_slot(){
+   uint8_t waited=0;
+   while(1){
+      expire_overdue(esp_timer_get_time());
+      portENTER_CRITICAL();
+      if(in_flight<window_size){
+         for(uint8_t i=0; i<MQTT_PIPELINE_MAX_WINDOW; i++){
+            if(slots[i].state==SLOT_FREE){
+               slots[i].state=SLOT_SENDING;
+               in_flight++;
+               portEXIT_CRITICAL();
+               return &slots[i];
+            }
+         }
+      }
+      portEXIT_CRITICAL();
+      if(!waited){
+         counters.window_waits++;
+         waited=1;
+      }
+      wait_for_ack(oldest_deadline(esp_timer_get_time()));
+   }
+}
+
+
+/*
+ * mqtt_pipeline_publish: Publish with QoS 1
+ *    Arguments:
+ *       - client: esp_mqtt_client_handle_t. Mqtt client
+ *       - topic: const char*. Topic
+ *       - payload: const char*. Payload
+ *       - length: size_t. Length of payload
+ *    Returns:
+ *       - msg_id: int. Message id, -1 if the client refused it
+ */
+int mqtt_pipeline_publish(esp_mqtt_client_handle_t client, const char* topic,
+      const char* payload, size_t length){
+   pipeline_slot *slot = reserve_slot();
+   size_t topic_length = strlen(topic);
+   if(length<=MQTT_PIPELINE_MAX_PAYLOAD && topic_length<MQTT_PIPELINE_MAX_TOPIC){
+      memcpy(slot->topic, topic, topic_length+1);
+      memcpy(slot->payload, payload, length);
+      slot->length=length;
+   }
+   else{
+      slot->length=0;
+   }
+   slot->sent_us=esp_timer_get_time();
+   int msg_id = esp_mqtt_client_publish(client, topic, payload, length, 1, 0);
+
+   portENTER_CRITICAL();
+   if(msg_id<=0){
+      slot->state=SLOT_FREE;
+      in_flight--;
+      counters.failed++;
+   }
+   else{
+      slot->msg_id=msg_id;
+      slot->state=SLOT_IN_FLIGHT;
+      counters.published++;
+      if(in_flight>counters.max_in_flight){
+         counters.max_in_flight=in_flight;
+      }
+      if(take_early_ack(msg_id)){
+         retire_slot(slot, esp_timer_get_time());
+      }
+   }
+   portEXIT_CRITICAL();
+   return msg_id>0 ? msg_id : -1;
+}
+
+
+/*
+ * mqtt_pipeline_on_published: Retire a message
+ *    Arguments:
+ *       - msg_id: int. Id of the acked message
+ */
+void mqtt_pipeline_on_published(int msg_id){
+   int64_t now = esp_timer_get_time();
+   uint8_t sending=0;
+   portENTER_CRITICAL();
+   for(uint8_t i=0; i<MQTT_PIPELINE_MAX_WINDOW; i++){
+      if(slots[i].state==SLOT_IN_FLIGHT && slots[i].msg_id==msg_id){
+         retire_slot(&slots[i], now);
+         portEXIT_CRITICAL();
+         if(ack_signal!=NULL){
+            xSemaphoreGive(ack_signal);
+         }
+         return;
+      }
+      sending |= slots[i].state==SLOT_SENDING;
+   }
+   if(sending && early_ack_count<MQTT_PIPELINE_MAX_WINDOW){
+      early_acks[early_ack_count++]=msg_id;
+   }
+   else{
+      counters.unknown_acks++;
+   }
+   portEXIT_CRITICAL();
+}
+
+
+/*
+ * mqtt_pipeline_wait_ack: Wait for the ack of a message
+ *    Arguments:
+ *       - msg_id: int. Id returned by mqtt_pipeline_publish
+ */
+esp_err_t mqtt_pipeline_wait_ack(int msg_id){
+   while(1){
+      pipeline_slot *slot = NULL;
+      portENTER_CRITICAL();
+      for(uint8_t i=0; i<MQTT_PIPELINE_MAX_WINDOW; i++){
+         if(slots[i].state==SLOT_IN_FLIGHT && slots[i].msg_id==msg_id){
+            slot = &slots[i];
+         }
+      }
+      portEXIT_CRITICAL();
+      if(slot==NULL){
+         // Retired by its ack
+         return ESP_OK;
+      }
+      if(esp_timer_get_time()-slot->sent_us>=ack_timeout_us){
+         // Only this task expires messages, the slot is still the same one
+         slot->length=0;
+         expire_slot(slot);
+         return ESP_ERR_TIMEOUT;
+      }
+      wait_for_ack(slot->sent_us+ack_timeout_us);
+   }
+}
+
+
+/*
+ * mqtt_pipeline_in_flight: Messages waiting for ack
+ */
+uint8_t mqtt_pipeline_in_flight(){
+   return in_flight;
+}
+
+
+/*
+ * mqtt_pipeline_drain: Wait until every message is acked or the deadline
+ *    passes
+ *    Arguments:
+ *       - timeout_ms: uint32_t. Maximum time to wait
+ *    Returns:
+ *       - expired: uint8_t. Messages that expired
+ */
+uint8_t mqtt_pipeline_drain(uint32_t timeout_ms){
+   int64_t deadline = esp_timer_get_time()+(int64_t)timeout_ms*1000;
+   while(in_flight>0 && esp_timer_get_time()<deadline){
+      wait_for_ack(deadline);
+   }
+   uint32_t expired = counters.expired;
+   for(uint8_t i=0; i<MQTT_PIPELINE_MAX_WINDOW; i++){
+      expire_slot(&slots[i]);
+   }
+   portENTER_CRITICAL();
+   early_ack_count=0;
+   portEXIT_CRITICAL();
+   return counters.expired-expired;
+}
+
+
+/*
+ * get_mqtt_pipeline_stats: Get counters of the pipeline
+ *    Arguments:
+ *       - stats: mqtt_pipeline_stats*. Where counters are copied to
+ */
+void get_mqtt_pipeline_stats(mqtt_pipeline_stats *stats){
+   portENTER_CRITICAL();
+   *stats=counters;
+   portEXIT_CRITICAL();
+}
@@ -5,14 +5,48 @@
  * @author: @Retrocamara42
  *
  */
+#define LOG_LOCAL_LEVEL LOG_LEVEL_MQTT
+#include "log_levels.h"
+#include <string.h>
+
 #include "mqtt_ssl.h"
+#include "diagnostics.h"
 
 static const char *MQTT_TAG = "MQTT_SSL";
 static uint8_t mqttStatusConnection=0;
+static mqtt_session_stats session_stats;
+// Handshakes seen by the previous report cycle
+static uint32_t cycle_handshakes=0;
 
-void default_mqtt_on_event_data_cb(uint8_t topic_len, char* topic, uint8_t data_len, char* data) { }
+void default_mqtt_on_event_data_cb(uint16_t topic_len, char* topic, uint32_t data_len, char* data) { }
 
 static mqtt_on_event_data_cb custom_mqtt_on_event_data_cb = &default_mqtt_on_event_data_cb;
+static mqtt_on_connected_cb custom_mqtt_on_connected_cb = NULL;
+
+/*
+ * rx_buffer: Buffer of the pool where a fragmented message is put together
+ *    - in_use: uint8_t. 1 while a message is being received
+ *    - msg_id: int. Id of the message, 0 for QoS 0
+ *    - topic_len: uint16_t. Length of topic
+ *    - received: uint32_t. Bytes of data received
+ *    - total: uint32_t. Length of the whole message
+ *    - topic: char[]. Topic, from the first fragment
+ *    - data: char[]. Data
+ */
+typedef struct {
+   uint8_t in_use;
+   int msg_id;
+   uint16_t topic_len;
+   uint32_t received;
+   uint32_t total;
+   char topic[MQTT_RX_MAX_TOPIC];
+   char data[MQTT_RX_BUFFER_SIZE];
+} rx_buffer;
+
+static rx_buffer rx_pool[MQTT_RX_POOL_SIZE];
+static mqtt_rx_stats rx_stats;
+// Fragments of a message dropped on its first fragment are skipped
+static int skipped_msg_id=-1;
 
 
 /*
@@ -20,11 +54,128 @@ static mqtt_on_event_data_cb custom_mqtt_on_event_data_cb = &default_mqtt_on_eve
  *    Arguments:
  *       - on_event_data_cb: void*. Custom function to run when data is received
  */
-void set_mqtt_on_event_data_cb(void (*on_event_data_cb)(uint8_t topic_len, char* topic, uint8_t data_len, char* data)){
+void set_mqtt_on_event_data_cb(void (*on_event_data_cb)(uint16_t topic_len, char* topic, uint32_t data_len, char* data)){
    custom_mqtt_on_event_data_cb=(*on_event_data_cb);
 }
 
 
+/*
+ * set_mqtt_on_connected_cb: Function that runs when the event MQTT_EVENT_CONNECTED is active
+ *    Arguments:
+ *       - on_connected_cb: void*. Custom function to run on each connection
+ */
+void set_mqtt_on_connected_cb(void (*on_connected_cb)()){
+   custom_mqtt_on_connected_cb=on_connected_cb;
+}
+
+
+/*
+ * deliver_message: Give a whole message to the data callback
+ */
+static void deliver_message(uint16_t topic_len, char* topic, uint32_t data_len, char* data){
+    rx_stats.messages++;
+    ESP_LOGD(MQTT_TAG, "TOPIC=%.*s", topic_len, topic);
+    ESP_LOGD(MQTT_TAG, "DATA=%.*s", (int)data_len, data);
+    custom_mqtt_on_event_data_cb(topic_len, topic, data_len, data);
+}
+
+
+/*
+ * release_rx_pool: Drop the messages being received, when the connection
+ *    is lost
+ */
+static void release_rx_pool(){
+    for(uint8_t i=0; i<MQTT_RX_POOL_SIZE; i++){
+        if(rx_pool[i].in_use){
+            rx_pool[i].in_use=0;
+            rx_stats.incomplete++;
+        }
+    }
+    skipped_msg_id=-1;
+}
+
+
+/*
+ * receive_fragment: Handle MQTT_EVENT_DATA. Whole messages are delivered
+ *   from the event, fragments are copied to a buffer of the pool until the
+ *   message is complete. Fragments of a message come in order
+ *    Arguments:
+ *       - event: esp_mqtt_event_handle_t. Mqtt event.
+ */
+static void receive_fragment(esp_mqtt_event_handle_t event){
+    uint32_t total = event->total_data_len>0 ? event->total_data_len : event->data_len;
+    if(event->current_data_offset==0 && (uint32_t)event->data_len>=total){
+        rx_stats.zero_copy++;
+        deliver_message(event->topic_len, event->topic, event->data_len, event->data);
+        return;
+    }
+    rx_buffer *buffer=NULL;
+    if(event->current_data_offset==0){
+        // A new message, whatever was pending for this id won't complete
+        skipped_msg_id=-1;
+        for(uint8_t i=0; i<MQTT_RX_POOL_SIZE; i++){
+            if(rx_pool[i].in_use && rx_pool[i].msg_id==event->msg_id){
+                rx_pool[i].in_use=0;
+                rx_stats.incomplete++;
+            }
+        }
+        if(total>MQTT_RX_BUFFER_SIZE || event->topic_len>MQTT_RX_MAX_TOPIC){
+            ESP_LOGW(MQTT_TAG, "Message of %d bytes dropped, too large", total);
+            rx_stats.too_large++;
+            skipped_msg_id=event->msg_id;
+            return;
+        }
+        for(uint8_t i=0; i<MQTT_RX_POOL_SIZE && buffer==NULL; i++){
+            if(!rx_pool[i].in_use){
+                buffer=&rx_pool[i];
+            }
+        }
+        if(buffer==NULL){
+            ESP_LOGW(MQTT_TAG, "No buffer for a message of %d bytes", total);
+            rx_stats.pool_exhausted++;
+            skipped_msg_id=event->msg_id;
+            return;
+        }
+        buffer->in_use=1;
+        buffer->msg_id=event->msg_id;
+        buffer->topic_len=event->topic_len;
+        buffer->received=0;
+        buffer->total=total;
+        memcpy(buffer->topic, event->topic, event->topic_len);
+    }
+    else{
+        if(event->msg_id==skipped_msg_id){
+            return;
+        }
+        for(uint8_t i=0; i<MQTT_RX_POOL_SIZE && buffer==NULL; i++){
+            if(rx_pool[i].in_use && rx_pool[i].msg_id==event->msg_id){
+                buffer=&rx_pool[i];
+            }
+        }
+        if(buffer==NULL){
+            rx_stats.incomplete++;
+            skipped_msg_id=event->msg_id;
+            return;
+        }
+    }
+    if((uint32_t)event->current_data_offset!=buffer->received
+            || buffer->received+event->data_len>buffer->total){
+        ESP_LOGW(MQTT_TAG, "Fragment out of order, message dropped");
+        buffer->in_use=0;
+        rx_stats.incomplete++;
+        skipped_msg_id=event->msg_id;
+        return;
+    }
+    memcpy(buffer->data+buffer->received, event->data, event->data_len);
+    buffer->received+=event->data_len;
+    rx_stats.fragments++;
+    if(buffer->received==buffer->total){
+        deliver_message(buffer->topic_len, buffer->topic, buffer->total, buffer->data);
+        buffer->in_use=0;
+    }
+}
+
+
 /*
  * mqtt_event_handler_cb: Logic for event handler for mqtt
  *    Arguments:
@@ -32,12 +183,24 @@ void set_mqtt_on_event_data_cb(void (*on_event_data_cb)(uint8_t topic_len, char*
  */
 static esp_err_t mqtt_event_handler_cb(esp_mqtt_event_handle_t event){
     switch(event->event_id){
+        case MQTT_EVENT_BEFORE_CONNECT:
+            session_stats.handshakes++;
+            DIAG_SPAN_BEGIN(DIAG_STAGE_MQTT_CONNECT);
+            break;
         case MQTT_EVENT_CONNECTED:
             ESP_LOGI(MQTT_TAG, "MQTT_EVENT_CONNECTED");
             mqttStatusConnection=1;
+            session_stats.connects++;
+            DIAG_SPAN_END(DIAG_STAGE_MQTT_CONNECT);
+            DIAG_WATCH_TASK("mqtt");
+            if(custom_mqtt_on_connected_cb!=NULL){
+                custom_mqtt_on_connected_cb();
+            }
             break;
         case MQTT_EVENT_DISCONNECTED:
             mqttStatusConnection=0;
+            session_stats.disconnects++;
+            release_rx_pool();
             break;
         case MQTT_EVENT_SUBSCRIBED:
             ESP_LOGI(MQTT_TAG, "MQTT_EVENT_SUBSCRIBED, msg_id=%d", event->msg_id);
@@ -45,11 +208,10 @@ static esp_err_t mqtt_event_handler_cb(esp_mqtt_event_handle_t event){
         case MQTT_EVENT_UNSUBSCRIBED:
             break;
         case MQTT_EVENT_PUBLISHED:
+            mqtt_pipeline_on_published(event->msg_id);
             break;
         case MQTT_EVENT_DATA:
-            printf("TOPIC=%.*s\r\n", event->topic_len, event->topic);
-            printf("DATA=%.*s\r\n", event->data_len, event->data);
-            custom_mqtt_on_event_data_cb(event->topic_len, event->topic, event->data_len, event->data);
+            receive_fragment(event);
             break;
         case MQTT_EVENT_ERROR:
             if (event->error_handle->error_type == MQTT_ERROR_TYPE_ESP_TLS) {
@@ -96,6 +258,54 @@ esp_mqtt_client_handle_t mqtt_app_start(const esp_mqtt_client_config_t* mqtt_cfg
 }
 
 
+/*
+ * mqtt_is_connected: Check connection to the broker
+ *    Returns:
+ *       - connected: uint8_t. 1 if connected
+ */
+uint8_t mqtt_is_connected(){
+   return mqttStatusConnection;
+}
+
+
+/*
+ * mqtt_session_begin_cycle: Account a report cycle in mqtt_session_stats
+ *    Returns:
+ *       - reused: uint8_t. 1 if the session of the previous cycle is
+ *          still open
+ */
+uint8_t mqtt_session_begin_cycle(){
+   uint8_t reused = session_stats.cycles>0 && mqttStatusConnection
+      && session_stats.handshakes==cycle_handshakes;
+   session_stats.cycles++;
+   if(reused){
+      session_stats.cycles_reused++;
+   }
+   cycle_handshakes=session_stats.handshakes;
+   return reused;
+}
+
+
+/*
+ * get_mqtt_session_stats: Get counters of the mqtt tls session
+ *    Arguments:
+ *       - stats: mqtt_session_stats*. Where counters are copied to
+ */
+void get_mqtt_session_stats(mqtt_session_stats *stats){
+   *stats=session_stats;
+}
+
+
+/*
+ * get_mqtt_rx_stats: Get counters of received messages
+ *    Arguments:
+ *       - stats: mqtt_rx_stats*. Where counters are copied to
+ */
+void get_mqtt_rx_stats(mqtt_rx_stats *stats){
+   *stats=rx_stats;
+}
+
+
 /*
  * mqtt_subscribe: Subscribe to mqtt topic
  *    Arguments:
@@ -104,7 +314,7 @@ esp_mqtt_client_handle_t mqtt_app_start(const esp_mqtt_client_config_t* mqtt_cfg
  *       - qos: uint8_t. Quality of service.
  */
 void mqtt_subscribe(esp_mqtt_client_handle_t client, char* topic, uint8_t qos){
-   uint8_t msg_id = esp_mqtt_client_subscribe(client, topic, qos);
+   int msg_id = esp_mqtt_client_subscribe(client, topic, qos);
    ESP_LOGI(MQTT_TAG, "sent subscribe successful, msg_id=%d", msg_id);
 }
 
@@ -118,6 +328,6 @@ void mqtt_subscribe(esp_mqtt_client_handle_t client, char* topic, uint8_t qos){
  *       - qos: uint8_t. Quality of service.
  */
 void mqtt_unsubscribe(esp_mqtt_client_handle_t client, char* topic){
-   uint8_t msg_id = esp_mqtt_client_unsubscribe(client, topic);
+   int msg_id = esp_mqtt_client_unsubscribe(client, topic);
    ESP_LOGI(MQTT_TAG, "sent unsubscribe successful, msg_id=%d", msg_id);
 }
@@ -0,0 +1,380 @@
+/*
+ * ota_update.c
+ * @description: Implementation of delta firmware updates over two app slots
+ * @author: @Retrocamara42
+ *
+ */
+#define LOG_LOCAL_LEVEL LOG_LEVEL_OTA
+#include "log_levels.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_http_client.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_task_wdt.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/sha256.h"
+#include "ota_update.h"
+#include "delta_patch.h"
+
+static const char *OTA_TAG = "ota";
+// Nvs key of the boot record
+static const char *OTA_RECORD_KEY = "boot";
+
+/*
+ * ota_slots: Slots of an update being applied
+ *    - running: esp_partition_t*. Slot of the running image, read by the
+ *       patch
+ *    - update: esp_partition_t*. Slot the new image is written to
+ *    - handle: esp_ota_handle_t. Handle of the write
+ *    - begun: uint8_t. 1 once esp_ota_begin erased the slot
+ */
+typedef struct {
+   const esp_partition_t *running;
+   const esp_partition_t *update;
+   esp_ota_handle_t handle;
+   uint8_t begun;
+} ota_slots;
+
+// Static, the window of the patch doesn't fit in the stack of the task
+static delta_patch patch;
+static uint8_t download_chunk[OTA_DOWNLOAD_CHUNK];
+static uint8_t signature[OTA_SIGNATURE_MAX_SIZE];
+// Sha256 of the new image, as it is written
+static mbedtls_sha256_context image_hash;
+static ota_update_stats update_stats;
+// 1 while the running image is on trial
+static uint8_t on_trial=0;
+
+
+static esp_err_t load_record(ota_boot_record *record){
+   nvs_handle handle;
+   esp_err_t err = nvs_open(OTA_NAMESPACE, NVS_READONLY, &handle);
+   if(err!=ESP_OK){
+      return err;
+   }
+   size_t length = sizeof *record;
+   err = nvs_get_blob(handle, OTA_RECORD_KEY, record, &length);
+   nvs_close(handle);
+   if(err==ESP_OK && length!=sizeof *record){
+      err = ESP_ERR_INVALID_SIZE;
+   }
+   return err;
+}
+
+
+static esp_err_t save_record(const ota_boot_record *record){
+   nvs_handle handle;
+   esp_err_t err = nvs_open(OTA_NAMESPACE, NVS_READWRITE, &handle);
+   if(err!=ESP_OK){
+      return err;
+   }
+   err = nvs_set_blob(handle, OTA_RECORD_KEY, record, sizeof *record);
+   if(err==ESP_OK){
+      err = nvs_commit(handle);
+   }
+   nvs_close(handle);
+   return err;
+}
+
+
+/*
+ * ota_update_check_boot: Count a boot of an image on trial, and boot the
+ *    previous slot once it has used its attempts
+ *    Arguments:
+ *       - radio_on: uint8_t. 1 if this boot brings up the radio
+ */
+esp_err_t ota_update_check_boot(uint8_t radio_on){
+   ota_boot_record record;
+   if(load_record(&record)!=ESP_OK || record.state!=OTA_STATE_PENDING){
+      return ESP_OK;
+   }
+   const esp_partition_t *running = esp_ota_get_running_partition();
+   if(running==NULL || strncmp(running->label, record.previous, sizeof record.previous)==0){
+      // Back on the previous image, after a rollback or a boot slot that
+      // couldn't be changed
+      ESP_LOGW(OTA_TAG, "Update not kept, running %s", record.previous);
+      record.state = OTA_STATE_VALID;
+      record.attempts = 0;
+      return save_record(&record);
+   }
+   on_trial = 1;
+   if(!radio_on){
+      return ESP_OK;
+   }
+   record.attempts++;
+   if(record.attempts>OTA_MAX_BOOT_ATTEMPTS){
+      const esp_partition_t *previous = esp_partition_find_first(ESP_PARTITION_TYPE_APP,
+         ESP_PARTITION_SUBTYPE_ANY, record.previous);
+      ESP_LOGE(OTA_TAG, "%s didn't reach the broker in %d boots, rolling back to %s",
+         running->label, OTA_MAX_BOOT_ATTEMPTS, record.previous);
+      if(previous!=NULL && esp_ota_set_boot_partition(previous)==ESP_OK){
+         esp_restart();
+         return ESP_OK;
+      }
+   }
+   ESP_LOGI(OTA_TAG, "%s on trial, boot %d of %d", running->label, record.attempts,
+      OTA_MAX_BOOT_ATTEMPTS);
+   return save_record(&record);
+}
+
+
+/*
+ * ota_update_mark_valid: Keep the running image
+ */
+void ota_update_mark_valid(void){
+   if(!on_trial){
+      return;
+   }
+   ota_boot_record record;
+   if(load_record(&record)==ESP_OK){
+      record.state = OTA_STATE_VALID;
+      record.attempts = 0;
+      if(save_record(&record)!=ESP_OK){
+         return;
+      }
+   }
+   on_trial = 0;
+   ESP_LOGI(OTA_TAG, "Update kept");
+}
+
+
+/*
+ * ota_update_trial_expired: Check if an image on trial ran OTA_TRIAL_TIME
+ *    seconds since boot without reaching the broker
+ */
+uint8_t ota_update_trial_expired(void){
+   return on_trial && esp_timer_get_time()>(int64_t)OTA_TRIAL_TIME*1000000;
+}
+
+
+/*
+ * read_running: Read the running image. Used by the patch
+ */
+static esp_err_t read_running(void *arg, uint32_t offset, uint8_t *data, size_t length){
+   ota_slots *slots = arg;
+   return esp_partition_read(slots->running, offset, data, length);
+}
+
+
+/*
+ * write_update: Write the next bytes of the new image. The slot is erased
+ *    on the first write, once the old image was checked and the size of the
+ *    new one is known. Used by the patch
+ */
+static esp_err_t write_update(void *arg, const uint8_t *data, size_t length){
+   ota_slots *slots = arg;
+   if(!slots->begun){
+      esp_err_t err = esp_ota_begin(slots->update, delta_patch_new_size(&patch), &slots->handle);
+      if(err!=ESP_OK){
+         return err;
+      }
+      slots->begun = 1;
+   }
+   esp_task_wdt_reset();
+   update_stats.image_bytes += length;
+   mbedtls_sha256_update_ret(&image_hash, data, length);
+   return esp_ota_write(slots->handle, data, length);
+}
+
+
+/*
+ * open_download: Start a get request to the update server
+ *    Returns:
+ *       - ESP_OK, ESP_ERR_INVALID_RESPONSE for a status other than 200, or
+ *          the error of http
+ */
+static esp_err_t open_download(esp_http_client_handle_t http_client, const char *url){
+   esp_err_t err = esp_http_client_set_url(http_client, url);
+   if(err==ESP_OK){
+      err = esp_http_client_open(http_client, 0);
+   }
+   if(err!=ESP_OK){
+      return err;
+   }
+   esp_http_client_fetch_headers(http_client);
+   int status = esp_http_client_get_status_code(http_client);
+   if(status!=200){
+      ESP_LOGW(OTA_TAG, "%s not downloaded, http status %d", url, status);
+      esp_http_client_close(http_client);
+      return ESP_ERR_INVALID_RESPONSE;
+   }
+   return ESP_OK;
+}
+
+
+/*
+ * download_signature: Download the signature of the new image
+ *    Returns:
+ *       - length: int. Length of the signature, or -1 if it couldn't be
+ *          downloaded or is longer than OTA_SIGNATURE_MAX_SIZE
+ */
+static int download_signature(esp_http_client_handle_t http_client, const char *url){
+   char signature_url[OTA_URL_SIZE+sizeof OTA_SIGNATURE_SUFFIX];
+   snprintf(signature_url, sizeof signature_url, "%s" OTA_SIGNATURE_SUFFIX, url);
+   if(open_download(http_client, signature_url)!=ESP_OK){
+      return -1;
+   }
+   int length = 0;
+   while(length<=OTA_SIGNATURE_MAX_SIZE){
+      // One byte more than fits tells a signature too long apart
+      int read = esp_http_client_read(http_client, (char*)download_chunk, sizeof download_chunk);
+      if(read<=0){
+         break;
+      }
+      if(length+read<=OTA_SIGNATURE_MAX_SIZE){
+         memcpy(signature+length, download_chunk, read);
+      }
+      length += read;
+   }
+   if(length<=0 || length>OTA_SIGNATURE_MAX_SIZE){
+      esp_http_client_close(http_client);
+      return -1;
+   }
+   // Whole body read, the patch reuses the connection
+   return length;
+}
+
+
+/*
+ * verify_image: Check the signature of the new image with the signing key
+ *    Returns:
+ *       - ESP_OK or ESP_ERR_OTA_VALIDATE_FAILED
+ */
+static esp_err_t verify_image(const uint8_t *hash, size_t signature_length){
+   mbedtls_pk_context key;
+   mbedtls_pk_init(&key);
+   // Length of an embedded pem includes its terminating null, as mbedtls
+   // expects
+   int ret = mbedtls_pk_parse_public_key(&key, ota_signing_key_pem_start,
+      ota_signing_key_pem_end-ota_signing_key_pem_start);
+   if(ret==0){
+      ret = mbedtls_pk_verify(&key, MBEDTLS_MD_SHA256, hash, 32, signature, signature_length);
+   }
+   mbedtls_pk_free(&key);
+   if(ret!=0){
+      ESP_LOGE(OTA_TAG, "Signature of the new image rejected: -0x%x", -ret);
+      return ESP_ERR_OTA_VALIDATE_FAILED;
+   }
+   return ESP_OK;
+}
+
+
+/*
+ * download_patch: Feed the body of a get request to the patch
+ */
+static esp_err_t download_patch(esp_http_client_handle_t http_client, const char *url){
+   esp_err_t err = open_download(http_client, url);
+   if(err!=ESP_OK){
+      return err;
+   }
+   while(err==ESP_OK){
+      int length = esp_http_client_read(http_client, (char*)download_chunk, sizeof download_chunk);
+      if(length<0){
+         return ESP_FAIL;
+      }
+      if(length==0){
+         break;
+      }
+      esp_task_wdt_reset();
+      update_stats.patch_bytes += length;
+      err = delta_patch_feed(&patch, download_chunk, length);
+   }
+   esp_http_client_close(http_client);
+   return err==ESP_OK ? delta_patch_finish(&patch) : err;
+}
+
+
+/*
+ * ota_update_apply: Download a patch and write the new image to the slot
+ *    that isn't running
+ *    Arguments:
+ *       - url: const char*. Https url of the patch
+ */
+esp_err_t ota_update_apply(const char *url){
+   int64_t start = esp_timer_get_time();
+   memset(&update_stats, 0, sizeof update_stats);
+   if(strncmp(url, "https://", 8)!=0){
+      ESP_LOGE(OTA_TAG, "Update rejected, %s isn't https", url);
+      return update_stats.result = ESP_ERR_INVALID_ARG;
+   }
+   ota_slots slots;
+   memset(&slots, 0, sizeof slots);
+   slots.running = esp_ota_get_running_partition();
+   slots.update = esp_ota_get_next_update_partition(NULL);
+   if(slots.running==NULL || slots.update==NULL || slots.update==slots.running){
+      return update_stats.result = ESP_ERR_NOT_FOUND;
+   }
+   esp_http_client_config_t config = {
+      .url = url,
+      .method = HTTP_METHOD_GET,
+      .timeout_ms = OTA_HTTP_TIMEOUT,
+      .cert_pem = (const char *)ota_server_cert_pem_start,
+   };
+   esp_http_client_handle_t http_client = esp_http_client_init(&config);
+   if(http_client==NULL){
+      return update_stats.result = ESP_ERR_NO_MEM;
+   }
+   // Signature first, nothing is erased for an unsigned update
+   int signature_length = download_signature(http_client, url);
+   if(signature_length<0){
+      esp_http_client_cleanup(http_client);
+      ESP_LOGE(OTA_TAG, "No signature for %s", url);
+      return update_stats.result = ESP_ERR_OTA_VALIDATE_FAILED;
+   }
+   ESP_LOGI(OTA_TAG, "Applying patch to %s from %s", slots.update->label, url);
+   mbedtls_sha256_init(&image_hash);
+   mbedtls_sha256_starts_ret(&image_hash, 0);
+   delta_patch_init(&patch, read_running, write_update, &slots);
+   esp_err_t err = download_patch(http_client, url);
+   esp_http_client_cleanup(http_client);
+   uint8_t hash[32];
+   mbedtls_sha256_finish_ret(&image_hash, hash);
+   mbedtls_sha256_free(&image_hash);
+
+   if(slots.begun){
+      // Checks the image and frees the handle, also after an error
+      esp_err_t end = esp_ota_end(slots.handle);
+      if(err==ESP_OK){
+         err = end;
+      }
+   }
+   else if(err==ESP_OK){
+      // Nothing written, an empty image
+      err = ESP_ERR_INVALID_SIZE;
+   }
+   if(err==ESP_OK){
+      err = verify_image(hash, signature_length);
+   }
+   if(err==ESP_OK){
+      ota_boot_record record;
+      memset(&record, 0, sizeof record);
+      record.state = OTA_STATE_PENDING;
+      memcpy(record.previous, slots.running->label, sizeof record.previous);
+      err = save_record(&record);
+   }
+   if(err==ESP_OK){
+      err = esp_ota_set_boot_partition(slots.update);
+   }
+   update_stats.duration_ms = (esp_timer_get_time()-start)/1000;
+   update_stats.result = err;
+   if(err!=ESP_OK){
+      ESP_LOGE(OTA_TAG, "Update failed after %d bytes of patch: %s", update_stats.patch_bytes,
+         esp_err_to_name(err));
+      return err;
+   }
+   ESP_LOGI(OTA_TAG, "%d bytes of patch wrote %d bytes to %s in %d ms", update_stats.patch_bytes,
+      update_stats.image_bytes, slots.update->label, update_stats.duration_ms);
+   return ESP_OK;
+}
+
+
+/*
+ * get_ota_update_stats: Get the last update applied
+ *    Arguments:
+ *       - stats: ota_update_stats*. Where it is copied to
+ */
+void get_ota_update_stats(ota_update_stats *stats){
+   *stats = update_stats;
+}
@@ -0,0 +1,418 @@
+/*
+ * outbox.c
+ * @description: Implementation of the store-and-forward outbox. Records are
+ *    appended to the sectors of the partition in order. The state word of a
+ *    record is programmed from valid to sent without erasing, so that a sector
+ *    is only erased when the log wraps around to it
+ * @author: @Retrocamara42
+ *
+ */
+#define LOG_LOCAL_LEVEL LOG_LEVEL_OUTBOX
+#include "log_levels.h"
+#include <string.h>
+
+#include "outbox.h"
+#include "rtc_budget.h"
+
+// Marks valid contents of rtc memory
+#define OUTBOX_MAGIC 0x4F425831
+// States of a record. Flash bits can only go from 1 to 0 without an erase
+#define OUTBOX_STATE_ERASED 0xFFFFFFFF
+#define OUTBOX_STATE_VALID 0xFFFF0000
+#define OUTBOX_STATE_SENT 0x00000000
+#define OUTBOX_NO_SEQUENCE 0xFFFFFFFF
+
+static const char *OUTBOX_TAG = "outbox";
+
+/*
+ * outbox_record: Header of a record, followed by the topic and the payload.
+ *    Records are padded to 4 bytes and never cross a sector
+ *    - state: uint32_t. OUTBOX_STATE_. Written last, erased means the
+ *       record was not completed
+ *    - sequence: uint32_t. Order of the record
+ *    - timestamp: uint32_t. Time of the message
+ *    - length: uint16_t. Length of topic and payload
+ *    - topic_length: uint8_t. Length of the topic
+ *    - checksum: uint8_t. Checksum of topic and payload
+ *    - boot: uint16_t. Boot of the timestamp
+ *    - reserved: uint16_t. Left erased
+ */
+typedef struct {
+   uint32_t state;
+   uint32_t sequence;
+   uint32_t timestamp;
+   uint16_t length;
+   uint8_t topic_length;
+   uint8_t checksum;
+   uint16_t boot;
+   uint16_t reserved;
+} outbox_record;
+
+/*
+ * outbox_position: Position of the log, kept in rtc memory
+ *    - magic: uint32_t. OUTBOX_MAGIC if the contents are valid
+ *    - write_offset: uint32_t. Offset of the next record
+ *    - read_offset: uint32_t. Offset of the oldest record not sent
+ *    - next_sequence: uint32_t. Sequence of the next record
+ *    - count: uint32_t. Records not sent
+ */
+typedef struct {
+   uint32_t magic;
+   uint32_t write_offset;
+   uint32_t read_offset;
+   uint32_t next_sequence;
+   uint32_t count;
+} outbox_position;
+
+static RTC_DATA_ATTR outbox_position position;
+_Static_assert(sizeof position<=RTC_BUDGET_OUTBOX, "outbox over its rtc budget");
+static outbox_stats counters;
+static const esp_partition_t *partition=NULL;
+// Single record buffer, word aligned for flash writes
+static uint32_t record_buffer[OUTBOX_MAX_RECORD/4];
+
+
+static uint32_t align_word(uint32_t size){
+   return (size+3)&~3;
+}
+
+
+static uint32_t sector_of(uint32_t offset){
+   return offset-offset%OUTBOX_SECTOR_SIZE;
+}
+
+
+static uint32_t next_sector(uint32_t offset){
+   return (sector_of(offset)+OUTBOX_SECTOR_SIZE)%partition->size;
+}
+
+
+static uint8_t record_checksum(const uint8_t *data, size_t length){
+   uint8_t sum=0;
+   for(size_t i=0; i<length; i++){
+      sum=(sum<<1 | sum>>7)^data[i];
+   }
+   return sum;
+}
+
+
+/*
+ * record_is_erased: Check if a header was never written
+ */
+static uint8_t record_is_erased(const outbox_record *record){
+   const uint8_t *bytes=(const uint8_t*)record;
+   for(size_t i=0; i<sizeof(outbox_record); i++){
+      if(bytes[i]!=0xFF){
+         return 0;
+      }
+   }
+   return 1;
+}
+
+
+/*
+ * record_fits: Check if a written header is sane at its offset
+ */
+static uint8_t record_fits(const outbox_record *record, uint32_t offset){
+   uint32_t size=align_word(sizeof(outbox_record)+record->length);
+   return record->sequence!=OUTBOX_NO_SEQUENCE && size<=OUTBOX_MAX_RECORD
+      && record->topic_length<=record->length && record->topic_length<=OUTBOX_MAX_TOPIC
+      && offset%OUTBOX_SECTOR_SIZE+size<=OUTBOX_SECTOR_SIZE;
+}
+
+
+/*
+ * next_record: Offset of the record that follows one. Skips the end of a
+ *    sector if a header doesn't fit there
+ */
+static uint32_t next_record(uint32_t offset, const outbox_record *record){
+   offset+=align_word(sizeof(outbox_record)+record->length);
+   if(offset%OUTBOX_SECTOR_SIZE==0){
+      return offset%partition->size;
+   }
+   if(offset%OUTBOX_SECTOR_SIZE+sizeof(outbox_record)>OUTBOX_SECTOR_SIZE){
+      return next_sector(offset);
+   }
+   return offset;
+}
+
+
+static esp_err_t read_record(uint32_t offset, outbox_record *record){
+   return esp_partition_read(partition, offset, record, sizeof(outbox_record));
+}
+
+
+static esp_err_t set_record_state(uint32_t offset, uint32_t state){
+   return esp_partition_write(partition, offset, &state, sizeof state);
+}
+
+
+/*
+ * outbox_scan: Find the position of the log after a power on. The newest
+ *    sector is the one whose first record has the highest sequence, the
+ *    records are walked from the oldest sector up to the end of it
+ */
+static void outbox_scan(){
+   uint32_t sectors=partition->size/OUTBOX_SECTOR_SIZE;
+   uint32_t oldest=0, newest=0;
+   uint32_t oldest_sequence=OUTBOX_NO_SEQUENCE, newest_sequence=0;
+   outbox_record record;
+   memset(&position, 0, sizeof position);
+   position.magic=OUTBOX_MAGIC;
+   position.next_sequence=1;
+   for(uint32_t sector=0; sector<sectors; sector++){
+      if(read_record(sector*OUTBOX_SECTOR_SIZE, &record)!=ESP_OK
+            || record.sequence==OUTBOX_NO_SEQUENCE){
+         continue;
+      }
+      if(record.sequence<oldest_sequence){
+         oldest_sequence=record.sequence;
+         oldest=sector*OUTBOX_SECTOR_SIZE;
+      }
+      if(record.sequence>=newest_sequence){
+         newest_sequence=record.sequence;
+         newest=sector*OUTBOX_SECTOR_SIZE;
+      }
+   }
+   if(oldest_sequence==OUTBOX_NO_SEQUENCE){
+      return;
+   }
+
+   uint32_t offset=oldest;
+   uint32_t max_records=partition->size/sizeof(outbox_record);
+   for(uint32_t i=0; i<max_records; i++){
+      esp_task_wdt_reset();
+      uint8_t erased=read_record(offset, &record)!=ESP_OK || record_is_erased(&record);
+      if(erased || !record_fits(&record, offset)){
+         if(sector_of(offset)==newest){
+            // Space after a torn record can't be written without an erase
+            position.write_offset=erased ? offset : next_sector(offset);
+            break;
+         }
+         offset=next_sector(offset);
+         continue;
+      }
+      if(record.state==OUTBOX_STATE_VALID){
+         if(position.count==0){
+            position.read_offset=offset;
+         }
+         position.count++;
+      }
+      position.next_sequence=record.sequence+1;
+      uint32_t next=next_record(offset, &record);
+      if(sector_of(offset)==newest && sector_of(next)!=newest){
+         position.write_offset=next;
+         break;
+      }
+      offset=next;
+   }
+   if(position.count==0){
+      position.read_offset=position.write_offset;
+   }
+}
+
+
+/*
+ * prepare_sector: Erase a sector before writing its first record. If the
+ *    log is full, it holds the oldest records, which are lost
+ */
+static esp_err_t prepare_sector(uint32_t offset){
+   outbox_record record;
+   esp_err_t err=read_record(offset, &record);
+   if(err!=ESP_OK || record_is_erased(&record)){
+      return err;
+   }
+   uint32_t dropped=0;
+   for(uint32_t record_offset=offset; sector_of(record_offset)==offset;){
+      if(read_record(record_offset, &record)!=ESP_OK || !record_fits(&record, record_offset)){
+         break;
+      }
+      dropped+=record.state==OUTBOX_STATE_VALID;
+      record_offset=next_record(record_offset, &record);
+      if(record_offset==offset){
+         break;
+      }
+   }
+   err=esp_partition_erase_range(partition, offset, OUTBOX_SECTOR_SIZE);
+   if(err!=ESP_OK){
+      return err;
+   }
+   counters.erases++;
+   if(dropped>0){
+      ESP_LOGW(OUTBOX_TAG, "Outbox full, %d oldest messages lost", dropped);
+      counters.dropped+=dropped;
+      position.count-=dropped<position.count ? dropped : position.count;
+   }
+   if(sector_of(position.read_offset)==offset){
+      position.read_offset=position.count>0 ? next_sector(offset) : offset;
+   }
+   return ESP_OK;
+}
+
+
+/*
+ * outbox_init: Find the outbox partition
+ *    Arguments:
+ *       - resumed: uint8_t. 1 after a wake from deep sleep
+ */
+esp_err_t outbox_init(uint8_t resumed){
+   partition=esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+      OUTBOX_PARTITION_SUBTYPE, OUTBOX_PARTITION_LABEL);
+   if(partition==NULL){
+      ESP_LOGE(OUTBOX_TAG, "No outbox partition");
+      return ESP_ERR_NOT_FOUND;
+   }
+   if(resumed && position.magic==OUTBOX_MAGIC && position.write_offset<partition->size
+         && position.read_offset<partition->size){
+      return ESP_OK;
+   }
+   outbox_scan();
+   ESP_LOGI(OUTBOX_TAG, "%d messages waiting", position.count);
+   return ESP_OK;
+}
+
+
+/*
+ * outbox_append: Queue a message
+ *    Arguments:
+ *       - topic: const char*. Topic
+ *       - payload: const char*. Payload
+ *       - length: size_t. Length of payload
+ *       - boot: uint16_t. Boot of the timestamp
+ *       - timestamp: uint32_t. Time of the message
+ */
+esp_err_t outbox_append(const char* topic, const char* payload, size_t length,
+         uint16_t boot, uint32_t timestamp){
+   if(partition==NULL){
+      return ESP_ERR_INVALID_STATE;
+   }
+   size_t topic_length=strlen(topic);
+   if(topic_length>OUTBOX_MAX_TOPIC
+         || sizeof(outbox_record)+topic_length+length>OUTBOX_MAX_RECORD){
+      return ESP_ERR_INVALID_SIZE;
+   }
+   outbox_record *record=(outbox_record*)record_buffer;
+   record->state=OUTBOX_STATE_ERASED;
+   record->sequence=position.next_sequence;
+   record->timestamp=timestamp;
+   record->boot=boot;
+   record->reserved=0xFFFF;
+   record->length=topic_length+length;
+   record->topic_length=topic_length;
+   uint8_t *data=(uint8_t*)(record+1);
+   memcpy(data, topic, topic_length);
+   memcpy(data+topic_length, payload, length);
+   record->checksum=record_checksum(data, record->length);
+   uint32_t size=align_word(sizeof(outbox_record)+record->length);
+   memset(data+record->length, 0xFF, size-sizeof(outbox_record)-record->length);
+
+   uint32_t offset=position.write_offset;
+   if(offset%OUTBOX_SECTOR_SIZE+size>OUTBOX_SECTOR_SIZE){
+      offset=next_sector(offset);
+   }
+   esp_err_t err=ESP_OK;
+   if(offset%OUTBOX_SECTOR_SIZE==0){
+      err=prepare_sector(offset);
+   }
+   // State is written last, a power loss before it leaves a torn record
+   if(err==ESP_OK){
+      err=esp_partition_write(partition, offset, record, size);
+   }
+   if(err==ESP_OK){
+      err=set_record_state(offset, OUTBOX_STATE_VALID);
+   }
+   if(err!=ESP_OK){
+      ESP_LOGE(OUTBOX_TAG, "Failed to write message: %s", esp_err_to_name(err));
+      return err;
+   }
+   if(position.count==0){
+      position.read_offset=offset;
+   }
+   position.write_offset=next_record(offset, record);
+   position.next_sequence++;
+   position.count++;
+   counters.appended++;
+   return ESP_OK;
+}
+
+
+/*
+ * outbox_count: Messages waiting in the outbox
+ */
+uint32_t outbox_count(){
+   return position.count;
+}
+
+
+/*
+ * outbox_replay: Publish queued messages, oldest first
+ *    Arguments:
+ *       - send: outbox_send_cb. Function that publishes each message
+ *       - arg: void*. Argument for send
+ *       - max_messages: uint32_t. Messages to publish at most
+ */
+esp_err_t outbox_replay(outbox_send_cb send, void* arg, uint32_t max_messages){
+   if(partition==NULL){
+      return ESP_ERR_INVALID_STATE;
+   }
+   outbox_record *record=(outbox_record*)record_buffer;
+   uint8_t *data=(uint8_t*)(record+1);
+   char topic[OUTBOX_MAX_TOPIC+1];
+   uint32_t sent=0;
+   // Bounds the walk if count doesn't match the log
+   uint32_t max_steps=partition->size/sizeof(outbox_record);
+   for(uint32_t step=0; position.count>0 && sent<max_messages; step++){
+      esp_task_wdt_reset();
+      uint32_t offset=position.read_offset;
+      if(step>=max_steps){
+         ESP_LOGW(OUTBOX_TAG, "Lost track of %d messages", position.count);
+         position.count=0;
+         break;
+      }
+      esp_err_t err=read_record(offset, record);
+      if(err!=ESP_OK){
+         return err;
+      }
+      if(record_is_erased(record) || !record_fits(record, offset)){
+         position.read_offset=next_sector(offset);
+         continue;
+      }
+      if(record->state==OUTBOX_STATE_VALID){
+         err=esp_partition_read(partition, offset+sizeof(outbox_record), data, record->length);
+         if(err!=ESP_OK){
+            return err;
+         }
+         if(record_checksum(data, record->length)!=record->checksum){
+            counters.corrupted++;
+         }
+         else{
+            memcpy(topic, data, record->topic_length);
+            topic[record->topic_length]='\0';
+            err=send(topic, (const char*)data+record->topic_length,
+               record->length-record->topic_length, record->boot, record->timestamp, arg);
+            if(err!=ESP_OK){
+               return err;
+            }
+            sent++;
+            counters.replayed++;
+         }
+         set_record_state(offset, OUTBOX_STATE_SENT);
+         position.count--;
+      }
+      position.read_offset=next_record(offset, record);
+   }
+   if(position.count==0){
+      position.read_offset=position.write_offset;
+   }
+   return ESP_OK;
+}
+
+
+/*
+ * get_outbox_stats: Get counters of the outbox
+ *    Arguments:
+ *       - stats: outbox_stats*. Output
+ */
+void get_outbox_stats(outbox_stats *stats){
+   *stats=counters;
+}
@@ -0,0 +1,166 @@
+/*
+ * payload_encoder.c
+ * @description: Implementation of a json payload encoder for sensor readings
+ * @author: @Retrocamara42
+ *
+ */
+#include <string.h>
+#include <math.h>
+
+#include "payload_encoder.h"
+
+static const int32_t powers_of_ten[] = {
+   1, 10, 100, 1000, 10000, 100000, 1000000, 10000000
+};
+
+
+/*
+ * append: Append a string to the payload
+ *    Returns:
+ *       - ESP_OK or ESP_ERR_INVALID_SIZE if it doesn't fit
+ */
+static esp_err_t append(payload_encoder *encoder, const char* str){
+   size_t len = strlen(str);
+   if(encoder->length+len >= PAYLOAD_MAX_LENGTH){
+      return ESP_ERR_INVALID_SIZE;
+   }
+   memcpy(encoder->buffer+encoder->length, str, len);
+   encoder->length+=len;
+   encoder->buffer[encoder->length]='\0';
+   return ESP_OK;
+}
+
+
+/*
+ * payload_encoder_init: Start a payload. Writes {"dev_name":"<device_name>"
+ *    or only { if device_name is NULL
+ *    Arguments:
+ *       - encoder: payload_encoder*. Encoder to initialize
+ *       - device_name: const char*. Name of the device or NULL
+ */
+esp_err_t payload_encoder_init(payload_encoder *encoder, const char* device_name){
+   encoder->length=0;
+   encoder->field_count=0;
+   encoder->buffer[0]='\0';
+   if(device_name==NULL){
+      return append(encoder, "{");
+   }
+   if(strlen(device_name)>PAYLOAD_MAX_DEVICE_NAME){
+      return ESP_ERR_INVALID_SIZE;
+   }
+   for(const char* c=device_name; *c; c++){
+      if(*c=='"' || *c=='\\' || (unsigned char)*c<0x20){
+         return ESP_ERR_INVALID_ARG;
+      }
+   }
+   esp_err_t err = append(encoder, "{\"dev_name\":\"");
+   if(err==ESP_OK) err = append(encoder, device_name);
+   if(err==ESP_OK) err = append(encoder, "\"");
+   return err;
+}
+
+
+/*
+ * payload_encoder_add_field: Append a value to the payload
+ *    Arguments:
+ *       - encoder: payload_encoder*. Encoder
+ *       - key: const char*. Json key of the value
+ *       - integer_digits: uint8_t. Digits reserved before the decimal point
+ *       - decimal_places: uint8_t. Digits after the decimal point
+ */
+esp_err_t payload_encoder_add_field(payload_encoder *encoder, const char* key,
+         uint8_t integer_digits, uint8_t decimal_places){
+   if(encoder->field_count>=PAYLOAD_MAX_FIELDS || integer_digits==0
+         || decimal_places>PAYLOAD_MAX_DECIMAL_PLACES
+         || integer_digits+decimal_places>=sizeof(powers_of_ten)/sizeof(powers_of_ten[0])){
+      return ESP_ERR_INVALID_ARG;
+   }
+   // Drop closing brace of the previous field
+   uint8_t length=encoder->length;
+   if(encoder->field_count>0){
+      encoder->length--;
+   }
+   // Sign, integer digits, decimal point and decimal digits
+   uint8_t width = 1+integer_digits+(decimal_places>0 ? 1+decimal_places : 0);
+   esp_err_t err = append(encoder, encoder->length>1 ? ",\"" : "\"");
+   if(err==ESP_OK) err = append(encoder, key);
+   if(err==ESP_OK) err = append(encoder, "\":");
+   if(err==ESP_OK && encoder->length+width+1>=PAYLOAD_MAX_LENGTH){
+      err = ESP_ERR_INVALID_SIZE;
+   }
+   if(err!=ESP_OK){
+      encoder->length=length;
+      if(encoder->field_count>0){
+         encoder->buffer[length-1]='}';
+      }
+      encoder->buffer[length]='\0';
+      return err;
+   }
+
+   payload_field *field = &encoder->fields[encoder->field_count];
+   field->offset=encoder->length;
+   field->width=width;
+   field->integer_digits=integer_digits;
+   field->decimal_places=decimal_places;
+   encoder->length+=width;
+   encoder->buffer[encoder->length++]='}';
+   encoder->buffer[encoder->length]='\0';
+   payload_encoder_set_value(encoder, encoder->field_count++, 0);
+   return ESP_OK;
+}
+
+
+/*
+ * payload_encoder_set_value: Write a value in the payload
+ *    Arguments:
+ *       - encoder: payload_encoder*. Encoder
+ *       - field: uint8_t. Index of the value, in order of addition
+ *       - value: float. Value to write
+ */
+void payload_encoder_set_value(payload_encoder *encoder, uint8_t field, float value){
+   if(field>=encoder->field_count){
+      return;
+   }
+   const payload_field *f = &encoder->fields[field];
+   if(isnan(value)){
+      // Can't be converted, and json has no nan
+      value=0;
+   }
+   int32_t limit = powers_of_ten[f->integer_digits+f->decimal_places]-1;
+   float scaled = value*powers_of_ten[f->decimal_places];
+   uint8_t negative = scaled<0;
+   int32_t digits;
+   // Compare as float first, so huge values don't overflow the conversion
+   if(negative){
+      digits = scaled<=-limit ? limit : (int32_t)(0.5f-scaled);
+   }
+   else{
+      digits = scaled>=limit ? limit : (int32_t)(scaled+0.5f);
+   }
+   if(digits>limit){
+      digits=limit;
+   }
+   if(digits==0){
+      negative=0;
+   }
+
+   // Written right to left: decimals, point, integer part, sign, padding
+   char *c = encoder->buffer+f->offset+f->width-1;
+   for(uint8_t i=0; i<f->decimal_places; i++){
+      *c-- = '0'+digits%10;
+      digits/=10;
+   }
+   if(f->decimal_places>0){
+      *c-- = '.';
+   }
+   do{
+      *c-- = '0'+digits%10;
+      digits/=10;
+   }while(digits>0);
+   if(negative){
+      *c-- = '-';
+   }
+   while(c>=encoder->buffer+f->offset){
+      *c-- = ' ';
+   }
+}
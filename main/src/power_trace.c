@@ -0,0 +1,175 @@
+/*
+ * power_trace.c
+ * @description: Implementation of the trace of power state transitions
+ * @author: @Retrocamara42
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "power_trace.h"
+#include "rtc_budget.h"
+#include "esp_attr.h"
+
+// Marks valid contents of rtc memory
+#define POWER_TRACE_MAGIC 0x50575254
+
+static const char* const state_names[POWER_STATE_COUNT] = {
+   "awake", "connect", "active", "tx", "modem_sleep", "deep_sleep",
+};
+
+// Low bits of a transition that hold the state, the rest hold the time
+#define POWER_TRACE_STATE_BITS 3
+#define POWER_TRACE_MAX_OFFSET (UINT32_MAX>>POWER_TRACE_STATE_BITS)
+
+/*
+ * power_trace_state_t: Transitions kept through deep sleep
+ *    - magic: uint32_t. POWER_TRACE_MAGIC if the contents are valid
+ *    - base_ms: uint32_t. Milliseconds since power on that times of the
+ *       transitions are relative to
+ *    - head: uint8_t. Oldest transition
+ *    - count: uint8_t. Transitions kept
+ *    - transitions: uint32_t[]. State entered by each transition, and the
+ *       milliseconds since base_ms it happened at, about 6 days at most
+ */
+typedef struct {
+   uint32_t magic;
+   uint32_t base_ms;
+   uint8_t head;
+   uint8_t count;
+   uint32_t transitions[POWER_TRACE_SIZE];
+} power_trace_state_t;
+
+static RTC_DATA_ATTR power_trace_state_t trace;
+_Static_assert(sizeof trace<=RTC_BUDGET_POWER_TRACE, "power_trace over its rtc budget");
+
+
+static power_state transition_state(uint32_t transition){
+   return transition&((1<<POWER_TRACE_STATE_BITS)-1);
+}
+
+
+static uint32_t transition_time(uint32_t transition){
+   return trace.base_ms+(transition>>POWER_TRACE_STATE_BITS);
+}
+
+
+/*
+ * power_trace_init: Clear the trace, unless waking from deep sleep
+ *    Arguments:
+ *       - resumed: uint8_t. 1 after a wake from deep sleep
+ */
+void power_trace_init(uint8_t resumed){
+   if(!resumed || trace.magic!=POWER_TRACE_MAGIC){
+      memset(&trace, 0, sizeof trace);
+      trace.magic=POWER_TRACE_MAGIC;
+   }
+}
+
+
+/*
+ * power_trace_state: Get the current state
+ */
+power_state power_trace_state(){
+   if(trace.count==0){
+      return POWER_STATE_COUNT;
+   }
+   return transition_state(trace.transitions[(trace.head+trace.count-1)%POWER_TRACE_SIZE]);
+}
+
+
+/*
+ * power_trace_enter: Record a transition
+ *    Arguments:
+ *       - state: power_state. New state
+ *       - now_ms: uint32_t. Milliseconds since power on
+ */
+void power_trace_enter(power_state state, uint32_t now_ms){
+   if(power_trace_state()==state){
+      return;
+   }
+   if(trace.count==0){
+      trace.base_ms=now_ms;
+   }
+   // Times past the longest offset are kept at it
+   uint32_t offset = now_ms-trace.base_ms;
+   if(offset>POWER_TRACE_MAX_OFFSET){
+      offset=POWER_TRACE_MAX_OFFSET;
+   }
+   uint8_t index;
+   if(trace.count<POWER_TRACE_SIZE){
+      index=(trace.head+trace.count)%POWER_TRACE_SIZE;
+      trace.count++;
+   }
+   else{
+      index=trace.head;
+      trace.head=(trace.head+1)%POWER_TRACE_SIZE;
+   }
+   trace.transitions[index]=(offset<<POWER_TRACE_STATE_BITS)|state;
+}
+
+
+/*
+ * power_trace_count: Get the transitions waiting to be exported
+ */
+uint8_t power_trace_count(){
+   return trace.count;
+}
+
+
+/*
+ * power_trace_export: Write the trace, oldest first
+ *    Arguments:
+ *       - out: char*. Where the trace is written to
+ *       - size: size_t. Size of out
+ */
+size_t power_trace_export(char* out, size_t size){
+   size_t length=0;
+   for(uint8_t i=0; i<trace.count; i++){
+      uint8_t index=(trace.head+i)%POWER_TRACE_SIZE;
+      uint32_t transition=trace.transitions[index];
+      int written = snprintf(out+length, size-length, "%u %s\n",
+         transition_time(transition), state_names[transition_state(transition)]);
+      if(written<0 || (size_t)written>=size-length){
+         return 0;
+      }
+      length+=written;
+   }
+   return length;
+}
+
+
+/*
+ * power_trace_clear: Drop the exported transitions, but the current state
+ */
+void power_trace_clear(){
+   if(trace.count>1){
+      trace.head=(trace.head+trace.count-1)%POWER_TRACE_SIZE;
+      trace.count=1;
+      // Times of the next trace start at the current state
+      uint32_t current=trace.transitions[trace.head];
+      trace.base_ms=transition_time(current);
+      trace.transitions[trace.head]=transition_state(current);
+   }
+}
+
+
+/*
+ * power_state_name: Name of a state in the trace
+ */
+const char* power_state_name(power_state state){
+   return state<POWER_STATE_COUNT ? state_names[state] : "unknown";
+}
+
+
+/*
+ * power_state_from_name: State of a name in the trace
+ */
+power_state power_state_from_name(const char* name, size_t length){
+   for(uint8_t i=0; i<POWER_STATE_COUNT; i++){
+      if(strlen(state_names[i])==length && memcmp(state_names[i], name, length)==0){
+         return i;
+      }
+   }
+   return POWER_STATE_COUNT;
+}
@@ -0,0 +1,106 @@
+/*
+ * rtc_state.c
+ * @description: Implementation of the state kept in rtc memory between
+ *    deep sleeps
+ * @author: @Retrocamara42
+ *
+ */
+#define LOG_LOCAL_LEVEL LOG_LEVEL_RTC
+#include "log_levels.h"
+#include <string.h>
+
+#include "rtc_state.h"
+#include "rtc_budget.h"
+
+// Marks valid contents of rtc memory
+#define RTC_STATE_MAGIC 0x52545331
+
+static const char *RTC_TAG = "rtc_state";
+static RTC_DATA_ATTR rtc_state state;
+_Static_assert(sizeof state<=RTC_BUDGET_RTC_STATE, "rtc_state over its rtc budget");
+
+
+/*
+ * next_boot: Increment the boot counter kept in flash
+ *    Returns:
+ *       - boot: uint16_t. Counter of this power on, 0 if flash can't be read
+ */
+static uint16_t next_boot(){
+   nvs_handle handle;
+   uint16_t boot=0;
+   if(nvs_open(RTC_STATE_NAMESPACE, NVS_READWRITE, &handle)!=ESP_OK){
+      return 0;
+   }
+   size_t length = sizeof boot;
+   if(nvs_get_blob(handle, "boot", &boot, &length)!=ESP_OK || length!=sizeof boot){
+      boot=0;
+   }
+   boot++;
+   if(nvs_set_blob(handle, "boot", &boot, sizeof boot)!=ESP_OK || nvs_commit(handle)!=ESP_OK){
+      ESP_LOGW(RTC_TAG, "Boot counter not saved");
+   }
+   nvs_close(handle);
+   return boot;
+}
+
+
+/*
+ * rtc_state_restore: Check the state kept in rtc memory
+ *    Returns:
+ *       - resumed: uint8_t. 1 if the device woke from deep sleep with a
+ *          valid state
+ */
+uint8_t rtc_state_restore(){
+   if(state.magic==RTC_STATE_MAGIC && esp_reset_reason()==ESP_RST_DEEPSLEEP){
+      ESP_LOGI(RTC_TAG, "Resumed from deep sleep, wake %d", state.wake_count);
+      return 1;
+   }
+   memset(&state, 0, sizeof state);
+   state.magic=RTC_STATE_MAGIC;
+   state.last_temperature=-99;
+   state.last_humidity=-99;
+   state.radio_on=1;
+   state.boot=next_boot();
+   ESP_LOGI(RTC_TAG, "Boot %d", state.boot);
+   return 0;
+}
+
+
+/*
+ * rtc_state_get: Get the state kept in rtc memory
+ */
+rtc_state* rtc_state_get(){
+   return &state;
+}
+
+
+/*
+ * rtc_state_clock: Seconds since power on, deep sleeps included
+ */
+uint32_t rtc_state_clock(){
+   return state.clock+(uint32_t)(esp_timer_get_time()/1000000);
+}
+
+
+/*
+ * rtc_state_clock_ms: Milliseconds since power on, deep sleeps included
+ */
+uint32_t rtc_state_clock_ms(){
+   return state.clock*1000+(uint32_t)(esp_timer_get_time()/1000);
+}
+
+
+/*
+ * rtc_state_deep_sleep: Enter deep sleep
+ *    Arguments:
+ *       - seconds: uint32_t. Time to sleep
+ *       - radio_on: uint8_t. 1 to have the radio on after waking
+ */
+void rtc_state_deep_sleep(uint32_t seconds, uint8_t radio_on){
+   state.clock=rtc_state_clock()+seconds;
+   state.wake_count++;
+   state.radio_on=radio_on;
+   ESP_LOGI(RTC_TAG, "Deep sleep for %d s, radio %s on wake", seconds, radio_on ? "on" : "off");
+   esp_deep_sleep_set_rf_option(radio_on ? RTC_RF_ON : RTC_RF_OFF);
+   esp_deep_sleep((uint64_t)seconds*1000000);
+}
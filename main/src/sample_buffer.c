@@ -0,0 +1,438 @@
+/*
+ * sample_buffer.c
+ * @description: Implementation of a buffer of sensor samples kept in rtc
+ *    memory with spill to flash, compressed with series_codec
+ * @author: @Retrocamara42
+ *
+ */
+#define LOG_LOCAL_LEVEL LOG_LEVEL_SAMPLES
+#include "log_levels.h"
+#include <string.h>
+#include <math.h>
+
+#include "sample_buffer.h"
+#include "rtc_budget.h"
+
+// Marks valid contents of rtc memory
+#define SAMPLE_BUFFER_MAGIC 0x53424632
+
+static const char *SAMPLE_TAG = "samples";
+
+/*
+ * sample_ring: Samples in rtc memory
+ *    - magic: uint32_t. SAMPLE_BUFFER_MAGIC if the contents are valid
+ *    - spilled: uint16_t. Samples in spilled blocks
+ *    - boot: uint16_t. Boot of the samples in block
+ *    - first_spill: uint8_t. Nvs slot of the oldest spilled block
+ *    - spills: uint8_t. Spilled blocks
+ *    - encoder: series_encoder. State of block
+ *    - block: uint8_t[]. Compressed samples, oldest first
+ */
+typedef struct {
+   uint32_t magic;
+   uint16_t spilled;
+   uint16_t boot;
+   uint8_t first_spill;
+   uint8_t spills;
+   series_encoder encoder;
+   uint8_t block[SAMPLE_BUFFER_BLOCK_SIZE];
+} sample_ring;
+
+static RTC_DATA_ATTR sample_ring ring;
+_Static_assert(sizeof ring<=RTC_BUDGET_SAMPLE_BUFFER, "sample_buffer over its rtc budget");
+// Spilled blocks start with the boot of their samples
+#define SPILL_HEADER_SIZE 2
+// Holds a spilled block with its header. Also holds a block compressed
+// again by drop_oldest, which can take a few more bytes than the block it
+// comes from
+static uint8_t spill_block[SPILL_HEADER_SIZE+SAMPLE_BUFFER_BLOCK_SIZE+SERIES_MAX_SAMPLE_SIZE];
+// A batch is sent as json or as decoded samples, never both at once
+static union {
+   char payload[SAMPLE_BATCH_MAX_LENGTH];
+   sensor_sample samples[SAMPLE_BUFFER_CAPACITY];
+} batch;
+
+/*
+ * batch_sender: Function a flush sends batches with, one of send_json and
+ *    send_samples is set
+ *    - send_json: sample_buffer_send_cb. Sends json batches
+ *    - send_samples: sample_buffer_samples_cb. Sends decoded samples
+ *    - arg: void*. Argument for the function
+ */
+typedef struct {
+   sample_buffer_send_cb send_json;
+   sample_buffer_samples_cb send_samples;
+   void *arg;
+} batch_sender;
+
+
+/*
+ * spill_key: Nvs key of a spill slot
+ */
+static void spill_key(uint8_t slot, char key[8]){
+   memcpy(key, "blk", 3);
+   key[3]='0'+slot;
+   key[4]='\0';
+}
+
+
+/*
+ * save_spill_state: Keep first_spill, spills and spilled in flash, so
+ *    spilled blocks are found after a power loss. Blocks listed under the
+ *    "state" key by older firmware have no boot and aren't read
+ */
+static esp_err_t save_spill_state(nvs_handle handle){
+   uint8_t state[4] = { ring.first_spill, ring.spills, ring.spilled&0xff, ring.spilled>>8 };
+   esp_err_t err = nvs_set_blob(handle, "spill_state", state, sizeof state);
+   if(err==ESP_OK){
+      err = nvs_commit(handle);
+   }
+   return err;
+}
+
+
+/*
+ * clear_block: Start an empty block in rtc memory
+ */
+static void clear_block(void){
+   series_encoder_init(&ring.encoder, ring.block, sizeof ring.block, SAMPLE_VALUES);
+}
+
+
+/*
+ * sample_to_tenths: Convert a value to the fixed point of sensor_sample,
+ *    clamped to int16. Nan is 0
+ *    Arguments:
+ *       - value: float. Value to convert
+ */
+int16_t sample_to_tenths(float value){
+   float tenths = value*10;
+   if(isnan(tenths)) return 0;
+   if(tenths>=INT16_MAX) return INT16_MAX;
+   if(tenths<=INT16_MIN) return INT16_MIN;
+   return (int16_t)(tenths<0 ? tenths-0.5f : tenths+0.5f);
+}
+
+
+/*
+ * spill: Move the block in rtc memory to flash, after its boot
+ *    Returns:
+ *       - ESP_OK or the nvs error
+ */
+static esp_err_t spill(void){
+   nvs_handle handle;
+   esp_err_t err = nvs_open(SAMPLE_BUFFER_NAMESPACE, NVS_READWRITE, &handle);
+   if(err!=ESP_OK){
+      return err;
+   }
+   char key[8];
+   spill_key((ring.first_spill+ring.spills)%SAMPLE_BUFFER_MAX_SPILLS, key);
+   size_t length = series_length(&ring.encoder);
+   spill_block[0] = ring.boot&0xff;
+   spill_block[1] = ring.boot>>8;
+   memcpy(spill_block+SPILL_HEADER_SIZE, ring.block, length);
+   err = nvs_set_blob(handle, key, spill_block, SPILL_HEADER_SIZE+length);
+   if(err==ESP_OK){
+      ring.spills++;
+      ring.spilled+=ring.encoder.count;
+      err = save_spill_state(handle);
+      clear_block();
+   }
+   nvs_close(handle);
+   return err;
+}
+
+
+/*
+ * sample_buffer_init: Check samples kept in rtc memory
+ *    Arguments:
+ *       - boot: uint16_t. Boot of the samples pushed from now on
+ */
+void sample_buffer_init(uint16_t boot){
+   if(ring.magic==SAMPLE_BUFFER_MAGIC && ring.encoder.value_count==SAMPLE_VALUES
+         && ring.encoder.count<=SAMPLE_BUFFER_CAPACITY
+         && series_length(&ring.encoder)<=sizeof ring.block
+         && ring.spills<=SAMPLE_BUFFER_MAX_SPILLS){
+      if(ring.boot!=boot && ring.encoder.count>0
+            && (ring.spills>=SAMPLE_BUFFER_MAX_SPILLS || spill()!=ESP_OK)){
+         ESP_LOGW(SAMPLE_TAG, "Lost %d samples of boot %d", ring.encoder.count, ring.boot);
+         clear_block();
+      }
+      ring.boot=boot;
+      return;
+   }
+   memset(&ring, 0, sizeof ring);
+   ring.magic=SAMPLE_BUFFER_MAGIC;
+   ring.boot=boot;
+   clear_block();
+
+   nvs_handle handle;
+   if(nvs_open(SAMPLE_BUFFER_NAMESPACE, NVS_READONLY, &handle)!=ESP_OK){
+      return;
+   }
+   uint8_t state[4];
+   size_t length = sizeof state;
+   if(nvs_get_blob(handle, "spill_state", state, &length)==ESP_OK && length==sizeof state
+         && state[0]<SAMPLE_BUFFER_MAX_SPILLS && state[1]<=SAMPLE_BUFFER_MAX_SPILLS){
+      ring.first_spill=state[0];
+      ring.spills=state[1];
+      ring.spilled=state[2]|(state[3]<<8);
+      ESP_LOGI(SAMPLE_TAG, "%d spilled blocks found in flash", ring.spills);
+   }
+   nvs_close(handle);
+}
+
+
+/*
+ * drop_oldest: Take the oldest sample out of the block in rtc memory. The
+ *    rest of the block is compressed again in spill_block. The sample after
+ *    the dropped one loses its delta, so more samples are dropped until the
+ *    block fits rtc memory again
+ */
+static void drop_oldest(void){
+   series_decoder decoder;
+   series_encoder encoder;
+   sensor_sample sample;
+   uint16_t dropped=1;
+   do{
+      series_decoder_init(&decoder, ring.block, series_length(&ring.encoder));
+      series_encoder_init(&encoder, spill_block, sizeof spill_block, SAMPLE_VALUES);
+      for(uint16_t i=0; i<dropped; i++){
+         series_next(&decoder, &sample.timestamp, sample.values);
+      }
+      while(series_next(&decoder, &sample.timestamp, sample.values)==ESP_OK){
+         series_append(&encoder, spill_block, sizeof spill_block, sample.timestamp, sample.values);
+      }
+      dropped++;
+   }while(series_length(&encoder)>sizeof ring.block);
+   ring.encoder=encoder;
+   memcpy(ring.block, spill_block, series_length(&encoder));
+}
+
+
+/*
+ * sample_buffer_push: Add a sample
+ *    Arguments:
+ *       - sample: sensor_sample*. Sample to add
+ */
+void sample_buffer_push(const sensor_sample *sample){
+   esp_err_t err = ring.encoder.count<SAMPLE_BUFFER_CAPACITY
+      ? series_append(&ring.encoder, ring.block, sizeof ring.block, sample->timestamp, sample->values)
+      : ESP_ERR_NO_MEM;
+   if(err==ESP_OK){
+      return;
+   }
+   err = ring.spills<SAMPLE_BUFFER_MAX_SPILLS ? spill() : ESP_ERR_NO_MEM;
+   if(err!=ESP_OK){
+      ESP_LOGW(SAMPLE_TAG, "Sample buffer full, dropping oldest sample: %s", esp_err_to_name(err));
+      drop_oldest();
+   }
+   // Drop more samples if the new one still doesn't fit
+   while(series_append(&ring.encoder, ring.block, sizeof ring.block, sample->timestamp,
+         sample->values)!=ESP_OK && ring.encoder.count>0){
+      drop_oldest();
+   }
+}
+
+
+/*
+ * sample_buffer_count: Samples in the buffer, including spilled ones
+ */
+uint16_t sample_buffer_count(void){
+   return ring.encoder.count+ring.spilled;
+}
+
+
+/*
+ * write_number: Write an integer. Tenths are written with a decimal point
+ *    Returns:
+ *       - end: char*. Position after the last character written
+ */
+static char* write_number(char *out, int32_t value, uint8_t tenths){
+   char digits[12];
+   uint8_t n=0;
+   uint32_t magnitude = value<0 ? -(uint32_t)value : (uint32_t)value;
+   if(value<0){
+      *out++='-';
+   }
+   do{
+      digits[n++]='0'+magnitude%10;
+      magnitude/=10;
+   }while(magnitude>0 || (tenths && n<2));
+   while(n>0){
+      *out++=digits[--n];
+      if(tenths && n==1){
+         *out++='.';
+      }
+   }
+   return out;
+}
+
+
+/*
+ * encode_batch: Encode a block as a json batch in batch.payload. Samples
+ *    after a truncated part of the block are lost
+ *    Arguments:
+ *       - block: uint8_t*. Compressed samples
+ *       - length: size_t. Length of block
+ *       - boot: uint16_t. Boot of the samples
+ *    Returns:
+ *       - length: size_t. Length of the batch
+ *       - count: uint16_t*. Samples in the batch
+ */
+static size_t encode_batch(const uint8_t *block, size_t length, uint16_t boot, uint16_t *count){
+   char *out=batch.payload;
+   series_decoder decoder;
+   sensor_sample sample;
+   *count=0;
+   memcpy(out, "{\"boot\":", 8);
+   out=write_number(out+8, boot, 0);
+   memcpy(out, ",\"samples\":[", 12);
+   out+=12;
+   if(series_decoder_init(&decoder, block, length)==ESP_OK && decoder.value_count==SAMPLE_VALUES){
+      while(*count<SAMPLE_BUFFER_CAPACITY
+            && series_next(&decoder, &sample.timestamp, sample.values)==ESP_OK){
+         if(*count>0){
+            *out++=',';
+         }
+         *out++='[';
+         out=write_number(out, sample.timestamp, 0);
+         for(uint8_t v=0; v<SAMPLE_VALUES; v++){
+            *out++=',';
+            out=write_number(out, sample.values[v], 1);
+         }
+         *out++=']';
+         (*count)++;
+      }
+   }
+   memcpy(out, "]}", 3);
+   out+=2;
+   return out-batch.payload;
+}
+
+
+/*
+ * decode_block: Decode a block in batch.samples. Samples after a truncated
+ *    part of the block are lost
+ *    Arguments:
+ *       - block: uint8_t*. Compressed samples
+ *       - length: size_t. Length of block
+ *    Returns:
+ *       - count: uint16_t. Samples decoded
+ */
+static uint16_t decode_block(const uint8_t *block, size_t length){
+   series_decoder decoder;
+   uint16_t count=0;
+   if(series_decoder_init(&decoder, block, length)==ESP_OK && decoder.value_count==SAMPLE_VALUES){
+      while(count<SAMPLE_BUFFER_CAPACITY && series_next(&decoder, &batch.samples[count].timestamp,
+            batch.samples[count].values)==ESP_OK){
+         count++;
+      }
+   }
+   return count;
+}
+
+
+/*
+ * send_block: Send the samples of a block as a batch, nothing is sent for
+ *    a block without samples
+ *    Returns:
+ *       - err: esp_err_t. Result of the send function
+ *       - count: uint16_t*. Samples in the batch
+ */
+static esp_err_t send_block(const batch_sender *sender, const uint8_t *block, size_t length,
+      uint16_t boot, uint16_t *count){
+   if(sender->send_json!=NULL){
+      size_t payload_length = encode_batch(block, length, boot, count);
+      return *count>0 ? sender->send_json(batch.payload, payload_length, sender->arg) : ESP_OK;
+   }
+   *count = decode_block(block, length);
+   return *count>0 ? sender->send_samples(batch.samples, *count, boot, sender->arg) : ESP_OK;
+}
+
+
+/*
+ * flush_spills: Send spilled blocks, oldest first
+ */
+static esp_err_t flush_spills(const batch_sender *sender){
+   nvs_handle handle;
+   esp_err_t err = nvs_open(SAMPLE_BUFFER_NAMESPACE, NVS_READWRITE, &handle);
+   if(err!=ESP_OK){
+      return err;
+   }
+   while(ring.spills>0){
+      char key[8];
+      spill_key(ring.first_spill, key);
+      size_t length=sizeof spill_block;
+      uint16_t count=0;
+      err = nvs_get_blob(handle, key, spill_block, &length);
+      if(err==ESP_OK && length<SPILL_HEADER_SIZE){
+         err = ESP_ERR_INVALID_SIZE;
+      }
+      if(err==ESP_OK){
+         err = send_block(sender, spill_block+SPILL_HEADER_SIZE, length-SPILL_HEADER_SIZE,
+            spill_block[0]|(spill_block[1]<<8), &count);
+         if(err!=ESP_OK){
+            break;
+         }
+      }
+      else{
+         ESP_LOGW(SAMPLE_TAG, "Lost spilled block %s: %s", key, esp_err_to_name(err));
+      }
+      nvs_erase_key(handle, key);
+      ring.first_spill=(ring.first_spill+1)%SAMPLE_BUFFER_MAX_SPILLS;
+      ring.spills--;
+      ring.spilled=ring.spills>0 && ring.spilled>count ? ring.spilled-count : 0;
+      err = save_spill_state(handle);
+   }
+   nvs_close(handle);
+   return err;
+}
+
+
+/*
+ * flush: Send spilled blocks, then the block in rtc memory
+ */
+static esp_err_t flush(const batch_sender *sender){
+   esp_err_t err = ESP_OK;
+   if(ring.spills>0){
+      err = flush_spills(sender);
+      if(err!=ESP_OK){
+         return err;
+      }
+   }
+   if(ring.encoder.count==0){
+      return ESP_OK;
+   }
+   uint16_t count;
+   err = send_block(sender, ring.block, series_length(&ring.encoder), ring.boot, &count);
+   if(err==ESP_OK){
+      clear_block();
+   }
+   return err;
+}
+
+
+/*
+ * sample_buffer_flush: Send buffered samples as json batches
+ *    Arguments:
+ *       - send: sample_buffer_send_cb. Function that sends each batch
+ *       - arg: void*. Argument for send
+ */
+esp_err_t sample_buffer_flush(sample_buffer_send_cb send, void *arg){
+   batch_sender sender = { .send_json = send, .arg = arg };
+   return flush(&sender);
+}
+
+
+/*
+ * sample_buffer_flush_samples: Send buffered samples in batches, with send
+ *    given the samples
+ *    Arguments:
+ *       - send: sample_buffer_samples_cb. Function that sends each batch
+ *       - arg: void*. Argument for send
+ */
+esp_err_t sample_buffer_flush_samples(sample_buffer_samples_cb send, void *arg){
+   batch_sender sender = { .send_samples = send, .arg = arg };
+   return flush(&sender);
+}
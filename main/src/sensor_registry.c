@@ -0,0 +1,350 @@
+/*
+ * sensor_registry.c
+ * @description: Implementation of the sensor registry and scheduler
+ * @author: @Retrocamara42
+ *
+ */
+#define LOG_LOCAL_LEVEL LOG_LEVEL_SENSOR
+#include "log_levels.h"
+#include "sensor_registry.h"
+#include "rtc_budget.h"
+#include "esp_attr.h"
+#include <string.h>
+#include <math.h>
+
+static const char *SENSOR_TAG = "sensors";
+static sensor_instance sensors[SENSOR_REGISTRY_MAX];
+static uint8_t sensor_count=0;
+
+/*
+ * sensor_rtc_state: State of a sensor that survives deep sleep
+ *    - next_read: uint32_t. Time of next read, 0 if due
+ *    - values: float[]. Last values read
+ *    - reported: float[]. Values of the last report
+ */
+typedef struct {
+   uint32_t next_read;
+   float values[SENSOR_MAX_VALUES];
+   float reported[SENSOR_MAX_VALUES];
+} sensor_rtc_state;
+
+static RTC_DATA_ATTR sensor_rtc_state sensor_states[SENSOR_REGISTRY_MAX];
+// Calls to sensor_registry_report_due since the last report. Starts full,
+// so that the first reading is always reported
+static RTC_DATA_ATTR uint16_t cycles_since_report=UINT16_MAX;
+static RTC_DATA_ATTR sensor_report_stats report_stats;
+_Static_assert(sizeof sensor_states+sizeof cycles_since_report+sizeof report_stats<=RTC_BUDGET_SENSOR_REGISTRY, "sensor registry over its rtc budget");
+
+
+/*
+ * to_tenths: Convert a value to tenths, rounded and clamped to int16. Nan
+ *    is 0
+ */
+static int16_t to_tenths(float value){
+   float tenths = value*10;
+   if(isnan(tenths)) return 0;
+   if(tenths>=INT16_MAX) return INT16_MAX;
+   if(tenths<=INT16_MIN) return INT16_MIN;
+   return (int16_t)(tenths<0 ? tenths-0.5f : tenths+0.5f);
+}
+
+
+/*
+ * sensor_registry_add: Add a sensor to the registry
+ *    Arguments:
+ *       - driver: sensor_driver*. Driver of the sensor
+ *       - sensor: void*. State of the sensor, must outlive the registry
+ *       - period: uint32_t. Seconds between reads
+ */
+esp_err_t sensor_registry_add(const sensor_driver *driver, void *sensor, uint32_t period){
+   if(sensor_count>=SENSOR_REGISTRY_MAX || driver->value_count>SENSOR_MAX_VALUES){
+      return ESP_ERR_NO_MEM;
+   }
+   sensor_instance *instance = &sensors[sensor_count++];
+   instance->driver = driver;
+   instance->sensor = sensor;
+   instance->period = period<driver->min_read_interval ? driver->min_read_interval : period;
+   instance->fresh = 0;
+   for(uint8_t v=0; v<SENSOR_MAX_VALUES; v++){
+      instance->deadband[v] = 0;
+   }
+   return ESP_OK;
+}
+
+
+/*
+ * sensor_registry_set_deadband: Set the change of each value of a sensor
+ *    needed for a report
+ *    Arguments:
+ *       - index: uint8_t. Index of the sensor, in order of addition
+ *       - deadband: float*. One threshold per value of the sensor
+ */
+void sensor_registry_set_deadband(uint8_t index, const float *deadband){
+   if(index>=sensor_count){
+      return;
+   }
+   for(uint8_t v=0; v<sensors[index].driver->value_count; v++){
+      sensors[index].deadband[v] = deadband[v];
+   }
+}
+
+
+/*
+ * sensor_registry_set_period: Change the time between reads of a sensor
+ *    Arguments:
+ *       - index: uint8_t. Index of the sensor, in order of addition
+ *       - period: uint32_t. Seconds between reads
+ *       - now: uint32_t. Current time in seconds
+ */
+esp_err_t sensor_registry_set_period(uint8_t index, uint32_t period, uint32_t now){
+   if(index>=sensor_count || period==0){
+      return ESP_ERR_INVALID_ARG;
+   }
+   sensor_instance *instance = &sensors[index];
+   instance->period = period<instance->driver->min_read_interval ?
+      instance->driver->min_read_interval : period;
+   // Only pulls the next read in, the scheduler isn't restarted
+   sensor_rtc_state *state = &sensor_states[index];
+   if(state->next_read>now+instance->period){
+      state->next_read = now+instance->period;
+   }
+   return ESP_OK;
+}
+
+
+/*
+ * sensor_registry_init: Configure every sensor and add their values to
+ *    the report
+ *    Arguments:
+ *       - device_name: char*. Name of the device
+ *       - report: payload_encoder*. Combined report, already initialized
+ *       - resumed: uint8_t. 1 after a wake from deep sleep
+ */
+void sensor_registry_init(char* device_name, payload_encoder *report, uint8_t resumed){
+   for(uint8_t i=0; i<sensor_count; i++){
+      sensor_instance *instance = &sensors[i];
+      esp_task_wdt_reset();
+      if(instance->driver->init(instance->sensor, device_name)!=ESP_OK){
+         ESP_LOGE(SENSOR_TAG, "Failed to init sensor %d (%s)", i, instance->driver->name);
+      }
+      instance->first_field = report->field_count;
+      if(instance->driver->encode(instance->sensor, report)!=ESP_OK){
+         ESP_LOGE(SENSOR_TAG, "Report too small for sensor %d (%s)", i, instance->driver->name);
+      }
+      sensor_rtc_state *state = &sensor_states[i];
+      if(resumed){
+         for(uint8_t v=0; v<instance->driver->value_count; v++){
+            payload_encoder_set_value(report, instance->first_field+v, state->values[v]);
+         }
+         continue;
+      }
+      state->next_read = 0;
+      for(uint8_t v=0; v<SENSOR_MAX_VALUES; v++){
+         state->values[v] = -99;
+         state->reported[v] = -99;
+      }
+   }
+   if(!resumed){
+      cycles_since_report = UINT16_MAX;
+      memset(&report_stats, 0, sizeof report_stats);
+   }
+}
+
+
+/*
+ * sensor_registry_count: Number of sensors in the registry
+ */
+uint8_t sensor_registry_count(){
+   return sensor_count;
+}
+
+
+/*
+ * sensor_registry_get: Get a sensor of the registry
+ *    Arguments:
+ *       - index: uint8_t. Index, in order of addition
+ */
+sensor_instance* sensor_registry_get(uint8_t index){
+   return index<sensor_count ? &sensors[index] : NULL;
+}
+
+
+/*
+ * sensor_scheduler_run: Read every sensor that is due and write its values
+ *    in the report
+ *    Arguments:
+ *       - now: uint32_t. Current time in seconds
+ *       - report: payload_encoder*. Combined report
+ */
+uint8_t sensor_scheduler_run(uint32_t now, payload_encoder *report){
+   uint8_t read=0;
+   for(uint8_t i=0; i<sensor_count; i++){
+      sensor_instance *instance = &sensors[i];
+      sensor_rtc_state *state = &sensor_states[i];
+      instance->fresh = 0;
+      if(state->next_read>now+SENSOR_COALESCE_WINDOW){
+         continue;
+      }
+      esp_task_wdt_reset();
+      // A failed read keeps the last values and isn't reported
+      float values[SENSOR_MAX_VALUES];
+      if(instance->driver->read(instance->sensor, values)==ESP_OK){
+         for(uint8_t v=0; v<instance->driver->value_count; v++){
+            state->values[v] = values[v];
+            payload_encoder_set_value(report, instance->first_field+v, values[v]);
+         }
+         instance->fresh = 1;
+         read++;
+      }
+      else{
+         ESP_LOGW(SENSOR_TAG, "Failed to read sensor %d (%s)", i, instance->driver->name);
+      }
+      // Keep the period even when a wake comes late
+      state->next_read = state->next_read==0 ? now : state->next_read;
+      while(state->next_read<=now+SENSOR_COALESCE_WINDOW){
+         state->next_read += instance->period;
+      }
+   }
+   return read;
+}
+
+
+/*
+ * sensor_scheduler_due: Count the sensors the next run reads
+ *    Arguments:
+ *       - now: uint32_t. Current time in seconds
+ */
+uint8_t sensor_scheduler_due(uint32_t now){
+   uint8_t due=0;
+   for(uint8_t i=0; i<sensor_count; i++){
+      due += sensor_states[i].next_read<=now+SENSOR_COALESCE_WINDOW;
+   }
+   return due;
+}
+
+
+/*
+ * sensor_scheduler_expire: Make every sensor due
+ */
+void sensor_scheduler_expire(){
+   for(uint8_t i=0; i<sensor_count; i++){
+      sensor_states[i].next_read = 0;
+   }
+}
+
+
+/*
+ * sensor_scheduler_next_read: Time until the next sensor is due
+ *    Arguments:
+ *       - now: uint32_t. Current time in seconds
+ */
+uint32_t sensor_scheduler_next_read(uint32_t now){
+   uint32_t next = UINT32_MAX;
+   for(uint8_t i=0; i<sensor_count; i++){
+      if(sensor_states[i].next_read<next){
+         next = sensor_states[i].next_read;
+      }
+   }
+   if(next==UINT32_MAX || next<=now){
+      return 1;
+   }
+   return next-now;
+}
+
+
+/*
+ * sensor_registry_report_due: Decide if the values read in the last
+ *    scheduler run have to be reported
+ *    Arguments:
+ *       - heartbeat_cycles: uint16_t. Maximum calls without a report
+ */
+uint8_t sensor_registry_report_due(uint16_t heartbeat_cycles){
+   if(cycles_since_report<UINT16_MAX){
+      cycles_since_report++;
+   }
+   for(uint8_t i=0; i<sensor_count; i++){
+      if(!sensors[i].fresh){
+         continue;
+      }
+      for(uint8_t v=0; v<sensors[i].driver->value_count; v++){
+         float delta = fabsf(sensor_states[i].values[v]-sensor_states[i].reported[v]);
+         if(delta>0 && delta>=sensors[i].deadband[v]){
+            return 1;
+         }
+      }
+   }
+   if(cycles_since_report>=heartbeat_cycles){
+      report_stats.heartbeats++;
+      return 1;
+   }
+   report_stats.suppressed++;
+   return 0;
+}
+
+
+/*
+ * sensor_registry_heartbeat_next: Check if the next call to
+ *    sensor_registry_report_due will report regardless of the values
+ *    Arguments:
+ *       - heartbeat_cycles: uint16_t. Maximum calls without a report
+ */
+uint8_t sensor_registry_heartbeat_next(uint16_t heartbeat_cycles){
+   return cycles_since_report==UINT16_MAX || cycles_since_report+1>=heartbeat_cycles;
+}
+
+
+/*
+ * sensor_registry_report_sent: Keep current values as the last reported
+ */
+void sensor_registry_report_sent(){
+   for(uint8_t i=0; i<sensor_count; i++){
+      memcpy(sensor_states[i].reported, sensor_states[i].values, sizeof sensor_states[i].values);
+   }
+   cycles_since_report = 0;
+   report_stats.sent++;
+}
+
+
+/*
+ * get_sensor_report_stats: Get counters of sent and suppressed reports
+ *    Arguments:
+ *       - stats: sensor_report_stats*. Output
+ */
+void get_sensor_report_stats(sensor_report_stats *stats){
+   *stats = report_stats;
+}
+
+
+/*
+ * sensor_registry_values: Last values of every sensor in tenths
+ *    Arguments:
+ *       - tenths: int16_t*. Output
+ *       - max: uint8_t. Size of tenths
+ */
+uint8_t sensor_registry_values(int16_t *tenths, uint8_t max){
+   uint8_t count=0;
+   for(uint8_t i=0; i<sensor_count; i++){
+      for(uint8_t v=0; v<sensors[i].driver->value_count && count<max; v++){
+         tenths[count++] = to_tenths(sensor_states[i].values[v]);
+      }
+   }
+   return count;
+}
+
+
+/*
+ * sensor_registry_encode_frame: Encode last values of every sensor as a
+ *    binary telemetry frame
+ *    Arguments:
+ *       - out: uint8_t*. Output buffer
+ *       - out_size: size_t. Size of out
+ */
+size_t sensor_registry_encode_frame(uint8_t *out, size_t out_size){
+   telemetry_frame frame;
+   frame.flags = 0;
+   frame.device_id[0] = '\0';
+   frame.sensor_type = sensor_count==1 ? sensors[0].driver->telemetry_type(sensors[0].sensor) : TELEMETRY_SENSOR_UNKNOWN;
+   frame.decimal_places = 1;
+   frame.value_count = sensor_registry_values(frame.values, TELEMETRY_MAX_VALUES);
+   return telemetry_frame_encode(&frame, out, out_size);
+}
@@ -0,0 +1,358 @@
+/*
+ * series_codec.c
+ * @description: Implementation of the streaming compressor for sensor time
+ *    series
+ * @author: @Retrocamara42
+ *
+ */
+#include <string.h>
+
+#include "series_codec.h"
+
+/*
+ * series_width: Prefix and width of a packed code
+ *    - prefix: uint8_t. Prefix bits
+ *    - prefix_bits: uint8_t. Length of prefix
+ *    - bits: uint8_t. Width of the code
+ */
+typedef struct {
+   uint8_t prefix;
+   uint8_t prefix_bits;
+   uint8_t bits;
+} series_width;
+
+// Widths after the one bit prefix of a code of 0, widest last. The widest
+// timestamp width is taken by absolute timestamps
+static const series_width timestamp_widths[] = {
+   { 0x2, 2, 7 }, { 0x6, 3, 12 }, { 0xE, 4, 20 }, { 0xF, 4, 32 },
+};
+static const series_width value_widths[] = {
+   { 0x2, 2, 2 }, { 0x6, 3, 5 }, { 0xE, 4, 9 }, { 0xF, 4, 17 },
+};
+#define SERIES_WIDTHS 4
+#define SERIES_ABSOLUTE (SERIES_WIDTHS-1)
+
+
+static uint32_t zigzag(int32_t value){
+   return ((uint32_t)value<<1)^(uint32_t)(value>>31);
+}
+
+
+static int32_t unzigzag(uint32_t code){
+   return (int32_t)((code>>1)^(0-(code&1)));
+}
+
+
+/*
+ * width_of: Width a zigzag code is packed in
+ *    Arguments:
+ *       - widths: series_width*. Widths to choose from
+ *       - code: uint32_t. Zigzag code, other than 0
+ *    Returns:
+ *       - index: uint8_t. Index in widths, SERIES_WIDTHS if none fits
+ */
+static uint8_t width_of(const series_width *widths, uint32_t code){
+   for(uint8_t i=0; i<SERIES_WIDTHS; i++){
+      if(widths[i].bits>=32 || code-1<(1UL<<widths[i].bits)){
+         return i;
+      }
+   }
+   return SERIES_WIDTHS;
+}
+
+
+/*
+ * put_bits: Write the low bits of a value, most significant first
+ *    Arguments:
+ *       - block: uint8_t*. Block
+ *       - position: uint32_t. Bit to start at, from the start of block
+ *       - value: uint32_t. Value to write
+ *       - bits: uint8_t. Bits to write, up to 32
+ */
+static void put_bits(uint8_t *block, uint32_t position, uint32_t value, uint8_t bits){
+   while(bits>0){
+      uint8_t *byte = block+position/8;
+      uint8_t room = 8-position%8;
+      uint8_t take = bits<room ? bits : room;
+      uint8_t shift = room-take;
+      uint8_t mask = ((1U<<take)-1)<<shift;
+      uint8_t chunk = (value>>(bits-take))&((1U<<take)-1);
+      *byte = (*byte&~mask)|(chunk<<shift);
+      position+=take;
+      bits-=take;
+   }
+}
+
+
+/*
+ * get_bits: Read bits written by put_bits. Reads past the end of the
+ *    block are checked by the caller
+ */
+static uint32_t get_bits(const uint8_t *block, uint32_t position, uint8_t bits){
+   uint32_t value = 0;
+   while(bits>0){
+      uint8_t byte = block[position/8];
+      uint8_t room = 8-position%8;
+      uint8_t take = bits<room ? bits : room;
+      uint8_t shift = room-take;
+      value = (value<<take)|((byte>>shift)&((1U<<take)-1));
+      position+=take;
+      bits-=take;
+   }
+   return value;
+}
+
+
+/*
+ * write_count: Keep the sample count of the header up to date
+ */
+static void write_count(uint8_t *block, uint16_t count){
+   block[3] = count&0xff;
+   block[4] = count>>8;
+}
+
+
+/*
+ * series_encoder_init: Start an empty block
+ *    Arguments:
+ *       - encoder: series_encoder*. State of the block
+ *       - block: uint8_t*. Block
+ *       - size: size_t. Size of block
+ *       - value_count: uint8_t. Values of each sample
+ */
+esp_err_t series_encoder_init(series_encoder *encoder, uint8_t *block, size_t size,
+      uint8_t value_count){
+   if(size<SERIES_HEADER_SIZE || value_count==0 || value_count>SERIES_MAX_VALUES){
+      return ESP_ERR_INVALID_ARG;
+   }
+   memset(encoder, 0, sizeof *encoder);
+   encoder->value_count = value_count;
+   block[0] = SERIES_MAGIC;
+   block[1] = SERIES_VERSION;
+   block[2] = value_count;
+   write_count(block, 0);
+   return ESP_OK;
+}
+
+
+/*
+ * series_append: Append a sample to a block. The bits it takes are counted
+ *    first, so a sample that doesn't fit leaves the block as it was
+ *    Arguments:
+ *       - encoder: series_encoder*. State of the block
+ *       - block: uint8_t*. Block
+ *       - size: size_t. Size of block
+ *       - timestamp: uint32_t. Timestamp of the sample
+ *       - values: int16_t*. Values of the sample
+ */
+esp_err_t series_append(series_encoder *encoder, uint8_t *block, size_t size,
+      uint32_t timestamp, const int16_t *values){
+   uint32_t position = SERIES_HEADER_SIZE*8+encoder->bits;
+   uint32_t needed;
+   int32_t delta = 0;
+   uint32_t timestamp_code = 0;
+   uint8_t timestamp_width = 0;
+   uint32_t value_codes[SERIES_MAX_VALUES];
+   uint8_t value_width[SERIES_MAX_VALUES];
+
+   if(encoder->count==0){
+      needed = 32+16*encoder->value_count;
+   }
+   else{
+      delta = (int32_t)(timestamp-encoder->timestamp);
+      timestamp_code = zigzag((int32_t)((uint32_t)delta-(uint32_t)encoder->delta));
+      needed = 1;
+      if(timestamp_code!=0){
+         timestamp_width = width_of(timestamp_widths, timestamp_code);
+         needed = timestamp_widths[timestamp_width].prefix_bits+timestamp_widths[timestamp_width].bits;
+      }
+      for(uint8_t i=0; i<encoder->value_count; i++){
+         value_codes[i] = zigzag((int32_t)values[i]-encoder->values[i]);
+         needed++;
+         if(value_codes[i]!=0){
+            value_width[i] = width_of(value_widths, value_codes[i]);
+            needed += value_widths[value_width[i]].prefix_bits-1+value_widths[value_width[i]].bits;
+         }
+      }
+   }
+   if(encoder->count==UINT16_MAX || position+needed>size*8){
+      return ESP_ERR_NO_MEM;
+   }
+
+   if(encoder->count==0){
+      put_bits(block, position, timestamp, 32);
+      position+=32;
+      for(uint8_t i=0; i<encoder->value_count; i++){
+         put_bits(block, position, (uint16_t)values[i], 16);
+         position+=16;
+      }
+   }
+   else{
+      if(timestamp_code==0){
+         put_bits(block, position++, 0, 1);
+      }
+      else{
+         const series_width *width = &timestamp_widths[timestamp_width];
+         put_bits(block, position, width->prefix, width->prefix_bits);
+         position+=width->prefix_bits;
+         put_bits(block, position, timestamp_width==SERIES_ABSOLUTE ? timestamp : timestamp_code-1,
+            width->bits);
+         position+=width->bits;
+      }
+      for(uint8_t i=0; i<encoder->value_count; i++){
+         if(value_codes[i]==0){
+            put_bits(block, position++, 0, 1);
+            continue;
+         }
+         const series_width *width = &value_widths[value_width[i]];
+         put_bits(block, position, width->prefix, width->prefix_bits);
+         position+=width->prefix_bits;
+         put_bits(block, position, value_codes[i]-1, width->bits);
+         position+=width->bits;
+      }
+   }
+   encoder->bits+=needed;
+   encoder->count++;
+   encoder->timestamp=timestamp;
+   encoder->delta=delta;
+   memcpy(encoder->values, values, encoder->value_count*sizeof(int16_t));
+   write_count(block, encoder->count);
+   return ESP_OK;
+}
+
+
+/*
+ * series_length: Length of a block, header included
+ */
+size_t series_length(const series_encoder *encoder){
+   return SERIES_HEADER_SIZE+(encoder->bits+7)/8;
+}
+
+
+/*
+ * series_decoder_init: Start reading a block
+ *    Arguments:
+ *       - decoder: series_decoder*. State of the reader
+ *       - block: uint8_t*. Block
+ *       - length: size_t. Length of block
+ */
+esp_err_t series_decoder_init(series_decoder *decoder, const uint8_t *block, size_t length){
+   if(length<SERIES_HEADER_SIZE){
+      return ESP_ERR_INVALID_SIZE;
+   }
+   if(block[0]!=SERIES_MAGIC || block[1]!=SERIES_VERSION){
+      return ESP_ERR_INVALID_VERSION;
+   }
+   if(block[2]==0 || block[2]>SERIES_MAX_VALUES){
+      return ESP_ERR_INVALID_ARG;
+   }
+   memset(decoder, 0, sizeof *decoder);
+   decoder->block = block;
+   decoder->length = length;
+   decoder->position = SERIES_HEADER_SIZE*8;
+   decoder->value_count = block[2];
+   decoder->count = block[3]|(block[4]<<8);
+   return ESP_OK;
+}
+
+
+/*
+ * read_bits: Read bits of the block being decoded
+ *    Returns:
+ *       - ESP_OK or ESP_ERR_INVALID_SIZE if the block ends before
+ */
+static esp_err_t read_bits(series_decoder *decoder, uint8_t bits, uint32_t *value){
+   if(decoder->position+bits>decoder->length*8){
+      return ESP_ERR_INVALID_SIZE;
+   }
+   *value = get_bits(decoder->block, decoder->position, bits);
+   decoder->position+=bits;
+   return ESP_OK;
+}
+
+
+/*
+ * read_width: Read the prefix of a packed code
+ *    Returns:
+ *       - ESP_OK or ESP_ERR_INVALID_SIZE
+ *       - index: uint8_t*. Index in the widths, SERIES_WIDTHS for a code of 0
+ */
+static esp_err_t read_width(series_decoder *decoder, uint8_t *index){
+   uint32_t bit;
+   for(uint8_t i=0; i<SERIES_WIDTHS; i++){
+      if(read_bits(decoder, 1, &bit)!=ESP_OK){
+         return ESP_ERR_INVALID_SIZE;
+      }
+      if(bit==0){
+         *index = i==0 ? SERIES_WIDTHS : i-1;
+         return ESP_OK;
+      }
+   }
+   *index = SERIES_ABSOLUTE;
+   return ESP_OK;
+}
+
+
+/*
+ * series_next: Read the next sample of a block
+ *    Arguments:
+ *       - decoder: series_decoder*. State of the reader
+ *       - timestamp: uint32_t*. Timestamp of the sample
+ *       - values: int16_t*. Values of the sample
+ */
+esp_err_t series_next(series_decoder *decoder, uint32_t *timestamp, int16_t *values){
+   if(decoder->index>=decoder->count){
+      return ESP_ERR_NOT_FOUND;
+   }
+   uint32_t code;
+   uint8_t index;
+   if(decoder->index==0){
+      if(read_bits(decoder, 32, &code)!=ESP_OK){
+         return ESP_ERR_INVALID_SIZE;
+      }
+      decoder->timestamp = code;
+      for(uint8_t i=0; i<decoder->value_count; i++){
+         if(read_bits(decoder, 16, &code)!=ESP_OK){
+            return ESP_ERR_INVALID_SIZE;
+         }
+         decoder->values[i] = (int16_t)code;
+      }
+   }
+   else{
+      if(read_width(decoder, &index)!=ESP_OK){
+         return ESP_ERR_INVALID_SIZE;
+      }
+      if(index==SERIES_WIDTHS){
+         decoder->timestamp += decoder->delta;
+      }
+      else{
+         if(read_bits(decoder, timestamp_widths[index].bits, &code)!=ESP_OK){
+            return ESP_ERR_INVALID_SIZE;
+         }
+         uint32_t previous = decoder->timestamp;
+         if(index==SERIES_ABSOLUTE){
+            decoder->timestamp = code;
+         }
+         else{
+            decoder->timestamp += (uint32_t)decoder->delta+(uint32_t)unzigzag(code+1);
+         }
+         decoder->delta = (int32_t)(decoder->timestamp-previous);
+      }
+      for(uint8_t i=0; i<decoder->value_count; i++){
+         if(read_width(decoder, &index)!=ESP_OK){
+            return ESP_ERR_INVALID_SIZE;
+         }
+         if(index==SERIES_WIDTHS){
+            continue;
+         }
+         if(read_bits(decoder, value_widths[index].bits, &code)!=ESP_OK){
+            return ESP_ERR_INVALID_SIZE;
+         }
+         decoder->values[i] = (int16_t)(decoder->values[i]+unzigzag(code+1));
+      }
+   }
+   decoder->index++;
+   *timestamp = decoder->timestamp;
+   memcpy(values, decoder->values, decoder->value_count*sizeof(int16_t));
+   return ESP_OK;
+}
@@ -0,0 +1,91 @@
+/*
+ * settings.c
+ * @description: Implementation of the settings of each sensor kept in flash
+ * @author: @Retrocamara42
+ *
+ */
+#define LOG_LOCAL_LEVEL LOG_LEVEL_SETTINGS
+#include "log_levels.h"
+#include <string.h>
+
+#include "settings.h"
+
+static const char *SETTINGS_TAG = "settings";
+
+
+/*
+ * settings_key: Nvs key of a sensor
+ */
+static void settings_key(uint8_t index, char key[8]){
+   memcpy(key, "sensor", 6);
+   key[6]='0'+index;
+   key[7]='\0';
+}
+
+
+/*
+ * settings_load: Apply the settings kept in flash to the sensors of the
+ *    registry
+ *    Arguments:
+ *       - now: uint32_t. Current time in seconds
+ */
+uint8_t settings_load(uint32_t now){
+   nvs_handle handle;
+   if(nvs_open(SETTINGS_NAMESPACE, NVS_READONLY, &handle)!=ESP_OK){
+      return 0;
+   }
+   uint8_t loaded=0;
+   for(uint8_t i=0; i<sensor_registry_count(); i++){
+      char key[8];
+      sensor_settings settings;
+      size_t length = sizeof settings;
+      settings_key(i, key);
+      if(nvs_get_blob(handle, key, &settings, &length)!=ESP_OK || length!=sizeof settings){
+         continue;
+      }
+      sensor_registry_set_period(i, settings.period, now);
+      sensor_registry_set_deadband(i, settings.deadband);
+      loaded++;
+   }
+   nvs_close(handle);
+   ESP_LOGI(SETTINGS_TAG, "Settings of %d sensors loaded", loaded);
+   return loaded;
+}
+
+
+/*
+ * settings_save_sensor: Keep the period and deadband of a sensor in flash
+ *    Arguments:
+ *       - index: uint8_t. Index of the sensor in the registry
+ */
+esp_err_t settings_save_sensor(uint8_t index){
+   sensor_instance *instance = sensor_registry_get(index);
+   if(instance==NULL){
+      return ESP_ERR_INVALID_ARG;
+   }
+   sensor_settings settings;
+   memset(&settings, 0, sizeof settings);
+   settings.period = instance->period;
+   memcpy(settings.deadband, instance->deadband, sizeof settings.deadband);
+
+   nvs_handle handle;
+   esp_err_t err = nvs_open(SETTINGS_NAMESPACE, NVS_READWRITE, &handle);
+   if(err!=ESP_OK){
+      return err;
+   }
+   char key[8];
+   sensor_settings stored;
+   size_t length = sizeof stored;
+   settings_key(index, key);
+   if(nvs_get_blob(handle, key, &stored, &length)==ESP_OK && length==sizeof stored
+         && memcmp(&stored, &settings, sizeof settings)==0){
+      nvs_close(handle);
+      return ESP_OK;
+   }
+   err = nvs_set_blob(handle, key, &settings, sizeof settings);
+   if(err==ESP_OK){
+      err = nvs_commit(handle);
+   }
+   nvs_close(handle);
+   return err;
+}
@@ -0,0 +1,134 @@
+/*
+ * telemetry_frame.c
+ * @description: Implementation of the compact binary payload for sensor
+ *    readings
+ * @author: @Retrocamara42
+ *
+ */
+#include <string.h>
+
+#include "telemetry_frame.h"
+
+static const float decimal_scales[] = { 1, 10, 100, 1000, 10000 };
+#define MAX_DECIMAL_PLACES (sizeof(decimal_scales)/sizeof(decimal_scales[0])-1)
+
+
+/*
+ * telemetry_frame_encode: Encode a frame
+ *    Arguments:
+ *       - frame: telemetry_frame*. Frame to encode
+ *       - out: uint8_t*. Output buffer
+ *       - out_size: size_t. Size of out
+ */
+size_t telemetry_frame_encode(const telemetry_frame *frame, uint8_t *out, size_t out_size){
+   size_t id_length = strnlen(frame->device_id, TELEMETRY_MAX_DEVICE_ID+1);
+   if(id_length>TELEMETRY_MAX_DEVICE_ID || frame->value_count>TELEMETRY_MAX_VALUES
+         || frame->decimal_places>MAX_DECIMAL_PLACES){
+      return 0;
+   }
+   uint8_t has_timestamp = frame->flags&TELEMETRY_FLAG_TIMESTAMP;
+   uint8_t has_boot = frame->flags&TELEMETRY_FLAG_BOOT;
+   size_t length = 4+id_length+3+2*frame->value_count+(has_timestamp ? 4 : 0)+(has_boot ? 2 : 0);
+   if(length>out_size){
+      return 0;
+   }
+
+   uint8_t *c = out;
+   *c++ = TELEMETRY_FRAME_MAGIC;
+   *c++ = TELEMETRY_FRAME_VERSION;
+   *c++ = frame->flags;
+   *c++ = (uint8_t)id_length;
+   memcpy(c, frame->device_id, id_length);
+   c += id_length;
+   *c++ = frame->sensor_type;
+   *c++ = frame->decimal_places;
+   *c++ = frame->value_count;
+   for(uint8_t i=0; i<frame->value_count; i++){
+      uint16_t value = (uint16_t)frame->values[i];
+      *c++ = value&0xff;
+      *c++ = value>>8;
+   }
+   if(has_timestamp){
+      *c++ = frame->timestamp&0xff;
+      *c++ = (frame->timestamp>>8)&0xff;
+      *c++ = (frame->timestamp>>16)&0xff;
+      *c++ = frame->timestamp>>24;
+   }
+   if(has_boot){
+      *c++ = frame->boot&0xff;
+      *c++ = frame->boot>>8;
+   }
+   return length;
+}
+
+
+/*
+ * telemetry_frame_decode: Decode a frame
+ *    Arguments:
+ *       - data: uint8_t*. Received frame
+ *       - length: size_t. Length of data
+ *       - frame: telemetry_frame*. Decoded frame
+ */
+esp_err_t telemetry_frame_decode(const uint8_t *data, size_t length, telemetry_frame *frame){
+   if(length<4){
+      return ESP_ERR_INVALID_SIZE;
+   }
+   if(data[0]!=TELEMETRY_FRAME_MAGIC || data[1]!=TELEMETRY_FRAME_VERSION){
+      return ESP_ERR_INVALID_VERSION;
+   }
+   frame->flags = data[2];
+   uint8_t id_length = data[3];
+   if(id_length>TELEMETRY_MAX_DEVICE_ID){
+      return ESP_ERR_INVALID_ARG;
+   }
+   const uint8_t *c = data+4;
+   const uint8_t *end = data+length;
+   if(end-c<id_length+3){
+      return ESP_ERR_INVALID_SIZE;
+   }
+   if(memchr(c, '\0', id_length)!=NULL){
+      return ESP_ERR_INVALID_ARG;
+   }
+   memcpy(frame->device_id, c, id_length);
+   frame->device_id[id_length] = '\0';
+   c += id_length;
+   frame->sensor_type = *c++;
+   frame->decimal_places = *c++;
+   frame->value_count = *c++;
+   if(frame->value_count>TELEMETRY_MAX_VALUES || frame->decimal_places>MAX_DECIMAL_PLACES){
+      return ESP_ERR_INVALID_ARG;
+   }
+   uint8_t has_timestamp = frame->flags&TELEMETRY_FLAG_TIMESTAMP;
+   uint8_t has_boot = frame->flags&TELEMETRY_FLAG_BOOT;
+   if(end-c!=2*frame->value_count+(has_timestamp ? 4 : 0)+(has_boot ? 2 : 0)){
+      return ESP_ERR_INVALID_SIZE;
+   }
+   for(uint8_t i=0; i<frame->value_count; i++){
+      frame->values[i] = (int16_t)(c[0]|(c[1]<<8));
+      c += 2;
+   }
+   frame->timestamp = 0;
+   if(has_timestamp){
+      frame->timestamp = (uint32_t)c[0]|((uint32_t)c[1]<<8)|((uint32_t)c[2]<<16)|((uint32_t)c[3]<<24);
+      c += 4;
+   }
+   frame->boot = 0;
+   if(has_boot){
+      frame->boot = (uint16_t)(c[0]|(c[1]<<8));
+   }
+   return ESP_OK;
+}
+
+
+/*
+ * telemetry_frame_value: Get a value as float
+ *    Arguments:
+ *       - frame: telemetry_frame*. Decoded frame
+ *       - index: uint8_t. Index of value
+ */
+float telemetry_frame_value(const telemetry_frame *frame, uint8_t index){
+   if(index>=frame->value_count || frame->decimal_places>MAX_DECIMAL_PLACES){
+      return 0;
+   }
+   return frame->values[index]/decimal_scales[frame->decimal_places];
+}
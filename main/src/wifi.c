@@ -5,12 +5,128 @@
  * @author: @Retrocamara42
  *
  */
+#define LOG_LOCAL_LEVEL LOG_LEVEL_WIFI
+#include "log_levels.h"
 #include "wifi.h"
+#include "rtc_budget.h"
+#include "rtc_state.h"
+
+// Marks valid contents of the fast connect cache
+#define WIFI_CACHE_MAGIC 0x57464331
 
 static int wifi_retry_num = 0;
 static const char *WIFI_TAG = "wifi station";
 static EventGroupHandle_t s_wifi_event_group;
 
+static RTC_DATA_ATTR wifi_fast_connect_cache fast_connect_cache;
+_Static_assert(sizeof fast_connect_cache<=RTC_BUDGET_WIFI, "wifi over its rtc budget");
+// Access point of the current connection, cached once it gets an ip
+static wifi_fast_connect_cache connected_ap;
+static wifi_config_t sta_config;
+static uint8_t fast_connect = 0;
+static uint8_t static_ip = 0;
+static int64_t connect_start = 0;
+static uint32_t connect_time_ms = 0;
+
+
+/*
+ * load_fast_connect_cache: Load the cache from nvs if rtc memory doesn't
+ *    have it
+ *    Returns:
+ *       - from_rtc: uint8_t. 1 if rtc memory had a valid cache. Only then the
+ *          ip lease is recent enough to be reused
+ */
+static uint8_t load_fast_connect_cache(){
+   if(fast_connect_cache.magic==WIFI_CACHE_MAGIC){
+      return 1;
+   }
+   nvs_handle handle;
+   if(nvs_open(WIFI_CACHE_NAMESPACE, NVS_READONLY, &handle)==ESP_OK){
+      size_t length = sizeof fast_connect_cache;
+      if(nvs_get_blob(handle, "cache", &fast_connect_cache, &length)!=ESP_OK
+            || length!=sizeof fast_connect_cache){
+         fast_connect_cache.magic = 0;
+      }
+      nvs_close(handle);
+   }
+   return 0;
+}
+
+
+/*
+ * save_fast_connect_cache: Keep the access point of the current connection.
+ *    Nvs is only written when it changed
+ */
+static void save_fast_connect_cache(){
+   uint8_t changed = fast_connect_cache.magic!=WIFI_CACHE_MAGIC
+      || memcmp(fast_connect_cache.bssid, connected_ap.bssid, sizeof connected_ap.bssid)
+      || fast_connect_cache.channel!=connected_ap.channel
+      || memcmp(&fast_connect_cache.ip_info, &connected_ap.ip_info, sizeof connected_ap.ip_info);
+   // A lease from dhcp is new, even for the same ip
+   uint32_t lease_time = static_ip ? fast_connect_cache.lease_time : rtc_state_clock();
+   fast_connect_cache = connected_ap;
+   fast_connect_cache.magic = WIFI_CACHE_MAGIC;
+   fast_connect_cache.lease_time = lease_time;
+   if(!changed){
+      return;
+   }
+   nvs_handle handle;
+   if(nvs_open(WIFI_CACHE_NAMESPACE, NVS_READWRITE, &handle)==ESP_OK){
+      nvs_set_blob(handle, "cache", &fast_connect_cache, sizeof fast_connect_cache);
+      nvs_commit(handle);
+      nvs_close(handle);
+   }
+}
+
+
+/*
+ * apply_fast_connect_cache: Set cached access point and channel in the
+ *    station config. The cached ip lease is set too if it can be reused: it
+ *    is younger than WIFI_CACHE_MAX_LEASE_AGE. After a reset the clock
+ *    starts over, so a lease from the future is too old
+ *    Arguments:
+ *       - from_rtc: uint8_t. 1 if the cache comes from rtc memory
+ */
+static void apply_fast_connect_cache(uint8_t from_rtc){
+   fast_connect = 0;
+   static_ip = 0;
+   if(fast_connect_cache.magic!=WIFI_CACHE_MAGIC){
+      return;
+   }
+   fast_connect = 1;
+   sta_config.sta.bssid_set = 1;
+   memcpy(sta_config.sta.bssid, fast_connect_cache.bssid, sizeof sta_config.sta.bssid);
+   sta_config.sta.channel = fast_connect_cache.channel;
+   uint32_t now = rtc_state_clock();
+   if(from_rtc && now>=fast_connect_cache.lease_time
+         && now-fast_connect_cache.lease_time<WIFI_CACHE_MAX_LEASE_AGE
+         && fast_connect_cache.ip_info.ip.addr!=0){
+      static_ip = 1;
+      tcpip_adapter_dhcpc_stop(TCPIP_ADAPTER_IF_STA);
+      tcpip_adapter_set_ip_info(TCPIP_ADAPTER_IF_STA, &fast_connect_cache.ip_info);
+      tcpip_adapter_set_dns_info(TCPIP_ADAPTER_IF_STA, TCPIP_ADAPTER_DNS_MAIN, &fast_connect_cache.dns);
+   }
+}
+
+
+/*
+ * fall_back_to_scan: Drop the cache and connect again with scan and dhcp
+ */
+static void fall_back_to_scan(){
+   ESP_LOGW(WIFI_TAG, "Cached connection failed, scanning");
+   fast_connect = 0;
+   fast_connect_cache.magic = 0;
+   sta_config.sta.bssid_set = 0;
+   sta_config.sta.channel = 0;
+   if(static_ip){
+      static_ip = 0;
+      tcpip_adapter_dhcpc_start(TCPIP_ADAPTER_IF_STA);
+   }
+   esp_wifi_set_config(ESP_IF_WIFI_STA, &sta_config);
+   connect_start = esp_timer_get_time();
+   esp_wifi_connect();
+}
+
 
 /*
  * _wifi_event_handler: Event handler to react after wifi connection
@@ -25,9 +141,17 @@ static void _wifi_event_handler(void* arg, esp_event_base_t event_base,
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
         // Wifi ready to connect
         esp_task_wdt_reset();
+        connect_start = esp_timer_get_time();
         esp_wifi_connect();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        wifi_event_sta_connected_t* event = (wifi_event_sta_connected_t*) event_data;
+        memcpy(connected_ap.bssid, event->bssid, sizeof connected_ap.bssid);
+        connected_ap.channel = event->channel;
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (wifi_retry_num < ESP_MAXIMUM_RETRY){
+        if (fast_connect){
+            esp_task_wdt_reset();
+            fall_back_to_scan();
+        } else if (wifi_retry_num < ESP_MAXIMUM_RETRY){
            // Reconnect to wifi
             esp_task_wdt_reset();
             esp_wifi_connect();
@@ -38,11 +162,15 @@ static void _wifi_event_handler(void* arg, esp_event_base_t event_base,
         }
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         // Wifi connected succesfully
+        ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
+        connect_time_ms = (uint32_t)((esp_timer_get_time()-connect_start)/1000);
+        ESP_LOGI(WIFI_TAG, "Got ip in %d ms with %s", connect_time_ms,
+            static_ip ? "cached ap and ip" : fast_connect ? "cached ap and dhcp" : "scan and dhcp");
+        connected_ap.ip_info = event->ip_info;
+        tcpip_adapter_get_dns_info(TCPIP_ADAPTER_IF_STA, TCPIP_ADAPTER_DNS_MAIN, &connected_ap.dns);
+        save_fast_connect_cache();
         wifi_retry_num = 0;
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
-        // Release semaphore
-        esp_task_wdt_reset();
-        xSemaphoreGive(wifi_semaphore);
     }
 }
 
@@ -76,9 +204,11 @@ void wifi_init_sta(wifi_config_t wifi_config){
    if (strlen((char *)wifi_config.sta.password)) {
       wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
    }
+   sta_config = wifi_config;
+   apply_fast_connect_cache(load_fast_connect_cache());
 
    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-   ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config));
+   ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &sta_config));
    ESP_ERROR_CHECK(esp_wifi_start());
    //ESP_LOGI(WIFI_TAG, "wifi_init_sta finished.");
 
@@ -106,30 +236,11 @@ void wifi_init_sta(wifi_config_t wifi_config){
 
 
 /*
- * create_wifi_semaphore: Create wifi semaphore. Used to stop the program to
- *    continue if wifi isn't connected yet
- */
-void create_wifi_semaphore(){
-   wifi_semaphore = xSemaphoreCreateBinary();
-}
-
-
-/*
- * take_from_wifi_semaphore: Increases semaphore count by one. Should be run after
- *   function wifi_init_sta
- *    Arguments:
- *       - ticks: TickType_t. Timeout before the semaphore releases by itself
- */
-void take_from_wifi_semaphore(TickType_t ticks){
-   xSemaphoreTake(wifi_semaphore, ticks);
-}
-
-
-
-/*
- * delete_wifi_semaphore: Delete wifi semaphore. Used after controller
- *   connected to wifi succesfully
+ * wifi_last_connect_time: Time from the start of the connection to getting
+ *    an ip, of the last connection
+ *    Returns:
+ *       - time: uint32_t. Time in ms
  */
-void delete_wifi_semaphore(){
-   vSemaphoreDelete(wifi_semaphore);
+uint32_t wifi_last_connect_time(){
+   return connect_time_ms;
 }